@@ -234,25 +234,37 @@ void dt_bilateral_splat(const dt_bilateral_t *b, const float *const in)
     }
   }
 
-  // merge the per-thread results into the final result
-  for (int slice = 1 ; slice < nthreads; slice++)
+  // merge the per-thread results into the final result. A cell of the grid only ever gets added to the
+  // same cell of another row, so each thread can run the whole merge on its own range of cells.
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buf, oy, nthreads) \
+  shared(b) \
+  schedule(static)
+#endif
+  for(int part = 0; part < nthreads; part++)
   {
-    // compute the first row of the final grid which this slice splats
-    const int destrow = (int)(slice * b->sliceheight / b->sigma_s);
-    float *dest = buf + destrow * oy;
-    // now iterate over the grid rows splatted for this slice
-    for(int j = slice * b->slicerows; j < (slice+1)*b->slicerows; j++)
+    const size_t first = (size_t)oy * part / nthreads;
+    const size_t last = (size_t)oy * (part + 1) / nthreads;
+    for(int slice = 1 ; slice < nthreads; slice++)
     {
-      float *src = buf + j * oy;
-      for(int i = 0; i < oy; i++)
+      // compute the first row of the final grid which this slice splats
+      const int destrow = (int)(slice * b->sliceheight / b->sigma_s);
+      float *dest = buf + (size_t)destrow * oy;
+      // now iterate over the grid rows splatted for this slice
+      for(int j = slice * b->slicerows; j < (slice+1)*b->slicerows; j++)
       {
-        dest[i] += src[i];
+        float *src = buf + (size_t)j * oy;
+        for(size_t i = first; i < last; i++)
+        {
+          dest[i] += src[i];
+        }
+        dest += oy;
+        // clear elements in the part of the buffer which holds the final result now that we've read the partial result,
+        // since we'll be adding to those locations later
+        if (j < b->size_y)
+          memset(src + first, '\0', sizeof(float) * (last - first));
       }
-      dest += oy;
-      // clear elements in the part of the buffer which holds the final result now that we've read the partial result,
-      // since we'll be adding to those locations later
-      if (j < b->size_y)
-        memset(buf + j*oy, '\0', sizeof(float) * oy);
     }
   }
 }
@@ -0,0 +1,189 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/darktable.h"
+#include "control/control.h"     // needed by dwt.h
+#include "common/dwt.h"          // for dwt_interleave_rows
+
+/***
+ * DOCUMENTATION
+ *
+ * À-trous wavelet decomposition with a cubic B spline scaling function, shared by
+ * filmic rgb (highlights reconstruction) and diffuse or sharpen.
+ * there is a paper from a guy we know that explains it : https://jo.dreggn.org/home/2010_atrous.pdf
+ *
+ * The 5×5 B spline kernel is separable, so each scale is computed as a vertical blur of
+ * a whole row into a thread-private row buffer, followed by a horizontal blur of that
+ * row, which is 10 multiply-add per pixel and channel instead of 25. Both passes run
+ * over contiguous floats of the RGBA row, so they vectorize on all 4 channels at once;
+ * only the few pixels at the left and right borders need clamped indices.
+ *
+ * The row buffers are allocated once with dt_bspline_alloc_tempbuf() and reused for
+ * all the scales of a decomposition.
+ *
+ * This is not the "hat" transform of common/dwt.c (used by retouch and denoise) nor
+ * the edge-aware one of common/eaw.c (used by atrous), which use different filters.
+ ***/
+
+// B spline filter
+#define BSPLINE_FSIZE 5
+
+// The B spline best approximate a Gaussian of standard deviation :
+// see https://eng.aurelienpierre.com/2021/03/rotation-invariant-laplacian-for-2d-grids/
+#define B_SPLINE_SIGMA 1.0553651328015339f
+
+static const float DT_ALIGNED_ARRAY bspline_filter[BSPLINE_FSIZE]
+    = { 1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f };
+
+
+// allocate the thread-private row buffers needed by the functions below for images
+// of the given width, free them with dt_free_align()
+static inline float *dt_bspline_alloc_tempbuf(const size_t width, size_t *padded_size)
+{
+  return dt_alloc_perthread_float(4 * width, padded_size);
+}
+
+
+// blur the RGBA row i over columns, spaced by mult rows
+static inline void bspline_vertical_pass(const float *const restrict in, float *const restrict temp,
+                                         const size_t i, const size_t width, const size_t height,
+                                         const int mult, const gboolean clip_negatives)
+{
+  // the offsets from the current pixel stay unchanged over the entire row
+  const float *restrict rows[BSPLINE_FSIZE];
+  for(int ii = 0; ii < BSPLINE_FSIZE; ++ii)
+  {
+    const size_t r = CLAMP(mult * (ii - (BSPLINE_FSIZE - 1) / 2) + (int)i, (int)0, (int)height - 1);
+    rows[ii] = in + 4 * r * width;
+  }
+
+#ifdef _OPENMP
+#pragma omp simd aligned(temp : 64)
+#endif
+  for(size_t k = 0; k < 4 * width; k++)
+  {
+    float acc = 0.0f;
+    for(int ii = 0; ii < BSPLINE_FSIZE; ++ii) acc += bspline_filter[ii] * rows[ii][k];
+    temp[k] = clip_negatives ? fmaxf(acc, 0.f) : acc;
+  }
+}
+
+
+// blur the RGBA row in temp over rows, spaced by mult columns. Write it to LF and,
+// if HF is not NULL, the difference between the input row and the blurred one to HF.
+static inline void bspline_horizontal_pass(const float *const restrict temp, const float *const restrict in,
+                                           float *const restrict HF, float *const restrict LF,
+                                           const size_t width, const int mult, const gboolean clip_negatives)
+{
+  // columns whose neighbours are all in the row
+  const size_t border = (size_t)2 * mult;
+  const gboolean has_inner = width > 2 * border;
+  const size_t end = has_inner ? width - border : 0;
+
+  for(size_t j = 0; j < width; j++)
+  {
+    if(has_inner && j == border)
+    {
+      // inner part of the row : contiguous and vectorizable, skip to the right border
+      const size_t shift = (size_t)4 * mult;
+      // only temp is a fresh allocation. in, HF and LF point to a row of the image, which is only
+      // 16 bytes aligned when the width is not a multiple of 4.
+#ifdef _OPENMP
+#pragma omp simd aligned(temp : 64) aligned(in, LF : 16)
+#endif
+      for(size_t k = 4 * border; k < 4 * end; k++)
+      {
+        float acc = 0.0f;
+        acc += bspline_filter[0] * temp[k - 2 * shift];
+        acc += bspline_filter[1] * temp[k - shift];
+        acc += bspline_filter[2] * temp[k];
+        acc += bspline_filter[3] * temp[k + shift];
+        acc += bspline_filter[4] * temp[k + 2 * shift];
+        LF[k] = clip_negatives ? fmaxf(acc, 0.f) : acc;
+      }
+      if(HF)
+      {
+#ifdef _OPENMP
+#pragma omp simd aligned(in, HF, LF : 16)
+#endif
+        for(size_t k = 4 * border; k < 4 * end; k++) HF[k] = in[k] - LF[k];
+      }
+      j = end - 1;
+      continue;
+    }
+
+    // the offsets change near the ends of the row, so recompute them for each pixel
+    size_t DT_ALIGNED_ARRAY indices[BSPLINE_FSIZE];
+    for(int jj = 0; jj < BSPLINE_FSIZE; ++jj)
+    {
+      const size_t col = CLAMP(mult * (jj - (BSPLINE_FSIZE - 1) / 2) + (int)j, (int)0, (int)width - 1);
+      indices[jj] = 4 * col;
+    }
+    for_four_channels(c, aligned(temp, in, HF, LF : 16))
+    {
+      float acc = 0.0f;
+      for(int jj = 0; jj < BSPLINE_FSIZE; ++jj) acc += bspline_filter[jj] * temp[indices[jj] + c];
+      LF[4 * j + c] = clip_negatives ? fmaxf(acc, 0.f) : acc;
+      if(HF) HF[4 * j + c] = in[4 * j + c] - LF[4 * j + c];
+    }
+  }
+}
+
+
+// one scale of the à-trous decomposition of an RGBA image : LF is the input blurred with
+// the B spline spaced by mult pixels, HF the difference between the input and LF.
+// HF may be NULL if only the blur is needed. tempbuf and padded_size come from
+// dt_bspline_alloc_tempbuf(). If clip_negatives is set, the blurred values are clipped
+// at 0 after each pass.
+static inline void decompose_2D_Bspline(const float *const restrict in, float *const restrict HF,
+                                        float *const restrict LF, const size_t width, const size_t height,
+                                        const int mult, float *const restrict tempbuf, const size_t padded_size,
+                                        const gboolean clip_negatives)
+{
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(width, height, mult, padded_size, clip_negatives) \
+  dt_omp_sharedconst(in, HF, LF, tempbuf) \
+  schedule(static)
+#endif
+  for(size_t row = 0; row < height; row++)
+  {
+    float *const restrict temp = dt_get_perthread(tempbuf, padded_size);
+    // interleave the order in which we process the rows so that we minimize cache misses
+    const size_t i = dwt_interleave_rows(row, height, mult);
+    const size_t offset = 4 * i * width;
+    bspline_vertical_pass(in, temp, i, width, height, mult, clip_negatives);
+    bspline_horizontal_pass(temp, in + offset, HF ? HF + offset : NULL, LF + offset, width, mult,
+                            clip_negatives);
+  }
+}
+
+
+static inline void blur_2D_Bspline(const float *const restrict in, float *const restrict out,
+                                   const size_t width, const size_t height, const int mult,
+                                   float *const restrict tempbuf, const size_t padded_size,
+                                   const gboolean clip_negatives)
+{
+  decompose_2D_Bspline(in, NULL, out, width, height, mult, tempbuf, padded_size, clip_negatives);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -316,48 +316,70 @@ restart:
   return 0;
 }
 
+// drop an unlocked entry from the cache. the cache lock has to be held by the caller.
+// returns the number of payload bytes freed, or 0 if the entry is in use.
+static size_t _cache_evict(dt_cache_t *cache, dt_cache_entry_t *entry)
+{
+  // if still locked by anyone else give up:
+  if(dt_pthread_rwlock_trywrlock(&entry->lock)) return 0;
+
+  if(entry->_lock_demoting)
+  {
+    // oops, we are currently demoting (rw -> r) lock to this entry in some thread. do not touch!
+    dt_pthread_rwlock_unlock(&entry->lock);
+    return 0;
+  }
+
+  // delete!
+  g_hash_table_remove(cache->hashtable, GINT_TO_POINTER(entry->key));
+  cache->lru = g_list_delete_link(cache->lru, entry->link);
+  cache->cost -= entry->cost;
+  const size_t freed = entry->data_size;
+
+  if(cache->cleanup)
+  {
+    assert(entry->data_size);
+    ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
+
+    cache->cleanup(cache->cleanup_data, entry);
+  }
+  else
+    dt_free_align(entry->data);
+
+  dt_pthread_rwlock_unlock(&entry->lock);
+  dt_pthread_rwlock_destroy(&entry->lock);
+  g_slice_free1(sizeof(*entry), entry);
+  return MAX(freed, 1);
+}
+
 // best-effort garbage collection. never blocks, never fails. well, sometimes it just doesn't free anything.
 void dt_cache_gc(dt_cache_t *cache, const float fill_ratio)
 {
   GList *l = cache->lru;
-  int cnt = 0;
   while(l)
   {
-    cnt++;
     dt_cache_entry_t *entry = (dt_cache_entry_t *)l->data;
     assert(entry->link->data == entry);
     l = g_list_next(l); // we might remove this element, so walk to the next one while we still have the pointer..
     if(cache->cost < cache->cost_quota * fill_ratio) break;
 
-    // if still locked by anyone else give up:
-    if(dt_pthread_rwlock_trywrlock(&entry->lock)) continue;
-
-    if(entry->_lock_demoting)
-    {
-      // oops, we are currently demoting (rw -> r) lock to this entry in some thread. do not touch!
-      dt_pthread_rwlock_unlock(&entry->lock);
-      continue;
-    }
-
-    // delete!
-    g_hash_table_remove(cache->hashtable, GINT_TO_POINTER(entry->key));
-    cache->lru = g_list_delete_link(cache->lru, entry->link);
-    cache->cost -= entry->cost;
-
-    if(cache->cleanup)
-    {
-      assert(entry->data_size);
-      ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
-
-      cache->cleanup(cache->cleanup_data, entry);
-    }
-    else
-      dt_free_align(entry->data);
+    _cache_evict(cache, entry);
+  }
+}
 
-    dt_pthread_rwlock_unlock(&entry->lock);
-    dt_pthread_rwlock_destroy(&entry->lock);
-    g_slice_free1(sizeof(*entry), entry);
+size_t dt_cache_reclaim(dt_cache_t *cache, const size_t bytes)
+{
+  size_t freed = 0;
+  dt_pthread_mutex_lock(&cache->lock);
+  GList *l = cache->lru;
+  while(l && freed < bytes)
+  {
+    dt_cache_entry_t *entry = (dt_cache_entry_t *)l->data;
+    l = g_list_next(l);
+    freed += _cache_evict(cache, entry);
   }
+  dt_pthread_mutex_unlock(&cache->lock);
+  return freed;
 }
 
 void dt_cache_release_with_caller(dt_cache_t *cache, dt_cache_entry_t *entry, const char *file, int line)
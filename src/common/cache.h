@@ -92,6 +92,10 @@ int32_t dt_cache_remove(dt_cache_t *cache, const uint32_t key);
 // will never lock and never fail, but sometimes not free memory (in case all
 // is locked)
 void dt_cache_gc(dt_cache_t *cache, const float fill_ratio);
+// evicts unlocked entries from the tip of the lru list until at least the given
+// number of payload bytes has been freed. takes the cache lock, so it must not be
+// called from within the allocate/cleanup callbacks. returns the bytes freed.
+size_t dt_cache_reclaim(dt_cache_t *cache, const size_t bytes);
 
 // iterate over all currently contained data blocks.
 // not thread safe! only use this for init/cleanup!
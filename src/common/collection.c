@@ -43,6 +43,9 @@
 #define SELECT_QUERY "SELECT DISTINCT * FROM %s"
 #define LIMIT_QUERY "LIMIT ?1, ?2"
 
+// bumped each time memory.collected_images is refilled
+static int _memory_generation = 0;
+
 static const char *comparators[] = {
   "<",  // DT_COLLECTION_RATING_COMP_LT = 0,
   "<=", // DT_COLLECTION_RATING_COMP_LEQ,
@@ -177,6 +180,13 @@ void dt_collection_memory_update()
 
   g_free(query);
   g_free(ins_query);
+
+  g_atomic_int_inc(&_memory_generation);
+}
+
+int dt_collection_memory_generation()
+{
+  return g_atomic_int_get(&_memory_generation);
 }
 
 static void _dt_collection_set_selq_pre_sort(const dt_collection_t *collection, char **selq_pre)
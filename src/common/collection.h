@@ -275,6 +275,8 @@ void dt_collection_move_before(const int32_t image_id, GList * selected_images);
 
 /* initialize memory table */
 void dt_collection_memory_update();
+/* number of times the memory table has been filled, to check copies of it for staleness */
+int dt_collection_memory_generation();
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -46,6 +46,7 @@
 #include "common/grealpath.h"
 #include "common/image.h"
 #include "common/image_cache.h"
+#include "common/memory_budget.h"
 #include "common/imageio_module.h"
 #include "common/iop_order.h"
 #include "common/l10n.h"
@@ -63,6 +64,7 @@
 #include "control/signal.h"
 #include "develop/blend.h"
 #include "develop/imageop.h"
+#include "develop/masks.h"
 #include "gui/accelerators.h"
 #include "gui/gtk.h"
 #include "gui/guides.h"
@@ -1048,6 +1050,13 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 
   darktable.noiseprofile_parser = dt_noiseprofile_init(noiseprofiles_from_command);
 
+  // accounts for the buffers of the mipmap and pixelpipe caches, so it has to be there first
+  darktable.memory_budget = (dt_memory_budget_t *)calloc(1, sizeof(dt_memory_budget_t));
+  dt_memory_budget_init(darktable.memory_budget);
+
+  darktable.masks_cache = (dt_masks_cache_t *)calloc(1, sizeof(dt_masks_cache_t));
+  dt_masks_cache_init(darktable.masks_cache);
+
   // must come before mipmap_cache, because that one will need to access
   // image dimensions stored in here:
   darktable.image_cache = (dt_image_cache_t *)calloc(1, sizeof(dt_image_cache_t));
@@ -1251,6 +1260,12 @@ void dt_cleanup()
   free(darktable.image_cache);
   dt_mipmap_cache_cleanup(darktable.mipmap_cache);
   free(darktable.mipmap_cache);
+  dt_masks_cache_cleanup(darktable.masks_cache);
+  free(darktable.masks_cache);
+  darktable.masks_cache = NULL;
+  dt_memory_budget_cleanup(darktable.memory_budget);
+  free(darktable.memory_budget);
+  darktable.memory_budget = NULL;
   if(init_gui)
   {
     dt_control_cleanup(darktable.control);
@@ -1527,7 +1542,7 @@ static inline int _get_num_atom_cores()
 #endif
 }
 
-static inline size_t _get_total_memory()
+size_t dt_get_total_memory()
 {
 #if defined(__linux__)
   FILE *f = g_fopen("/proc/meminfo", "rb");
@@ -1568,7 +1583,7 @@ int dt_worker_threads()
 {
   const int atom_cores = _get_num_atom_cores();
   const size_t threads = dt_get_num_threads();
-  const size_t mem = _get_total_memory();
+  const size_t mem = dt_get_total_memory();
   if(mem >= (8lu << 20) && threads >= 4 && atom_cores == 0)
     return 4;
   else if(threads >= 2 && atom_cores == 0)
@@ -1580,7 +1595,7 @@ void dt_configure_performance()
 {
   const int atom_cores = _get_num_atom_cores();
   const size_t threads = dt_get_num_threads();
-  const size_t mem = _get_total_memory();
+  const size_t mem = dt_get_total_memory();
   const size_t bits = CHAR_BIT * sizeof(void *);
   gchar *demosaic_quality = dt_conf_get_string("plugins/darkroom/demosaic/quality");
 
@@ -232,6 +232,8 @@ struct dt_control_t;
 struct dt_develop_t;
 struct dt_mipmap_cache_t;
 struct dt_image_cache_t;
+struct dt_memory_budget_t;
+struct dt_masks_cache_t;
 struct dt_lib_t;
 struct dt_conf_t;
 struct dt_points_t;
@@ -296,6 +298,8 @@ typedef struct darktable_t
   struct dt_gui_gtk_t *gui;
   struct dt_mipmap_cache_t *mipmap_cache;
   struct dt_image_cache_t *image_cache;
+  struct dt_memory_budget_t *memory_budget;
+  struct dt_masks_cache_t *masks_cache;
   struct dt_bauhaus_t *bauhaus;
   const struct dt_database_t *db;
   const struct dt_pwstorage_t *pwstorage;
@@ -345,6 +349,8 @@ void dt_print(dt_debug_thread_t thread, const char *msg, ...) __attribute__((for
 void dt_gettime_t(char *datetime, size_t datetime_len, time_t t);
 void dt_gettime(char *datetime, size_t datetime_len);
 int dt_worker_threads();
+// physical memory of the machine in kB
+size_t dt_get_total_memory();
 void *dt_alloc_align(size_t alignment, size_t size);
 static inline float *dt_alloc_align_float(size_t pixels)
 {
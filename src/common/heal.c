@@ -16,9 +16,12 @@
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#ifndef DT_UNIT_TEST
 #include "control/control.h"
 #include "develop/imageop.h"
+#endif
 #include "heal.h"
+#include <float.h>
 #if defined(__SSE__)
 #include <xmmintrin.h>
 #endif
@@ -36,9 +39,9 @@
  * but subtract them I2 = I0 - I1, where I0 is the sample image to be
  * corrected, I1 is the reference pattern. Then we solve DeltaI=0
  * (Laplace) with I2 Dirichlet conditions at the borders of the
- * mask. The solver is a red/black checker Gauss-Seidel with over-relaxation.
- * It could benefit from a multi-grid evaluation of an initial solution
- * before the main iteration loop.
+ * mask. The solver is a multigrid V-cycle with red/black checker Gauss-Seidel
+ * as smoother. The original Gauss-Seidel with over-relaxation is still used
+ * for small areas, where it converges quickly enough.
  *
  * I reduced the convergence criteria to 0.1% (0.001) as we are
  * dealing here with RGB integer components, more is overkill.
@@ -174,11 +177,13 @@ static float dt_heal_laplace_iteration(float *pixels, const float *const Adiag,
 }
 
 // Solve the laplace equation for pixels and store the result in-place.
-static void dt_heal_laplace_loop(float *pixels, const int width, const int height, const int ch,
-                                 const float *const mask, const int use_sse)
+// Returns the number of iterations.
+static int dt_heal_laplace_loop(float *pixels, const int width, const int height, const int ch,
+                                const float *const mask, const int use_sse)
 {
   int nmask = 0;
   int nmask2 = 0;
+  int iter = 0;
 
   float *Adiag = dt_alloc_align_float((size_t)width * height);
   int *Aidx = dt_alloc_align(64, sizeof(int) * 5 * width * height);
@@ -246,7 +251,7 @@ static void dt_heal_laplace_loop(float *pixels, const int width, const int heigh
   const float err_exit = epsilon * epsilon * w * w;
 
   /* Gauss-Seidel with successive over-relaxation */
-  for(int iter = 0; iter < max_iter; iter++)
+  for(iter = 0; iter < max_iter; iter++)
   {
     // process red/black cells separate
     float err = dt_heal_laplace_iteration(pixels, Adiag, Aidx, w, 0, nmask2, ch, use_sse);
@@ -258,8 +263,358 @@ static void dt_heal_laplace_loop(float *pixels, const int width, const int heigh
 cleanup:
   if(Adiag) dt_free_align(Adiag);
   if(Aidx) dt_free_align(Aidx);
+
+  return iter;
+}
+
+
+/* Multigrid solver for the same system.
+ *
+ * Red/black SOR only removes the high frequencies of the error quickly, large heal areas
+ * need many hundreds of sweeps until the low frequencies have propagated through the
+ * whole region. Here a few Gauss-Seidel sweeps are used as a smoother only, the remaining
+ * smooth error is solved for on a pyramid of coarser grids (V-cycle) where it is cheap to
+ * do so. Iteration stops as soon as the residual is below the same tolerance as above.
+ *
+ * Every level solves A u = f on the cells of its mask, A being the 5 point laplacian with
+ * the diagonal reduced at the canvas border (Neumann) and the cells outside of the mask
+ * being fixed (Dirichlet). On the finest level f = 0 and the fixed cells hold the border
+ * values, on the coarser levels f is the restricted residual and the fixed cells are 0.
+ */
+
+// heal areas smaller than that converge quickly enough with SOR. the multigrid has to set up
+// its levels first, which only pays off reliably for larger areas.
+#define DT_HEAL_MG_MIN_SIZE 256
+// levels smaller than that are solved directly
+#define DT_HEAL_MG_COARSEST 8
+#define DT_HEAL_MG_MAX_LEVELS 16
+#define DT_HEAL_MG_MAX_CYCLES 100
+#define DT_HEAL_MG_PRE_SMOOTH 2
+#define DT_HEAL_MG_POST_SMOOTH 2
+#define DT_HEAL_MG_COARSE_SWEEPS 64
+#define DT_HEAL_MG_OMEGA 1.15f
+
+typedef struct dt_heal_mg_level_t
+{
+  int width, height;
+  float *u;      // solution, ch floats per cell
+  float *f;      // right hand side, NULL for zero
+  float *r;      // residual
+  uint8_t *mask; // cells to solve for
+} dt_heal_mg_level_t;
+
+// one red or black half sweep of Gauss-Seidel, slightly over-relaxed which speeds up the
+// V-cycle by about a third
+static inline void _heal_mg_smooth_ch(const dt_heal_mg_level_t *const l, const int color, const int ch,
+                                      const int ch1)
+{
+  const int width = l->width;
+  const int height = l->height;
+  float *const u = l->u;
+  const float *const f = l->f;
+  const uint8_t *const mask = l->mask;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(width, height, u, f, mask, color, ch, ch1) \
+  schedule(static)
+#endif
+  for(int i = 0; i < height; i++)
+  {
+    const float *const up = u + (size_t)(i > 0 ? i - 1 : i) * width * ch;
+    const float *const down = u + (size_t)(i < height - 1 ? i + 1 : i) * width * ch;
+    const float *const frow = f ? f + (size_t)i * width * ch : NULL;
+    float *const row = u + (size_t)i * width * ch;
+    const int ai = (i > 0) + (i < height - 1);
+    // neighbours off the canvas are replaced by the cell itself and taken out again by
+    // subtracting it, which avoids branching on the borders in the inner loop
+    const float skip_i = 2 - ai;
+    for(int j = (i + color) & 1; j < width; j += 2)
+    {
+      if(!mask[(size_t)i * width + j]) continue;
+      const int jl = j > 0 ? j - 1 : j;
+      const int jr = j < width - 1 ? j + 1 : j;
+      const int a = ai + (j > 0) + (j < width - 1);
+      if(a == 0) continue;
+      const float inv_a = 1.0f / a;
+      const float skip = skip_i + (jl == j) + (jr == j);
+      float *const c = row + (size_t)j * ch;
+      for(int k = 0; k < ch1; k++)
+      {
+        const float sum = (frow ? frow[(size_t)j * ch + k] : 0.0f) + up[(size_t)j * ch + k]
+                          + down[(size_t)j * ch + k] + row[(size_t)jl * ch + k] + row[(size_t)jr * ch + k]
+                          - skip * c[k];
+        c[k] += DT_HEAL_MG_OMEGA * (sum * inv_a - c[k]);
+      }
+    }
+  }
+}
+
+static void _heal_mg_smooth(const dt_heal_mg_level_t *const l, const int color, const int ch, const int ch1)
+{
+  // let the compiler unroll the channel loop for the common case
+  if(ch == 4 && ch1 == 3)
+    _heal_mg_smooth_ch(l, color, 4, 3);
+  else
+    _heal_mg_smooth_ch(l, color, ch, ch1);
+}
+
+// r = f - A u on the mask, returns the sum of the squared residuals
+static inline float _heal_mg_residual_ch(const dt_heal_mg_level_t *const l, const int ch, const int ch1)
+{
+  const int width = l->width;
+  const int height = l->height;
+  const float *const u = l->u;
+  const float *const f = l->f;
+  float *const r = l->r;
+  const uint8_t *const mask = l->mask;
+  float err = 0.f;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(width, height, u, f, r, mask, ch, ch1) \
+  schedule(static) \
+  reduction(+ : err)
+#endif
+  for(int i = 0; i < height; i++)
+  {
+    const float *const up = u + (size_t)(i > 0 ? i - 1 : i) * width * ch;
+    const float *const down = u + (size_t)(i < height - 1 ? i + 1 : i) * width * ch;
+    const float *const frow = f ? f + (size_t)i * width * ch : NULL;
+    const float *const row = u + (size_t)i * width * ch;
+    float *const rrow = r + (size_t)i * width * ch;
+    const int ai = (i > 0) + (i < height - 1);
+    const float skip_i = 2 - ai;
+    float row_err[4] = { 0.0f }; // heal works on up to 4 channels
+    for(int j = 0; j < width; j++)
+    {
+      float *const res = rrow + (size_t)j * ch;
+      if(!mask[(size_t)i * width + j])
+      {
+        for(int k = 0; k < ch1; k++) res[k] = 0.0f;
+        continue;
+      }
+      const int jl = j > 0 ? j - 1 : j;
+      const int jr = j < width - 1 ? j + 1 : j;
+      const float a = ai + (j > 0) + (j < width - 1);
+      const float skip = skip_i + (jl == j) + (jr == j);
+      const float *const c = row + (size_t)j * ch;
+      for(int k = 0; k < ch1; k++)
+      {
+        res[k] = (frow ? frow[(size_t)j * ch + k] : 0.0f) + up[(size_t)j * ch + k] + down[(size_t)j * ch + k]
+                 + row[(size_t)jl * ch + k] + row[(size_t)jr * ch + k] - (skip + a) * c[k];
+        // one sum per channel keeps the additions independent
+        row_err[k] += res[k] * res[k];
+      }
+    }
+    for(int k = 0; k < ch1; k++) err += row_err[k];
+  }
+
+  return err;
+}
+
+static float _heal_mg_residual(const dt_heal_mg_level_t *const l, const int ch, const int ch1)
+{
+  if(ch == 4 && ch1 == 3)
+    return _heal_mg_residual_ch(l, 4, 3);
+  else
+    return _heal_mg_residual_ch(l, ch, ch1);
+}
+
+// f of the coarse level is the sum of the residuals of its 2x2 children, the coarse grid
+// spacing being twice as large. the coarse solution starts at 0.
+static void _heal_mg_restrict(const dt_heal_mg_level_t *const fine, const dt_heal_mg_level_t *const coarse,
+                              const int ch, const int ch1)
+{
+  const int fw = fine->width;
+  const int fh = fine->height;
+  const int cw = coarse->width;
+  const int ch_ = coarse->height;
+  const float *const r = fine->r;
+  float *const f = coarse->f;
+  float *const u = coarse->u;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(fw, fh, cw, ch_, r, f, u, ch, ch1) \
+  schedule(static)
+#endif
+  for(int i = 0; i < ch_; i++)
+  {
+    for(int j = 0; j < cw; j++)
+    {
+      const size_t cidx = ((size_t)i * cw + j) * ch;
+      for(int k = 0; k < ch1; k++)
+      {
+        float sum = 0.0f;
+        for(int ii = 2 * i; ii < MIN(2 * i + 2, fh); ii++)
+          for(int jj = 2 * j; jj < MIN(2 * j + 2, fw); jj++) sum += r[((size_t)ii * fw + jj) * ch + k];
+        f[cidx + k] = sum;
+        u[cidx + k] = 0.0f;
+      }
+    }
+  }
+}
+
+// bilinear interpolation of the coarse correction, added to the fine solution on its mask
+static void _heal_mg_prolong(const dt_heal_mg_level_t *const coarse, const dt_heal_mg_level_t *const fine,
+                             const int ch, const int ch1)
+{
+  const int fw = fine->width;
+  const int fh = fine->height;
+  const int cw = coarse->width;
+  const int ch_ = coarse->height;
+  const float *const e = coarse->u;
+  float *const u = fine->u;
+  const uint8_t *const mask = fine->mask;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(fw, fh, cw, ch_, e, u, mask, ch, ch1) \
+  schedule(static)
+#endif
+  for(int i = 0; i < fh; i++)
+  {
+    // the centre of coarse cell c is at fine coordinate 2c + 0.5
+    const int i0 = i >> 1;
+    const int i1 = CLAMP((i & 1) ? i0 + 1 : i0 - 1, 0, ch_ - 1);
+    for(int j = 0; j < fw; j++)
+    {
+      if(!mask[(size_t)i * fw + j]) continue;
+      const int j0 = j >> 1;
+      const int j1 = CLAMP((j & 1) ? j0 + 1 : j0 - 1, 0, cw - 1);
+      const float *const e00 = e + ((size_t)i0 * cw + j0) * ch;
+      const float *const e01 = e + ((size_t)i0 * cw + j1) * ch;
+      const float *const e10 = e + ((size_t)i1 * cw + j0) * ch;
+      const float *const e11 = e + ((size_t)i1 * cw + j1) * ch;
+      float *const out = u + ((size_t)i * fw + j) * ch;
+      for(int k = 0; k < ch1; k++)
+        out[k] += (9.0f * e00[k] + 3.0f * (e01[k] + e10[k]) + e11[k]) * (1.0f / 16.0f);
+    }
+  }
+}
+
+static void _heal_mg_vcycle(const dt_heal_mg_level_t *const levels, const int nlevels, const int l, const int ch,
+                            const int ch1, int *sweeps)
+{
+  if(l == nlevels - 1)
+  {
+    for(int s = 0; s < DT_HEAL_MG_COARSE_SWEEPS; s++)
+    {
+      _heal_mg_smooth(levels + l, 0, ch, ch1);
+      _heal_mg_smooth(levels + l, 1, ch, ch1);
+    }
+    return;
+  }
+
+  for(int s = 0; s < DT_HEAL_MG_PRE_SMOOTH; s++)
+  {
+    _heal_mg_smooth(levels + l, 0, ch, ch1);
+    _heal_mg_smooth(levels + l, 1, ch, ch1);
+  }
+  if(l == 0) *sweeps += DT_HEAL_MG_PRE_SMOOTH;
+
+  _heal_mg_residual(levels + l, ch, ch1);
+  _heal_mg_restrict(levels + l, levels + l + 1, ch, ch1);
+  _heal_mg_vcycle(levels, nlevels, l + 1, ch, ch1, sweeps);
+  _heal_mg_prolong(levels + l + 1, levels + l, ch, ch1);
+
+  for(int s = 0; s < DT_HEAL_MG_POST_SMOOTH; s++)
+  {
+    _heal_mg_smooth(levels + l, 0, ch, ch1);
+    _heal_mg_smooth(levels + l, 1, ch, ch1);
+  }
+  if(l == 0) *sweeps += DT_HEAL_MG_POST_SMOOTH;
 }
 
+// Solve the laplace equation for pixels with multigrid and store the result in-place.
+// Returns the number of sweeps over the full resolution grid, or -1 if we ran out of memory.
+static int dt_heal_laplace_multigrid(float *pixels, const int width, const int height, const int ch,
+                                     const float *const mask)
+{
+  const int ch1 = (ch == 4) ? ch - 1 : ch;
+  dt_heal_mg_level_t levels[DT_HEAL_MG_MAX_LEVELS] = { { 0 } };
+  int nlevels = 0;
+  int sweeps = -1;
+  int nmask = 0;
+  const float epsilon = (0.1 / 255);
+  const float err_exit = epsilon * epsilon;
+
+  // finest level works in place on pixels
+  levels[0].width = width;
+  levels[0].height = height;
+  levels[0].u = pixels;
+  levels[0].r = dt_alloc_align_float((size_t)ch * width * height);
+  levels[0].mask = dt_alloc_align(64, (size_t)width * height);
+  nlevels = 1;
+  if(!levels[0].r || !levels[0].mask) goto cleanup;
+
+  for(size_t k = 0; k < (size_t)width * height; k++)
+  {
+    levels[0].mask[k] = mask[k] != 0.f;
+    nmask += levels[0].mask[k];
+  }
+  if(nmask == 0)
+  {
+    sweeps = 0;
+    goto cleanup;
+  }
+
+  // coarser levels. a cell is fixed as soon as one of its children is, otherwise the
+  // coarse border would move outwards and the coarse problem might lose all its fixed
+  // cells. thin parts of the mask vanish that way, the smoother takes care of them.
+  while(nlevels < DT_HEAL_MG_MAX_LEVELS && levels[nlevels - 1].width > DT_HEAL_MG_COARSEST
+        && levels[nlevels - 1].height > DT_HEAL_MG_COARSEST)
+  {
+    const dt_heal_mg_level_t *const fine = levels + nlevels - 1;
+    dt_heal_mg_level_t *const l = levels + nlevels;
+    l->width = (fine->width + 1) / 2;
+    l->height = (fine->height + 1) / 2;
+    const size_t size = (size_t)l->width * l->height;
+    l->u = dt_alloc_align_float(ch * size);
+    l->f = dt_alloc_align_float(ch * size);
+    l->r = dt_alloc_align_float(ch * size);
+    l->mask = dt_alloc_align(64, size);
+    nlevels++;
+    if(!l->u || !l->f || !l->r || !l->mask) goto cleanup;
+
+    memset(l->u, 0, sizeof(float) * ch * size);
+    memset(l->r, 0, sizeof(float) * ch * size);
+    for(int i = 0; i < l->height; i++)
+      for(int j = 0; j < l->width; j++)
+      {
+        uint8_t m = 1;
+        for(int ii = 2 * i; ii < MIN(2 * i + 2, fine->height); ii++)
+          for(int jj = 2 * j; jj < MIN(2 * j + 2, fine->width); jj++) m &= fine->mask[(size_t)ii * fine->width + jj];
+        l->mask[(size_t)i * l->width + j] = m;
+      }
+  }
+
+  sweeps = 0;
+  float prev_err = FLT_MAX;
+  for(int cycle = 0; cycle < DT_HEAL_MG_MAX_CYCLES; cycle++)
+  {
+    const float err = _heal_mg_residual(levels, ch, ch1);
+    sweeps++;
+    // stop when converged, or when float precision doesn't allow to get any closer
+    if(err < err_exit || err > 0.99f * prev_err) break;
+    prev_err = err;
+
+    _heal_mg_vcycle(levels, nlevels, 0, ch, ch1, &sweeps);
+  }
+
+cleanup:
+  if(sweeps < 0) fprintf(stderr, "dt_heal_laplace_multigrid: error allocating memory for healing\n");
+  for(int l = 0; l < nlevels; l++)
+  {
+    if(l > 0 && levels[l].u) dt_free_align(levels[l].u);
+    if(levels[l].f) dt_free_align(levels[l].f);
+    if(levels[l].r) dt_free_align(levels[l].r);
+    if(levels[l].mask) dt_free_align(levels[l].mask);
+  }
+
+  return sweeps;
+}
 
 /* Original Algorithm Design:
  *
@@ -280,7 +635,9 @@ void dt_heal(const float *const src_buffer, float *dest_buffer, const float *con
   /* subtract pattern from image and store the result in diff */
   dt_heal_sub(dest_buffer, src_buffer, diff_buffer, width, height, ch);
 
-  dt_heal_laplace_loop(diff_buffer, width, height, ch, mask_buffer, use_sse);
+  if(MIN(width, height) < DT_HEAL_MG_MIN_SIZE
+     || dt_heal_laplace_multigrid(diff_buffer, width, height, ch, mask_buffer) < 0)
+    dt_heal_laplace_loop(diff_buffer, width, height, ch, mask_buffer, use_sse);
 
   /* add solution to original image and store in dest */
   dt_heal_add(diff_buffer, src_buffer, dest_buffer, width, height, ch);
@@ -474,16 +474,10 @@ int dt_history_merge_module_into_history(dt_develop_t *dev_dest, dt_develop_t *d
   return module_added;
 }
 
-static int _history_copy_and_paste_on_image_merge(int32_t imgid, int32_t dest_imgid, GList *ops, const gboolean copy_full)
+// read the histories of imgid and dest_imgid into dev_src and dev_dest, the database part of a merge
+static void _history_merge_read(dt_develop_t *dev_src, dt_develop_t *dev_dest, const int32_t imgid,
+                                const int32_t dest_imgid)
 {
-  GList *modules_used = NULL;
-
-  dt_develop_t _dev_src = { 0 };
-  dt_develop_t _dev_dest = { 0 };
-
-  dt_develop_t *dev_src = &_dev_src;
-  dt_develop_t *dev_dest = &_dev_dest;
-
   // we will do the copy/paste on memory so we can deal with masks
   dt_dev_init(dev_src, FALSE);
   dt_dev_init(dev_dest, FALSE);
@@ -504,7 +498,14 @@ static int _history_copy_and_paste_on_image_merge(int32_t imgid, int32_t dest_im
 
   dt_ioppr_check_iop_order(dev_src, imgid, "_history_copy_and_paste_on_image_merge 1");
   dt_ioppr_check_iop_order(dev_dest, dest_imgid, "_history_copy_and_paste_on_image_merge 1");
+}
 
+// merge the modules of dev_src into the history of dev_dest. it is all done in memory, without touching
+// the database, so it can run on several images at once.
+static void _history_merge_apply(dt_develop_t *dev_src, dt_develop_t *dev_dest, const int32_t dest_imgid,
+                                 GList *ops, const gboolean copy_full)
+{
+  GList *modules_used = NULL;
   GList *mod_list = NULL;
 
   if(ops)
@@ -567,20 +568,34 @@ static int _history_copy_and_paste_on_image_merge(int32_t imgid, int32_t dest_im
 
   dt_ioppr_check_iop_order(dev_dest, dest_imgid, "_history_copy_and_paste_on_image_merge 2");
 
+  g_list_free(modules_used);
+}
+
+// write the merged history of dev_dest to the database and free both
+static void _history_merge_write(dt_develop_t *dev_src, dt_develop_t *dev_dest, const int32_t dest_imgid)
+{
   // write history and forms to db
   dt_dev_write_history_ext(dev_dest, dest_imgid);
 
   dt_dev_cleanup(dev_src);
   dt_dev_cleanup(dev_dest);
+}
 
-  g_list_free(modules_used);
+static int _history_copy_and_paste_on_image_merge(int32_t imgid, int32_t dest_imgid, GList *ops, const gboolean copy_full)
+{
+  dt_develop_t dev_src = { 0 };
+  dt_develop_t dev_dest = { 0 };
+
+  _history_merge_read(&dev_src, &dev_dest, imgid, dest_imgid);
+  _history_merge_apply(&dev_src, &dev_dest, dest_imgid, ops, copy_full);
+  _history_merge_write(&dev_src, &dev_dest, dest_imgid);
 
   return 0;
 }
 
-static int _history_copy_and_paste_on_image_overwrite(const int32_t imgid, const int32_t dest_imgid, GList *ops, const gboolean copy_full)
+// clear the history of dest_imgid before an overwrite
+static void _history_overwrite_delete(const int32_t dest_imgid)
 {
-  int ret_val = 0;
   sqlite3_stmt *stmt;
 
   // replace history stack
@@ -605,6 +620,14 @@ static int _history_copy_and_paste_on_image_overwrite(const int32_t imgid, const
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, dest_imgid);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+}
+
+static int _history_copy_and_paste_on_image_overwrite(const int32_t imgid, const int32_t dest_imgid, GList *ops, const gboolean copy_full)
+{
+  int ret_val = 0;
+  sqlite3_stmt *stmt;
+
+  _history_overwrite_delete(dest_imgid);
 
   // the user wants an exact duplicate of the history, so just copy the db
   if(!ops)
@@ -732,6 +755,59 @@ static int _history_copy_and_paste_on_image_overwrite(const int32_t imgid, const
   return ret_val;
 }
 
+// record the state of dest_imgid before a paste into hist, and copy the module order if asked
+static void _history_paste_on_image_start(const int32_t imgid, const int32_t dest_imgid,
+                                          const gboolean copy_iop_order, dt_undo_lt_history_t *hist)
+{
+  hist->imgid = dest_imgid;
+  dt_history_snapshot_undo_create(hist->imgid, &hist->before, &hist->before_history_end);
+
+  if(copy_iop_order)
+  {
+    GList *iop_list = dt_ioppr_get_iop_order_list(imgid, FALSE);
+    dt_ioppr_write_iop_order_list(iop_list, dest_imgid);
+    g_list_free_full(iop_list, g_free);
+  }
+}
+
+// the database part of a paste, recording the before and after states into hist. it doesn't touch the
+// gui, the caller holds the image locks.
+static int _history_paste_on_image_db(const int32_t imgid, const int32_t dest_imgid, const gboolean merge,
+                                      GList *ops, const gboolean copy_iop_order, const gboolean copy_full,
+                                      dt_undo_lt_history_t *hist)
+{
+  _history_paste_on_image_start(imgid, dest_imgid, copy_iop_order, hist);
+
+  int ret_val = 0;
+  if(merge)
+    ret_val = _history_copy_and_paste_on_image_merge(imgid, dest_imgid, ops, copy_full);
+  else
+    ret_val = _history_copy_and_paste_on_image_overwrite(imgid, dest_imgid, ops, copy_full);
+
+  dt_history_snapshot_undo_create(hist->imgid, &hist->after, &hist->after_history_end);
+  return ret_val;
+}
+
+// what is left to do once the history of dest_imgid has been replaced: tags, sidecar and thumbnail
+static void _history_paste_on_image_done(const int32_t dest_imgid, const guint tagid)
+{
+  /* attach changed tag reflecting actual change */
+  dt_tag_attach(tagid, dest_imgid, FALSE, FALSE);
+  /* set change_timestamp */
+  dt_image_cache_set_change_timestamp(darktable.image_cache, dest_imgid);
+
+  /* update xmp file */
+  dt_image_synch_xmp(dest_imgid);
+
+  dt_mipmap_cache_remove(darktable.mipmap_cache, dest_imgid);
+
+  /* update the aspect ratio. recompute only if really needed for performance reasons */
+  if(darktable.collection->params.sort == DT_COLLECTION_SORT_ASPECT_RATIO)
+    dt_image_set_aspect_ratio(dest_imgid, FALSE);
+  else
+    dt_image_reset_aspect_ratio(dest_imgid, FALSE);
+}
+
 int dt_history_copy_and_paste_on_image(const int32_t imgid, const int32_t dest_imgid,
                                        const gboolean merge, GList *ops,
                                        const gboolean copy_iop_order, const gboolean copy_full)
@@ -751,34 +827,15 @@ int dt_history_copy_and_paste_on_image(const int32_t imgid, const int32_t dest_i
   if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
 
   dt_undo_lt_history_t *hist = dt_history_snapshot_item_init();
-  hist->imgid = dest_imgid;
-  dt_history_snapshot_undo_create(hist->imgid, &hist->before, &hist->before_history_end);
-
-  if(copy_iop_order)
-  {
-    GList *iop_list = dt_ioppr_get_iop_order_list(imgid, FALSE);
-    dt_ioppr_write_iop_order_list(iop_list, dest_imgid);
-    g_list_free_full(iop_list, g_free);
-  }
-
-  int ret_val = 0;
-  if(merge)
-    ret_val = _history_copy_and_paste_on_image_merge(imgid, dest_imgid, ops, copy_full);
-  else
-    ret_val = _history_copy_and_paste_on_image_overwrite(imgid, dest_imgid, ops, copy_full);
+  const int ret_val = _history_paste_on_image_db(imgid, dest_imgid, merge, ops, copy_iop_order, copy_full, hist);
 
-  dt_history_snapshot_undo_create(hist->imgid, &hist->after, &hist->after_history_end);
   dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
   dt_undo_record(darktable.undo, NULL, DT_UNDO_LT_HISTORY, (dt_undo_data_t)hist,
                  dt_history_snapshot_undo_pop, dt_history_snapshot_undo_lt_history_data_free);
   dt_undo_end_group(darktable.undo);
 
-  /* attach changed tag reflecting actual change */
   guint tagid = 0;
   dt_tag_new("darktable|changed", &tagid);
-  dt_tag_attach(tagid, dest_imgid, FALSE, FALSE);
-  /* set change_timestamp */
-  dt_image_cache_set_change_timestamp(darktable.image_cache, dest_imgid);
 
   /* if current image in develop reload history */
   if(dt_dev_is_current_image(darktable.develop, dest_imgid))
@@ -787,18 +844,9 @@ int dt_history_copy_and_paste_on_image(const int32_t imgid, const int32_t dest_i
     dt_dev_modulegroups_set(darktable.develop, dt_dev_modulegroups_get(darktable.develop));
   }
 
-  /* update xmp file */
-  dt_image_synch_xmp(dest_imgid);
-
-  dt_mipmap_cache_remove(darktable.mipmap_cache, dest_imgid);
+  _history_paste_on_image_done(dest_imgid, tagid);
   dt_image_update_final_size(imgid);
 
-  /* update the aspect ratio. recompute only if really needed for performance reasons */
-  if(darktable.collection->params.sort == DT_COLLECTION_SORT_ASPECT_RATIO)
-    dt_image_set_aspect_ratio(dest_imgid, FALSE);
-  else
-    dt_image_reset_aspect_ratio(dest_imgid, FALSE);
-
   // signal that the mipmap need to be updated
   DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, dest_imgid);
 
@@ -807,6 +855,157 @@ int dt_history_copy_and_paste_on_image(const int32_t imgid, const int32_t dest_i
   return ret_val;
 }
 
+typedef struct _history_undo_group_t
+{
+  dt_undo_lt_history_t **hists;
+  int count;
+} _history_undo_group_t;
+
+// the undo list may only be changed from the gui thread. a paste job records all its images there at once,
+// so no undo item of the user's other actions can get into its group.
+static gboolean _history_record_undo_group(gpointer user_data)
+{
+  _history_undo_group_t *group = (_history_undo_group_t *)user_data;
+  dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
+  for(int k = 0; k < group->count; k++)
+    dt_undo_record(darktable.undo, NULL, DT_UNDO_LT_HISTORY, (dt_undo_data_t)group->hists[k],
+                   dt_history_snapshot_undo_pop, dt_history_snapshot_undo_lt_history_data_free);
+  dt_undo_end_group(darktable.undo);
+  free(group->hists);
+  free(group);
+  return FALSE;
+}
+
+int dt_history_paste_on_list_ext(const GList *list, const int32_t imgid, const gboolean merge, GList *ops,
+                                 const gboolean copy_iop_order, const gboolean copy_full, const gboolean undo,
+                                 dt_job_t *job)
+{
+  if(imgid <= 0 || !list) return 0;
+
+  const int total = g_list_length((GList *)list);
+  int32_t *imgs = malloc(sizeof(int32_t) * total);
+  dt_undo_lt_history_t **hists = calloc(total, sizeof(dt_undo_lt_history_t *));
+  // the source and destination histories of a batch, two per image
+  dt_develop_t *devs = calloc(2 * DT_HISTORY_BATCH_SIZE, sizeof(dt_develop_t));
+  if(!imgs || !hists || !devs)
+  {
+    free(imgs);
+    free(hists);
+    free(devs);
+    return 0;
+  }
+  int n = 0;
+  for(const GList *l = list; l; l = g_list_next(l))
+    if(GPOINTER_TO_INT(l->data) != imgid) imgs[n++] = GPOINTER_TO_INT(l->data);
+
+  guint tagid = 0;
+  dt_tag_new("darktable|changed", &tagid);
+
+  const double start = dt_get_wtime();
+
+  // keep the source image from being edited while we copy from it, and lock the destination images
+  // while we read or write them, except for those sharing the lock of the source which we already hold.
+  dt_lock_image(imgid);
+  const int src_lock = imgid & (DT_IMAGE_DBLOCKS - 1);
+
+  // an overwrite of selected modules is a merge onto an emptied history
+  const gboolean do_merge = merge || ops;
+
+  int done = 0;
+  while(done < n && !(job && dt_control_job_get_state(job) == DT_JOB_STATE_CANCELLED))
+  {
+    const int batch = MIN(DT_HISTORY_BATCH_SIZE, n - done);
+
+    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "BEGIN", NULL, NULL, NULL);
+
+    // all the database work is done serially, on the one connection
+    for(int k = 0; k < batch; k++)
+    {
+      const int32_t dest = imgs[done + k];
+      const gboolean own_lock = (dest & (DT_IMAGE_DBLOCKS - 1)) != src_lock;
+      if(own_lock) dt_lock_image(dest);
+      hists[done + k] = dt_history_snapshot_item_init();
+      _history_paste_on_image_start(imgid, dest, copy_iop_order, hists[done + k]);
+      if(!do_merge)
+        _history_copy_and_paste_on_image_overwrite(imgid, dest, NULL, copy_full);
+      else
+      {
+        if(!merge) _history_overwrite_delete(dest);
+        _history_merge_read(&devs[2 * k], &devs[2 * k + 1], imgid, dest);
+      }
+      if(own_lock) dt_unlock_image(dest);
+    }
+
+    // only the merge, in memory, runs in parallel
+    if(do_merge)
+    {
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(imgs, devs, done, batch, ops, copy_full) \
+  schedule(dynamic)
+#endif
+      for(int k = 0; k < batch; k++)
+        _history_merge_apply(&devs[2 * k], &devs[2 * k + 1], imgs[done + k], ops, copy_full);
+    }
+
+    for(int k = 0; k < batch; k++)
+    {
+      const int32_t dest = imgs[done + k];
+      const gboolean own_lock = (dest & (DT_IMAGE_DBLOCKS - 1)) != src_lock;
+      if(own_lock) dt_lock_image(dest);
+      if(do_merge)
+      {
+        _history_merge_write(&devs[2 * k], &devs[2 * k + 1], dest);
+        memset(&devs[2 * k], 0, 2 * sizeof(dt_develop_t));
+      }
+      dt_undo_lt_history_t *hist = hists[done + k];
+      dt_history_snapshot_undo_create(hist->imgid, &hist->after, &hist->after_history_end);
+      if(own_lock) dt_unlock_image(dest);
+    }
+    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+
+    // the rest is not thread safe, or is cheap. the undo items are kept for the end.
+    for(int k = done; k < done + batch; k++)
+    {
+      if(!undo) dt_history_snapshot_undo_lt_history_data_free(hists[k]);
+      _history_paste_on_image_done(imgs[k], tagid);
+    }
+
+    done += batch;
+    if(job) dt_control_job_set_progress(job, (double)done / n);
+  }
+
+  dt_unlock_image(imgid);
+
+  if(undo && done)
+  {
+    // hands hists over
+    _history_undo_group_t *group = malloc(sizeof(_history_undo_group_t));
+    if(group)
+    {
+      group->hists = hists;
+      group->count = done;
+      hists = NULL;
+      g_main_context_invoke(NULL, _history_record_undo_group, group);
+    }
+    else
+      for(int k = 0; k < done; k++) dt_history_snapshot_undo_lt_history_data_free(hists[k]);
+  }
+
+  dt_image_update_final_size(imgid);
+
+  // one signal for all the thumbnails
+  if(done) DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, -1);
+
+  dt_print(DT_DEBUG_PERF, "[history] pasted onto %d of %d images in %.3f secs\n", done, n,
+           dt_get_wtime() - start);
+
+  free(devs);
+  free(hists);
+  free(imgs);
+  return done;
+}
+
 GList *dt_history_get_items(const int32_t imgid, gboolean enabled)
 {
   GList *result = NULL;
@@ -950,7 +1149,7 @@ static int dt_history_end_attop(const int32_t imgid)
   - is used in lighttable and darkroom mode
   - It compresses history *exclusively* in the database and does *not* touch anything on the history stack
 */
-void dt_history_compress_on_image(const int32_t imgid)
+static void _history_compress_on_image(const int32_t imgid)
 {
   dt_lock_image(imgid);
   sqlite3_stmt *stmt;
@@ -976,7 +1175,7 @@ void dt_history_compress_on_image(const int32_t imgid)
   const char *op_mask_manager = "mask_manager";
   gboolean manager_position = FALSE;
 
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "BEGIN", NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "SAVEPOINT compress_history", NULL, NULL, NULL);
 
   // We must know for sure whether there is a mask manager at slot 0 in history
   // because only if this is **not** true history nums and history_end must be increased
@@ -1070,8 +1269,12 @@ void dt_history_compress_on_image(const int32_t imgid)
   dt_unlock_image(imgid);
   dt_history_hash_write_from_history(imgid, DT_HISTORY_HASH_CURRENT);
 
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "RELEASE compress_history", NULL, NULL, NULL);
+}
 
+void dt_history_compress_on_image(const int32_t imgid)
+{
+  _history_compress_on_image(imgid);
   DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, imgid);
 }
 
@@ -1091,7 +1294,7 @@ void dt_history_truncate_on_image(const int32_t imgid, const int32_t history_end
     return;
   }
 
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "BEGIN", NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "SAVEPOINT truncate_history", NULL, NULL, NULL);
 
   // delete end of history
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
@@ -1125,100 +1328,124 @@ void dt_history_truncate_on_image(const int32_t imgid, const int32_t history_end
   dt_unlock_image(imgid);
   dt_history_hash_write_from_history(imgid, DT_HISTORY_HASH_CURRENT);
 
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "RELEASE truncate_history", NULL, NULL, NULL);
 
   DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, imgid);
 }
 
-int dt_history_compress_on_list(const GList *imgs)
+// compress and renumber the history of one image, returns TRUE if it could not be compressed
+static gboolean _history_compress_on_list_image(const int32_t imgid)
 {
-  int uncompressed=0;
-
-  // Get the list of selected images
-  for(const GList *l = imgs; l; l = g_list_next(l))
+  dt_lock_image(imgid);
+  const int test = dt_history_end_attop(imgid);
+  if (test == 1) // we do a compression and we know for sure history_end is at the top!
   {
-    const int imgid = GPOINTER_TO_INT(l->data);
-    dt_lock_image(imgid);
-    const int test = dt_history_end_attop(imgid);
-    if (test == 1) // we do a compression and we know for sure history_end is at the top!
-    {
-      dt_history_set_compress_problem(imgid, FALSE);
-      dt_history_compress_on_image(imgid);
+    dt_history_set_compress_problem(imgid, FALSE);
+    _history_compress_on_image(imgid);
 
-      // now the modules are in right order but need renumbering to remove leaks
-      int max=0;    // the maximum num in main_history for an image
-      int size=0;   // the number of items in main_history for an image
-      int done=0;   // used for renumbering index
+    // now the modules are in right order but need renumbering to remove leaks
+    int max=0;    // the maximum num in main_history for an image
+    int size=0;   // the number of items in main_history for an image
+    int done=0;   // used for renumbering index
 
-      sqlite3_stmt *stmt2;
+    sqlite3_stmt *stmt2;
 
-      // get highest num in history
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-        "SELECT MAX(num) FROM main.history WHERE imgid=?1", -1, &stmt2, NULL);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt2, 1, imgid);
-      if (sqlite3_step(stmt2) == SQLITE_ROW)
-        max = sqlite3_column_int(stmt2, 0);
-      sqlite3_finalize(stmt2);
+    // get highest num in history
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+      "SELECT MAX(num) FROM main.history WHERE imgid=?1", -1, &stmt2, NULL);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt2, 1, imgid);
+    if (sqlite3_step(stmt2) == SQLITE_ROW)
+      max = sqlite3_column_int(stmt2, 0);
+    sqlite3_finalize(stmt2);
 
-      // get number of items in main.history
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-        "SELECT COUNT(*) FROM main.history WHERE imgid = ?1", -1, &stmt2, NULL);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt2, 1, imgid);
-      if(sqlite3_step(stmt2) == SQLITE_ROW)
-        size = sqlite3_column_int(stmt2, 0);
-      sqlite3_finalize(stmt2);
+    // get number of items in main.history
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+      "SELECT COUNT(*) FROM main.history WHERE imgid = ?1", -1, &stmt2, NULL);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt2, 1, imgid);
+    if(sqlite3_step(stmt2) == SQLITE_ROW)
+      size = sqlite3_column_int(stmt2, 0);
+    sqlite3_finalize(stmt2);
 
-      if ((size>0) && (max>0))
+    if ((size>0) && (max>0))
+    {
+      for (int index=0;index<(max+1);index++)
       {
-        for (int index=0;index<(max+1);index++)
+        sqlite3_stmt *stmt3;
+        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+          "SELECT num FROM main.history WHERE imgid=?1 AND num=?2", -1, &stmt3, NULL);
+        DT_DEBUG_SQLITE3_BIND_INT(stmt3, 1, imgid);
+        DT_DEBUG_SQLITE3_BIND_INT(stmt3, 2, index);
+        if (sqlite3_step(stmt3) == SQLITE_ROW)
         {
-          sqlite3_stmt *stmt3;
+          sqlite3_stmt *stmt4;
+          // step by step set the correct num
           DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-            "SELECT num FROM main.history WHERE imgid=?1 AND num=?2", -1, &stmt3, NULL);
-          DT_DEBUG_SQLITE3_BIND_INT(stmt3, 1, imgid);
-          DT_DEBUG_SQLITE3_BIND_INT(stmt3, 2, index);
-          if (sqlite3_step(stmt3) == SQLITE_ROW)
-          {
-            sqlite3_stmt *stmt4;
-            // step by step set the correct num
-            DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-              "UPDATE main.history SET num = ?3 WHERE imgid = ?1 AND num = ?2", -1, &stmt4, NULL);
-            DT_DEBUG_SQLITE3_BIND_INT(stmt4, 1, imgid);
-            DT_DEBUG_SQLITE3_BIND_INT(stmt4, 2, index);
-            DT_DEBUG_SQLITE3_BIND_INT(stmt4, 3, done);
-            sqlite3_step(stmt4);
-            sqlite3_finalize(stmt4);
-
-            done++;
-          }
-          sqlite3_finalize(stmt3);
+            "UPDATE main.history SET num = ?3 WHERE imgid = ?1 AND num = ?2", -1, &stmt4, NULL);
+          DT_DEBUG_SQLITE3_BIND_INT(stmt4, 1, imgid);
+          DT_DEBUG_SQLITE3_BIND_INT(stmt4, 2, index);
+          DT_DEBUG_SQLITE3_BIND_INT(stmt4, 3, done);
+          sqlite3_step(stmt4);
+          sqlite3_finalize(stmt4);
+
+          done++;
         }
+        sqlite3_finalize(stmt3);
       }
-      // update history end
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-        "UPDATE main.images SET history_end = ?2 WHERE id = ?1", -1, &stmt2, NULL);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt2, 1, imgid);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt2, 2, done);
-      sqlite3_step(stmt2);
-      sqlite3_finalize(stmt2);
-
-      dt_image_write_sidecar_file(imgid);
     }
-    if (test == 0) // no compression as history_end is right in the middle of history
-    {
-      uncompressed++;
-      dt_history_set_compress_problem(imgid, TRUE);
-    }
-    if (test == -1)
-      dt_history_set_compress_problem(imgid, FALSE);
+    // update history end
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+      "UPDATE main.images SET history_end = ?2 WHERE id = ?1", -1, &stmt2, NULL);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt2, 1, imgid);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt2, 2, done);
+    sqlite3_step(stmt2);
+    sqlite3_finalize(stmt2);
 
-    dt_unlock_image(imgid);
-    dt_history_hash_write_from_history(imgid, DT_HISTORY_HASH_CURRENT);
+    dt_image_write_sidecar_file(imgid);
   }
+  if (test == 0) // no compression as history_end is right in the middle of history
+    dt_history_set_compress_problem(imgid, TRUE);
+  if (test == -1)
+    dt_history_set_compress_problem(imgid, FALSE);
+
+  dt_unlock_image(imgid);
+  dt_history_hash_write_from_history(imgid, DT_HISTORY_HASH_CURRENT);
+
+  return test == 0;
+}
+
+int dt_history_compress_on_list_ext(const GList *imgs, dt_job_t *job)
+{
+  int uncompressed = 0;
+  const int total = g_list_length((GList *)imgs);
+  const double start = dt_get_wtime();
+
+  // the work is all in the database, so rather than going parallel we save on transactions
+  int done = 0;
+  const GList *l = imgs;
+  while(l && !(job && dt_control_job_get_state(job) == DT_JOB_STATE_CANCELLED))
+  {
+    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "BEGIN", NULL, NULL, NULL);
+    for(int k = 0; l && k < DT_HISTORY_BATCH_SIZE; k++, l = g_list_next(l), done++)
+      if(_history_compress_on_list_image(GPOINTER_TO_INT(l->data))) uncompressed++;
+    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+
+    if(job) dt_control_job_set_progress(job, (double)done / total);
+  }
+
+  // one signal for all the thumbnails
+  if(done) DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, -1);
+
+  dt_print(DT_DEBUG_PERF, "[history] compressed %d of %d images in %.3f secs\n", done, total,
+           dt_get_wtime() - start);
 
   return uncompressed;
 }
 
+int dt_history_compress_on_list(const GList *imgs)
+{
+  return dt_history_compress_on_list_ext(imgs, NULL);
+}
+
 gboolean dt_history_check_module_exists(int32_t imgid, const char *operation)
 {
   gboolean result = FALSE;
@@ -1631,27 +1858,41 @@ gboolean dt_history_copy_parts(int imgid)
     return FALSE;
 }
 
-gboolean dt_history_paste_on_list(const GList *list, gboolean undo)
+// paste the copied history onto list. the image being edited in darkroom needs its develop reloaded, it is
+// pasted on alone. all the others go in batches.
+static void _history_paste_on_list(const GList *list, const gboolean undo)
 {
-  if(darktable.view_manager->copy_paste.copied_imageid <= 0) return FALSE;
-  if(!list) // do we have any images to receive the pasted history?
-    return FALSE;
-
-  const int mode = dt_conf_get_int("plugins/lighttable/copy_history/pastemode");
-  gboolean merge = FALSE;
-  if(mode == 0) merge = TRUE;
+  const dt_history_copy_item_t *cp = &darktable.view_manager->copy_paste;
+  const gboolean merge = dt_conf_get_int("plugins/lighttable/copy_history/pastemode") == 0;
 
   if(undo) dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
-  for(GList *l = (GList *)list; l; l = g_list_next(l))
+
+  GList *others = NULL;
+  for(const GList *l = list; l; l = g_list_next(l))
   {
     const int dest = GPOINTER_TO_INT(l->data);
-    dt_history_copy_and_paste_on_image(darktable.view_manager->copy_paste.copied_imageid,
-                                       dest, merge,
-                                       darktable.view_manager->copy_paste.selops,
-                                       darktable.view_manager->copy_paste.copy_iop_order,
-                                       darktable.view_manager->copy_paste.full_copy);
+    if(dt_dev_is_current_image(darktable.develop, dest))
+      dt_history_copy_and_paste_on_image(cp->copied_imageid, dest, merge, cp->selops, cp->copy_iop_order,
+                                         cp->full_copy);
+    else
+      others = g_list_prepend(others, l->data);
   }
+  others = g_list_reverse(others);
+
+  dt_history_paste_on_list_ext(others, cp->copied_imageid, merge, cp->selops, cp->copy_iop_order, cp->full_copy,
+                               undo, NULL);
+  g_list_free(others);
+
   if(undo) dt_undo_end_group(darktable.undo);
+}
+
+gboolean dt_history_paste_on_list(const GList *list, gboolean undo)
+{
+  if(darktable.view_manager->copy_paste.copied_imageid <= 0) return FALSE;
+  if(!list) // do we have any images to receive the pasted history?
+    return FALSE;
+
+  _history_paste_on_list(list, undo);
   return TRUE;
 }
 
@@ -1661,10 +1902,6 @@ gboolean dt_history_paste_parts_on_list(const GList *list, gboolean undo)
   if(!list) // do we have any images to receive the pasted history?
     return FALSE;
 
-  const int mode = dt_conf_get_int("plugins/lighttable/copy_history/pastemode");
-  gboolean merge = FALSE;
-  if(mode == 0) merge = TRUE;
-
   // at the time the dialog is started, some signals are sent and this in turn call
   // back dt_view_get_images_to_act_on() which free list and create a new one.
 
@@ -1680,17 +1917,7 @@ gboolean dt_history_paste_parts_on_list(const GList *list, gboolean undo)
     return FALSE;
   }
 
-  if(undo) dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
-  for (const GList *l = l_copy; l; l = g_list_next(l))
-  {
-    const int dest = GPOINTER_TO_INT(l->data);
-    dt_history_copy_and_paste_on_image(darktable.view_manager->copy_paste.copied_imageid,
-                                       dest, merge,
-                                       darktable.view_manager->copy_paste.selops,
-                                       darktable.view_manager->copy_paste.copy_iop_order,
-                                       darktable.view_manager->copy_paste.full_copy);
-  }
-  if(undo) dt_undo_end_group(darktable.undo);
+  _history_paste_on_list(l_copy, undo);
 
   g_list_free(l_copy);
   return TRUE;
@@ -25,6 +25,10 @@
 
 struct dt_develop_t;
 struct dt_iop_module_t;
+struct _dt_job_t;
+
+// number of images handled in one database transaction by the bulk operations
+#define DT_HISTORY_BATCH_SIZE 64
 
 // history hash is designed to detect any change made on the image
 // if current = basic the image has only the mandatory modules with their original settings
@@ -79,6 +83,15 @@ gboolean dt_history_copy_parts(int imgid);
 gboolean dt_history_paste_on_list(const GList *list, gboolean undo);
 gboolean dt_history_paste_parts_on_list(const GList *list, gboolean undo);
 
+/** paste the history of imgid onto the images of list, DT_HISTORY_BATCH_SIZE images per transaction. the
+    database work is serial, only the merge of the histories of a batch runs in parallel. this never touches the develop of the darkroom, so the image being edited
+    there must not be in list. if job is not NULL it receives the progress and can cancel between batches.
+    the undo group is recorded from the gui thread, once all batches are done.
+    returns the number of images done. */
+int dt_history_paste_on_list_ext(const GList *list, const int32_t imgid, const gboolean merge, GList *ops,
+                                 const gboolean copy_iop_order, const gboolean copy_full, const gboolean undo,
+                                 struct _dt_job_t *job);
+
 static inline gboolean dt_history_module_skip_copy(const int flags)
 {
   return flags & (IOP_FLAGS_DEPRECATED | IOP_FLAGS_UNSAFE_COPY | IOP_FLAGS_HIDDEN);
@@ -95,6 +108,8 @@ gboolean dt_history_delete_on_list(const GList *list, gboolean undo);
 
 /** compress history stack */
 int dt_history_compress_on_list(const GList *imgs);
+/** as above, in batches of DT_HISTORY_BATCH_SIZE images per transaction, reporting to job if not NULL */
+int dt_history_compress_on_list_ext(const GList *imgs, struct _dt_job_t *job);
 void dt_history_compress_on_image(const int32_t imgid);
 
 /** truncate history stack */
@@ -27,6 +27,40 @@
 #include <sqlite3.h>
 #include <inttypes.h>
 
+static void _image_cache_fill_snapshot(const dt_image_t *img, dt_image_snapshot_t *snap)
+{
+  memset(snap, 0, sizeof(dt_image_snapshot_t));
+  snap->id = img->id;
+  snap->group_id = img->group_id;
+  snap->film_id = img->film_id;
+  snap->version = img->version;
+  snap->flags = img->flags;
+  snap->orientation = img->orientation;
+  snap->width = img->width;
+  snap->height = img->height;
+  snap->final_width = img->final_width;
+  snap->final_height = img->final_height;
+  snap->p_width = img->p_width;
+  snap->p_height = img->p_height;
+  snap->crop_x = img->crop_x;
+  snap->crop_y = img->crop_y;
+  snap->crop_width = img->crop_width;
+  snap->crop_height = img->crop_height;
+  snap->aspect_ratio = img->aspect_ratio;
+  snap->is_hdr = dt_image_is_hdr(img);
+  snap->import_timestamp = img->import_timestamp;
+  snap->change_timestamp = img->change_timestamp;
+  snap->export_timestamp = img->export_timestamp;
+  snap->print_timestamp = img->print_timestamp;
+}
+
+static void _image_cache_publish(dt_image_cache_t *cache, const dt_image_t *img)
+{
+  dt_image_snapshot_t snap;
+  _image_cache_fill_snapshot(img, &snap);
+  dt_image_snapshot_publish(&cache->snapshots, &snap);
+}
+
 void dt_image_cache_allocate(void *data, dt_cache_entry_t *entry)
 {
   entry->cost = sizeof(dt_image_t);
@@ -160,11 +194,16 @@ void dt_image_cache_allocate(void *data, dt_cache_entry_t *entry)
   img->cache_entry = entry; // init backref
   // could downgrade lock write->read on entry->lock if we were using concurrencykit..
   dt_image_refresh_makermodel(img);
+  if(img->id > 0) _image_cache_publish((dt_image_cache_t *)data, img);
 }
 
 void dt_image_cache_deallocate(void *data, dt_cache_entry_t *entry)
 {
+  dt_image_cache_t *cache = (dt_image_cache_t *)data;
   dt_image_t *img = (dt_image_t *)entry->data;
+  // once the entry is gone, nothing republishes the snapshot. drop it, so that the next reader
+  // reloads the image from the database and sees changes done there directly (e.g. `version').
+  dt_image_snapshot_invalidate(&cache->snapshots, entry->key);
   g_free(img->profile);
   g_free(img);
 }
@@ -182,6 +221,7 @@ void dt_image_cache_init(dt_image_cache_t *cache)
   dt_cache_init(&cache->cache, sizeof(dt_image_t), max_mem);
   dt_cache_set_allocate_callback(&cache->cache, &dt_image_cache_allocate, cache);
   dt_cache_set_cleanup_callback(&cache->cache, &dt_image_cache_deallocate, cache);
+  dt_image_snapshot_table_init(&cache->snapshots);
 
   dt_print(DT_DEBUG_CACHE, "[image_cache] has %d entries\n", num);
 }
@@ -189,6 +229,7 @@ void dt_image_cache_init(dt_image_cache_t *cache)
 void dt_image_cache_cleanup(dt_image_cache_t *cache)
 {
   dt_cache_cleanup(&cache->cache);
+  dt_image_snapshot_table_cleanup(&cache->snapshots);
 }
 
 void dt_image_cache_print(dt_image_cache_t *cache)
@@ -205,6 +246,8 @@ dt_image_t *dt_image_cache_get(dt_image_cache_t *cache, const int32_t imgid, cha
   ASAN_UNPOISON_MEMORY_REGION(entry->data, sizeof(dt_image_t));
   dt_image_t *img = (dt_image_t *)entry->data;
   img->cache_entry = entry;
+  // the snapshot is outdated as soon as the writer starts changing the struct
+  if(mode == 'w') dt_image_snapshot_invalidate(&cache->snapshots, imgid);
   return img;
 }
 
@@ -216,9 +259,29 @@ dt_image_t *dt_image_cache_testget(dt_image_cache_t *cache, const int32_t imgid,
   ASAN_UNPOISON_MEMORY_REGION(entry->data, sizeof(dt_image_t));
   dt_image_t *img = (dt_image_t *)entry->data;
   img->cache_entry = entry;
+  if(mode == 'w') dt_image_snapshot_invalidate(&cache->snapshots, imgid);
   return img;
 }
 
+gboolean dt_image_cache_get_snapshot(dt_image_cache_t *cache, const int32_t imgid, dt_image_snapshot_t *snap)
+{
+  if(imgid <= 0) return FALSE;
+  if(dt_image_snapshot_read(&cache->snapshots, imgid, snap)) return TRUE;
+
+  // slow path: not loaded yet, pushed out by another image or currently being written.
+  // publish again while holding the read lock, so no writer can interleave.
+  const dt_image_t *img = dt_image_cache_get(cache, imgid, 'r');
+  if(!img) return FALSE;
+  const gboolean found = img->id == imgid;
+  if(found)
+  {
+    _image_cache_fill_snapshot(img, snap);
+    dt_image_snapshot_publish(&cache->snapshots, snap);
+  }
+  dt_image_cache_read_release(cache, img);
+  return found;
+}
+
 // drops the read lock on an image struct
 void dt_image_cache_read_release(dt_image_cache_t *cache, const dt_image_t *img)
 {
@@ -305,6 +368,8 @@ void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_i
     // also synch dttags file:
     dt_image_write_sidecar_file(img->id);
   }
+  // still holding the lock, so this is the latest state of the image
+  _image_cache_publish(cache, img);
   dt_cache_release(&cache->cache, img->cache_entry);
 }
 
@@ -312,6 +377,7 @@ void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_i
 // remove the image from the cache
 void dt_image_cache_remove(dt_image_cache_t *cache, const int32_t imgid)
 {
+  dt_image_snapshot_invalidate(&cache->snapshots, imgid);
   dt_cache_remove(&cache->cache, imgid);
 }
 
@@ -20,10 +20,13 @@
 
 #include "common/cache.h"
 #include "common/image.h"
+#include "common/image_snapshot.h"
 
 typedef struct dt_image_cache_t
 {
   dt_cache_t cache;
+  // lock-free copies of the most used fields, for readers which don't need the full struct
+  dt_image_snapshot_table_t snapshots;
 }
 dt_image_cache_t;
 
@@ -55,6 +58,11 @@ dt_image_t *dt_image_cache_get(dt_image_cache_t *cache, const int32_t imgid, cha
 // is currently unavailable.
 dt_image_t *dt_image_cache_testget(dt_image_cache_t *cache, const int32_t imgid, char mode);
 
+// copies the frequently read fields of the image to snap without taking any lock if
+// they are known already, otherwise they are loaded through a regular read get.
+// returns FALSE if the image does not exist.
+gboolean dt_image_cache_get_snapshot(dt_image_cache_t *cache, const int32_t imgid, dt_image_snapshot_t *snap);
+
 // drops the read lock on an image struct
 void dt_image_cache_read_release(dt_image_cache_t *cache, const dt_image_t *img);
 
@@ -0,0 +1,109 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/image_snapshot.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// a reader gives up after that many attempts to get a consistent copy
+#define DT_IMAGE_SNAPSHOT_RETRIES 64
+
+void dt_image_snapshot_table_init(dt_image_snapshot_table_t *table)
+{
+  table->slots = calloc(DT_IMAGE_SNAPSHOT_SLOTS, sizeof(dt_image_snapshot_slot_t));
+  if(!table->slots) return;
+  for(int k = 0; k < DT_IMAGE_SNAPSHOT_SLOTS; k++)
+  {
+    dt_atomic_set_int(&table->slots[k].seq, 0);
+    table->slots[k].snap.id = -1;
+  }
+}
+
+void dt_image_snapshot_table_cleanup(dt_image_snapshot_table_t *table)
+{
+  free(table->slots);
+  table->slots = NULL;
+}
+
+static inline dt_image_snapshot_slot_t *_slot(dt_image_snapshot_table_t *table, const int32_t imgid)
+{
+  return table->slots + (imgid & (DT_IMAGE_SNAPSHOT_SLOTS - 1));
+}
+
+gboolean dt_image_snapshot_read(dt_image_snapshot_table_t *table, const int32_t imgid,
+                                dt_image_snapshot_t *snap)
+{
+  if(!table->slots || imgid <= 0) return FALSE;
+  dt_image_snapshot_slot_t *slot = _slot(table, imgid);
+
+  for(int k = 0; k < DT_IMAGE_SNAPSHOT_RETRIES; k++)
+  {
+    const int seq = dt_atomic_get_int(&slot->seq);
+    if(seq & 1) continue;
+
+    dt_image_snapshot_t copy;
+    memcpy(&copy, &slot->snap, sizeof(dt_image_snapshot_t));
+    // the copy must be complete before we look at the sequence number again
+    dt_atomic_fence();
+    if(dt_atomic_get_int(&slot->seq) != seq) continue;
+
+    if(copy.id != imgid) return FALSE;
+    *snap = copy;
+    return TRUE;
+  }
+  return FALSE;
+}
+
+// the sequence number doubles as the lock of the writers
+static inline int _write_begin(dt_image_snapshot_slot_t *slot)
+{
+  int seq = dt_atomic_get_int(&slot->seq);
+  while((seq & 1) || !dt_atomic_CAS_int(&slot->seq, &seq, seq + 1))
+    seq = dt_atomic_get_int(&slot->seq);
+  return seq + 1;
+}
+
+static inline void _write_end(dt_image_snapshot_slot_t *slot, const int seq)
+{
+  dt_atomic_set_int(&slot->seq, seq + 1);
+}
+
+void dt_image_snapshot_publish(dt_image_snapshot_table_t *table, const dt_image_snapshot_t *snap)
+{
+  if(!table->slots || snap->id <= 0) return;
+  dt_image_snapshot_slot_t *slot = _slot(table, snap->id);
+
+  const int seq = _write_begin(slot);
+  memcpy(&slot->snap, snap, sizeof(dt_image_snapshot_t));
+  _write_end(slot, seq);
+}
+
+void dt_image_snapshot_invalidate(dt_image_snapshot_table_t *table, const int32_t imgid)
+{
+  if(!table->slots || imgid <= 0) return;
+  dt_image_snapshot_slot_t *slot = _slot(table, imgid);
+
+  const int seq = _write_begin(slot);
+  if(slot->snap.id == imgid) slot->snap.id = -1;
+  _write_end(slot, seq);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,76 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/atomic.h"
+#include <glib.h>
+#include <inttypes.h>
+#include <time.h>
+
+// number of slots in the table, must be a power of two. images whose ids are equal modulo
+// this number share a slot and push each other out.
+#define DT_IMAGE_SNAPSHOT_SLOTS 8192
+
+// a copy of the fields of dt_image_t which are read all the time by the thumbnails, the
+// collection and the overlays.
+typedef struct dt_image_snapshot_t
+{
+  int32_t id, group_id, film_id, version;
+  int32_t flags;
+  int32_t orientation; // dt_image_orientation_t
+  int32_t width, height, final_width, final_height, p_width, p_height;
+  int32_t crop_x, crop_y, crop_width, crop_height;
+  float aspect_ratio;
+  gboolean is_hdr; // dt_image_is_hdr()
+  time_t import_timestamp, change_timestamp, export_timestamp, print_timestamp;
+} dt_image_snapshot_t;
+
+typedef struct dt_image_snapshot_slot_t
+{
+  dt_atomic_int seq; // odd while being written
+  dt_image_snapshot_t snap;
+} dt_image_snapshot_slot_t;
+
+// a direct mapped table of snapshots, indexed by image id. every slot is a sequence lock:
+// writers bump the sequence number before and after updating it, readers copy the slot
+// and retry if the sequence number changed meanwhile. so readers never take a lock and
+// never block writers or each other.
+typedef struct dt_image_snapshot_table_t
+{
+  dt_image_snapshot_slot_t *slots;
+} dt_image_snapshot_table_t;
+
+void dt_image_snapshot_table_init(dt_image_snapshot_table_t *table);
+void dt_image_snapshot_table_cleanup(dt_image_snapshot_table_t *table);
+
+// copies the snapshot of imgid to snap. returns FALSE if there is none, or if it could
+// not be read because of writers holding the slot all the time.
+gboolean dt_image_snapshot_read(dt_image_snapshot_table_t *table, const int32_t imgid,
+                                dt_image_snapshot_t *snap);
+
+// makes snap the current snapshot of image snap->id. callers must make sure that
+// snapshots of the same image are published in order, i.e. while holding its cache lock.
+void dt_image_snapshot_publish(dt_image_snapshot_table_t *table, const dt_image_snapshot_t *snap);
+
+// drops the snapshot of imgid, if there is one.
+void dt_image_snapshot_invalidate(dt_image_snapshot_table_t *table, const int32_t imgid);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
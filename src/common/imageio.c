@@ -26,6 +26,7 @@
 #include "common/image_cache.h"
 #include "common/imageio.h"
 #include "common/imageio_module.h"
+#include "common/memory_budget.h"
 #ifdef HAVE_OPENEXR
 #include "common/imageio_exr.h"
 #endif
@@ -646,6 +647,97 @@ int dt_imageio_export(const int32_t imgid, const char *filename, dt_imageio_modu
                                         storage, storage_params, num, total, metadata);
 }
 
+// convert a band of rows of the pipe output for formats writing rows, like the in place
+// conversion in dt_imageio_export_with_flags() does for the whole image.
+static void _export_convert_rows(const void *in, void *out, const size_t npixels, const int bpp,
+                                 const gboolean float_input, const gboolean swap_rb)
+{
+  const int r = swap_rb ? 2 : 0;
+  const int b = swap_rb ? 0 : 2;
+  if(bpp == 8 && float_input)
+  {
+    const float *const inbuf = (const float *)in;
+    uint8_t *const outbuf = (uint8_t *)out;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(inbuf, outbuf, npixels, r, b) \
+    schedule(static)
+#endif
+    for(size_t k = 0; k < npixels; k++)
+    {
+      outbuf[4 * k + 0] = roundf(CLAMP(inbuf[4 * k + r] * 0xff, 0, 0xff));
+      outbuf[4 * k + 1] = roundf(CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff));
+      outbuf[4 * k + 2] = roundf(CLAMP(inbuf[4 * k + b] * 0xff, 0, 0xff));
+      outbuf[4 * k + 3] = 0;
+    }
+  }
+  else if(bpp == 8)
+  {
+    const uint8_t *const inbuf = (const uint8_t *)in;
+    uint8_t *const outbuf = (uint8_t *)out;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(inbuf, outbuf, npixels, r, b) \
+    schedule(static)
+#endif
+    for(size_t k = 0; k < npixels; k++)
+    {
+      outbuf[4 * k + 0] = inbuf[4 * k + r];
+      outbuf[4 * k + 1] = inbuf[4 * k + 1];
+      outbuf[4 * k + 2] = inbuf[4 * k + b];
+      outbuf[4 * k + 3] = inbuf[4 * k + 3];
+    }
+  }
+  else if(bpp == 16)
+  {
+    const float *const inbuf = (const float *)in;
+    uint16_t *const outbuf = (uint16_t *)out;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(inbuf, outbuf, npixels) \
+    schedule(static)
+#endif
+    for(size_t k = 0; k < npixels; k++)
+    {
+      for(int i = 0; i < 3; i++) outbuf[4 * k + i] = roundf(CLAMP(inbuf[4 * k + i] * 0xffff, 0, 0xffff));
+      outbuf[4 * k + 3] = 0;
+    }
+  }
+}
+
+// hand the pipe output to a format implementing write_rows(), converting a few rows at a time
+static int _export_write_rows(dt_imageio_module_format_t *format, dt_imageio_module_data_t *format_params,
+                              const char *filename, const void *in, const int bpp, const gboolean float_input,
+                              const gboolean swap_rb, dt_colorspaces_color_profile_type_t icc_type,
+                              const char *icc_filename, void *exif, int exif_len, int imgid, int num, int total,
+                              dt_dev_pixelpipe_t *pipe, const gboolean export_masks)
+{
+  void *handle = format->write_rows_begin(format_params, filename, icc_type, icc_filename, exif, exif_len, imgid,
+                                          num, total, pipe, export_masks);
+  if(!handle) return 1;
+
+  const size_t width = format_params->width;
+  const int height = format_params->height;
+  const size_t in_stride = width * 4 * (float_input ? sizeof(float) : sizeof(uint8_t));
+  // float output and 8-bit output in the right byte order are handed over without copy
+  const gboolean passthrough = (bpp == 32) || (bpp == 8 && !float_input && !swap_rb);
+  const int band = 32;
+  void *rows = passthrough ? NULL : dt_alloc_align(64, width * band * 4 * (bpp / 8));
+
+  int res = (!passthrough && !rows);
+  for(int y = 0; y < height && !res; y += band)
+  {
+    const int num_rows = MIN(band, height - y);
+    const uint8_t *src = (const uint8_t *)in + y * in_stride;
+    if(!passthrough) _export_convert_rows(src, rows, width * num_rows, bpp, float_input, swap_rb);
+    res = format->write_rows(format_params, handle, passthrough ? src : rows, y, num_rows);
+  }
+  res |= format->write_rows_end(format_params, handle, res);
+
+  dt_free_align(rows);
+  return res;
+}
+
 // internal function: to avoid exif blob reading + 8-bit byteorder flag + high-quality override
 int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
                                  dt_imageio_module_format_t *format, dt_imageio_module_data_t *format_params,
@@ -914,6 +1006,12 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
 
   const int bpp = format->bpp(format_params);
 
+  // back-pressure: the pipe will hold about two float buffers of the output size in its cache,
+  // wait for concurrent exports to hand back their memory if that would exceed the budget.
+  if(!thumbnail_export)
+    dt_memory_budget_admit(darktable.memory_budget,
+                           (size_t)2 * processed_width * processed_height * 4 * sizeof(float));
+
   dt_get_times(&start);
   if(high_quality_processing)
   {
@@ -958,8 +1056,18 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
 
   uint8_t *outbuf = pipe.backbuf;
 
+  // formats writing rows convert them on the fly, the others get the whole image converted in place
+  const gboolean write_rows = format->write_rows_begin && format->write_rows && format->write_rows_end
+                              && !(format->flags(format_params) & FORMAT_FLAGS_NO_ROWS);
+  const gboolean float_output = bpp > 8 || high_quality_processing;
+  const gboolean swap_rb = bpp == 8 && (high_quality_processing ? display_byteorder : !display_byteorder);
+
   // downconversion to low-precision formats:
-  if(bpp == 8)
+  if(write_rows)
+  {
+    // done while writing
+  }
+  else if(bpp == 8)
   {
     if(display_byteorder)
     {
@@ -1044,15 +1152,23 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
     // last param is dng mode, it's false here
     length = dt_exif_read_blob(&exif_profile, pathname, imgid, sRGB, processed_width, processed_height, 0);
 
-    res = format->write_image(format_params, filename, outbuf, icc_type, icc_filename, exif_profile, length, imgid,
-                              num, total, &pipe, export_masks);
+    if(write_rows)
+      res = _export_write_rows(format, format_params, filename, outbuf, bpp, float_output, swap_rb, icc_type,
+                               icc_filename, exif_profile, length, imgid, num, total, &pipe, export_masks);
+    else
+      res = format->write_image(format_params, filename, outbuf, icc_type, icc_filename, exif_profile, length,
+                                imgid, num, total, &pipe, export_masks);
 
     free(exif_profile);
   }
   else
   {
-    res = format->write_image(format_params, filename, outbuf, icc_type, icc_filename, NULL, 0, imgid, num, total,
-                              &pipe, export_masks);
+    if(write_rows)
+      res = _export_write_rows(format, format_params, filename, outbuf, bpp, float_output, swap_rb, icc_type,
+                               icc_filename, NULL, 0, imgid, num, total, &pipe, export_masks);
+    else
+      res = format->write_image(format_params, filename, outbuf, icc_type, icc_filename, NULL, 0, imgid, num,
+                                total, &pipe, export_masks);
   }
 
   if(res)
@@ -138,6 +138,8 @@ int dt_imageio_jpeg_decompress_header(const void *in, size_t length, dt_imageio_
   }
 
   jpg->dinfo.src = &(jpg->src);
+  jpg->in = (const uint8_t *)in;
+  jpg->length = length;
   setup_read_exif(&(jpg->dinfo));
   setup_read_icc_profile(&(jpg->dinfo));
   jpeg_read_header(&(jpg->dinfo), TRUE);
@@ -158,7 +160,7 @@ int dt_imageio_jpeg_decompress_header(const void *in, size_t length, dt_imageio_
 static int decompress_jsc(dt_imageio_jpeg_t *jpg, uint8_t *out)
 {
   uint8_t *tmp = out;
-  while(jpg->dinfo.output_scanline < jpg->dinfo.image_height)
+  while(jpg->dinfo.output_scanline < jpg->dinfo.output_height)
   {
     if(jpeg_read_scanlines(&(jpg->dinfo), &tmp, 1) != 1)
     {
@@ -175,14 +177,14 @@ static int decompress_plain(dt_imageio_jpeg_t *jpg, uint8_t *out)
   JSAMPROW row_pointer[1];
   row_pointer[0] = (uint8_t *)dt_alloc_align(64, (size_t)jpg->dinfo.output_width * jpg->dinfo.num_components);
   uint8_t *tmp = out;
-  while(jpg->dinfo.output_scanline < jpg->dinfo.image_height)
+  while(jpg->dinfo.output_scanline < jpg->dinfo.output_height)
   {
     if(jpeg_read_scanlines(&(jpg->dinfo), row_pointer, 1) != 1)
     {
       dt_free_align(row_pointer[0]);
       return 1;
     }
-    for(unsigned int i = 0; i < jpg->dinfo.image_width; i++)
+    for(unsigned int i = 0; i < jpg->dinfo.output_width; i++)
     {
       for(int k = 0; k < 3; k++) tmp[4 * i + k] = row_pointer[0][3 * i + k];
     }
@@ -192,8 +194,253 @@ static int decompress_plain(dt_imageio_jpeg_t *jpg, uint8_t *out)
   return 0;
 }
 
+void dt_imageio_jpeg_set_target_size(dt_imageio_jpeg_t *jpg, const int max_width, const int max_height)
+{
+  if(max_width <= 0 || max_height <= 0) return;
+
+  // the image is later fitted into max_width x max_height, so we may shrink it by
+  // the smaller of the two ratios without losing any resolution.
+  const float ratio = fminf((float)jpg->dinfo.image_width / max_width,
+                            (float)jpg->dinfo.image_height / max_height);
+  unsigned int denom = 1;
+  while(denom < 8 && 2 * denom <= ratio) denom *= 2;
+  if(denom == 1) return;
+
+  // jerr only lives until we return, so hand the caller's error manager back on both paths
+  struct jpeg_error_mgr *const caller_err = jpg->dinfo.err;
+  struct dt_imageio_jpeg_error_mgr jerr;
+  jpg->dinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
+  if(setjmp(jerr.setjmp_buffer))
+  {
+    // keep decoding at full size
+    jpg->dinfo.scale_num = jpg->dinfo.scale_denom = 1;
+    jpg->dinfo.err = caller_err;
+    return;
+  }
+
+  jpg->dinfo.scale_num = 1;
+  jpg->dinfo.scale_denom = denom;
+  jpeg_calc_output_dimensions(&(jpg->dinfo));
+  jpg->width = jpg->dinfo.output_width;
+  jpg->height = jpg->dinfo.output_height;
+  jpg->dinfo.err = caller_err;
+}
+
+/*
+ * Parallel decoding using restart markers.
+ *
+ * A restart marker resets the DC predictors of the entropy decoder, so the data following
+ * it can be decoded without knowledge of what came before. If the restart interval spans a
+ * whole number of MCU rows, we cut the scan into horizontal bands at the markers and decode
+ * them as stand-alone JPEGs: the original header with a patched image height, the band's
+ * entropy coded data with its restart markers renumbered from RST0, and an EOI marker.
+ *
+ * Upsampling of subsampled chroma looks at the neighbouring rows, so each band is decoded with
+ * one extra restart interval above and below, which is thrown away. The bands are of a fixed
+ * height, independent of the number of threads, and the result is bit-identical to a
+ * sequential decode.
+ */
+
+// below this size the setup costs more than we gain
+#define DT_JPEG_PARALLEL_MIN_PIXELS (4 * 1024 * 1024)
+// height of the bands in rows of the full size image
+#define DT_JPEG_PARALLEL_BAND_ROWS 256
+
+// decodes a stand-alone band and writes rows skip .. skip + rows - 1 of it to out
+static int decompress_band(const dt_imageio_jpeg_t *jpg, const uint8_t *band, const size_t band_length,
+                           uint8_t *out, const int skip, const int rows)
+{
+  dt_imageio_jpeg_t b;
+  if(dt_imageio_jpeg_decompress_header(band, band_length, &b)) return 1;
+
+  // rows are converted through a temporary buffer if we are not decoding to RGBX,
+  // and the skipped rows always go there
+  const gboolean direct = jpg->dinfo.out_color_components == 4;
+  JSAMPROW row = (JSAMPROW)dt_alloc_align(64, (size_t)4 * jpg->width);
+
+  struct dt_imageio_jpeg_error_mgr jerr;
+  b.dinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
+  if(setjmp(jerr.setjmp_buffer))
+  {
+    dt_free_align(row);
+    jpeg_destroy_decompress(&(b.dinfo));
+    return 1;
+  }
+
+  b.dinfo.out_color_space = jpg->dinfo.out_color_space;
+  b.dinfo.out_color_components = jpg->dinfo.out_color_components;
+  b.dinfo.scale_num = jpg->dinfo.scale_num;
+  b.dinfo.scale_denom = jpg->dinfo.scale_denom;
+  (void)jpeg_start_decompress(&(b.dinfo));
+
+  if(b.dinfo.output_width != (JDIMENSION)jpg->width || b.dinfo.output_height < (JDIMENSION)(skip + rows)
+     || b.dinfo.output_components != (direct ? 4 : 3) || !row)
+  {
+    dt_free_align(row);
+    jpeg_destroy_decompress(&(b.dinfo));
+    return 1;
+  }
+
+  uint8_t *tmp = out;
+  for(int r = 0; r < skip + rows; r++)
+  {
+    JSAMPROW dest = direct && r >= skip ? tmp : row;
+    if(jpeg_read_scanlines(&(b.dinfo), &dest, 1) != 1)
+    {
+      dt_free_align(row);
+      jpeg_destroy_decompress(&(b.dinfo));
+      return 1;
+    }
+    if(r < skip) continue;
+    if(!direct)
+      for(unsigned int i = 0; i < b.dinfo.output_width; i++)
+        for(int k = 0; k < 3; k++) tmp[4 * i + k] = row[3 * i + k];
+    tmp += (size_t)4 * jpg->width;
+  }
+
+  // the rows below are only there for the upsampling, no need to decode them
+  jpeg_destroy_decompress(&(b.dinfo));
+  dt_free_align(row);
+  return 0;
+}
+
+// returns 0 if the image has been decoded, non-zero if the caller should use the sequential path
+static int decompress_parallel(dt_imageio_jpeg_t *jpg, uint8_t *out)
+{
+  const struct jpeg_decompress_struct *dinfo = &(jpg->dinfo);
+  if(!jpg->in || dt_get_num_threads() < 2 || dinfo->progressive_mode || dinfo->restart_interval == 0
+     || dinfo->data_precision != 8 || dinfo->num_components != dinfo->comps_in_scan
+     || (size_t)dinfo->image_width * dinfo->image_height < DT_JPEG_PARALLEL_MIN_PIXELS)
+    return 1;
+
+  // MCU geometry of the (single, interleaved) scan
+  const int mcu_w = dinfo->comps_in_scan == 1 ? DCTSIZE : dinfo->max_h_samp_factor * DCTSIZE;
+  const int mcu_h = dinfo->comps_in_scan == 1 ? DCTSIZE : dinfo->max_v_samp_factor * DCTSIZE;
+  const int mcus_per_row = (dinfo->image_width + mcu_w - 1) / mcu_w;
+  const int mcu_rows = (dinfo->image_height + mcu_h - 1) / mcu_h;
+  if(dinfo->restart_interval % mcus_per_row) return 1;
+  const int rows_per_interval = dinfo->restart_interval / mcus_per_row;
+  const int intervals = (mcu_rows + rows_per_interval - 1) / rows_per_interval;
+
+  // the source manager stopped right behind the SOS marker, i.e. at the start of the entropy coded data
+  const uint8_t *in = jpg->in;
+  const size_t header_length = jpg->src.next_input_byte - in;
+  if(header_length < 4 || header_length >= jpg->length) return 1;
+
+  // find the image height in the baseline/extended sequential frame header
+  size_t sof = 0;
+  for(size_t pos = 2; pos + 4 <= header_length;)
+  {
+    if(in[pos] != 0xFF) return 1;
+    const uint8_t marker = in[pos + 1];
+    if(marker == 0xFF)
+    {
+      pos++;
+      continue;
+    }
+    if(marker == 0xC0 || marker == 0xC1) sof = pos + 5;
+    pos += 2 + ((in[pos + 2] << 8) | in[pos + 3]);
+  }
+  if(!sof || sof + 2 > header_length) return 1;
+
+  // locate all restart markers and the end of the scan
+  size_t *rst = (size_t *)dt_alloc_align(64, sizeof(size_t) * intervals);
+  if(!rst) return 1;
+  int nrst = 0;
+  size_t end = 0;
+  for(size_t pos = header_length; pos + 1 < jpg->length; pos++)
+  {
+    if(in[pos] != 0xFF || in[pos + 1] == 0x00 || in[pos + 1] == 0xFF) continue;
+    if(in[pos + 1] >= 0xD0 && in[pos + 1] <= 0xD7 && nrst < intervals - 1)
+    {
+      rst[nrst++] = pos;
+      pos++;
+      continue;
+    }
+    // EOI, or another marker (DNL, a second scan) we do not handle here
+    if(in[pos + 1] == 0xD9) end = pos;
+    break;
+  }
+  if(!end || nrst != intervals - 1)
+  {
+    dt_free_align(rst);
+    return 1;
+  }
+
+  const int interval_rows = rows_per_interval * mcu_h;
+  const int intervals_per_band = MAX(1, DT_JPEG_PARALLEL_BAND_ROWS / interval_rows);
+  const int nbands = (intervals + intervals_per_band - 1) / intervals_per_band;
+  if(nbands < 2)
+  {
+    dt_free_align(rst);
+    return 1;
+  }
+
+  const int height = dinfo->image_height;
+  const int out_height = jpg->height;
+  const int denom = dinfo->scale_denom / dinfo->scale_num;
+  int failed = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, rst, jpg, out, header_length, sof, end, intervals, intervals_per_band, nbands) \
+  dt_omp_firstprivate(interval_rows, height, out_height, denom) \
+  schedule(dynamic) reduction(|:failed)
+#endif
+  for(int b = 0; b < nbands; b++)
+  {
+    // the intervals we want and the ones we decode, with one more on either side for context
+    const int i0 = b * intervals_per_band;
+    const int i1 = MIN(intervals, i0 + intervals_per_band);
+    const int d0 = MAX(0, i0 - 1);
+    const int d1 = MIN(intervals, i1 + 1);
+    const size_t start = d0 == 0 ? header_length : rst[d0 - 1] + 2;
+    const size_t stop = d1 == intervals ? end : rst[d1 - 1];
+    const int rows = MIN(height, d1 * interval_rows) - d0 * interval_rows;
+    // interval_rows is a multiple of the MCU height, so this is exact for all supported scale factors
+    const int out_row0 = i0 * interval_rows / denom;
+    const int out_row1 = i1 == intervals ? out_height : i1 * interval_rows / denom;
+    const int skip = (i0 - d0) * interval_rows / denom;
+
+    const size_t band_length = header_length + (stop - start) + 2;
+    uint8_t *band = (uint8_t *)dt_alloc_align(64, band_length);
+    if(!band)
+    {
+      failed |= 1;
+      continue;
+    }
+    memcpy(band, in, header_length);
+    band[sof] = rows >> 8;
+    band[sof + 1] = rows & 0xFF;
+    memcpy(band + header_length, in + start, stop - start);
+    // the decoder expects the markers to count up from RST0
+    for(int i = d0; i < d1 - 1; i++) band[header_length + rst[i] - start + 1] = 0xD0 + ((i - d0) & 7);
+    band[band_length - 2] = 0xFF;
+    band[band_length - 1] = 0xD9;
+
+    failed |= decompress_band(jpg, band, band_length, out + (size_t)4 * jpg->width * out_row0, skip,
+                              out_row1 - out_row0);
+    dt_free_align(band);
+  }
+
+  dt_free_align(rst);
+  dt_print(DT_DEBUG_IMAGEIO, "[imageio_jpeg] parallel decoding of %dx%d in %d bands %s\n", jpg->width, jpg->height,
+           nbands, failed ? "failed" : "done");
+  return failed;
+}
+
 int dt_imageio_jpeg_decompress(dt_imageio_jpeg_t *jpg, uint8_t *out)
 {
+  // large images with suitable restart markers are decoded in parallel bands,
+  // everything else (and any failure in there) takes the sequential path below.
+  if(!decompress_parallel(jpg, out))
+  {
+    jpeg_destroy_decompress(&(jpg->dinfo));
+    return 0;
+  }
+
   struct dt_imageio_jpeg_error_mgr jerr;
   jpg->dinfo.err = jpeg_std_error(&jerr.pub);
   jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
@@ -578,6 +825,8 @@ int dt_imageio_jpeg_read_header(const char *filename, dt_imageio_jpeg_t *jpg)
   }
   jpeg_create_decompress(&(jpg->dinfo));
   jpeg_stdio_src(&(jpg->dinfo), jpg->f);
+  jpg->in = NULL;
+  jpg->length = 0;
   setup_read_exif(&(jpg->dinfo));
   setup_read_icc_profile(&(jpg->dinfo));
   // jpg->dinfo.buffered_image = TRUE;
@@ -598,7 +847,7 @@ int dt_imageio_jpeg_read_header(const char *filename, dt_imageio_jpeg_t *jpg)
 static int read_jsc(dt_imageio_jpeg_t *jpg, uint8_t *out)
 {
   uint8_t *tmp = out;
-  while(jpg->dinfo.output_scanline < jpg->dinfo.image_height)
+  while(jpg->dinfo.output_scanline < jpg->dinfo.output_height)
   {
     if(jpeg_read_scanlines(&(jpg->dinfo), &tmp, 1) != 1)
     {
@@ -615,7 +864,7 @@ static int read_plain(dt_imageio_jpeg_t *jpg, uint8_t *out)
   JSAMPROW row_pointer[1];
   row_pointer[0] = (uint8_t *)dt_alloc_align(64, (size_t)jpg->dinfo.output_width * jpg->dinfo.num_components);
   uint8_t *tmp = out;
-  while(jpg->dinfo.output_scanline < jpg->dinfo.image_height)
+  while(jpg->dinfo.output_scanline < jpg->dinfo.output_height)
   {
     if(jpeg_read_scanlines(&(jpg->dinfo), row_pointer, 1) != 1)
     {
@@ -624,7 +873,7 @@ static int read_plain(dt_imageio_jpeg_t *jpg, uint8_t *out)
       fclose(jpg->f);
       return 1;
     }
-    for(unsigned int i = 0; i < jpg->dinfo.image_width; i++)
+    for(unsigned int i = 0; i < jpg->dinfo.output_width; i++)
       for(int k = 0; k < 3; k++) tmp[4 * i + k] = row_pointer[0][3 * i + k];
     tmp += 4 * jpg->width;
   }
@@ -732,13 +981,30 @@ dt_imageio_retval_t dt_imageio_open_jpeg(dt_image_t *img, const char *filename,
 
   if(!img->exif_inited) (void)dt_exif_read(img, filename);
 
+  // read the whole file to memory, this allows decoding it in parallel
+  gchar *blob = NULL;
+  gsize length = 0;
+  if(!g_file_get_contents(filename, &blob, &length, NULL)) return DT_IMAGEIO_FILE_CORRUPTED;
+
   dt_imageio_jpeg_t jpg;
-  if(dt_imageio_jpeg_read_header(filename, &jpg)) return DT_IMAGEIO_FILE_CORRUPTED;
+  if(dt_imageio_jpeg_decompress_header(blob, length, &jpg))
+  {
+    g_free(blob);
+    return DT_IMAGEIO_FILE_CORRUPTED;
+  }
   img->width = jpg.width;
   img->height = jpg.height;
 
   uint8_t *tmp = (uint8_t *)dt_alloc_align(64, sizeof(uint8_t) * 4 * jpg.width * jpg.height);
-  if(dt_imageio_jpeg_read(&jpg, tmp))
+  if(!tmp)
+  {
+    jpeg_destroy_decompress(&(jpg.dinfo));
+    g_free(blob);
+    return DT_IMAGEIO_CACHE_FULL;
+  }
+  const int failed = dt_imageio_jpeg_decompress(&jpg, tmp);
+  g_free(blob);
+  if(failed)
   {
     dt_free_align(tmp);
     return DT_IMAGEIO_FILE_CORRUPTED;
@@ -40,11 +40,17 @@ typedef struct dt_imageio_jpeg_t
   struct jpeg_decompress_struct dinfo;
   struct jpeg_compress_struct cinfo;
   FILE *f;
+  const uint8_t *in; // compressed data when decoding from memory, NULL when reading from file
+  size_t length;
 } dt_imageio_jpeg_t;
 
 /** reads the header and fills width/height in jpg struct. */
 int dt_imageio_jpeg_decompress_header(const void *in, size_t length, dt_imageio_jpeg_t *jpg);
-/** reads the whole image to the out buffer, which has to be large enough. */
+/** use libjpeg's DCT scaling to decode at 1/2, 1/4 or 1/8 of the size, as long as the result still covers
+ * max_width x max_height. has to be called after reading the header, updates width/height in jpg struct. */
+void dt_imageio_jpeg_set_target_size(dt_imageio_jpeg_t *jpg, const int max_width, const int max_height);
+/** reads the whole image to the out buffer, which has to be large enough. large images with restart markers
+ * are decoded in parallel bands. */
 int dt_imageio_jpeg_decompress(dt_imageio_jpeg_t *jpg, uint8_t *out);
 /** compresses in to out buffer with given quality (0..100). out buffer must be large enough. returns actual
  * data length. */
@@ -39,7 +39,8 @@ typedef enum dt_imageio_format_flags_t
 {
   FORMAT_FLAGS_SUPPORT_XMP = 1,
   FORMAT_FLAGS_NO_TMPFILE = 2,
-  FORMAT_FLAGS_SUPPORT_LAYERS = 4
+  FORMAT_FLAGS_SUPPORT_LAYERS = 4,
+  FORMAT_FLAGS_NO_ROWS = 8 // write_image() needs the whole image, even if write_rows() is implemented
 } dt_imageio_format_flags_t;
 
 /**
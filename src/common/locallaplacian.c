@@ -428,63 +428,8 @@ static inline float curve_scalar(
   return val;
 }
 
-#if defined(__SSE2__)
-static inline __m128 curve_vec4(
-    const __m128 x,
-    const __m128 g,
-    const __m128 sigma,
-    const __m128 shadows,
-    const __m128 highlights,
-    const __m128 clarity)
-{
-  // TODO: pull these non-data dependent constants out of the loop to see
-  // whether the compiler fail to do so
-  const __m128 const0 = _mm_set_ps1(0x3f800000u);
-  const __m128 const1 = _mm_set_ps1((float)0x402DF854u); // for e^x
-  const __m128 sign_mask = _mm_set1_ps(-0.f); // -0.f = 1 << 31
-  const __m128 one = _mm_set1_ps(1.0f);
-  const __m128 two = _mm_set1_ps(2.0f);
-  const __m128 twothirds = _mm_set1_ps(2.0f/3.0f);
-  const __m128 twosig = _mm_mul_ps(two, sigma);
-  const __m128 sigma2 = _mm_mul_ps(sigma, sigma);
-  const __m128 s22 = _mm_mul_ps(twothirds, sigma2);
-
-  const __m128 c = _mm_sub_ps(x, g);
-  const __m128 select = _mm_cmplt_ps(c, _mm_setzero_ps());
-  // select shadows or highlights as multiplier for linear part, based on c < 0
-  const __m128 shadhi = _mm_or_ps(_mm_andnot_ps(select, shadows), _mm_and_ps(select, highlights));
-  // flip sign bit of sigma based on c < 0 (c < 0 ? - sigma : sigma)
-  const __m128 ssigma = _mm_xor_ps(sigma, _mm_and_ps(select, sign_mask));
-  // this contains the linear parts valid for c > 2*sigma or c < - 2*sigma
-  const __m128 vlin = _mm_add_ps(g, _mm_add_ps(ssigma, _mm_mul_ps(shadhi, _mm_sub_ps(c, ssigma))));
-
-  const __m128 t = _mm_min_ps(one, _mm_max_ps(_mm_setzero_ps(),
-        _mm_div_ps(c, _mm_mul_ps(two, ssigma))));
-  const __m128 t2 = _mm_mul_ps(t, t);
-  const __m128 mt = _mm_sub_ps(one, t);
-
-  // midtone value fading over to linear part, without local contrast:
-  const __m128 vmid = _mm_add_ps(g,
-      _mm_add_ps(_mm_mul_ps(_mm_mul_ps(ssigma, two), _mm_mul_ps(mt, t)),
-        _mm_mul_ps(t2, _mm_add_ps(ssigma, _mm_mul_ps(ssigma, shadhi)))));
-
-  // c > 2*sigma?
-  const __m128 linselect = _mm_cmpgt_ps(_mm_andnot_ps(sign_mask, c), twosig);
-  const __m128 val = _mm_or_ps(_mm_and_ps(linselect, vlin), _mm_andnot_ps(linselect, vmid));
-
-  // midtone local contrast
-  // dt_fast_expf in sse:
-  const __m128 arg = _mm_xor_ps(sign_mask, _mm_div_ps(_mm_mul_ps(c, c), s22));
-  const __m128 k0 = _mm_add_ps(const0, _mm_mul_ps(arg, _mm_sub_ps(const1, const0)));
-  const __m128 k = _mm_max_ps(k0, _mm_setzero_ps());
-  const __m128i ki = _mm_cvtps_epi32(k);
-  const __m128 gauss = _mm_load_ps((float*)&ki);
-  const __m128 vcon = _mm_mul_ps(clarity, _mm_mul_ps(c, gauss));
-  return _mm_add_ps(val, vcon);
-}
-
-// sse (4-wide)
-void apply_curve_sse2(
+// scalar version
+void apply_curve(
     float *const out,
     const float *const in,
     const uint32_t w,
@@ -496,68 +441,70 @@ void apply_curve_sse2(
     const float highlights,
     const float clarity)
 {
-  // TODO: do all this in avx2 8-wide (should be straight forward):
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(clarity, g, h, highlights, in, out, padding, shadows, sigma, w) \
+  dt_omp_firstprivate(clarity, g, h, highlights, in, out, padding, sigma, shadows, w) \
   schedule(static)
 #endif
   for(uint32_t j=padding;j<h-padding;j++)
   {
     const float *in2  = in  + j*w + padding;
     float *out2 = out + j*w + padding;
-    // find 4-byte aligned block in the middle:
-    const float *const beg = (float *)((size_t)(out2+3)&(size_t)0x10ul);
-    const float *const end = (float *)((size_t)(out2+w-padding)&(size_t)0x10ul);
-    const float *const fin = out2+w-padding;
-    const __m128 g4 = _mm_set1_ps(g);
-    const __m128 sig4 = _mm_set1_ps(sigma);
-    const __m128 shd4 = _mm_set1_ps(shadows);
-    const __m128 hil4 = _mm_set1_ps(highlights);
-    const __m128 clr4 = _mm_set1_ps(clarity);
-    for(;out2<beg;out2++,in2++)
-      *out2 = curve_scalar(*in2, g, sigma, shadows, highlights, clarity);
-    for(;out2<end;out2+=4,in2+=4)
-      _mm_stream_ps(out2, curve_vec4(_mm_load_ps(in2), g4, sig4, shd4, hil4, clr4));
-    for(;out2<fin;out2++,in2++)
-      *out2 = curve_scalar(*in2, g, sigma, shadows, highlights, clarity);
+    for(uint32_t i=padding;i<w-padding;i++)
+      (*out2++) = curve_scalar(*(in2++), g, sigma, shadows, highlights, clarity);
     out2 = out + j*w;
     for(int i=0;i<padding;i++)   out2[i] = out2[padding];
     for(int i=w-padding;i<w;i++) out2[i] = out2[w-padding-1];
   }
   pad_by_replication(out, w, h, padding);
 }
+
+// blur and downsample to the next coarser level of a gaussian pyramid
+static inline void ll_gauss_reduce(
+    const float *const input, // fine input buffer
+    float *const coarse,      // coarse scale, blurred input buf
+    const int wd,             // fine res
+    const int ht,
+    const int use_sse2)
+{
+#if defined(__SSE2__)
+  if(use_sse2)
+    gauss_reduce_sse2(input, coarse, wd, ht);
+  else
 #endif
+    gauss_reduce(input, coarse, wd, ht);
+}
 
-// scalar version
-void apply_curve(
-    float *const out,
-    const float *const in,
-    const uint32_t w,
-    const uint32_t h,
-    const uint32_t padding,
-    const float g,
-    const float sigma,
-    const float shadows,
-    const float highlights,
-    const float clarity)
+// add the laplacian coefficients of the pyramid remapped for gamma[k] to out, weighted by how
+// close the brightness of the input pyramid is to gamma[k]. every pixel only gets contributions
+// from the two gamma values around its brightness, in the same order as if they were blended at once.
+static inline void ll_add_laplacian(
+    float *const out,            // accumulated coefficients at fine res
+    const float *const input,    // gaussian pyramid of the input at fine res
+    const float *const coarse,   // coarse res gaussian of the remapped pyramid
+    const float *const fine,     // fine res gaussian of the remapped pyramid
+    const int wd,                // fine width
+    const int ht,                // fine height
+    const float *const gamma,
+    const int k)
 {
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(clarity, g, h, highlights, in, out, padding, sigma, shadows, w) \
-  schedule(static)
+  dt_omp_firstprivate(out, input, coarse, fine, wd, ht, gamma, k) \
+  schedule(static) \
+  collapse(2)
 #endif
-  for(uint32_t j=padding;j<h-padding;j++)
+  for(int j=0;j<ht;j++) for(int i=0;i<wd;i++)
   {
-    const float *in2  = in  + j*w + padding;
-    float *out2 = out + j*w + padding;
-    for(uint32_t i=padding;i<w-padding;i++)
-      (*out2++) = curve_scalar(*(in2++), g, sigma, shadows, highlights, clarity);
-    out2 = out + j*w;
-    for(int i=0;i<padding;i++)   out2[i] = out2[padding];
-    for(int i=w-padding;i<w;i++) out2[i] = out2[w-padding-1];
+    const float v = input[j*wd+i];
+    int hi = 1;
+    for(;hi<num_gamma-1 && gamma[hi] <= v;hi++);
+    const int lo = hi-1;
+    if(k != lo && k != hi) continue;
+    const float a = CLAMPS((v - gamma[lo])/(gamma[hi]-gamma[lo]), 0.0f, 1.0f);
+    const float l = ll_laplacian(coarse, fine, i, j, wd, ht);
+    out[j*wd+i] += l * (k == lo ? 1.0f-a : a);
   }
-  pad_by_replication(out, w, h, padding);
 }
 
 void local_laplacian_internal(
@@ -569,6 +516,7 @@ void local_laplacian_internal(
     const float shadows,        // user param: lift shadows
     const float highlights,     // user param: compress highlights
     const float clarity,        // user param: increase clarity/local contrast
+    const int fast,             // flag whether to keep the finest level of the input
     const int use_sse2,         // flag whether to use SSE version
     local_laplacian_boundary_t *b)
 {
@@ -580,6 +528,8 @@ void local_laplacian_internal(
   if(b && b->mode == 2) // higher number here makes it less prone to aliasing and slower.
     last_level = num_levels > 4 ? 4 : num_levels-1;
   const int max_supp = 1<<last_level;
+  // level from which on the pyramids are remapped
+  const int first_level = (fast && last_level > 1) ? 1 : 0;
   int w, h;
   float *padded[max_levels] = {0};
   if(b && b->mode == 2)
@@ -597,51 +547,62 @@ void local_laplacian_internal(
     output[l] = dt_alloc_align_float((size_t)dl(w,l) * dl(h,l));
 
   // create gauss pyramid of padded input, write coarse directly to output
-#if defined(__SSE2__)
-  if(use_sse2)
-  {
-    for(int l=1;l<last_level;l++)
-      gauss_reduce_sse2(padded[l-1], padded[l], dl(w,l-1), dl(h,l-1));
-    gauss_reduce_sse2(padded[last_level-1], output[last_level], dl(w,last_level-1), dl(h,last_level-1));
-  }
-  else
-#endif
-  {
-    for(int l=1;l<last_level;l++)
-      gauss_reduce(padded[l-1], padded[l], dl(w,l-1), dl(h,l-1));
-    gauss_reduce(padded[last_level-1], output[last_level], dl(w,last_level-1), dl(h,last_level-1));
-  }
+  for(int l=1;l<last_level;l++)
+    ll_gauss_reduce(padded[l-1], padded[l], dl(w,l-1), dl(h,l-1), use_sse2);
+  ll_gauss_reduce(padded[last_level-1], output[last_level], dl(w,last_level-1), dl(h,last_level-1), use_sse2);
 
   // evenly sample brightness [0,1]:
   float gamma[num_gamma] = {0.0f};
   for(int k=0;k<num_gamma;k++) gamma[k] = (k+.5f)/(float)num_gamma;
   // for(int k=0;k<num_gamma;k++) gamma[k] = k/(num_gamma-1.0f);
 
-  // allocate memory for intermediate laplacian pyramids
-  float *buf[num_gamma][max_levels] = {{0}};
-  for(int k=0;k<num_gamma;k++) for(int l=0;l<=last_level;l++)
-    buf[k][l] = dt_alloc_align_float((size_t)dl(w,l)*dl(h,l));
+  // the finer levels of the output pyramid first collect the laplacian coefficients,
+  // the expanded coarser levels are added once they are complete.
+  for(int l=0;l<last_level;l++)
+    memset(output[l], 0, sizeof(float) * dl(w,l) * dl(h,l));
 
   // the paper says remapping only level 3 not 0 does the trick, too
   // (but i really like the additional octave of sharpness we get,
-  // willing to pay the cost).
+  // willing to pay the cost). in fast mode, use the finest scale from
+  // the input, which does not amplify noise and only remaps a quarter of the pixels.
+  if(first_level > 0)
+  {
+    const int pw = dl(w,0), ph = dl(h,0);
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(ph, pw) \
+    shared(output, padded) \
+    schedule(static) \
+    collapse(2)
+#endif
+    for(int j=0;j<ph;j++) for(int i=0;i<pw;i++)
+      output[0][j*pw+i] = ll_laplacian(padded[1], padded[0], i, j, pw, ph);
+  }
+
+  // process one remapped image at a time, it only needs two levels of its gaussian pyramid
+  // at once: even levels go to remapped[0] and odd levels to remapped[1].
+  float *remapped[2];
+  remapped[0] = dt_alloc_align_float((size_t)dl(w,first_level) * dl(h,first_level));
+  remapped[1] = dt_alloc_align_float((size_t)dl(w,first_level+1) * dl(h,first_level+1));
   for(int k=0;k<num_gamma;k++)
   { // process images
-#if defined(__SSE2__)
-    if(use_sse2)
-      apply_curve_sse2(buf[k][0], padded[0], w, h, max_supp, gamma[k], sigma, shadows, highlights, clarity);
-    else // brackets in next line needed for silly gcc warning:
-#endif
-    {apply_curve(buf[k][0], padded[0], w, h, max_supp, gamma[k], sigma, shadows, highlights, clarity);}
+    apply_curve(remapped[0], padded[first_level], dl(w,first_level), dl(h,first_level), max_supp >> first_level,
+                gamma[k], sigma, shadows, highlights, clarity);
 
-    // create gaussian pyramids
-    for(int l=1;l<=last_level;l++)
-#if defined(__SSE2__)
-      if(use_sse2)
-        gauss_reduce_sse2(buf[k][l-1], buf[k][l], dl(w,l-1), dl(h,l-1));
-      else
-#endif
-        gauss_reduce(buf[k][l-1], buf[k][l], dl(w,l-1), dl(h,l-1));
+    for(int l=first_level;l<last_level;l++)
+    {
+      const float *const fine = remapped[(l-first_level)&1];
+      float *const coarse = remapped[(l-first_level+1)&1];
+      ll_gauss_reduce(fine, coarse, dl(w,l), dl(h,l), use_sse2);
+      ll_add_laplacian(output[l], padded[l], coarse, fine, dl(w,l), dl(h,l), gamma, k);
+    }
+  }
+  dt_free_align(remapped[0]);
+  dt_free_align(remapped[1]);
+  for(int l=1;l<max_levels;l++)
+  {
+    dt_free_align(padded[l]);
+    padded[l] = NULL;
   }
 
   // resample output[last_level] from preview
@@ -707,36 +668,23 @@ void local_laplacian_internal(
   {
     const int pw = dl(w,l), ph = dl(h,l);
 
-    gauss_expand(output[l+1], output[l], pw, ph);
-    // go through all coefficients in the upsampled gauss buffer:
+    // add the upsampled coarse level to the coefficients. the boundary replicates
+    // the closest pixels which have the full support.
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
     dt_omp_firstprivate(ph, pw) \
-    shared(w,h,buf,output,l,gamma,padded) \
+    shared(output, l) \
     schedule(static) \
     collapse(2)
 #endif
     for(int j=0;j<ph;j++) for(int i=0;i<pw;i++)
-    {
-      const float v = padded[l][j*pw+i];
-      int hi = 1;
-      for(;hi<num_gamma-1 && gamma[hi] <= v;hi++);
-      int lo = hi-1;
-      const float a = CLAMPS((v - gamma[lo])/(gamma[hi]-gamma[lo]), 0.0f, 1.0f);
-      const float l0 = ll_laplacian(buf[lo][l+1], buf[lo][l], i, j, pw, ph);
-      const float l1 = ll_laplacian(buf[hi][l+1], buf[hi][l], i, j, pw, ph);
-      output[l][j*pw+i] += l0 * (1.0f-a) + l1 * a;
-      // we could do this to save on memory (no need for finest buf[][]).
-      // unfortunately it results in a quite noticeable loss of sharpness, i think
-      // the extra level is worth it.
-      // else if(l == 0) // use finest scale from input to not amplify noise (and use less memory)
-      //   output[l][j*pw+i] += ll_laplacian(padded[l+1], padded[l], i, j, pw, ph);
-    }
+      output[l][j*pw+i] += ll_expand_gaussian(output[l+1],
+          CLAMPS(i, 1, ((pw-1)&~1)-1), CLAMPS(j, 1, ((ph-1)&~1)-1), pw, ph);
   }
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
   dt_omp_firstprivate(ht, input, max_supp, out, wd) \
-  shared(w,output,buf) \
+  shared(w,output) \
   schedule(static) \
   collapse(2)
 #endif
@@ -761,7 +709,6 @@ void local_laplacian_internal(
   {
     if(!b || b->mode != 1 || l)   dt_free_align(padded[l]);
     if(!b || b->mode != 1)        dt_free_align(output[l]);
-    for(int k=0; k<num_gamma;k++) dt_free_align(buf[k][l]);
   }
 }
 
@@ -776,11 +723,33 @@ size_t local_laplacian_memory_use(const int width,     // width of input image
 
   size_t memory_use = 0;
 
+  // input and output pyramids
+  for(int l=0;l<num_levels;l++)
+    memory_use += sizeof(float) * 2 * dl(paddwd, l) * dl(paddht, l);
+  // two levels of the remapped pyramid
+  memory_use += sizeof(float) * (dl(paddwd, 0) * dl(paddht, 0) + dl(paddwd, 1) * dl(paddht, 1));
+
+  return memory_use;
+}
+
+#ifdef HAVE_OPENCL
+// the opencl code still keeps one remapped pyramid alive for each gamma value
+size_t local_laplacian_memory_use_cl(const int width,     // width of input image
+                                     const int height)    // height of input image
+{
+  const int num_levels = MIN(max_levels, 31-__builtin_clz(MIN(width,height)));
+  const int max_supp = 1<<(num_levels-1);
+  const int paddwd = width  + 2*max_supp;
+  const int paddht = height + 2*max_supp;
+
+  size_t memory_use = 0;
+
   for(int l=0;l<num_levels;l++)
     memory_use += sizeof(float) * (2 + num_gamma) * dl(paddwd, l) * dl(paddht, l);
 
   return memory_use;
 }
+#endif
 
 size_t local_laplacian_singlebuffer_size(const int width,     // width of input image
                                          const int height)    // height of input image
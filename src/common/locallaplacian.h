@@ -54,6 +54,7 @@ void local_laplacian_internal(
     const float shadows,        // user param: lift shadows
     const float highlights,     // user param: compress highlights
     const float clarity,        // user param: increase clarity/local contrast
+    const int fast,             // keep the finest level of the input instead of remapping it
     const int use_sse2,         // switch on sse optimised version, if available
     // the following is just needed for clipped roi with boundary conditions from coarse buffer (can be 0)
     local_laplacian_boundary_t *b);
@@ -67,14 +68,20 @@ void local_laplacian(
     const float shadows,        // user param: lift shadows
     const float highlights,     // user param: compress highlights
     const float clarity,        // user param: increase clarity/local contrast
+    const int fast,             // keep the finest level of the input instead of remapping it
     local_laplacian_boundary_t *b) // can be 0
 {
-  local_laplacian_internal(input, out, wd, ht, sigma, shadows, highlights, clarity, 0, b);
+  local_laplacian_internal(input, out, wd, ht, sigma, shadows, highlights, clarity, fast, 0, b);
 }
 
 size_t local_laplacian_memory_use(const int width,      // width of input image
                                   const int height);    // height of input image
 
+#ifdef HAVE_OPENCL
+size_t local_laplacian_memory_use_cl(const int width,   // width of input image
+                                     const int height); // height of input image
+#endif
+
 
 size_t local_laplacian_singlebuffer_size(const int width,       // width of input image
                                          const int height);     // height of input image
@@ -90,8 +97,9 @@ void local_laplacian_sse2(
     const float shadows,        // user param: lift shadows
     const float highlights,     // user param: compress highlights
     const float clarity,        // user param: increase clarity/local contrast
+    const int fast,             // keep the finest level of the input instead of remapping it
     local_laplacian_boundary_t *b) // can be 0
 {
-  local_laplacian_internal(input, out, wd, ht, sigma, shadows, highlights, clarity, 1, b);
+  local_laplacian_internal(input, out, wd, ht, sigma, shadows, highlights, clarity, fast, 1, b);
 }
 #endif
@@ -0,0 +1,194 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/memory_budget.h"
+#include "common/darktable.h"
+#include "control/conf.h"
+
+#include <errno.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+// how long a job waits for memory to be released before going ahead anyways
+#define DT_MEMORY_BUDGET_TIMEOUT 10.0
+// how often the caches are asked again while waiting
+#define DT_MEMORY_BUDGET_POLL 0.25
+
+static size_t _default_limit()
+{
+  // leave a quarter of the physical memory to the rest of darktable and the system
+  size_t limit = (dt_get_total_memory() / 4 * 3) << 10;
+
+#ifndef _WIN32
+  // respect an address space limit set for this process (ulimit -v)
+  struct rlimit rlim = { 0 };
+  if(!getrlimit(RLIMIT_AS, &rlim) && rlim.rlim_cur != RLIM_INFINITY)
+  {
+    const size_t as_limit = (size_t)rlim.rlim_cur / 4 * 3;
+    limit = limit ? MIN(limit, as_limit) : as_limit;
+  }
+#endif
+
+  return limit;
+}
+
+void dt_memory_budget_init(dt_memory_budget_t *budget)
+{
+  dt_pthread_mutex_init(&budget->lock, NULL);
+  pthread_cond_init(&budget->released, NULL);
+  budget->used = budget->peak = 0;
+  budget->caches = NULL;
+
+  // in megabytes, 0 selects a limit based on the available memory and a negative value disables the governor
+  const int conf = dt_conf_get_int("memory_budget");
+  if(conf > 0)
+    budget->limit = (size_t)conf << 20;
+  else if(conf == 0)
+    budget->limit = _default_limit();
+  else
+    budget->limit = 0;
+
+  dt_print(DT_DEBUG_MEMORY, "[memory budget] limit set to %zu MB\n", budget->limit >> 20);
+}
+
+void dt_memory_budget_cleanup(dt_memory_budget_t *budget)
+{
+  dt_memory_budget_print(budget);
+  g_list_free(budget->caches);
+  budget->caches = NULL;
+  pthread_cond_destroy(&budget->released);
+  dt_pthread_mutex_destroy(&budget->lock);
+}
+
+void dt_memory_budget_register_cache(dt_memory_budget_t *budget, dt_cache_t *cache)
+{
+  if(!budget) return;
+  dt_pthread_mutex_lock(&budget->lock);
+  budget->caches = g_list_append(budget->caches, cache);
+  dt_pthread_mutex_unlock(&budget->lock);
+}
+
+void dt_memory_budget_add(dt_memory_budget_t *budget, const size_t bytes)
+{
+  if(!budget || !bytes) return;
+  dt_pthread_mutex_lock(&budget->lock);
+  budget->used += bytes;
+  budget->peak = MAX(budget->peak, budget->used);
+  dt_pthread_mutex_unlock(&budget->lock);
+}
+
+void dt_memory_budget_sub(dt_memory_budget_t *budget, const size_t bytes)
+{
+  if(!budget || !bytes) return;
+  dt_pthread_mutex_lock(&budget->lock);
+  budget->used -= MIN(bytes, budget->used);
+  pthread_cond_broadcast(&budget->released);
+  dt_pthread_mutex_unlock(&budget->lock);
+}
+
+// evict cold entries from the registered caches. must be called without holding the
+// budget lock, as the cleanup callbacks of the caches will call dt_memory_budget_sub().
+static size_t _reclaim(dt_memory_budget_t *budget, const size_t bytes)
+{
+  dt_pthread_mutex_lock(&budget->lock);
+  GList *caches = g_list_copy(budget->caches);
+  dt_pthread_mutex_unlock(&budget->lock);
+
+  size_t freed = 0;
+  for(GList *l = caches; l && freed < bytes; l = g_list_next(l))
+    freed += dt_cache_reclaim((dt_cache_t *)l->data, bytes - freed);
+
+  g_list_free(caches);
+  return freed;
+}
+
+static gboolean _admit(dt_memory_budget_t *budget, const size_t bytes, const double timeout)
+{
+  if(!budget || !budget->limit) return TRUE;
+
+  const double start = dt_get_wtime();
+  gboolean admitted = FALSE;
+  size_t used = 0;
+
+  while(TRUE)
+  {
+    dt_pthread_mutex_lock(&budget->lock);
+    used = budget->used;
+    dt_pthread_mutex_unlock(&budget->lock);
+
+    // a single buffer larger than the whole budget will never fit, don't bother waiting for it
+    if(used + bytes <= budget->limit || bytes > budget->limit)
+    {
+      admitted = bytes <= budget->limit;
+      break;
+    }
+
+    if(_reclaim(budget, used + bytes - budget->limit)) continue;
+
+    const double now = dt_get_wtime();
+    if(now - start >= timeout) break;
+
+    // nothing left to evict, wait for other jobs to finish and give their buffers back
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += (long)(DT_MEMORY_BUDGET_POLL * 1e9);
+    ts.tv_sec += ts.tv_nsec / 1000000000;
+    ts.tv_nsec %= 1000000000;
+
+    dt_pthread_mutex_lock(&budget->lock);
+    if(budget->used + bytes > budget->limit)
+      dt_pthread_cond_timedwait(&budget->released, &budget->lock, &ts);
+    dt_pthread_mutex_unlock(&budget->lock);
+  }
+
+  const double waited = dt_get_wtime() - start;
+  if(!admitted)
+    dt_print(DT_DEBUG_MEMORY, "[memory budget] %zu MB requested with %zu of %zu MB in use, going ahead anyways\n",
+             bytes >> 20, used >> 20, budget->limit >> 20);
+  else if(waited > 0.01)
+    dt_print(DT_DEBUG_MEMORY | DT_DEBUG_PERF, "[memory budget] %zu MB admitted after %.3f secs\n", bytes >> 20,
+             waited);
+
+  return admitted;
+}
+
+gboolean dt_memory_budget_admit(dt_memory_budget_t *budget, const size_t bytes)
+{
+  return _admit(budget, bytes, DT_MEMORY_BUDGET_TIMEOUT);
+}
+
+gboolean dt_memory_budget_admit_nowait(dt_memory_budget_t *budget, const size_t bytes)
+{
+  return _admit(budget, bytes, 0.0);
+}
+
+void dt_memory_budget_print(dt_memory_budget_t *budget)
+{
+  if(!budget) return;
+  dt_pthread_mutex_lock(&budget->lock);
+  dt_print(DT_DEBUG_MEMORY, "[memory budget] %zu MB in use, peak %zu MB, limit %zu MB\n", budget->used >> 20,
+           budget->peak >> 20, budget->limit >> 20);
+  dt_pthread_mutex_unlock(&budget->lock);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,66 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/cache.h"
+#include "common/dtpthread.h"
+#include <glib.h>
+#include <stddef.h>
+
+// process wide accounting of the large image buffers held by the mipmap cache (full and
+// float buffers) and by the pixelpipe caches. the governor does not allocate anything
+// itself, the owners of the buffers report what they hold. before a job allocates a big
+// buffer it asks for admission, which will shrink the registered caches and then wait
+// for other jobs to give memory back if the budget is exhausted.
+typedef struct dt_memory_budget_t
+{
+  dt_pthread_mutex_t lock;
+  pthread_cond_t released; // signalled whenever memory is given back
+  size_t limit;            // in bytes, 0 means unlimited
+  size_t used;             // bytes currently accounted for
+  size_t peak;             // high water mark, for statistics
+  GList *caches;           // dt_cache_t that may be shrunk under pressure
+}
+dt_memory_budget_t;
+
+void dt_memory_budget_init(dt_memory_budget_t *budget);
+void dt_memory_budget_cleanup(dt_memory_budget_t *budget);
+
+// allow the governor to evict unlocked entries from this cache when memory is tight.
+void dt_memory_budget_register_cache(dt_memory_budget_t *budget, dt_cache_t *cache);
+
+// account for buffers being allocated and freed. all functions accept a NULL budget.
+void dt_memory_budget_add(dt_memory_budget_t *budget, const size_t bytes);
+void dt_memory_budget_sub(dt_memory_budget_t *budget, const size_t bytes);
+
+// back-pressure for new jobs: returns TRUE as soon as `bytes' fit into the budget. if they
+// don't, the registered caches are shrunk and the caller is blocked until enough memory has
+// been released or a timeout expires, in which case FALSE is returned. callers are expected
+// to go ahead anyways, so this never deadlocks on memory held by the calling thread itself.
+gboolean dt_memory_budget_admit(dt_memory_budget_t *budget, const size_t bytes);
+
+// the same without waiting: only shrinks the registered caches. for callers holding locks others may
+// be waiting for, which must not stall them.
+gboolean dt_memory_budget_admit_nowait(dt_memory_budget_t *budget, const size_t bytes);
+
+void dt_memory_budget_print(dt_memory_budget_t *budget);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -26,7 +26,9 @@
 #include "common/imageio.h"
 #include "common/imageio_jpeg.h"
 #include "common/imageio_module.h"
+#include "common/memory_budget.h"
 #include "control/conf.h"
+#include "control/control.h"
 #include "control/jobs.h"
 #include "develop/imageop_math.h"
 
@@ -42,6 +44,7 @@
 #include <string.h>
 #include <strings.h>
 #include <unistd.h>
+#include <zlib.h>
 #if defined(__SSE__)
 #include <xmmintrin.h>
 #endif
@@ -57,6 +60,10 @@
 #define DT_MIPMAP_CACHE_FILE_VERSION 23
 #define DT_MIPMAP_CACHE_DEFAULT_FILE_NAME "mipmaps"
 
+// full buffers which are evicted are compressed into the scratch directory in chunks of this size
+#define DT_MIPMAP_SPILL_MAGIC 0xD75911
+#define DT_MIPMAP_SPILL_CHUNK ((size_t)4 << 20)
+
 typedef enum dt_mipmap_buffer_dsc_flags
 {
   DT_MIPMAP_BUFFER_DSC_FLAG_NONE = 0,
@@ -86,6 +93,7 @@ struct dt_mipmap_buffer_dsc
   uint32_t height;
   float iscale;
   size_t size;
+  uint32_t bpp; // bytes per pixel of a full buffer
   dt_mipmap_buffer_dsc_flags flags;
   dt_colorspaces_color_profile_type_t color_space;
 
@@ -263,10 +271,18 @@ void *dt_mipmap_cache_alloc(dt_mipmap_buffer_t *buf, const dt_image_t *img)
   // so only check size and re-alloc if necessary:
   if(!buf->buf || ((void *)dsc == (void *)dt_mipmap_cache_static_dead_image) || (entry->data_size < buffer_size))
   {
-    if((void *)dsc != (void *)dt_mipmap_cache_static_dead_image) dt_free_align(entry->data);
+    if((void *)dsc != (void *)dt_mipmap_cache_static_dead_image)
+    {
+      dt_free_align(entry->data);
+      dt_memory_budget_sub(darktable.memory_budget, entry->data_size);
+    }
 
     entry->data_size = 0;
 
+    // make room if we are about to blow the memory budget. the entry is write locked, readers of this image
+    // and maybe the gui are blocked on it, so don't wait for other jobs to give memory back.
+    dt_memory_budget_admit_nowait(darktable.memory_budget, buffer_size);
+
     entry->data = dt_alloc_align(64, buffer_size);
 
     if(!entry->data)
@@ -279,12 +295,14 @@ void *dt_mipmap_cache_alloc(dt_mipmap_buffer_t *buf, const dt_image_t *img)
     }
 
     entry->data_size = buffer_size;
+    dt_memory_budget_add(darktable.memory_budget, buffer_size);
 
     // set buffer size only if we're making it larger.
     dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
   }
 
   dsc->size = buffer_size;
+  dsc->bpp = bpp;
 
   dsc->width = wd;
   dsc->height = ht;
@@ -344,6 +362,9 @@ void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
       exit(1);
     }
 
+    // thumbnails live within their own quota, only the float buffers count towards the memory budget
+    if(mip >= DT_MIPMAP_F) dt_memory_budget_add(darktable.memory_budget, entry->data_size);
+
     dsc = entry->data;
 
     if(mip <= DT_MIPMAP_F)
@@ -446,6 +467,296 @@ static void dt_mipmap_cache_unlink_ondisk_thumbnail(void *data, uint32_t imgid,
   }
 }
 
+/*
+ * spilling of full buffers
+ *
+ * decoding a raw file is expensive, so when a full buffer gets evicted from the cache it is
+ * handed over to a background job which compresses it into the scratch directory. the next
+ * request for this image reads it back, as long as the image struct still describes the
+ * buffer we have written. the scratch directory only lives as long as this darktable instance.
+ */
+
+typedef struct _spill_header_t
+{
+  uint32_t magic;
+  uint32_t imgid;
+  uint32_t width;
+  uint32_t height;
+  uint64_t size; // uncompressed payload in bytes
+} _spill_header_t;
+
+// the state of an image in cache->spilled. images without a scratch file are not in there.
+#define DT_MIPMAP_SPILL_WRITING GINT_TO_POINTER(1)
+#define DT_MIPMAP_SPILL_CANCELLED GINT_TO_POINTER(2) // removed while writing it
+#define DT_MIPMAP_SPILL_ON_DISK GINT_TO_POINTER(3)
+
+typedef struct _spill_job_t
+{
+  dt_mipmap_cache_t *cache;
+  uint32_t imgid;
+  void *data;       // the evicted cache entry, now owned by the job
+  size_t data_size; // as accounted in the memory budget
+} _spill_job_t;
+
+static void _spill_filename(const dt_mipmap_cache_t *cache, const uint32_t imgid, char *filename,
+                            const size_t len)
+{
+  snprintf(filename, len, "%s/%" PRIu32 ".full", cache->spilldir, imgid);
+}
+
+// write the buffer to filename, returns the compressed size or 0 on failure
+static size_t _spill_write(const char *filename, const uint32_t imgid, const struct dt_mipmap_buffer_dsc *dsc,
+                           const size_t size)
+{
+  const uint8_t *const in = (const uint8_t *)(dsc + 1);
+
+  FILE *f = g_fopen(filename, "wb");
+  if(!f) return 0;
+
+  const _spill_header_t header = { DT_MIPMAP_SPILL_MAGIC, imgid, dsc->width, dsc->height, size };
+  int failed = fwrite(&header, sizeof(header), 1, f) != 1;
+
+  // compress a batch of chunks on all threads, then write them out in order. this keeps
+  // the extra memory we need bounded while we are probably short on it already.
+  const int nthreads = dt_get_num_threads();
+  const size_t chunks = (size + DT_MIPMAP_SPILL_CHUNK - 1) / DT_MIPMAP_SPILL_CHUNK;
+  const uLong bound = compressBound(DT_MIPMAP_SPILL_CHUNK);
+  uint8_t *scratch = dt_alloc_align(64, (size_t)nthreads * bound);
+  uLongf *lengths = calloc(nthreads, sizeof(uLongf));
+  failed |= !scratch || !lengths;
+
+  size_t written = 0;
+  for(size_t c0 = 0; c0 < chunks && !failed; c0 += nthreads)
+  {
+    const int batch = MIN((size_t)nthreads, chunks - c0);
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, scratch, lengths, batch, bound, c0, size) \
+  schedule(static) reduction(|:failed)
+#endif
+    for(int k = 0; k < batch; k++)
+    {
+      const size_t offset = (c0 + k) * DT_MIPMAP_SPILL_CHUNK;
+      lengths[k] = bound;
+      failed |= compress2(scratch + k * bound, &lengths[k], in + offset, MIN(DT_MIPMAP_SPILL_CHUNK, size - offset),
+                          Z_BEST_SPEED) != Z_OK;
+    }
+
+    for(int k = 0; k < batch && !failed; k++)
+    {
+      const uint32_t length = lengths[k];
+      failed |= fwrite(&length, sizeof(length), 1, f) != 1;
+      failed |= fwrite(scratch + k * bound, 1, length, f) != length;
+      written += length;
+    }
+  }
+
+  failed |= fclose(f) != 0;
+  dt_free_align(scratch);
+  free(lengths);
+
+  return failed ? 0 : written;
+}
+
+static int32_t _spill_job_run(dt_job_t *job)
+{
+  _spill_job_t *params = dt_control_job_get_params(job);
+  dt_mipmap_cache_t *cache = params->cache;
+  const struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)params->data;
+  const double start = dt_get_wtime();
+
+  char filename[PATH_MAX] = { 0 };
+  _spill_filename(cache, params->imgid, filename, sizeof(filename));
+  // write to a temporary name, so that a load never sees a partial file
+  gchar *tmpname = g_strconcat(filename, ".part", NULL);
+
+  // only the pixels, not the rest of a reused larger buffer
+  const size_t size = (size_t)dsc->width * dsc->height * dsc->bpp;
+  size_t written = 0;
+  struct statvfs vfsbuf;
+  if(size && size <= dsc->size - sizeof(*dsc) && !statvfs(cache->spilldir, &vfsbuf)
+     && (size_t)vfsbuf.f_frsize * vfsbuf.f_bavail >= size + ((size_t)100 << 20))
+    written = _spill_write(tmpname, params->imgid, dsc, size);
+
+  dt_pthread_mutex_lock(&cache->spill_mutex);
+  // the image may have been removed or reimported meanwhile
+  const gboolean cancelled
+      = g_hash_table_lookup(cache->spilled, GUINT_TO_POINTER(params->imgid)) == DT_MIPMAP_SPILL_CANCELLED;
+  if(!written || cancelled || g_rename(tmpname, filename))
+  {
+    g_unlink(tmpname);
+    g_hash_table_remove(cache->spilled, GUINT_TO_POINTER(params->imgid));
+  }
+  else
+  {
+    g_hash_table_insert(cache->spilled, GUINT_TO_POINTER(params->imgid), DT_MIPMAP_SPILL_ON_DISK);
+    dt_print(DT_DEBUG_CACHE | DT_DEBUG_PERF,
+             "[mipmap_cache] spilled full buffer of image %" PRIu32 ", %.1f MB -> %.1f MB in %.3f secs\n",
+             params->imgid, size / (1024.0 * 1024.0), written / (1024.0 * 1024.0), dt_get_wtime() - start);
+  }
+  dt_pthread_mutex_unlock(&cache->spill_mutex);
+
+  if(!written)
+    dt_print(DT_DEBUG_CACHE, "[mipmap_cache] failed to spill full buffer of image %" PRIu32 "\n", params->imgid);
+
+  g_free(tmpname);
+  return 0;
+}
+
+static void _spill_job_free(void *p)
+{
+  _spill_job_t *params = (_spill_job_t *)p;
+  dt_free_align(params->data);
+  dt_memory_budget_sub(darktable.memory_budget, params->data_size);
+  free(params);
+}
+
+// hand the evicted full buffer in entry over to a background job writing it to the scratch
+// directory. this is called with the cache locked, so it must not do the work itself. returns
+// TRUE if the job now owns the buffer.
+static gboolean _spill_full(dt_mipmap_cache_t *cache, dt_cache_entry_t *entry)
+{
+  const uint32_t imgid = get_imgid(entry->key);
+
+  // the full buffer is never changed after loading, so an existing file is still good
+  dt_pthread_mutex_lock(&cache->spill_mutex);
+  const gboolean pending = g_hash_table_contains(cache->spilled, GUINT_TO_POINTER(imgid));
+  if(!pending) g_hash_table_insert(cache->spilled, GUINT_TO_POINTER(imgid), DT_MIPMAP_SPILL_WRITING);
+  dt_pthread_mutex_unlock(&cache->spill_mutex);
+  if(pending) return FALSE;
+
+  _spill_job_t *params = malloc(sizeof(_spill_job_t));
+  dt_job_t *job = params ? dt_control_job_create(&_spill_job_run, "spill full buffer") : NULL;
+  if(!job)
+  {
+    free(params);
+    dt_pthread_mutex_lock(&cache->spill_mutex);
+    g_hash_table_remove(cache->spilled, GUINT_TO_POINTER(imgid));
+    dt_pthread_mutex_unlock(&cache->spill_mutex);
+    return FALSE;
+  }
+  params->cache = cache;
+  params->imgid = imgid;
+  params->data = entry->data;
+  params->data_size = entry->data_size;
+  dt_control_job_set_params(job, params, _spill_job_free);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+  return TRUE;
+}
+
+// forget what has been spilled for imgid, including a file still being written. this is called for
+// every change of a thumbnail, so it only goes to the file system if there is something to remove.
+static void _spill_remove(dt_mipmap_cache_t *cache, const uint32_t imgid)
+{
+  if(!cache->spilldir[0]) return;
+
+  dt_pthread_mutex_lock(&cache->spill_mutex);
+  const gpointer state = g_hash_table_lookup(cache->spilled, GUINT_TO_POINTER(imgid));
+  if(state == DT_MIPMAP_SPILL_WRITING)
+    // the job will throw its file away
+    g_hash_table_insert(cache->spilled, GUINT_TO_POINTER(imgid), DT_MIPMAP_SPILL_CANCELLED);
+  else if(state == DT_MIPMAP_SPILL_ON_DISK)
+  {
+    char filename[PATH_MAX] = { 0 };
+    _spill_filename(cache, imgid, filename, sizeof(filename));
+    g_unlink(filename);
+    g_hash_table_remove(cache->spilled, GUINT_TO_POINTER(imgid));
+  }
+  dt_pthread_mutex_unlock(&cache->spill_mutex);
+}
+
+// fill the write locked full buffer from the scratch directory. returns TRUE on success,
+// FALSE if the image has to be loaded from its file.
+static gboolean _unspill_full(dt_mipmap_cache_t *cache, dt_mipmap_buffer_t *buf, const dt_image_t *img)
+{
+  // the loader is only known if the image struct has been filled in by an earlier load
+  if(!cache->spilldir[0] || img->loader == LOADER_UNKNOWN) return FALSE;
+
+  dt_pthread_mutex_lock(&cache->spill_mutex);
+  const gboolean on_disk
+      = g_hash_table_lookup(cache->spilled, GUINT_TO_POINTER(img->id)) == DT_MIPMAP_SPILL_ON_DISK;
+  dt_pthread_mutex_unlock(&cache->spill_mutex);
+  if(!on_disk) return FALSE;
+
+  char filename[PATH_MAX] = { 0 };
+  _spill_filename(cache, img->id, filename, sizeof(filename));
+  FILE *f = g_fopen(filename, "rb");
+  if(!f)
+  {
+    _spill_remove(cache, img->id);
+    return FALSE;
+  }
+
+  const double start = dt_get_wtime();
+  const size_t size = (size_t)img->width * img->height * dt_iop_buffer_dsc_to_bpp(&img->buf_dsc);
+
+  _spill_header_t header;
+  if(fread(&header, sizeof(header), 1, f) != 1 || header.magic != DT_MIPMAP_SPILL_MAGIC
+     || header.imgid != (uint32_t)img->id || header.width != (uint32_t)img->width
+     || header.height != (uint32_t)img->height
+     || header.size != size)
+  {
+    fclose(f);
+    _spill_remove(cache, img->id);
+    return FALSE;
+  }
+
+  uint8_t *out = (uint8_t *)dt_mipmap_cache_alloc(buf, img);
+  if(!out)
+  {
+    fclose(f);
+    return FALSE;
+  }
+
+  const int nthreads = dt_get_num_threads();
+  const size_t chunks = (size + DT_MIPMAP_SPILL_CHUNK - 1) / DT_MIPMAP_SPILL_CHUNK;
+  const uLong bound = compressBound(DT_MIPMAP_SPILL_CHUNK);
+  uint8_t *scratch = dt_alloc_align(64, (size_t)nthreads * bound);
+  uint32_t *lengths = calloc(nthreads, sizeof(uint32_t));
+  int failed = !scratch || !lengths;
+
+  // read a batch of chunks and inflate them on all threads
+  for(size_t c0 = 0; c0 < chunks && !failed; c0 += nthreads)
+  {
+    const int batch = MIN((size_t)nthreads, chunks - c0);
+    for(int k = 0; k < batch && !failed; k++)
+    {
+      failed |= fread(&lengths[k], sizeof(uint32_t), 1, f) != 1 || lengths[k] > bound;
+      failed |= !failed && fread(scratch + k * bound, 1, lengths[k], f) != lengths[k];
+    }
+    if(failed) break;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(out, scratch, lengths, batch, bound, c0, size) \
+  schedule(static) reduction(|:failed)
+#endif
+    for(int k = 0; k < batch; k++)
+    {
+      const size_t offset = (c0 + k) * DT_MIPMAP_SPILL_CHUNK;
+      const uLongf expected = MIN(DT_MIPMAP_SPILL_CHUNK, size - offset);
+      uLongf length = expected;
+      failed |= uncompress(out + offset, &length, scratch + k * bound, lengths[k]) != Z_OK || length != expected;
+    }
+  }
+
+  fclose(f);
+  dt_free_align(scratch);
+  free(lengths);
+
+  if(failed)
+  {
+    // the buffer is allocated now, the caller will just load the image into it
+    _spill_remove(cache, img->id);
+    return FALSE;
+  }
+
+  dt_print(DT_DEBUG_CACHE | DT_DEBUG_PERF,
+           "[mipmap_cache] restored full buffer of image %d from scratch file in %.3f secs\n", img->id,
+           dt_get_wtime() - start);
+  return TRUE;
+}
+
 void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
 {
   dt_mipmap_cache_t *cache = (dt_mipmap_cache_t *)data;
@@ -516,6 +827,18 @@ write_error:
       }
     }
   }
+  else if((void *)entry->data != (void *)dt_mipmap_cache_static_dead_image)
+  {
+    struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
+    // only spill buffers which have been loaded successfully, and only while there are
+    // background jobs to do it. the job takes the buffer over.
+    if(mip == DT_MIPMAP_FULL && cache->spilldir[0] && dsc->width > 0 && dsc->height > 0
+       && !(dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE) && darktable.gui && dt_control_running()
+       && dt_conf_get_bool("cache_spill_full") && _spill_full(cache, entry))
+      return;
+
+    dt_memory_budget_sub(darktable.memory_budget, entry->data_size);
+  }
   dt_free_align(entry->data);
 }
 
@@ -526,6 +849,25 @@ static uint32_t nearest_power_of_two(const uint32_t value)
   return rc;
 }
 
+// removes a scratch directory of spilled buffers with everything in it
+static void _remove_dir(const char *path)
+{
+  GDir *dir = g_dir_open(path, 0, NULL);
+  if(!dir) return;
+  const gchar *name;
+  while((name = g_dir_read_name(dir)))
+  {
+    gchar *filename = g_build_filename(path, name, NULL);
+    if(g_file_test(filename, G_FILE_TEST_IS_DIR))
+      _remove_dir(filename);
+    else
+      g_unlink(filename);
+    g_free(filename);
+  }
+  g_dir_close(dir);
+  g_rmdir(path);
+}
+
 void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
 {
   dt_mipmap_cache_get_filename(cache->cachedir, sizeof(cache->cachedir));
@@ -602,13 +944,42 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
   cache->buffer_size[DT_MIPMAP_F] = sizeof(struct dt_mipmap_buffer_dsc)
                                         + 4 * sizeof(float) * cache->max_width[DT_MIPMAP_F]
                                           * cache->max_height[DT_MIPMAP_F];
+
+  // the float buffers are what the memory budget may take back when it runs short
+  dt_memory_budget_register_cache(darktable.memory_budget, &cache->mip_full.cache);
+  dt_memory_budget_register_cache(darktable.memory_budget, &cache->mip_f.cache);
+
+  // scratch space for evicted full buffers. it goes next to the thumbnails and not into the temp dir,
+  // which often lives in memory. the library lock makes sure that we are the only instance using it,
+  // so whatever is in there has been left behind by a crash.
+  dt_pthread_mutex_init(&cache->spill_mutex, NULL);
+  cache->spilled = g_hash_table_new(NULL, NULL);
+  cache->spilldir[0] = '\0';
+  if(cache->cachedir[0])
+  {
+    char parent[PATH_MAX] = { 0 };
+    snprintf(parent, sizeof(parent), "%s.spill", cache->cachedir);
+    _remove_dir(parent);
+    snprintf(cache->spilldir, sizeof(cache->spilldir), "%s/%d", parent, (int)getpid());
+    if(g_mkdir_with_parents(cache->spilldir, 0700)) cache->spilldir[0] = '\0';
+  }
 }
 
 void dt_mipmap_cache_cleanup(dt_mipmap_cache_t *cache)
 {
+  // no need to spill anything on the way out
+  if(cache->spilldir[0])
+  {
+    char parent[PATH_MAX] = { 0 };
+    snprintf(parent, sizeof(parent), "%s.spill", cache->cachedir);
+    _remove_dir(parent);
+    cache->spilldir[0] = '\0';
+  }
   dt_cache_cleanup(&cache->mip_thumbs.cache);
   dt_cache_cleanup(&cache->mip_full.cache);
   dt_cache_cleanup(&cache->mip_f.cache);
+  g_hash_table_destroy(cache->spilled);
+  dt_pthread_mutex_destroy(&cache->spill_mutex);
 }
 
 void dt_mipmap_cache_print(dt_mipmap_cache_t *cache)
@@ -779,7 +1150,10 @@ void dt_mipmap_cache_get_with_caller(
         buf->width = buf->height = 0;
         buf->iscale = 0.0f;
         buf->color_space = DT_COLORSPACE_NONE; // TODO: does the full buffer need to know this?
-        dt_imageio_retval_t ret = dt_imageio_open(&buffered_image, filename, buf); // TODO: color_space?
+        // read back what has been spilled to disk when it was evicted, or load the image:
+        dt_imageio_retval_t ret = DT_IMAGEIO_OK;
+        if(!_unspill_full(cache, buf, &buffered_image))
+          ret = dt_imageio_open(&buffered_image, filename, buf); // TODO: color_space?
         // might have been reallocated:
         ASAN_UNPOISON_MEMORY_REGION(entry->data, dt_mipmap_buffer_dsc_size);
         dsc = (struct dt_mipmap_buffer_dsc *)buf->cache_entry->data;
@@ -1011,6 +1385,9 @@ void dt_mipmap_cache_remove(dt_mipmap_cache_t *cache, const uint32_t imgid)
   {
     dt_mipmap_cache_remove_at_size(cache, imgid, k);
   }
+
+  // and of a spilled full buffer, the image might have been removed or reimported
+  _spill_remove(cache, imgid);
 }
 void dt_mipmap_cache_evict_at_size(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip)
 {
@@ -1203,6 +1580,11 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
       dt_imageio_jpeg_t jpg;
       if(!dt_imageio_jpeg_read_header(filename, &jpg))
       {
+        // no need to decode more pixels than the thumbnail will hold
+        if(orientation & ORIENTATION_SWAP_XY)
+          dt_imageio_jpeg_set_target_size(&jpg, ht, wd);
+        else
+          dt_imageio_jpeg_set_target_size(&jpg, wd, ht);
         uint8_t *tmp = (uint8_t *)malloc(sizeof(uint8_t) * jpg.width * jpg.height * 4);
         *color_space = dt_imageio_jpeg_read_color_space(&jpg);
         if(!dt_imageio_jpeg_read(&jpg, tmp))
@@ -1265,7 +1647,7 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
   if(res)
   {
     // try the real thing: rawspeed + pixelpipe
-    dt_imageio_module_format_t format;
+    dt_imageio_module_format_t format = { 0 };
     _dummy_data_t dat;
     format.bpp = _bpp;
     format.write_image = _write_image;
@@ -99,6 +99,9 @@ typedef struct dt_mipmap_cache_t
   dt_mipmap_cache_one_t mip_f;
   dt_mipmap_cache_one_t mip_full;
   char cachedir[PATH_MAX]; // cached sha1sum filename for faster access
+  char spilldir[PATH_MAX]; // scratch directory for evicted full buffers, empty if disabled
+  dt_pthread_mutex_t spill_mutex;
+  GHashTable *spilled;      // images with a scratch file in spilldir, written or being written
 } dt_mipmap_cache_t;
 
 // dynamic memory allocation interface for imageio backend: a write locked
@@ -34,9 +34,11 @@
 #include "common/grouping.h"
 #include "common/import_session.h"
 #include "control/conf.h"
+#include "develop/develop.h"
 #include "develop/imageop_math.h"
 
 #include "gui/gtk.h"
+#include "gui/hist_dialog.h"
 
 #include <gio/gio.h>
 #include <glib.h>
@@ -66,6 +68,15 @@ typedef struct dt_control_datetime_t
   char datetime[DT_DATETIME_LENGTH];
 } dt_control_datetime_t;
 
+typedef struct dt_control_paste_history_t
+{
+  int32_t imgid; // the image the history is copied from
+  GList *ops;
+  gboolean merge;
+  gboolean copy_iop_order;
+  gboolean copy_full;
+} dt_control_paste_history_t;
+
 typedef struct dt_control_gpx_apply_t
 {
   gchar *filename;
@@ -2067,6 +2078,159 @@ void dt_control_write_sidecar_files()
                                                           FALSE));
 }
 
+static int32_t dt_control_paste_history_job_run(dt_job_t *job)
+{
+  dt_control_image_enumerator_t *params = dt_control_job_get_params(job);
+  const dt_control_paste_history_t *d = params->data;
+  const guint total = g_list_length(params->index);
+  char message[512] = { 0 };
+
+  snprintf(message, sizeof(message),
+           ngettext("pasting history onto %d image", "pasting history onto %d images", total), total);
+  dt_control_job_set_progress_message(job, message);
+
+  dt_history_paste_on_list_ext(params->index, d->imgid, d->merge, d->ops, d->copy_iop_order, d->copy_full,
+                               TRUE, job);
+
+  dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_RELOAD, DT_COLLECTION_PROP_UNDEF,
+                             g_list_copy(params->index));
+  dt_control_queue_redraw_center();
+  return 0;
+}
+
+static void dt_control_paste_history_job_cleanup(void *p)
+{
+  dt_control_image_enumerator_t *params = (dt_control_image_enumerator_t *)p;
+  dt_control_paste_history_t *d = params->data;
+
+  if(d) g_list_free(d->ops);
+  free(d);
+
+  dt_control_image_enumerator_cleanup(params);
+}
+
+void dt_control_paste_history(GList *imgs)
+{
+  const dt_history_copy_item_t *cp = &darktable.view_manager->copy_paste;
+  if(!imgs || cp->copied_imageid <= 0)
+  {
+    g_list_free(imgs);
+    return;
+  }
+
+  // in darkroom the image being edited may be among the targets and needs to be reloaded right away,
+  // a single image is not worth a job.
+  const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
+  if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM || !imgs->next)
+  {
+    // this may change the history of the darkroom's image, record it for its undo
+    dt_dev_undo_start_record(darktable.develop);
+    const gboolean pasted = dt_history_paste_on_list(imgs, TRUE);
+    dt_dev_undo_end_record(darktable.develop);
+    if(pasted)
+      dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_RELOAD, DT_COLLECTION_PROP_UNDEF,
+                                 imgs);
+    else
+      g_list_free(imgs);
+    return;
+  }
+
+  dt_job_t *job = dt_control_job_create(&dt_control_paste_history_job_run, "paste history");
+  dt_control_image_enumerator_t *params = job ? dt_control_image_enumerator_alloc() : NULL;
+  dt_control_paste_history_t *d = params ? calloc(1, sizeof(dt_control_paste_history_t)) : NULL;
+  if(!d)
+  {
+    free(params);
+    if(job) dt_control_job_dispose(job);
+    g_list_free(imgs);
+    return;
+  }
+
+  // the copy/paste settings may change while the job is waiting, take a snapshot
+  d->imgid = cp->copied_imageid;
+  d->ops = g_list_copy(cp->selops);
+  d->merge = dt_conf_get_int("plugins/lighttable/copy_history/pastemode") == 0;
+  d->copy_iop_order = cp->copy_iop_order;
+  d->copy_full = cp->full_copy;
+  params->index = imgs;
+  params->data = d;
+
+  dt_control_job_add_progress(job, _("paste history"), TRUE);
+  dt_control_job_set_params(job, params, dt_control_paste_history_job_cleanup);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_FG, job);
+}
+
+void dt_control_paste_parts_history(GList *imgs)
+{
+  if(!imgs || darktable.view_manager->copy_paste.copied_imageid <= 0)
+  {
+    g_list_free(imgs);
+    return;
+  }
+
+  // the dialog updates the selected modules in copy_paste
+  const int res = dt_gui_hist_dialog_new(&(darktable.view_manager->copy_paste),
+                                         darktable.view_manager->copy_paste.copied_imageid, FALSE);
+  if(res != GTK_RESPONSE_OK)
+  {
+    g_list_free(imgs);
+    return;
+  }
+
+  dt_control_paste_history(imgs);
+}
+
+static int32_t dt_control_compress_history_job_run(dt_job_t *job)
+{
+  dt_control_image_enumerator_t *params = dt_control_job_get_params(job);
+  const guint total = g_list_length(params->index);
+  char message[512] = { 0 };
+
+  snprintf(message, sizeof(message),
+           ngettext("compressing history of %d image", "compressing history of %d images", total), total);
+  dt_control_job_set_progress_message(job, message);
+
+  const int missing = dt_history_compress_on_list_ext(params->index, job);
+
+  dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_RELOAD, DT_COLLECTION_PROP_UNDEF,
+                             g_list_copy(params->index));
+  dt_control_queue_redraw_center();
+
+  if(missing)
+    dt_control_log(ngettext("no history compression of 1 image.\nsee tag: darktable|problem|history-compress.",
+                            "no history compression of %d images.\nsee tag: darktable|problem|history-compress.",
+                            missing), missing);
+  return 0;
+}
+
+void dt_control_compress_history(GList *imgs)
+{
+  if(!imgs) return;
+
+  // write what is being edited first, the job reads from the database
+  const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
+  if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
+
+  dt_job_t *job = dt_control_job_create(&dt_control_compress_history_job_run, "compress history");
+  if(!job)
+  {
+    g_list_free(imgs);
+    return;
+  }
+  dt_control_image_enumerator_t *params = dt_control_image_enumerator_alloc();
+  if(!params)
+  {
+    dt_control_job_dispose(job);
+    g_list_free(imgs);
+    return;
+  }
+  params->index = imgs;
+
+  dt_control_job_add_progress(job, _("compress history"), TRUE);
+  dt_control_job_set_params(job, params, dt_control_image_enumerator_cleanup);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_FG, job);
+}
+
 static int _control_import_image_copy(const char *filename,
                                       struct dt_import_session_t *session, GList **imgs)
 {
@@ -31,6 +31,12 @@ void dt_control_gpx_apply(const gchar *filename, int32_t filmid, const gchar *tz
 void dt_control_datetime(const long int offset, const char *datetime, GList *imgs);
 
 void dt_control_write_sidecar_files();
+// paste the copied history onto imgs, in the background for more than one image. takes ownership of imgs.
+void dt_control_paste_history(GList *imgs);
+// same, after asking for the modules to paste
+void dt_control_paste_parts_history(GList *imgs);
+// compress the history of imgs in the background. takes ownership of imgs.
+void dt_control_compress_history(GList *imgs);
 void dt_control_delete_images();
 void dt_control_delete_image(int imgid);
 void dt_control_duplicate_images();
@@ -29,6 +29,7 @@
 #include "common/history.h"
 #include "common/image_cache.h"
 #include "common/imageio.h"
+#include "common/math.h"
 #include "common/mipmap_cache.h"
 #include "common/opencl.h"
 #include "common/tags.h"
@@ -40,6 +41,7 @@
 #include "develop/imageop.h"
 #include "develop/lightroom.h"
 #include "develop/masks.h"
+#include "develop/tiling.h"
 #include "gui/gtk.h"
 #include "gui/presets.h"
 
@@ -496,6 +498,257 @@ restart:
   DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_PREVIEW2_PIPE_FINISHED);
 }
 
+// progressive rendering of the center view: the view is refined in tiles of this size (in pixels),
+// starting under the pointer. smaller views are rendered in one go.
+#define DT_DEV_PROGRESSIVE_TILE 512
+#define DT_DEV_PROGRESSIVE_MIN_TILES 4
+// scale divisor of the coarse pass rendered when there is no preview to start from
+#define DT_DEV_PROGRESSIVE_COARSE 4
+
+typedef struct _dev_tile_t
+{
+  int x, y, width, height;
+  float dist;
+} _dev_tile_t;
+
+static int _dev_tile_cmp(const void *a, const void *b)
+{
+  const float da = ((const _dev_tile_t *)a)->dist, db = ((const _dev_tile_t *)b)->dist;
+  return (da > db) - (da < db);
+}
+
+// the margin, in pixels of the view, each tile has to be rendered with so that its pixels come out as in the
+// whole view, or -1 if the view can't be rendered in tiles. like the tiling code, this relies on the overlap
+// the modules report: every active module must either be point-wise or allow tiling.
+static int _dev_progressive_margin(const dt_develop_t *dev, const float scale)
+{
+  const dt_iop_roi_t roi = { 0, 0, DT_DEV_PROGRESSIVE_TILE, DT_DEV_PROGRESSIVE_TILE, scale };
+  int margin = 0;
+  for(const GList *nodes = dev->pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(!piece->enabled) continue;
+    dt_iop_module_t *module = piece->module;
+
+    // the blending itself is never tiled, a mask which is blurred or feathered reaches over the tile border
+    const dt_develop_blend_params_t *const bp = (dt_develop_blend_params_t *)piece->blendop_data;
+    if((module->flags() & IOP_FLAGS_SUPPORTS_BLENDING) && bp && bp->mask_mode != DEVELOP_MASK_DISABLED
+       && (bp->feathering_radius > 0.0f || bp->blur_radius > 0.0f || bp->details != 0.0f))
+      return -1;
+
+    // gamma only converts to the display buffer
+    if(piece->process_pointwise_ready || !strcmp(module->op, "gamma")) continue;
+    if(!piece->process_tiling_ready) return -1;
+
+    // the neighbourhoods of consecutive modules add up
+    dt_develop_tiling_t tiling = { 0 };
+    module->tiling_callback(module, piece, &roi, &roi, &tiling);
+    margin += tiling.overlap;
+    if(margin > DT_DEV_PROGRESSIVE_TILE / 2) return -1;
+  }
+  return margin;
+}
+
+// returns the margin of the tiles if the view is to be rendered progressively, else -1
+static int _dev_use_progressive(const dt_develop_t *dev, const int wd, const int ht, const float scale)
+{
+  // a focused module may read the output of the full pipe for its on-canvas ui, it needs the view in one piece
+  if(!dev->gui_attached || dev->gui_module) return -1;
+  if((size_t)wd * ht < (size_t)DT_DEV_PROGRESSIVE_MIN_TILES * DT_DEV_PROGRESSIVE_TILE * DT_DEV_PROGRESSIVE_TILE)
+    return -1;
+  if(!dt_conf_get_bool("darkroom/ui/progressive_rendering")) return -1;
+  return _dev_progressive_margin(dev, scale);
+}
+
+// has the view or the history changed since we started?
+static gboolean _dev_progressive_stale(dt_develop_t *dev, const float zoom_x, const float zoom_y)
+{
+  return dev->gui_leaving || dev->pipe->changed != DT_DEV_PIPE_UNCHANGED
+         || dev->pipe->input_timestamp != dev->timestamp
+         || dt_control_get_dev_zoom_x() != zoom_x || dt_control_get_dev_zoom_y() != zoom_y;
+}
+
+// make sure output_backbuf can hold the view and shows it at the given position. called with backbuf_mutex held.
+static gboolean _dev_progressive_output(dt_dev_pixelpipe_t *pipe, const int wd, const int ht, const float scale,
+                                        const float zoom_x, const float zoom_y)
+{
+  if(pipe->output_backbuf == NULL || pipe->output_backbuf_width != wd || pipe->output_backbuf_height != ht)
+  {
+    g_free(pipe->output_backbuf);
+    pipe->output_backbuf = g_malloc0(sizeof(uint8_t) * 4 * wd * ht);
+    pipe->output_backbuf_width = pipe->output_backbuf ? wd : 0;
+    pipe->output_backbuf_height = pipe->output_backbuf ? ht : 0;
+  }
+  pipe->backbuf_scale = scale;
+  pipe->backbuf_zoom_x = zoom_x;
+  pipe->backbuf_zoom_y = zoom_y;
+  pipe->output_imgid = pipe->image.id;
+  return pipe->output_backbuf != NULL;
+}
+
+// fill the view with a nearest neighbour upscaling of the part of `in' it covers, `in' spanning
+// from (x0, y0) to (x1, y1) in view coordinates
+static void _dev_progressive_upscale(uint8_t *const out, const int wd, const int ht, const uint8_t *const in,
+                                     const int iwd, const int iht, const float x0, const float y0,
+                                     const float x1, const float y1)
+{
+  const float sx = iwd / (x1 - x0), sy = iht / (y1 - y0);
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(out, wd, ht, in, iwd, iht, x0, y0, sx, sy) \
+  schedule(static)
+#endif
+  for(int j = 0; j < ht; j++)
+  {
+    const int sj = CLAMP((int)((j + 0.5f - y0) * sy), 0, iht - 1);
+    const uint32_t *const row = (const uint32_t *)in + (size_t)sj * iwd;
+    uint32_t *const dst = (uint32_t *)out + (size_t)j * wd;
+    for(int i = 0; i < wd; i++) dst[i] = row[CLAMP((int)((i + 0.5f - x0) * sx), 0, iwd - 1)];
+  }
+}
+
+// render the view at (x, y, wd, ht) in tiles. a coarse approximation is shown first, the preview if we
+// have one or else a low resolution run of the full pipe, and then refined from the pointer outwards.
+// each tile is rendered with margin more pixels on all sides, which are thrown away.
+// returns non-zero if interrupted, like dt_dev_pixelpipe_process().
+static int _dev_process_image_progressive(dt_develop_t *dev, const int x, const int y, const int wd, const int ht,
+                                          const float scale, const int margin, const float zoom_x,
+                                          const float zoom_y, const dt_times_t *start)
+{
+  dt_dev_pixelpipe_t *pipe = dev->pipe;
+
+  // nothing changed since the last complete rendering, e.g. when the job has been queued again
+  // while we were busy with the very same view
+  dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+  const gboolean done = dev->progressive.timestamp == dev->timestamp && pipe->output_backbuf
+                        && pipe->output_imgid == pipe->image.id && pipe->output_backbuf_width == wd
+                        && pipe->output_backbuf_height == ht && pipe->backbuf_scale == scale
+                        && pipe->backbuf_zoom_x == zoom_x && pipe->backbuf_zoom_y == zoom_y;
+  dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+  if(done) return 0;
+
+  // the coarse pass
+  const float full_wd = scale * pipe->processed_width, full_ht = scale * pipe->processed_height;
+  dt_dev_pixelpipe_t *preview = dev->preview_pipe;
+  dt_pthread_mutex_lock(&preview->backbuf_mutex);
+  const gboolean have_preview = dev->preview_status == DT_DEV_PIXELPIPE_VALID && preview->output_backbuf
+                                && preview->output_imgid == pipe->image.id;
+  if(have_preview)
+  {
+    dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+    if(_dev_progressive_output(pipe, wd, ht, 0.0f, zoom_x, zoom_y))
+      _dev_progressive_upscale(pipe->output_backbuf, wd, ht, preview->output_backbuf,
+                               preview->output_backbuf_width, preview->output_backbuf_height, -x, -y,
+                               full_wd - x, full_ht - y);
+    dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+  }
+  dt_pthread_mutex_unlock(&preview->backbuf_mutex);
+
+  pipe->progressive = 1;
+  if(!have_preview)
+  {
+    const int cwd = MAX(1, wd / DT_DEV_PROGRESSIVE_COARSE), cht = MAX(1, ht / DT_DEV_PROGRESSIVE_COARSE);
+    if(dt_dev_pixelpipe_process(pipe, dev, x / DT_DEV_PROGRESSIVE_COARSE, y / DT_DEV_PROGRESSIVE_COARSE, cwd, cht,
+                                scale / DT_DEV_PROGRESSIVE_COARSE))
+    {
+      pipe->progressive = 0;
+      return 1;
+    }
+    dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+    if(_dev_progressive_output(pipe, wd, ht, 0.0f, zoom_x, zoom_y) && pipe->backbuf)
+      _dev_progressive_upscale(pipe->output_backbuf, wd, ht, pipe->backbuf, pipe->backbuf_width,
+                               pipe->backbuf_height, 0.0f, 0.0f, cwd * DT_DEV_PROGRESSIVE_COARSE,
+                               cht * DT_DEV_PROGRESSIVE_COARSE);
+    dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+  }
+
+  // from now on the gui draws our output instead of the preview
+  dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+  const gboolean have_output = _dev_progressive_output(pipe, wd, ht, scale, zoom_x, zoom_y);
+  dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+  if(!have_output)
+  {
+    pipe->progressive = 0;
+    return dt_dev_pixelpipe_process(pipe, dev, x, y, wd, ht, scale);
+  }
+  dt_control_queue_redraw_center();
+  dt_show_times_f(start, "[dev_process_image]", "to first pixels (%s)", have_preview ? "preview" : "coarse");
+
+  // the tiles, nearest to the pointer first
+  const int tiles_x = (wd + DT_DEV_PROGRESSIVE_TILE - 1) / DT_DEV_PROGRESSIVE_TILE;
+  const int tiles_y = (ht + DT_DEV_PROGRESSIVE_TILE - 1) / DT_DEV_PROGRESSIVE_TILE;
+  const int closeup = dt_control_get_dev_closeup();
+  const float px = 0.5f * wd + dev->progressive.pointer_x * darktable.gui->ppd / (1 << closeup);
+  const float py = 0.5f * ht + dev->progressive.pointer_y * darktable.gui->ppd / (1 << closeup);
+  _dev_tile_t *tiles = malloc(sizeof(_dev_tile_t) * tiles_x * tiles_y);
+  uint64_t *hashes = malloc(sizeof(uint64_t) * pipe->cache.entries);
+  if(!tiles || !hashes)
+  {
+    free(tiles);
+    free(hashes);
+    pipe->progressive = 0;
+    return dt_dev_pixelpipe_process(pipe, dev, x, y, wd, ht, scale);
+  }
+  int ntiles = 0;
+  for(int ty = 0; ty < tiles_y; ty++)
+    for(int tx = 0; tx < tiles_x; tx++)
+    {
+      _dev_tile_t *t = tiles + ntiles++;
+      t->x = tx * DT_DEV_PROGRESSIVE_TILE;
+      t->y = ty * DT_DEV_PROGRESSIVE_TILE;
+      t->width = MIN(DT_DEV_PROGRESSIVE_TILE, wd - t->x);
+      t->height = MIN(DT_DEV_PROGRESSIVE_TILE, ht - t->y);
+      const float dx = t->x + 0.5f * t->width - px, dy = t->y + 0.5f * t->height - py;
+      t->dist = dx * dx + dy * dy;
+    }
+  qsort(tiles, ntiles, sizeof(_dev_tile_t), _dev_tile_cmp);
+
+  int err = 0;
+  for(int k = 0; k < ntiles && !err; k++)
+  {
+    // the user has moved on, don't waste time on tiles nobody will see
+    if(_dev_progressive_stale(dev, zoom_x, zoom_y))
+    {
+      dt_print(DT_DEBUG_DEV, "[dev_process_image] progressive rendering cancelled after %d of %d tiles\n", k,
+               ntiles);
+      err = 1;
+      break;
+    }
+
+    // the margin is clipped at the border of the view, where the whole view has no neighbours either
+    const _dev_tile_t *t = tiles + k;
+    const int rx = MAX(0, t->x - margin), ry = MAX(0, t->y - margin);
+    const int rwd = MIN(wd, t->x + t->width + margin) - rx, rht = MIN(ht, t->y + t->height + margin) - ry;
+
+    dt_dev_pixelpipe_cache_save_hashes(&pipe->cache, hashes);
+    err = dt_dev_pixelpipe_process(pipe, dev, x + rx, y + ry, rwd, rht, scale);
+
+    if(!err)
+    {
+      dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+      if(pipe->backbuf && pipe->backbuf_width == rwd && pipe->backbuf_height == rht
+         && pipe->output_backbuf_width == wd && pipe->output_backbuf_height == ht)
+      {
+        for(int j = 0; j < t->height; j++)
+          memcpy(pipe->output_backbuf + 4 * ((size_t)(t->y + j) * wd + t->x),
+                 pipe->backbuf + 4 * ((size_t)(t->y - ry + j) * rwd + t->x - rx), (size_t)4 * t->width);
+      }
+      dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+      dt_control_queue_redraw_center();
+    }
+
+    // nothing will ask for the buffers of a tile again. recycle them for the next tile rather than have
+    // them push out the other cache lines, the important output of gamma in particular.
+    dt_dev_pixelpipe_cache_drop_since(&pipe->cache, hashes);
+  }
+
+  free(tiles);
+  free(hashes);
+  pipe->progressive = 0;
+  if(!err) dev->progressive.timestamp = pipe->input_timestamp;
+  return err;
+}
+
 void dt_dev_process_image_job(dt_develop_t *dev)
 {
   dt_pthread_mutex_lock(&dev->pipe_mutex);
@@ -602,7 +855,11 @@ restart:
   y = MAX(0, scale * dev->pipe->processed_height * (.5 + zoom_y) - ht / 2);
 
   dt_get_times(&start);
-  if(dt_dev_pixelpipe_process(dev->pipe, dev, x, y, wd, ht, scale))
+  const int margin = _dev_use_progressive(dev, wd, ht, scale);
+  const int err = margin >= 0
+                      ? _dev_process_image_progressive(dev, x, y, wd, ht, scale, margin, zoom_x, zoom_y, &start)
+                      : dt_dev_pixelpipe_process(dev->pipe, dev, x, y, wd, ht, scale);
+  if(err)
   {
     // interrupted because image changed?
     if(dev->image_force_reload)
@@ -756,8 +1013,8 @@ void dt_dev_configure(dt_develop_t *dev, int wd, int ht)
   }
 }
 
-// helper used to synch a single history item with db
-int dt_dev_write_history_item(const int imgid, dt_dev_history_item_t *h, int32_t num)
+// write the main.history row of a history item, without its masks
+static void _dev_write_history_item_row(const int imgid, dt_dev_history_item_t *h, const int32_t num)
 {
   sqlite3_stmt *stmt;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
@@ -795,6 +1052,12 @@ int dt_dev_write_history_item(const int imgid, dt_dev_history_item_t *h, int32_t
 
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+}
+
+// helper used to synch a single history item with db
+int dt_dev_write_history_item(const int imgid, dt_dev_history_item_t *h, int32_t num)
+{
+  _dev_write_history_item_row(imgid, h, num);
 
   // write masks (if any)
   for(GList *forms = h->forms; forms; forms = g_list_next(forms))
@@ -1284,22 +1547,157 @@ static void _cleanup_history(const int imgid)
   sqlite3_finalize(stmt);
 }
 
+// compare a history item with the main.history row the statement is positioned on
+static gboolean _dev_history_item_is_stored(sqlite3_stmt *stmt, const dt_dev_history_item_t *h)
+{
+  const char *operation = (const char *)sqlite3_column_text(stmt, 1);
+  const char *multi_name = (const char *)sqlite3_column_text(stmt, 8);
+  return operation && !strcmp(operation, h->module->op)
+         && sqlite3_column_bytes(stmt, 2) == h->module->params_size
+         && !memcmp(sqlite3_column_blob(stmt, 2), h->params, h->module->params_size)
+         && sqlite3_column_int(stmt, 3) == h->module->version()
+         && sqlite3_column_int(stmt, 4) == h->enabled
+         && sqlite3_column_bytes(stmt, 5) == sizeof(dt_develop_blend_params_t)
+         && !memcmp(sqlite3_column_blob(stmt, 5), h->blend_params, sizeof(dt_develop_blend_params_t))
+         && sqlite3_column_int(stmt, 6) == dt_develop_blend_version()
+         && sqlite3_column_int(stmt, 7) == h->multi_priority
+         && !strcmp(multi_name ? multi_name : "", h->multi_name);
+}
+
+// compare a stored main.masks_history row with a form, points are stored as an array of point structs
+static gboolean _dev_form_is_stored(sqlite3_stmt *stmt, const dt_masks_form_t *form)
+{
+  const char *name = (const char *)sqlite3_column_text(stmt, 2);
+  if(sqlite3_column_int(stmt, 1) != form->type || strcmp(name ? name : "", form->name)
+     || sqlite3_column_int(stmt, 3) != form->version
+     || sqlite3_column_bytes(stmt, 6) != 2 * sizeof(float)
+     || memcmp(sqlite3_column_blob(stmt, 6), form->source, 2 * sizeof(float)))
+    return FALSE;
+
+  const size_t point_size = form->functions->point_struct_size;
+  const guint nb = g_list_length(form->points);
+  if(sqlite3_column_int(stmt, 5) != (int)nb || sqlite3_column_bytes(stmt, 4) != (int)(nb * point_size))
+    return FALSE;
+
+  const char *points = (const char *)sqlite3_column_blob(stmt, 4);
+  for(const GList *l = form->points; l; l = g_list_next(l), points += point_size)
+    if(memcmp(points, l->data, point_size)) return FALSE;
+  return TRUE;
+}
+
+// check whether the masks stored for history item num are the forms of the item
+static gboolean _dev_history_masks_are_stored(sqlite3_stmt *stmt, const int imgid, const int num,
+                                              const dt_dev_history_item_t *h)
+{
+  // forms without functions are never written, see dt_masks_write_masks_history_item()
+  int expected = 0;
+  for(const GList *forms = h->forms; forms; forms = g_list_next(forms))
+  {
+    const dt_masks_form_t *form = (dt_masks_form_t *)forms->data;
+    if(form && form->functions) expected++;
+  }
+
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, num);
+
+  int found = 0;
+  gboolean same = TRUE;
+  while(same && sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int formid = sqlite3_column_int(stmt, 0);
+    const dt_masks_form_t *form = NULL;
+    for(const GList *forms = h->forms; forms && !form; forms = g_list_next(forms))
+    {
+      const dt_masks_form_t *f = (dt_masks_form_t *)forms->data;
+      if(f && f->functions && f->formid == formid) form = f;
+    }
+    same = form && _dev_form_is_stored(stmt, form);
+    found++;
+  }
+  sqlite3_reset(stmt);
+  return same && found == expected;
+}
+
 void dt_dev_write_history_ext(dt_develop_t *dev, const int imgid)
 {
   sqlite3_stmt *stmt;
+  sqlite3 *db = dt_database_get(darktable.db);
   dt_lock_image(imgid);
 
-  _cleanup_history(imgid);
+  // only items which differ from what is stored are written, all in one go. a savepoint
+  // (unlike BEGIN) also works if our caller has opened a transaction already.
+  DT_DEBUG_SQLITE3_EXEC(db, "SAVEPOINT write_history", NULL, NULL, NULL);
+  const int changes_before = sqlite3_total_changes(db);
+
+  // first find out which items are stored already, without touching the tables we are reading
+  const int count = g_list_length(dev->history);
+  gboolean *item_stored = (gboolean *)calloc(MAX(count, 1), sizeof(gboolean));
+  gboolean *masks_stored = (gboolean *)calloc(MAX(count, 1), sizeof(gboolean));
+
+  sqlite3_stmt *masks_stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(db,
+                              "SELECT formid, form, name, version, points, points_count, source"
+                              " FROM main.masks_history"
+                              " WHERE imgid = ?1 AND num = ?2",
+                              -1, &masks_stmt, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(db,
+                              "SELECT num, operation, op_params, module, enabled, blendop_params,"
+                              "       blendop_version, multi_priority, multi_name"
+                              " FROM main.history"
+                              " WHERE imgid = ?1"
+                              " ORDER BY num",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  int row = sqlite3_step(stmt);
+  int i = 0, forms_count = 0;
+  for(const GList *history = dev->history; history; history = g_list_next(history), i++)
+  {
+    const dt_dev_history_item_t *hist = (dt_dev_history_item_t *)(history->data);
+    forms_count += g_list_length(hist->forms);
+    while(row == SQLITE_ROW && sqlite3_column_int(stmt, 0) < i) row = sqlite3_step(stmt);
+    if(row != SQLITE_ROW || sqlite3_column_int(stmt, 0) != i) continue;
+
+    item_stored[i] = _dev_history_item_is_stored(stmt, hist);
+    masks_stored[i] = _dev_history_masks_are_stored(masks_stmt, imgid, i, hist);
+  }
+  sqlite3_finalize(stmt);
+  sqlite3_finalize(masks_stmt);
 
   // write history entries
 
+  int items_written = 0, masks_written = 0;
   GList *history = dev->history;
   if (DT_IOP_ORDER_INFO)
     fprintf(stderr,"\n^^^^ Writing history image: %i, iop version: %i",imgid,dev->iop_order_version);
-  for(int i = 0; history; i++)
+  for(i = 0; history; i++)
   {
     dt_dev_history_item_t *hist = (dt_dev_history_item_t *)(history->data);
-    (void)dt_dev_write_history_item(imgid, hist, i);
+
+    if(!item_stored[i])
+    {
+      _dev_write_history_item_row(imgid, hist, i);
+      items_written++;
+    }
+
+    if(!masks_stored[i])
+    {
+      DT_DEBUG_SQLITE3_PREPARE_V2(db, "DELETE FROM main.masks_history WHERE imgid = ?1 AND num = ?2", -1,
+                                  &stmt, NULL);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, i);
+      sqlite3_step(stmt);
+      sqlite3_finalize(stmt);
+
+      for(GList *forms = hist->forms; forms; forms = g_list_next(forms))
+      {
+        dt_masks_form_t *form = (dt_masks_form_t *)forms->data;
+        if(form) dt_masks_write_masks_history_item(imgid, i, form);
+      }
+      masks_written++;
+    }
+
     if (DT_IOP_ORDER_INFO)
     {
       fprintf(stderr,"\n%20s, num %i, order %d, v(%i), multiprio %i",
@@ -1310,10 +1708,25 @@ void dt_dev_write_history_ext(dt_develop_t *dev, const int imgid)
   }
   if (DT_IOP_ORDER_INFO)
     fprintf(stderr,"\nvvvv\n");
+  free(item_stored);
+  free(masks_stored);
+
+  // drop whatever is left above the current history
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, "DELETE FROM main.history WHERE imgid = ?1 AND num >= ?2", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, count);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, "DELETE FROM main.masks_history WHERE imgid = ?1 AND num >= ?2", -1, &stmt,
+                              NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, count);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
 
   // update history end
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "UPDATE main.images SET history_end = ?1 WHERE id = ?2", -1,
+  DT_DEBUG_SQLITE3_PREPARE_V2(db,
+                              "UPDATE main.images SET history_end = ?1 WHERE id = ?2 AND history_end IS NOT ?1", -1,
                               &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, dev->history_end);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, imgid);
@@ -1325,6 +1738,14 @@ void dt_dev_write_history_ext(dt_develop_t *dev, const int imgid)
   dt_ioppr_write_iop_order_list(dev->iop_order_list, imgid);
   dt_history_hash_write_from_history(imgid, DT_HISTORY_HASH_CURRENT);
 
+  DT_DEBUG_SQLITE3_EXEC(db, "RELEASE write_history", NULL, NULL, NULL);
+
+  // deleting and re-inserting everything would have changed about twice as many rows as there are items and forms
+  dt_print(DT_DEBUG_SQL, "[dev_write_history] image %d: %d of %d items and %d mask sets written, %d rows changed"
+                         " instead of ~%d\n",
+           imgid, items_written, count, masks_written, sqlite3_total_changes(db) - changes_before,
+           2 * (count + forms_count));
+
   dt_unlock_image(imgid);
 }
 
@@ -2605,16 +3026,70 @@ int dt_dev_distort_backtransform(dt_develop_t *dev, float *points, size_t points
   return dt_dev_distort_backtransform_plus(dev, dev->preview_pipe, 0.0f, DT_DEV_TRANSFORM_DIR_ALL, points, points_count);
 }
 
+// apply a projective map to all points in one pass
+static void _distort_apply_matrix(const float *const matrix, float *const restrict points, const size_t points_count)
+{
+  const float m0 = matrix[0], m1 = matrix[1], m2 = matrix[2];
+  const float m3 = matrix[3], m4 = matrix[4], m5 = matrix[5];
+  const float m6 = matrix[6], m7 = matrix[7], m8 = matrix[8];
+
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) \
+  dt_omp_firstprivate(points, points_count, m0, m1, m2, m3, m4, m5, m6, m7, m8) \
+  schedule(static) if(points_count > 100)
+#endif
+  for(size_t i = 0; i < points_count * 2; i += 2)
+  {
+    const float x = points[i];
+    const float y = points[i + 1];
+    const float w = m6 * x + m7 * y + m8;
+    points[i] = (m0 * x + m1 * y + m2) / w;
+    points[i + 1] = (m3 * x + m4 * y + m5) / w;
+  }
+}
+
+// modules which describe their transformation as matrix are not run one after the other, their
+// matrices are accumulated and applied in a single pass once a module without one comes along.
+static void _distort_module(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, const int backward,
+                            float *const composed, gboolean *pending, float *points, const size_t points_count)
+{
+  float DT_ALIGNED_ARRAY matrix[9];
+  if(module->distort_matrix && module->distort_matrix(module, piece, backward, matrix))
+  {
+    if(*pending)
+    {
+      float DT_ALIGNED_ARRAY tmp[9];
+      mat3mul(tmp, matrix, composed);
+      memcpy(composed, tmp, sizeof(tmp));
+    }
+    else
+      memcpy(composed, matrix, sizeof(matrix));
+    *pending = TRUE;
+    return;
+  }
+
+  if(*pending) _distort_apply_matrix(composed, points, points_count);
+  *pending = FALSE;
+
+  if(backward)
+    module->distort_backtransform(module, piece, points, points_count);
+  else
+    module->distort_transform(module, piece, points, points_count);
+}
+
 // only call directly or indirectly from dt_dev_distort_transform_plus, so that it runs with the history locked
 int dt_dev_distort_transform_locked(dt_develop_t *dev, dt_dev_pixelpipe_t *pipe, const double iop_order,
                                     const int transf_direction, float *points, size_t points_count)
 {
+  float DT_ALIGNED_ARRAY composed[9];
+  gboolean pending = FALSE;
   GList *modules = pipe->iop;
   GList *pieces = pipe->nodes;
   while(modules)
   {
     if(!pieces)
     {
+      if(pending) _distort_apply_matrix(composed, points, points_count);
       return 0;
     }
     dt_iop_module_t *module = (dt_iop_module_t *)(modules->data);
@@ -2628,11 +3103,12 @@ int dt_dev_distort_transform_locked(dt_develop_t *dev, dt_dev_pixelpipe_t *pipe,
        && !(dev->gui_module && dev->gui_module != module
             && (dev->gui_module->operation_tags_filter() & module->operation_tags())))
     {
-      module->distort_transform(module, piece, points, points_count);
+      _distort_module(module, piece, FALSE, composed, &pending, points, points_count);
     }
     modules = g_list_next(modules);
     pieces = g_list_next(pieces);
   }
+  if(pending) _distort_apply_matrix(composed, points, points_count);
   return 1;
 }
 
@@ -2658,12 +3134,15 @@ int dt_dev_distort_transform_plus(dt_develop_t *dev, dt_dev_pixelpipe_t *pipe, c
 int dt_dev_distort_backtransform_locked(dt_develop_t *dev, dt_dev_pixelpipe_t *pipe, const double iop_order,
                                         const int transf_direction, float *points, size_t points_count)
 {
+  float DT_ALIGNED_ARRAY composed[9];
+  gboolean pending = FALSE;
   GList *modules = g_list_last(pipe->iop);
   GList *pieces = g_list_last(pipe->nodes);
   while(modules)
   {
     if(!pieces)
     {
+      if(pending) _distort_apply_matrix(composed, points, points_count);
       return 0;
     }
     dt_iop_module_t *module = (dt_iop_module_t *)(modules->data);
@@ -2677,11 +3156,12 @@ int dt_dev_distort_backtransform_locked(dt_develop_t *dev, dt_dev_pixelpipe_t *p
        && !(dev->gui_module && dev->gui_module != module
             && (dev->gui_module->operation_tags_filter() & module->operation_tags())))
     {
-      module->distort_backtransform(module, piece, points, points_count);
+      _distort_module(module, piece, TRUE, composed, &pending, points, points_count);
     }
     modules = g_list_previous(modules);
     pieces = g_list_previous(pieces);
   }
+  if(pending) _distort_apply_matrix(composed, points, points_count);
   return 1;
 }
 
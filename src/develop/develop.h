@@ -167,6 +167,13 @@ typedef struct dt_develop_t
   // width, height: dimensions of window
   int32_t width, height;
 
+  // progressive rendering of the center view
+  struct
+  {
+    float pointer_x, pointer_y; // pointer position relative to the center of the view, refined first
+    uint32_t timestamp;         // dev->timestamp of the last complete progressive rendering
+  } progressive;
+
   // image processing pipeline with caching
   struct dt_dev_pixelpipe_t *pipe, *preview_pipe, *preview2_pipe;
   dt_pthread_mutex_t pipe_mutex, preview_pipe_mutex,
@@ -1756,6 +1756,9 @@ void dt_iop_commit_params(dt_iop_module_t *module, dt_iop_params_t *params,
   if(module->flags() & IOP_FLAGS_ALLOW_TILING)
     piece->process_tiling_ready = 1;
 
+  // register if module is point-wise, commit_params can overwrite this.
+  piece->process_pointwise_ready = (module->flags() & IOP_FLAGS_POINTWISE) ? 1 : 0;
+
   if(darktable.unmuted & DT_DEBUG_PARAMS && module->so->get_introspection())
     _iop_validate_params(module->so->get_introspection()->field, params, TRUE);
 
@@ -20,6 +20,7 @@
 #include <assert.h> // for assert
 #include <glib.h> // for MIN, MAX, CLAMP, inline
 #include <math.h> // for round, floorf, fmaxf
+#include <string.h> // for memset
 #include "common/darktable.h"        // for darktable, darktable_t, dt_code...
 #include "common/imageio.h"          // for FILTERS_ARE_4BAYER
 #include "common/interpolation.h"    // for dt_interpolation_new, dt_interp...
@@ -171,6 +172,155 @@ int dt_iop_clip_and_zoom_roi_cl(int devid, cl_mem dev_out, cl_mem dev_in, const
 
 #endif
 
+/*
+ * Box filtering of a uint16 mosaic, as used to build the downscaled mosaic of the preview pipe.
+ *
+ * Every output pixel is the average of the input pixels of its own CFA color inside a box. Rather than
+ * visiting the box for each output pixel, every thread keeps the column sums of the rows of the current box,
+ * one set per row phase of the CFA, and updates them as the box slides down. Along the row these are turned
+ * into prefix sums over the columns of the same phase, so each output pixel costs a couple of lookups per
+ * CFA cell of its color. The sums are exact, the result is identical to the per-pixel loops.
+ */
+
+// the box of output row y covers the input rows box_y[2 * y] to box_y[2 * y + 1], inclusive, and the same
+// for box_x along the columns. an empty box has its end before its start.
+static gboolean _clip_and_zoom_mosaic_box(uint16_t *const out, const uint16_t *const in,
+                                          const dt_iop_roi_t *const roi_out, const dt_iop_roi_t *const roi_in,
+                                          const int32_t out_stride, const int32_t in_stride,
+                                          const int *const box_x, const int *const box_y,
+                                          const uint32_t filters, const uint8_t (*const xtrans)[6])
+{
+  const int width = roi_in->width;
+  const int period = (filters == 9u) ? 6 : 2;
+
+  // the row and column phases of the CFA cells of each color
+  int cell_p[4][36], cell_q[4][36];
+  int ncells[4] = { 0 };
+  for(int p = 0; p < period; p++)
+    for(int q = 0; q < period; q++)
+    {
+      const int c = (filters == 9u) ? FCxtrans(p, q, roi_in, xtrans) : FC(p, q, filters);
+      cell_p[c][ncells[c]] = p;
+      cell_q[c][ncells[c]++] = q;
+    }
+
+  const int nchunks = MIN(roi_out->height, dt_get_num_threads());
+  const size_t rows_size = (size_t)period * width;
+  // for each output column and column phase, the first and last input column of that phase in the box and
+  // their number
+  int *const first = dt_alloc_align(64, sizeof(int) * period * roi_out->width);
+  int *const last = dt_alloc_align(64, sizeof(int) * period * roi_out->width);
+  int *const ncols = dt_alloc_align(64, sizeof(int) * period * roi_out->width);
+  uint32_t *const rows = dt_alloc_align(64, sizeof(uint32_t) * rows_size * nchunks);
+  uint64_t *const prefix = dt_alloc_align(64, sizeof(uint64_t) * rows_size * nchunks);
+  if(!first || !last || !ncols || !rows || !prefix)
+  {
+    dt_free_align(first);
+    dt_free_align(last);
+    dt_free_align(ncols);
+    dt_free_align(rows);
+    dt_free_align(prefix);
+    return FALSE;
+  }
+
+  for(int x = 0; x < roi_out->width; x++)
+    for(int q = 0; q < period; q++)
+    {
+      const int l = box_x[2 * x], r = box_x[2 * x + 1];
+      const int f = l + (q - l % period + period) % period;
+      const int e = r - (r % period - q + period) % period;
+      // point before the first column, as looked up in the prefix sums
+      first[x * period + q] = f - period;
+      last[x * period + q] = e;
+      ncols[x * period + q] = e < f ? 0 : (e - f) / period + 1;
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, in_stride, out, out_stride, roi_out, box_y, filters, xtrans) \
+  dt_omp_firstprivate(width, period, nchunks, first, last, ncols, rows, prefix, rows_size) \
+  shared(cell_p, cell_q, ncells) schedule(static)
+#endif
+  for(int chunk = 0; chunk < nchunks; chunk++)
+  {
+    uint32_t *const rs = rows + rows_size * chunk;
+    uint64_t *const ps = prefix + rows_size * chunk;
+    int count[6] = { 0 };
+    // the rows currently summed up in rs
+    int y0 = 0, y1 = -1;
+
+    const int start = (int)((int64_t)roi_out->height * chunk / nchunks);
+    const int end = (int)((int64_t)roi_out->height * (chunk + 1) / nchunks);
+    for(int y = start; y < end; y++)
+    {
+      const int a = box_y[2 * y], b = box_y[2 * y + 1];
+
+      // the boxes only move downwards, start over if this one doesn't overlap with the last
+      if(y1 < y0 || a < y0 || b < y1 || a > y1)
+      {
+        memset(rs, 0, sizeof(uint32_t) * rows_size);
+        memset(count, 0, sizeof(count));
+        y0 = a;
+        y1 = a - 1;
+      }
+      for(; y0 < a; y0++)
+      {
+        const uint16_t *const row = in + (size_t)in_stride * y0;
+        uint32_t *const acc = rs + (size_t)width * (y0 % period);
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+        for(int i = 0; i < width; i++) acc[i] -= row[i];
+        count[y0 % period]--;
+      }
+      for(; y1 < b; y1++)
+      {
+        const uint16_t *const row = in + (size_t)in_stride * (y1 + 1);
+        uint32_t *const acc = rs + (size_t)width * ((y1 + 1) % period);
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+        for(int i = 0; i < width; i++) acc[i] += row[i];
+        count[(y1 + 1) % period]++;
+      }
+
+      // prefix sums over the columns of the same phase
+      for(int p = 0; p < period; p++)
+      {
+        if(!count[p]) continue;
+        const uint32_t *const acc = rs + (size_t)width * p;
+        uint64_t *const pre = ps + (size_t)width * p;
+        for(int i = 0; i < MIN(period, width); i++) pre[i] = acc[i];
+        for(int i = period; i < width; i++) pre[i] = pre[i - period] + acc[i];
+      }
+
+      uint16_t *const outc = out + (size_t)out_stride * y;
+      for(int x = 0; x < roi_out->width; x++)
+      {
+        const int c = (filters == 9u) ? FCxtrans(y, x, roi_out, xtrans) : FC(y, x, filters);
+        uint64_t col = 0;
+        uint32_t num = 0;
+        for(int k = 0; k < ncells[c]; k++)
+        {
+          const int p = cell_p[c][k], q = x * period + cell_q[c][k];
+          if(!count[p] || !ncols[q]) continue;
+          const uint64_t *const pre = ps + (size_t)width * p;
+          col += pre[last[q]] - (first[q] >= 0 ? pre[first[q]] : 0);
+          num += count[p] * ncols[q];
+        }
+        if(num) outc[x] = col / num;
+      }
+    }
+  }
+
+  dt_free_align(first);
+  dt_free_align(last);
+  dt_free_align(ncols);
+  dt_free_align(rows);
+  dt_free_align(prefix);
+  return TRUE;
+}
+
 void dt_iop_clip_and_zoom_mosaic_half_size(uint16_t *const out, const uint16_t *const in,
                                                  const dt_iop_roi_t *const roi_out,
                                                  const dt_iop_roi_t *const roi_in, const int32_t out_stride,
@@ -204,6 +354,36 @@ void dt_iop_clip_and_zoom_mosaic_half_size(uint16_t *const out, const uint16_t *
       clut[c][++clut[c][0]] = x + y * in_stride;
     }
 
+  // the boxes sampled by the loops below, for the fast path. the rows of a box go from miny to the second
+  // row of the last 2x2 block starting before maxy, and the same for the columns.
+  int *const box_x = malloc(sizeof(int) * 2 * roi_out->width);
+  int *const box_y = malloc(sizeof(int) * 2 * roi_out->height);
+  if(box_x && box_y)
+  {
+    for(int y = 0; y < roi_out->height; y++)
+    {
+      const float fy = (y + roi_out->y) * px_footprint;
+      const int miny = (CLAMPS((int)floorf(fy - px_footprint), 0, roi_in->height-3) & ~1u) + rggby;
+      const int maxy = MIN(roi_in->height-1, (int)ceilf(fy + px_footprint));
+      box_y[2 * y] = miny;
+      box_y[2 * y + 1] = miny + 2 * (maxy > miny ? (maxy - miny + 1) / 2 : 0) - 1;
+    }
+    float fx = roi_out->x * px_footprint;
+    for(int x = 0; x < roi_out->width; x++, fx += px_footprint)
+    {
+      const int minx = (CLAMPS((int)floorf(fx - px_footprint), 0, roi_in->width-3) & ~1u) + rggbx;
+      const int maxx = MIN(roi_in->width-1, (int)ceilf(fx + px_footprint));
+      box_x[2 * x] = minx;
+      box_x[2 * x + 1] = minx + 2 * (maxx > minx ? (maxx - minx + 1) / 2 : 0) - 1;
+    }
+  }
+  const gboolean done = box_x && box_y
+                        && _clip_and_zoom_mosaic_box(out, in, roi_out, roi_in, out_stride, in_stride, box_x, box_y,
+                                                     filters, NULL);
+  free(box_x);
+  free(box_y);
+  if(done) return;
+
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
   dt_omp_firstprivate(filters, in, in_stride, out, out_stride, px_footprint, rggbx, rggby, roi_in, roi_out) \
@@ -444,6 +624,31 @@ void dt_iop_clip_and_zoom_mosaic_third_size_xtrans(uint16_t *const out, const ui
   // Use box filter of width px_footprint*2+1 centered on the current
   // sample (rounded to nearest input pixel) to anti-alias. Higher MP
   // images need larger filters to avoid artifacts.
+
+  int *const box_x = malloc(sizeof(int) * 2 * roi_out->width);
+  int *const box_y = malloc(sizeof(int) * 2 * roi_out->height);
+  if(box_x && box_y)
+  {
+    for(int y = 0; y < roi_out->height; y++)
+    {
+      const float fy = (y + roi_out->y) * px_footprint;
+      box_y[2 * y] = MAX(0, (int)roundf(fy - px_footprint));
+      box_y[2 * y + 1] = MIN(roi_in->height-1, (int)roundf(fy + px_footprint));
+    }
+    float fx = roi_out->x * px_footprint;
+    for(int x = 0; x < roi_out->width; x++, fx += px_footprint)
+    {
+      box_x[2 * x] = MAX(0, (int)roundf(fx - px_footprint));
+      box_x[2 * x + 1] = MIN(roi_in->width-1, (int)roundf(fx + px_footprint));
+    }
+  }
+  const gboolean done = box_x && box_y
+                        && _clip_and_zoom_mosaic_box(out, in, roi_out, roi_in, out_stride, in_stride, box_x, box_y,
+                                                     9u, xtrans);
+  free(box_x);
+  free(box_y);
+  if(done) return;
+
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
   dt_omp_firstprivate(in, in_stride, out, out_stride, px_footprint, roi_in, roi_out, xtrans) \
@@ -328,6 +328,20 @@ int dt_masks_group_render(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece
 int dt_masks_group_render_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
                               const dt_iop_roi_t *roi, float *buffer);
 
+/** cache of rasterized group masks, shared by all pipes. an entry is found again if the forms,
+ * the distortions applied to them and the requested region are the same. */
+typedef struct dt_masks_cache_t
+{
+  dt_pthread_mutex_t lock;
+  GList *entries;  // most recently used first
+  size_t size;     // bytes held by the entries
+  size_t max_size; // in bytes, 0 disables the cache
+  uint64_t hits, misses;
+} dt_masks_cache_t;
+
+void dt_masks_cache_init(dt_masks_cache_t *cache);
+void dt_masks_cache_cleanup(dt_masks_cache_t *cache);
+
 // returns current masks version
 int dt_masks_version(void);
 
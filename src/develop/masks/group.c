@@ -16,6 +16,7 @@
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "common/debug.h"
+#include "common/memory_budget.h"
 #include "control/conf.h"
 #include "control/control.h"
 #include "develop/blend.h"
@@ -664,13 +665,192 @@ static int _group_get_mask_roi(const dt_iop_module_t *const restrict module,
   return nb_ok != 0;
 }
 
+typedef struct dt_masks_cache_entry_t
+{
+  uint64_t hash;
+  dt_iop_roi_t roi;
+  float *mask;
+  size_t size;
+} dt_masks_cache_entry_t;
+
+void dt_masks_cache_init(dt_masks_cache_t *cache)
+{
+  dt_pthread_mutex_init(&cache->lock, NULL);
+  cache->entries = NULL;
+  cache->size = 0;
+  cache->max_size = (size_t)MAX(0, dt_conf_get_int("cache_masks_size")) << 20;
+  cache->hits = cache->misses = 0;
+}
+
+static void _cache_entry_free(dt_masks_cache_entry_t *entry)
+{
+  dt_memory_budget_sub(darktable.memory_budget, entry->size);
+  dt_free_align(entry->mask);
+  free(entry);
+}
+
+void dt_masks_cache_cleanup(dt_masks_cache_t *cache)
+{
+  dt_print(DT_DEBUG_MASKS, "[masks cache] %" PRIu64 " hits, %" PRIu64 " misses\n", cache->hits, cache->misses);
+  g_list_free_full(cache->entries, (GDestroyNotify)_cache_entry_free);
+  cache->entries = NULL;
+  dt_pthread_mutex_destroy(&cache->lock);
+}
+
+static inline uint64_t _hash_bytes(uint64_t hash, const void *data, const size_t size)
+{
+  // bernstein hash (djb2)
+  const char *str = (const char *)data;
+  for(size_t i = 0; i < size; i++) hash = ((hash << 5) + hash) ^ str[i];
+  return hash;
+}
+
+// everything the rasterization of the form depends on, following the forms the same way as _group_get_mask_roi()
+static uint64_t _form_hash(uint64_t hash, dt_develop_t *dev, const dt_masks_form_t *form)
+{
+  hash = _hash_bytes(hash, &form->type, sizeof(dt_masks_type_t));
+  hash = _hash_bytes(hash, &form->formid, sizeof(int));
+  hash = _hash_bytes(hash, &form->version, sizeof(int));
+  hash = _hash_bytes(hash, form->source, sizeof(float) * 2);
+
+  for(const GList *points = form->points; points; points = g_list_next(points))
+  {
+    if(form->type & DT_MASKS_GROUP)
+    {
+      const dt_masks_point_group_t *fpt = (dt_masks_point_group_t *)points->data;
+      const dt_masks_form_t *sel = dt_masks_get_from_id(dev, fpt->formid);
+      if(sel)
+      {
+        hash = _hash_bytes(hash, &fpt->state, sizeof(int));
+        hash = _hash_bytes(hash, &fpt->opacity, sizeof(float));
+        hash = _form_hash(hash, dev, sel);
+      }
+    }
+    else if(form->functions)
+      hash = _hash_bytes(hash, points->data, form->functions->point_struct_size);
+  }
+  return hash;
+}
+
+static uint64_t _mask_hash(const dt_iop_module_t *const module, const dt_dev_pixelpipe_iop_t *const piece,
+                           const dt_masks_form_t *const form)
+{
+  const dt_dev_pixelpipe_t *const pipe = piece->pipe;
+  uint64_t hash = _form_hash(5381, module->dev, form);
+
+  // the shapes are distorted by all modules up to this one (DT_DEV_TRANSFORM_DIR_BACK_INCL).
+  // we hold the pipe, so the nodes can't change under our feet.
+  for(const GList *modules = pipe->iop, *pieces = pipe->nodes; modules && pieces;
+      modules = g_list_next(modules), pieces = g_list_next(pieces))
+  {
+    const dt_iop_module_t *m = (dt_iop_module_t *)modules->data;
+    const dt_dev_pixelpipe_iop_t *p = (dt_dev_pixelpipe_iop_t *)pieces->data;
+    if(p->enabled && m->iop_order <= module->iop_order && (m->operation_tags() & IOP_TAG_DISTORT))
+      hash = ((hash << 5) + hash) ^ p->hash;
+  }
+
+  // the pipe type is deliberately left out, so pipes with the same geometry share their masks. the image
+  // is not: some distortions also depend on it, like flip on the exif orientation.
+  hash = _hash_bytes(hash, &pipe->image.id, sizeof(pipe->image.id));
+  hash = _hash_bytes(hash, &module->iop_order, sizeof(module->iop_order));
+  hash = _hash_bytes(hash, &pipe->iwidth, sizeof(int));
+  hash = _hash_bytes(hash, &pipe->iheight, sizeof(int));
+  hash = _hash_bytes(hash, &pipe->iscale, sizeof(float));
+  return hash;
+}
+
+static gboolean _cache_get(dt_masks_cache_t *cache, const uint64_t hash, const dt_iop_roi_t *roi, float *buffer,
+                           const size_t size)
+{
+  gboolean found = FALSE;
+  dt_pthread_mutex_lock(&cache->lock);
+  for(GList *l = cache->entries; l; l = g_list_next(l))
+  {
+    dt_masks_cache_entry_t *entry = (dt_masks_cache_entry_t *)l->data;
+    if(entry->hash == hash && !memcmp(&entry->roi, roi, sizeof(dt_iop_roi_t)))
+    {
+      memcpy(buffer, entry->mask, size);
+      cache->entries = g_list_concat(l, g_list_remove_link(cache->entries, l));
+      found = TRUE;
+      break;
+    }
+  }
+  if(found)
+    cache->hits++;
+  else
+    cache->misses++;
+  dt_print(DT_DEBUG_MASKS, "[masks cache] %s for %dx%d, %" PRIu64 " hits, %" PRIu64 " misses, %zu MB used\n",
+           found ? "hit" : "miss", roi->width, roi->height, cache->hits, cache->misses, cache->size >> 20);
+  dt_pthread_mutex_unlock(&cache->lock);
+  return found;
+}
+
+static void _cache_put(dt_masks_cache_t *cache, const uint64_t hash, const dt_iop_roi_t *roi, const float *buffer,
+                       const size_t size)
+{
+  dt_masks_cache_entry_t *entry = (dt_masks_cache_entry_t *)malloc(sizeof(dt_masks_cache_entry_t));
+  float *mask = dt_alloc_align(64, size);
+  if(!entry || !mask)
+  {
+    free(entry);
+    dt_free_align(mask);
+    return;
+  }
+  memcpy(mask, buffer, size);
+  entry->hash = hash;
+  entry->roi = *roi;
+  entry->mask = mask;
+  entry->size = size;
+  dt_memory_budget_add(darktable.memory_budget, size);
+
+  dt_pthread_mutex_lock(&cache->lock);
+  // another pipe might have rendered the same mask in the meantime
+  for(GList *l = cache->entries; l; l = g_list_next(l))
+  {
+    const dt_masks_cache_entry_t *other = (dt_masks_cache_entry_t *)l->data;
+    if(other->hash == hash && !memcmp(&other->roi, roi, sizeof(dt_iop_roi_t)))
+    {
+      dt_pthread_mutex_unlock(&cache->lock);
+      _cache_entry_free(entry);
+      return;
+    }
+  }
+  cache->entries = g_list_prepend(cache->entries, entry);
+  cache->size += size;
+
+  // evict the least recently used masks
+  while(cache->size > cache->max_size)
+  {
+    GList *last = g_list_last(cache->entries);
+    dt_masks_cache_entry_t *old = (dt_masks_cache_entry_t *)last->data;
+    cache->entries = g_list_delete_link(cache->entries, last);
+    cache->size -= old->size;
+    _cache_entry_free(old);
+  }
+  dt_pthread_mutex_unlock(&cache->lock);
+}
+
 int dt_masks_group_render_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
                               const dt_iop_roi_t *roi, float *buffer)
 {
   const double start = dt_get_wtime();
   if(!form) return 0;
 
+  // don't let a single mask push out all the others
+  dt_masks_cache_t *cache = darktable.masks_cache;
+  const size_t size = sizeof(float) * roi->width * roi->height;
+  const gboolean cacheable = cache && size <= cache->max_size / 4;
+  const uint64_t hash = cacheable ? _mask_hash(module, piece, form) : 0;
+
+  if(cacheable && _cache_get(cache, hash, roi, buffer, size))
+  {
+    if(darktable.unmuted & DT_DEBUG_PERF)
+      dt_print(DT_DEBUG_MASKS, "[masks] cached masks took %0.04f sec\n", dt_get_wtime() - start);
+    return 1;
+  }
+
   const int ok = dt_masks_get_mask_roi(module, piece, form, roi, buffer);
+  if(ok && cacheable) _cache_put(cache, hash, roi, buffer, size);
 
   if(darktable.unmuted & DT_DEBUG_PERF)
     dt_print(DT_DEBUG_MASKS, "[masks] render all masks took %0.04f sec\n", dt_get_wtime() - start);
@@ -17,10 +17,12 @@
 */
 
 #include "develop/pixelpipe_cache.h"
+#include "common/memory_budget.h"
 #include "develop/format.h"
 #include "develop/pixelpipe_hb.h"
 #include "libs/lib.h"
 #include <stdlib.h>
+#include <string.h>
 
 
 // TODO: make cache global (needs to be thread safe then)
@@ -51,6 +53,7 @@ int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, si
     { // allow 0 initial buffer size (yet unknown dimensions)
       cache->data[k] = (void *)dt_alloc_align(64, size);
       if(!cache->data[k]) goto alloc_memory_fail;
+      dt_memory_budget_add(darktable.memory_budget, size);
 #ifdef _DEBUG
       memset(cache->data[k], 0x5d, size);
 #endif
@@ -72,6 +75,7 @@ alloc_memory_fail:
   // but will only fail to generate thumbnails for example.
   for(int k = 0; k < cache->entries; k++)
   {
+    if(cache->data[k]) dt_memory_budget_sub(darktable.memory_budget, cache->size[k]);
     dt_free_align(cache->data[k]);
     cache->size[k] = 0;
     cache->data[k] = NULL;
@@ -81,7 +85,11 @@ alloc_memory_fail:
 
 void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache)
 {
-  for(int k = 0; k < cache->entries; k++) dt_free_align(cache->data[k]);
+  for(int k = 0; k < cache->entries; k++)
+  {
+    if(cache->data[k]) dt_memory_budget_sub(darktable.memory_budget, cache->size[k]);
+    dt_free_align(cache->data[k]);
+  }
   free(cache->data);
   free(cache->dsc);
   free(cache->basichash);
@@ -90,6 +98,31 @@ void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache)
   free(cache->size);
 }
 
+// bernstein hash (djb2) step for one piece of the pipe
+static inline uint64_t _basichash_piece(uint64_t hash, const dt_dev_pixelpipe_iop_t *piece)
+{
+  dt_develop_t *dev = piece->module->dev;
+  if(!(dev->gui_module && dev->gui_module != piece->module
+       && (dev->gui_module->operation_tags_filter() & piece->module->operation_tags())))
+  {
+    hash = ((hash << 5) + hash) ^ piece->hash;
+    if(piece->module->request_color_pick != DT_REQUEST_COLORPICK_OFF)
+    {
+      if(darktable.lib->proxy.colorpicker.size)
+      {
+        const char *str = (const char *)piece->module->color_picker_box;
+        for(size_t i = 0; i < sizeof(float) * 4; i++) hash = ((hash << 5) + hash) ^ str[i];
+      }
+      else
+      {
+        const char *str = (const char *)piece->module->color_picker_point;
+        for(size_t i = 0; i < sizeof(float) * 2; i++) hash = ((hash << 5) + hash) ^ str[i];
+      }
+    }
+  }
+  return hash;
+}
+
 uint64_t dt_dev_pixelpipe_cache_basichash(int imgid, struct dt_dev_pixelpipe_t *pipe, int module)
 {
   // bernstein hash (djb2)
@@ -99,31 +132,20 @@ uint64_t dt_dev_pixelpipe_cache_basichash(int imgid, struct dt_dev_pixelpipe_t *
   GList *pieces = pipe->nodes;
   for(int k = 0; k < module && pieces; k++)
   {
-    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
-    dt_develop_t *dev = piece->module->dev;
-    if(!(dev->gui_module && dev->gui_module != piece->module
-         && (dev->gui_module->operation_tags_filter() & piece->module->operation_tags())))
-    {
-      hash = ((hash << 5) + hash) ^ piece->hash;
-      if(piece->module->request_color_pick != DT_REQUEST_COLORPICK_OFF)
-      {
-        if(darktable.lib->proxy.colorpicker.size)
-        {
-          const char *str = (const char *)piece->module->color_picker_box;
-          for(size_t i = 0; i < sizeof(float) * 4; i++) hash = ((hash << 5) + hash) ^ str[i];
-        }
-        else
-        {
-          const char *str = (const char *)piece->module->color_picker_point;
-          for(size_t i = 0; i < sizeof(float) * 2; i++) hash = ((hash << 5) + hash) ^ str[i];
-        }
-      }
-    }
+    hash = _basichash_piece(hash, (dt_dev_pixelpipe_iop_t *)pieces->data);
     pieces = g_list_next(pieces);
   }
   return hash;
 }
 
+void dt_dev_pixelpipe_cache_basichashes(int imgid, struct dt_dev_pixelpipe_t *pipe, uint64_t *hashes)
+{
+  uint64_t hash = hashes[0] = 5381 + imgid + (pipe->type & DT_DEV_PIXELPIPE_FAST);
+  int k = 1;
+  for(GList *pieces = pipe->nodes; pieces; pieces = g_list_next(pieces), k++)
+    hashes[k] = hash = _basichash_piece(hash, (dt_dev_pixelpipe_iop_t *)pieces->data);
+}
+
 uint64_t dt_dev_pixelpipe_cache_basichash_prior(int imgid, struct dt_dev_pixelpipe_t *pipe,
                                                 const dt_iop_module_t *const module)
 {
@@ -151,12 +173,18 @@ uint64_t dt_dev_pixelpipe_cache_basichash_prior(int imgid, struct dt_dev_pixelpi
 void dt_dev_pixelpipe_cache_fullhash(int imgid, const dt_iop_roi_t *roi, struct dt_dev_pixelpipe_t *pipe, int module,
                                      uint64_t *basichash, uint64_t *fullhash)
 {
-  uint64_t hash = *basichash = dt_dev_pixelpipe_cache_basichash(imgid, pipe, module);
+  *basichash = dt_dev_pixelpipe_cache_basichash(imgid, pipe, module);
+  *fullhash = dt_dev_pixelpipe_cache_roihash(*basichash, roi);
+}
+
+uint64_t dt_dev_pixelpipe_cache_roihash(uint64_t basichash, const dt_iop_roi_t *roi)
+{
+  uint64_t hash = basichash;
   // also add scale, x and y:
   const char *str = (const char *)roi;
   for(size_t i = 0; i < sizeof(dt_iop_roi_t); i++)
     hash = ((hash << 5) + hash) ^ str[i];
-  *fullhash = hash;
+  return hash;
 }
 
 uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const dt_iop_roi_t *roi, dt_dev_pixelpipe_t *pipe, int module)
@@ -222,9 +250,11 @@ int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const u
     // weight);
     if(cache->size[max] < size)
     {
+      if(cache->data[max]) dt_memory_budget_sub(darktable.memory_budget, cache->size[max]);
       dt_free_align(cache->data[max]);
       cache->data[max] = (void *)dt_alloc_align(64, size);
       cache->size[max] = size;
+      if(cache->data[max]) dt_memory_budget_add(darktable.memory_budget, size);
     }
     *data = cache->data[max];
     sz = cache->size[max];
@@ -294,6 +324,25 @@ void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *da
   }
 }
 
+void dt_dev_pixelpipe_cache_save_hashes(const dt_dev_pixelpipe_cache_t *cache, uint64_t *hashes)
+{
+  memcpy(hashes, cache->hash, sizeof(uint64_t) * cache->entries);
+}
+
+void dt_dev_pixelpipe_cache_drop_since(dt_dev_pixelpipe_cache_t *cache, const uint64_t *hashes)
+{
+  for(int k = 0; k < cache->entries; k++)
+  {
+    if(cache->hash[k] != hashes[k])
+    {
+      cache->basichash[k] = -1;
+      cache->hash[k] = -1;
+      cache->used[k] = INT32_MAX / 2; // older than anything else, this is the next line to be taken
+      ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
+    }
+  }
+}
+
 void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache)
 {
   for(int k = 0; k < cache->entries; k++)
@@ -61,6 +61,10 @@ uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const struct dt_iop_roi_t *roi,
 /** return both of the above hashes */
 void dt_dev_pixelpipe_cache_fullhash(int imgid, const dt_iop_roi_t *roi, struct dt_dev_pixelpipe_t *pipe, int module,
                                      uint64_t *basichash, uint64_t *fullhash);
+/** fills hashes[k] with the basichash of the first k modules for all k up to the number of nodes, in one pass */
+void dt_dev_pixelpipe_cache_basichashes(int imgid, struct dt_dev_pixelpipe_t *pipe, uint64_t *hashes);
+/** adds the current viewport to a basichash */
+uint64_t dt_dev_pixelpipe_cache_roihash(uint64_t basichash, const struct dt_iop_roi_t *roi);
 /** get the basichash for the last enabled module prior to the specified one */
 uint64_t dt_dev_pixelpipe_cache_basichash_prior(int imgid, struct dt_dev_pixelpipe_t *pipe,
                                                 const struct dt_iop_module_t *const module);
@@ -92,6 +96,12 @@ void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data
 /** mark the given cache line pointer as invalid. */
 void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *data);
 
+/** copies the hashes of all cache lines to hashes, which has room for cache->entries values. */
+void dt_dev_pixelpipe_cache_save_hashes(const dt_dev_pixelpipe_cache_t *cache, uint64_t *hashes);
+
+/** invalidates the cache lines filled since hashes have been saved, and makes them the first to be reused. */
+void dt_dev_pixelpipe_cache_drop_since(dt_dev_pixelpipe_cache_t *cache, const uint64_t *hashes);
+
 /** print out cache lines/hashes (debug). */
 void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache);
 
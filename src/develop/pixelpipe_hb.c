@@ -163,6 +163,7 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   pipe->processed_width = pipe->backbuf_width = pipe->iwidth = 0;
   pipe->processed_height = pipe->backbuf_height = pipe->iheight = 0;
   pipe->nodes = NULL;
+  memset(&pipe->plan, 0, sizeof(pipe->plan));
   pipe->backbuf_size = size;
   if(!dt_dev_pixelpipe_cache_init(&(pipe->cache), entries, pipe->backbuf_size)) return 0;
   pipe->cache_obsolete = 0;
@@ -183,6 +184,7 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   dt_atomic_set_int(&pipe->shutdown,FALSE);
   pipe->opencl_error = 0;
   pipe->tiling = 0;
+  pipe->progressive = 0;
   pipe->mask_display = DT_DEV_PIXELPIPE_DISPLAY_NONE;
   pipe->bypass_blendif = 0;
   pipe->input_timestamp = 0;
@@ -253,6 +255,223 @@ void dt_dev_pixelpipe_cleanup(dt_dev_pixelpipe_t *pipe)
   }
 }
 
+static void _plan_free(dt_dev_pixelpipe_plan_t *plan)
+{
+  free(plan->modules);
+  free(plan->pieces);
+  free(plan->prev);
+  free(plan->fused);
+  free(plan->pointwise);
+  free(plan->basichash);
+  memset(plan, 0, sizeof(*plan));
+}
+
+// returns FALSE if out of memory. the plan is empty then, and the pipe runs without it.
+static gboolean _plan_build(dt_dev_pixelpipe_t *pipe)
+{
+  dt_dev_pixelpipe_plan_t *plan = &pipe->plan;
+  _plan_free(plan);
+  const int count = g_list_length(pipe->nodes);
+  plan->modules = (dt_iop_module_t **)calloc(count + 1, sizeof(dt_iop_module_t *));
+  plan->pieces = (dt_dev_pixelpipe_iop_t **)calloc(count + 1, sizeof(dt_dev_pixelpipe_iop_t *));
+  plan->prev = (int *)calloc(count + 1, sizeof(int));
+  plan->fused = (int *)calloc(count + 1, sizeof(int));
+  plan->pointwise = (int *)calloc(count + 1, sizeof(int));
+  plan->basichash = (uint64_t *)calloc(count + 1, sizeof(uint64_t));
+  if(!plan->modules || !plan->pieces || !plan->prev || !plan->fused || !plan->pointwise || !plan->basichash)
+  {
+    fprintf(stderr, "[pixelpipe] not able to allocate the plan of %d nodes, running without it\n", count);
+    _plan_free(plan);
+    return FALSE;
+  }
+  plan->count = count;
+  int k = 0;
+  for(GList *modules = pipe->iop, *pieces = pipe->nodes; modules && pieces;
+      modules = g_list_next(modules), pieces = g_list_next(pieces), k++)
+  {
+    plan->modules[k] = (dt_iop_module_t *)modules->data;
+    plan->pieces[k] = (dt_dev_pixelpipe_iop_t *)pieces->data;
+  }
+  return TRUE;
+}
+
+// is this node left out of the current run?
+static gboolean _plan_skip(const dt_develop_t *dev, const dt_iop_module_t *module,
+                           const dt_dev_pixelpipe_iop_t *piece)
+{
+  return !piece->enabled
+         || (dev->gui_module && dev->gui_module != module
+             && dev->gui_module->operation_tags_filter() & module->operation_tags());
+}
+
+// plan->prev[k], or the same looked up in the node list if there is no plan
+static int _plan_prev(const dt_dev_pixelpipe_t *pipe, const dt_develop_t *dev, int k)
+{
+  if(pipe->plan.prev) return pipe->plan.prev[k];
+  for(; k > 0; k--)
+    if(!_plan_skip(dev, g_list_nth_data(pipe->iop, k - 1), g_list_nth_data(pipe->nodes, k - 1))) break;
+  return k;
+}
+
+// can the work of this active node be left to a later one? only if nobody needs to see its output.
+static gboolean _rawfront_fusable(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece)
+{
+  if(!module->fuse_rawfront || !module->fuse_rawfront(module, piece, NULL, NULL)) return FALSE;
+  if(module->request_color_pick != DT_REQUEST_COLORPICK_OFF) return FALSE;
+  if(piece->request_histogram & DT_REQUEST_ON) return FALSE;
+  const dt_develop_blend_params_t *const bp = (dt_develop_blend_params_t *)piece->blendop_data;
+  if((module->flags() & IOP_FLAGS_SUPPORTS_BLENDING) && bp && bp->mask_mode != DEVELOP_MASK_DISABLED)
+    return FALSE;
+  return TRUE;
+}
+
+// leaves the point-wise raw modules right before the first module accepting them to that one,
+// which then does their work while reading its input. the buffer hashes are not affected, they
+// include all the modules anyway.
+static void _plan_fuse_rawfront(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
+{
+  dt_dev_pixelpipe_plan_t *plan = &pipe->plan;
+  memset(plan->fused, 0, sizeof(int) * (plan->count + 1));
+
+  // the fused operations are only done on the cpu
+  if(pipe->devid >= 0) return;
+
+  // a mask is only ever displayed by the focused module in the darkroom's main pipe. it turns the display on
+  // while processing, and the modules after it are bypassed then, so none of them may be left to another one.
+  const dt_iop_module_t *display = pipe == dev->pipe && dev->gui_attached ? dev->gui_module : NULL;
+
+  int first = 0; // first node of the run of fusable active nodes before k, 0 if none
+  for(int k = 1; k <= plan->count; k++)
+  {
+    if(plan->prev[k] != k) continue;
+    dt_iop_module_t *module = plan->modules[k - 1];
+    dt_dev_pixelpipe_iop_t *piece = plan->pieces[k - 1];
+
+    if(first && module->accept_rawfront && module->accept_rawfront(module, piece))
+    {
+      for(int j = first; j < k; j++) plan->fused[j] = plan->prev[j] == j;
+      break;
+    }
+    if(module == display) break;
+    if(!_rawfront_fusable(module, piece))
+      first = 0;
+    else if(!first)
+      first = k;
+  }
+
+  // the skipped nodes in between have to follow too
+  for(int k = 1; k <= plan->count; k++)
+    if(plan->fused[k] || plan->prev[k] != k) plan->prev[k] = plan->prev[k - 1];
+}
+
+// collects the work of the fused nodes right before pos into front, and updates dsc as if they
+// had been processed
+static void _plan_collect_rawfront(dt_dev_pixelpipe_t *pipe, const int pos, dt_iop_buffer_dsc_t *dsc,
+                                   dt_dev_pixelpipe_rawfront_t *front)
+{
+  const dt_dev_pixelpipe_plan_t *plan = &pipe->plan;
+  front->count = 0;
+  for(int c = 0; c < 4; c++)
+  {
+    front->coeffs[c] = 1.0f;
+    front->clip[c] = FLT_MAX;
+  }
+  if(!plan->fused) return;
+
+  for(int k = plan->prev[pos - 1] + 1; k < pos; k++)
+  {
+    if(!plan->fused[k]) continue;
+    dt_iop_module_t *module = plan->modules[k - 1];
+    if(module->fuse_rawfront(module, plan->pieces[k - 1], dsc, front))
+    {
+      front->count++;
+      dt_print(DT_DEBUG_PERF, "[dev_pixelpipe] `%s' fused into `%s' [%s]\n", module->op,
+               plan->modules[pos - 1]->op, _pipe_type_to_str(pipe->type));
+    }
+  }
+}
+
+// can this active node be run in one pass with its neighbours? only if it is point-wise and nobody needs
+// to see its input or output. the input of the focused module is kept, it is likely to be needed again soon.
+static gboolean _pointwise_fusable(dt_develop_t *dev, dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece)
+{
+  if(!(module->flags() & IOP_FLAGS_POINTWISE) || !piece->process_pointwise_ready) return FALSE;
+  if(module->default_colorspace(module, piece->pipe, piece) == iop_cs_RAW) return FALSE;
+  if(module == dev->gui_module) return FALSE;
+  if(module->request_color_pick != DT_REQUEST_COLORPICK_OFF) return FALSE;
+  if(piece->request_histogram & DT_REQUEST_ON) return FALSE;
+  const dt_develop_blend_params_t *const bp = (dt_develop_blend_params_t *)piece->blendop_data;
+  if((module->flags() & IOP_FLAGS_SUPPORTS_BLENDING) && bp && bp->mask_mode != DEVELOP_MASK_DISABLED)
+    return FALSE;
+  return TRUE;
+}
+
+// leaves each run of point-wise nodes to its last node, which processes all of them in strips of rows
+// small enough to stay in the cache, instead of each node streaming the full buffer through memory.
+// the buffer hashes are not affected, the outputs of the other nodes of the run are just never stored.
+static void _plan_fuse_pointwise(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
+{
+  dt_dev_pixelpipe_plan_t *plan = &pipe->plan;
+  memset(plan->pointwise, 0, sizeof(int) * (plan->count + 1));
+  for(int k = 0; k < plan->count; k++) plan->pieces[k]->pointwise_first = 0;
+
+  // only on the cpu, for the pipes which do not show intermediate results. masks are only displayed in the
+  // darkroom's main pipe, which is not one of them.
+  if(pipe->devid >= 0) return;
+  if(!(pipe->type & (DT_DEV_PIXELPIPE_EXPORT | DT_DEV_PIXELPIPE_THUMBNAIL | DT_DEV_PIXELPIPE_PREVIEW))) return;
+
+  int first = 0; // first and last node of the run of fusable active nodes before k, 0 if none
+  int last = 0;
+  for(int k = 1; k <= plan->count + 1; k++)
+  {
+    if(k <= plan->count && plan->prev[k] != k) continue;
+    if(k <= plan->count && _pointwise_fusable(dev, plan->modules[k - 1], plan->pieces[k - 1]))
+    {
+      if(!first) first = k;
+      last = k;
+      continue;
+    }
+    if(last > first)
+    {
+      for(int j = first; j < last; j++) plan->pointwise[j] = plan->prev[j] == j;
+      plan->pieces[last - 1]->pointwise_first = first;
+    }
+    first = last = 0;
+  }
+
+  for(int k = 1; k <= plan->count; k++)
+    if(plan->pointwise[k] || plan->prev[k] != k) plan->prev[k] = plan->prev[k - 1];
+}
+
+// per-run part of the plan: which nodes take part and the hashes up to each of them
+static void _plan_prepare(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
+{
+  dt_dev_pixelpipe_plan_t *plan = &pipe->plan;
+
+  // if a module is active, check if this module allow a fast pipe run
+  if(darktable.develop && dev->gui_module && dev->gui_module->flags() & IOP_FLAGS_ALLOW_FAST_PIPE)
+    pipe->type |= DT_DEV_PIXELPIPE_FAST;
+  else
+    pipe->type &= ~DT_DEV_PIXELPIPE_FAST;
+
+  if(!plan->prev && !_plan_build(pipe))
+  {
+    // nothing is fused without a plan
+    for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+      ((dt_dev_pixelpipe_iop_t *)nodes->data)->pointwise_first = 0;
+    return;
+  }
+
+  plan->prev[0] = 0;
+  for(int k = 1; k <= plan->count; k++)
+    plan->prev[k] = _plan_skip(dev, plan->modules[k - 1], plan->pieces[k - 1]) ? plan->prev[k - 1] : k;
+
+  _plan_fuse_rawfront(pipe, dev);
+  _plan_fuse_pointwise(pipe, dev);
+
+  dt_dev_pixelpipe_cache_basichashes(pipe->image.id, pipe, plan->basichash);
+}
+
 void dt_dev_pixelpipe_cleanup_nodes(dt_dev_pixelpipe_t *pipe)
 {
   dt_atomic_set_int(&pipe->shutdown,TRUE); // tell pipe that it should shut itself down if currently running
@@ -277,6 +496,7 @@ void dt_dev_pixelpipe_cleanup_nodes(dt_dev_pixelpipe_t *pipe)
   }
   g_list_free(pipe->nodes);
   pipe->nodes = NULL;
+  _plan_free(&pipe->plan);
   // also cleanup iop here
   if(pipe->iop)
   {
@@ -324,12 +544,14 @@ void dt_dev_pixelpipe_create_nodes(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
     piece->hash = 0;
     piece->process_cl_ready = 0;
     piece->process_tiling_ready = 0;
+    piece->process_pointwise_ready = 0;
     piece->raster_masks = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, dt_free_align_ptr);
     memset(&piece->processed_roi_in, 0, sizeof(piece->processed_roi_in));
     memset(&piece->processed_roi_out, 0, sizeof(piece->processed_roi_out));
     dt_iop_init_pipe(piece->module, pipe, piece);
     pipe->nodes = g_list_append(pipe->nodes, piece);
   }
+  _plan_build(pipe);
   dt_pthread_mutex_unlock(&pipe->busy_mutex); // safe for others to use/mess with the pipe now
 }
 
@@ -1080,6 +1302,113 @@ static void collect_histogram_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev
   return;
 }
 
+// about the size in bytes of the strips in which a run of point-wise modules is processed, so that the
+// intermediate results stay in the cache
+#define DT_PIXELPIPE_POINTWISE_STRIP_SIZE (1 << 20)
+
+// processes piece and the point-wise nodes before it which the plan left to it, one strip of rows after the
+// other. for each node this is what pixelpipe_process_on_CPU() does, without the pickers, histograms,
+// blending and tiling, which the plan has ruled out.
+static int _pixelpipe_process_pointwise_on_CPU(dt_dev_pixelpipe_t *pipe, float *input,
+                                               dt_iop_buffer_dsc_t *input_format, const dt_iop_roi_t *roi_in,
+                                               void **output, const dt_iop_roi_t *roi_out,
+                                               dt_dev_pixelpipe_iop_t *piece, dt_pixelpipe_flow_t *pixelpipe_flow)
+{
+  const dt_dev_pixelpipe_plan_t *plan = &pipe->plan;
+  const size_t row_size = (size_t)4 * roi_out->width;
+  // a multiple of 4 rows keeps the strips 64 byte aligned, and each thread should get some rows
+  const int rows = (MAX((int)dt_get_num_threads(),
+                        (int)(DT_PIXELPIPE_POINTWISE_STRIP_SIZE / (sizeof(float) * row_size))) + 3) & ~3;
+  const size_t strip_size = row_size * MIN(rows, roi_out->height);
+
+  dt_dev_pixelpipe_iop_t **nodes = malloc(sizeof(dt_dev_pixelpipe_iop_t *) * (plan->count + 1));
+  dt_iop_buffer_dsc_t *dsc = malloc(sizeof(dt_iop_buffer_dsc_t) * (plan->count + 1));
+  float *strip[2] = { dt_alloc_align_float(strip_size), dt_alloc_align_float(strip_size) };
+  if(nodes == NULL || dsc == NULL || strip[0] == NULL || strip[1] == NULL)
+  {
+    free(nodes);
+    free(dsc);
+    dt_free_align(strip[0]);
+    dt_free_align(strip[1]);
+    return 1;
+  }
+
+  int count = 0;
+  for(int k = piece->pointwise_first; k <= plan->count && plan->pieces[k - 1] != piece; k++)
+    if(plan->pointwise[k])
+    {
+      nodes[count++] = plan->pieces[k - 1];
+      dt_print(DT_DEBUG_PERF, "[dev_pixelpipe] `%s' run in one pass with `%s' [%s]\n", plan->modules[k - 1]->op,
+               piece->module->op, _pipe_type_to_str(pipe->type));
+    }
+  nodes[count++] = piece;
+
+  const dt_iop_order_iccprofile_info_t *const work_profile = dt_ioppr_get_pipe_work_profile_info(pipe);
+
+  // the input is transformed to the colorspace of the first module as a whole, as for any module
+  const dt_iop_buffer_dsc_t format_in = *input_format;
+  dt_iop_module_t *first = nodes[0]->module;
+  dt_ioppr_transform_image_colorspace(first, input, input, roi_in->width, roi_in->height, input_format->cst,
+                                      first->input_colorspace(first, pipe, nodes[0]), &input_format->cst,
+                                      work_profile);
+
+  int err = 0;
+  for(int y = 0; y < roi_out->height; y += rows)
+  {
+    if(dt_atomic_get_int(&pipe->shutdown))
+    {
+      err = 1;
+      break;
+    }
+
+    dt_iop_roi_t roi = *roi_out;
+    roi.y += y;
+    roi.height = MIN(rows, roi_out->height - y);
+
+    float *in = input + row_size * y;
+    dt_iop_buffer_dsc_t format = format_in;
+    for(int n = 0; n < count; n++)
+    {
+      dt_dev_pixelpipe_iop_t *p = nodes[n];
+      dt_iop_module_t *module = p->module;
+      float *out = (n == count - 1) ? (float *)*output + row_size * y : strip[n & 1];
+
+      if(y == 0)
+      {
+        // the buffer descriptions, as dt_dev_pixelpipe_process_rec() would set them up
+        p->dsc_in = format;
+        p->dsc_out = p->dsc_in;
+        module->output_format(module, pipe, p, &p->dsc_out);
+        p->processed_roi_in = p->processed_roi_out = *roi_out;
+        dsc[n] = p->dsc_out;
+      }
+
+      // start each strip from the same description, as process() may update it
+      pipe->dsc = dsc[n];
+      if(n > 0)
+        dt_ioppr_transform_image_colorspace(module, in, in, roi.width, roi.height, format.cst,
+                                            module->input_colorspace(module, pipe, p), &format.cst,
+                                            work_profile);
+
+      module->process(module, p, in, out, &roi, &roi);
+
+      pipe->dsc.cst = module->output_colorspace(module, pipe, p);
+      if(y == 0) p->dsc_out = pipe->dsc;
+      format = pipe->dsc;
+      in = out;
+    }
+  }
+
+  *pixelpipe_flow |= (PIXELPIPE_FLOW_PROCESSED_ON_CPU);
+  *pixelpipe_flow &= ~(PIXELPIPE_FLOW_PROCESSED_ON_GPU | PIXELPIPE_FLOW_PROCESSED_WITH_TILING);
+
+  free(nodes);
+  free(dsc);
+  dt_free_align(strip[0]);
+  dt_free_align(strip[1]);
+  return err;
+}
+
 static int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
                                     float *input, dt_iop_buffer_dsc_t *input_format, const dt_iop_roi_t *roi_in,
                                     void **output, dt_iop_buffer_dsc_t **out_format, const dt_iop_roi_t *roi_out,
@@ -1089,6 +1418,11 @@ static int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
   if(dt_atomic_get_int(&pipe->shutdown))
     return 1;
 
+  // a run of point-wise modules ending with this one is processed in one pass
+  if(piece->pointwise_first)
+    return _pixelpipe_process_pointwise_on_CPU(pipe, input, input_format, roi_in, output, roi_out, piece,
+                                               pixelpipe_flow);
+
   // Fetch RGB working profile
   // if input is RAW, we can't color convert because RAW is not in a color space
   // so we send NULL to by-pass
@@ -1196,7 +1530,7 @@ static int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
 // recursive helper for process:
 static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
                                         void **cl_mem_output, dt_iop_buffer_dsc_t **out_format,
-                                        const dt_iop_roi_t *roi_out, GList *modules, GList *pieces, int pos)
+                                        const dt_iop_roi_t *roi_out, int pos)
 {
   if (dt_atomic_get_int(&pipe->shutdown))
     return 1;
@@ -1210,23 +1544,16 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
   dt_iop_module_t *module = NULL;
   dt_dev_pixelpipe_iop_t *piece = NULL;
 
-  // if a module is active, check if this module allow a fast pipe run
-
-  if(darktable.develop && dev->gui_module && dev->gui_module->flags() & IOP_FLAGS_ALLOW_FAST_PIPE)
-    pipe->type |= DT_DEV_PIXELPIPE_FAST;
-  else
-    pipe->type &= ~DT_DEV_PIXELPIPE_FAST;
-
-  if(modules)
+  // _plan_prev() has already skipped disabled modules, pos is 0 or an active one
+  if(pos > 0 && pipe->plan.modules)
   {
-    module = (dt_iop_module_t *)modules->data;
-    piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
-    // skip this module?
-    if(!piece->enabled
-       || (dev->gui_module && dev->gui_module != module
-           && dev->gui_module->operation_tags_filter() & module->operation_tags()))
-      return dt_dev_pixelpipe_process_rec(pipe, dev, output, cl_mem_output, out_format, &roi_in,
-                                          g_list_previous(modules), g_list_previous(pieces), pos - 1);
+    module = pipe->plan.modules[pos - 1];
+    piece = pipe->plan.pieces[pos - 1];
+  }
+  else if(pos > 0)
+  {
+    module = (dt_iop_module_t *)g_list_nth_data(pipe->iop, pos - 1);
+    piece = (dt_dev_pixelpipe_iop_t *)g_list_nth_data(pipe->nodes, pos - 1);
   }
 
   if(module) g_strlcpy(module_name, module->op, MIN(sizeof(module_name), sizeof(module->op)));
@@ -1247,7 +1574,9 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
      || module == NULL
      || strcmp(module->op, "gamma") != 0)
   {
-    dt_dev_pixelpipe_cache_fullhash(pipe->image.id, roi_out, pipe, pos, &basichash, &hash);
+    basichash = pipe->plan.basichash ? pipe->plan.basichash[pos]
+                                     : dt_dev_pixelpipe_cache_basichash(pipe->image.id, pipe, pos);
+    hash = dt_dev_pixelpipe_cache_roihash(basichash, roi_out);
     cache_available = dt_dev_pixelpipe_cache_available(&(pipe->cache), hash);
   }
   if(cache_available)
@@ -1258,7 +1587,7 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
 
     (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), basichash, hash, bufsize, output, out_format);
 
-    if(!modules) return 0;
+    if(!module) return 0;
     // go to post-collect directly:
     goto post_process_collect_info;
   }
@@ -1274,7 +1603,7 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
 
 
   // 3) input -> output
-  if(!modules)
+  if(!module)
   {
     // 3a) import input array with given scale and roi
     if(dt_atomic_get_int(&pipe->shutdown))
@@ -1349,18 +1678,18 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     dt_iop_buffer_dsc_t _input_format = { 0 };
     dt_iop_buffer_dsc_t *input_format = &_input_format;
 
-    piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
-
     piece->processed_roi_in = roi_in;
     piece->processed_roi_out = *roi_out;
 
     if(dt_dev_pixelpipe_process_rec(pipe, dev, &input, &cl_mem_input, &input_format, &roi_in,
-                                    g_list_previous(modules), g_list_previous(pieces), pos - 1))
+                                    _plan_prev(pipe, dev, pos - 1)))
       return 1;
 
     const size_t in_bpp = dt_iop_buffer_dsc_to_bpp(input_format);
 
-    piece->dsc_out = piece->dsc_in = *input_format;
+    piece->dsc_in = *input_format;
+    _plan_collect_rawfront(pipe, pos, &piece->dsc_in, &piece->rawfront);
+    piece->dsc_out = piece->dsc_in;
 
     module->output_format(module, pipe, piece, &piece->dsc_out);
 
@@ -2277,11 +2606,13 @@ void dt_dev_pixelpipe_disable_before(dt_dev_pixelpipe_t *pipe, const char *op)
 
 static int dt_dev_pixelpipe_process_rec_and_backcopy(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
                                                      void **cl_mem_output, dt_iop_buffer_dsc_t **out_format,
-                                                     const dt_iop_roi_t *roi_out, GList *modules, GList *pieces,
-                                                     int pos)
+                                                     const dt_iop_roi_t *roi_out)
 {
   dt_pthread_mutex_lock(&pipe->busy_mutex);
-  int ret = dt_dev_pixelpipe_process_rec(pipe, dev, output, cl_mem_output, out_format, roi_out, modules, pieces, pos);
+  // nodes might have been recreated since the last run, so do this while we hold the pipe
+  _plan_prepare(pipe, dev);
+  int ret = dt_dev_pixelpipe_process_rec(pipe, dev, output, cl_mem_output, out_format, roi_out,
+                                         _plan_prev(pipe, dev, g_list_length(pipe->nodes)));
 #ifdef HAVE_OPENCL
   // copy back final opencl buffer (if any) to CPU
   if(ret)
@@ -2344,11 +2675,6 @@ int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x,
   if(pipe->forms) g_list_free_full(pipe->forms, (void (*)(void *))dt_masks_free_form);
   pipe->forms = dt_masks_dup_forms_deep(dev->forms, NULL);
 
-  //  go through list of modules from the end:
-  const guint pos = g_list_length(pipe->iop);
-  GList *modules = g_list_last(pipe->iop);
-  GList *pieces = g_list_last(pipe->nodes);
-
 // re-entry point: in case of late opencl errors we start all over again with opencl-support disabled
 restart:
 
@@ -2369,8 +2695,7 @@ restart:
 
   // run pixelpipe recursively and get error status
   const int err =
-    dt_dev_pixelpipe_process_rec_and_backcopy(pipe, dev, &buf, &cl_mem_out, &out_format, &roi, modules,
-                                              pieces, pos);
+    dt_dev_pixelpipe_process_rec_and_backcopy(pipe, dev, &buf, &cl_mem_out, &out_format, &roi);
 
   // get status summary of opencl queue by checking the eventlist
   const int oclerr = (pipe->devid >= 0) ? (dt_opencl_events_flush(pipe->devid, 1) != 0) : 0;
@@ -2435,9 +2760,10 @@ restart:
   pipe->backbuf_width = width;
   pipe->backbuf_height = height;
 
-  if((pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW
-     || (pipe->type & DT_DEV_PIXELPIPE_FULL) == DT_DEV_PIXELPIPE_FULL
-     || (pipe->type & DT_DEV_PIXELPIPE_PREVIEW2) == DT_DEV_PIXELPIPE_PREVIEW2)
+  if(!pipe->progressive
+     && ((pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW
+         || (pipe->type & DT_DEV_PIXELPIPE_FULL) == DT_DEV_PIXELPIPE_FULL
+         || (pipe->type & DT_DEV_PIXELPIPE_PREVIEW2) == DT_DEV_PIXELPIPE_PREVIEW2))
   {
     if(pipe->output_backbuf == NULL || pipe->output_backbuf_width != pipe->backbuf_width || pipe->output_backbuf_height != pipe->backbuf_height)
     {
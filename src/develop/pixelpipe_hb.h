@@ -42,6 +42,19 @@ typedef struct dt_dev_pixelpipe_raster_mask_t
   float *mask;
 } dt_dev_pixelpipe_raster_mask_t;
 
+/**
+ * point-wise operations on the raw mosaic which are left to a later module, so that it can do
+ * them while reading its input instead of every module streaming the full buffer through
+ * memory. per CFA color, the input is multiplied by coeffs and then clipped to clip.
+ * see fuse_rawfront() and accept_rawfront() in iop_api.h.
+ */
+typedef struct dt_dev_pixelpipe_rawfront_t
+{
+  int count; // number of fused modules, nothing to do if 0
+  float coeffs[4];
+  float clip[4];
+} dt_dev_pixelpipe_rawfront_t;
+
 typedef struct dt_dev_pixelpipe_iop_t
 {
   struct dt_iop_module_t *module;  // the module in the dev operation stack
@@ -66,11 +79,15 @@ typedef struct dt_dev_pixelpipe_iop_t
   dt_iop_roi_t processed_roi_in, processed_roi_out; // the actual roi that was used for processing the piece
   int process_cl_ready;       // set this to 0 in commit_params to temporarily disable the use of process_cl
   int process_tiling_ready;   // set this to 0 in commit_params to temporarily disable tiling
+  int process_pointwise_ready; // set this to 0 in commit_params to temporarily keep a point-wise module on its own
 
   // the following are used internally for caching:
   dt_iop_buffer_dsc_t dsc_in, dsc_out;
 
   GHashTable *raster_masks; // GList* of dt_dev_pixelpipe_raster_mask_t
+
+  dt_dev_pixelpipe_rawfront_t rawfront; // work of the fused modules before this one, for this run
+  int pointwise_first; // first node of the point-wise modules run in one pass with this one, 0 if none, for this run
 } dt_dev_pixelpipe_iop_t;
 
 typedef enum dt_dev_pixelpipe_change_t
@@ -83,6 +100,22 @@ typedef enum dt_dev_pixelpipe_change_t
   DT_DEV_PIPE_ZOOMED = 1 << 3 // zoom event, preview pipe does not need changes
 } dt_dev_pixelpipe_change_t;
 
+/**
+ * flat view of the nodes, so that a run does not have to walk the lists. the arrays are
+ * rebuilt whenever the nodes are (re)created, the per-run part is filled in when processing
+ * starts, as enabled states, the focused module and color pickers may change in between.
+ */
+typedef struct dt_dev_pixelpipe_plan_t
+{
+  int count;                              // number of nodes
+  struct dt_iop_module_t **modules;       // modules[k] and pieces[k] are the k-th node
+  struct dt_dev_pixelpipe_iop_t **pieces;
+  int *prev;                              // prev[k]: largest j <= k with j == 0 or node j-1 active in this run
+  int *fused;                             // fused[k]: node k-1 is done by the next active node in this run
+  int *pointwise;                         // pointwise[k]: node k-1 is run in one pass with the next active node
+  uint64_t *basichash;                    // basichash[k]: hash of the first k nodes in this run
+} dt_dev_pixelpipe_plan_t;
+
 /**
  * this encapsulates the pixelpipe.
  * a develop module will need several of these:
@@ -117,6 +150,8 @@ typedef struct dt_dev_pixelpipe_t
 
   // instances of pixelpipe, stored in GList of dt_dev_pixelpipe_iop_t
   GList *nodes;
+  // flat arrays of the above, see dt_dev_pixelpipe_plan_t
+  dt_dev_pixelpipe_plan_t plan;
   // event flag
   dt_dev_pixelpipe_change_t changed;
   // backbuffer (output)
@@ -148,6 +183,8 @@ typedef struct dt_dev_pixelpipe_t
   int opencl_error;
   // running in a tiling context?
   int tiling;
+  // is the output composed from several runs by the caller? then output_backbuf is left alone
+  int progressive;
   // should this pixelpipe display a mask in the end?
   int mask_display;
   // should this pixelpipe completely suppressed the blendif module?
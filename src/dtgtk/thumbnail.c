@@ -142,18 +142,19 @@ static void _image_get_infos(dt_thumbnail_t *thumb)
   // we only get here infos that might change, others(exif, ...) are cached on widget creation
 
   thumb->rating = 0;
-  const dt_image_t *img = dt_image_cache_get(darktable.image_cache, thumb->imgid, 'r');
-  if(img)
+  // this runs for every visible thumbnail on each redraw, use the lock-free copy
+  dt_image_snapshot_t img;
+  if(dt_image_cache_get_snapshot(darktable.image_cache, thumb->imgid, &img))
   {
-    thumb->has_localcopy = (img->flags & DT_IMAGE_LOCAL_COPY);
-    thumb->rating = img->flags & DT_IMAGE_REJECTED ? DT_VIEW_REJECT : (img->flags & DT_VIEW_RATINGS_MASK);
-    thumb->is_bw = dt_image_monochrome_flags(img);
-    thumb->is_bw_flow = dt_image_use_monochrome_workflow(img);
-    thumb->is_hdr = dt_image_is_hdr(img);
-
-    thumb->groupid = img->group_id;
-
-    dt_image_cache_read_release(darktable.image_cache, img);
+    thumb->has_localcopy = (img.flags & DT_IMAGE_LOCAL_COPY);
+    thumb->rating = img.flags & DT_IMAGE_REJECTED ? DT_VIEW_REJECT : (img.flags & DT_VIEW_RATINGS_MASK);
+    // same as dt_image_monochrome_flags() and dt_image_use_monochrome_workflow()
+    thumb->is_bw = img.flags & (DT_IMAGE_MONOCHROME | DT_IMAGE_MONOCHROME_PREVIEW | DT_IMAGE_MONOCHROME_BAYER);
+    thumb->is_bw_flow = (img.flags & (DT_IMAGE_MONOCHROME | DT_IMAGE_MONOCHROME_BAYER))
+                        || ((img.flags & DT_IMAGE_MONOCHROME_PREVIEW) && (img.flags & DT_IMAGE_MONOCHROME_WORKFLOW));
+    thumb->is_hdr = img.is_hdr;
+
+    thumb->groupid = img.group_id;
   }
 
   // colorlabels
@@ -345,12 +346,8 @@ static void _get_dimensions_for_img_to_fit(dt_thumbnail_t *thumb, int max_width,
   if(ar < 0.001)
   {
     // let's try with the aspect_ratio store in image structure, even if it's less accurate
-    const dt_image_t *img = dt_image_cache_get(darktable.image_cache, thumb->imgid, 'r');
-    if(img)
-    {
-      ar = img->aspect_ratio;
-      dt_image_cache_read_release(darktable.image_cache, img);
-    }
+    dt_image_snapshot_t img;
+    if(dt_image_cache_get_snapshot(darktable.image_cache, thumb->imgid, &img)) ar = img.aspect_ratio;
   }
 
   if(ar > 0.001)
@@ -380,15 +377,12 @@ static void _get_dimensions_for_zoomed_img(dt_thumbnail_t *thumb, int max_width,
   // calling dt_thumbnail_get_zoom100 is used to get the max zoom, but also to ensure that final_width and
   // height are available.
   const float zoom_100 = dt_thumbnail_get_zoom100(thumb);
-  const dt_image_t *img = dt_image_cache_get(darktable.image_cache, thumb->imgid, 'r');
-  if(img)
+  dt_image_snapshot_t img;
+  if(dt_image_cache_get_snapshot(darktable.image_cache, thumb->imgid, &img)
+     && img.final_width > 0 && img.final_height > 0)
   {
-    if(img->final_width > 0 && img->final_height > 0)
-    {
-      iw = img->final_width;
-      ih = img->final_height;
-    }
-    dt_image_cache_read_release(darktable.image_cache, img);
+    iw = img.final_width;
+    ih = img.final_height;
   }
 
   // scale first to "img to fit", then apply the zoom ratio to get the resulting final (zoomed) image
@@ -214,35 +214,71 @@ static dt_thumbnail_t *_thumb_get_under_mouse(dt_thumbtable_t *table)
   return _thumb_get_at_pos(table, x, y);
 }
 
-// get imgid from rowid
-static int _thumb_get_imgid(int rowid)
+// in-memory copy of memory.collected_images, so scrolling doesn't need a sql query per thumbnail.
+// it is only used from the gui thread and refreshed whenever the memory table has been refilled.
+static struct
 {
-  int id = -1;
+  int *imgids;         // imgid of each rowid, at index rowid - 1
+  int count;           // highest rowid
+  GHashTable *rowids;  // imgid -> rowid
+  int generation;      // dt_collection_memory_generation() of this copy
+} _collected = { NULL, 0, NULL, -1 };
+
+static void _collected_update()
+{
+  const int generation = dt_collection_memory_generation();
+  if(_collected.imgids && generation == _collected.generation) return;
+
   sqlite3_stmt *stmt;
-  gchar *query = dt_util_dstrcat(NULL, "SELECT imgid FROM memory.collected_images WHERE rowid=%d", rowid);
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
+  int count = 0;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT MAX(rowid) FROM memory.collected_images",
+                              -1, &stmt, NULL);
+  if(sqlite3_step(stmt) == SQLITE_ROW) count = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
+
+  g_free(_collected.imgids);
+  _collected.imgids = g_malloc_n(MAX(count, 1), sizeof(int));
+  _collected.count = count;
+  for(int k = 0; k < count; k++) _collected.imgids[k] = -1;
+  if(_collected.rowids)
+    g_hash_table_remove_all(_collected.rowids);
+  else
+    _collected.rowids = g_hash_table_new(NULL, NULL);
+
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT rowid, imgid FROM memory.collected_images ORDER BY rowid", -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
   {
-    id = sqlite3_column_int(stmt, 0);
+    const int rowid = sqlite3_column_int(stmt, 0);
+    const int imgid = sqlite3_column_int(stmt, 1);
+    if(rowid < 1 || rowid > count) continue;
+    _collected.imgids[rowid - 1] = imgid;
+    g_hash_table_insert(_collected.rowids, GINT_TO_POINTER(imgid), GINT_TO_POINTER(rowid));
   }
-  g_free(query);
   sqlite3_finalize(stmt);
-  return id;
+  _collected.generation = generation;
+}
+
+// get imgid from rowid
+static int _thumb_get_imgid(int rowid)
+{
+  _collected_update();
+  if(rowid < 1 || rowid > _collected.count) return -1;
+  return _collected.imgids[rowid - 1];
 }
 // get rowid from imgid
 static int _thumb_get_rowid(int imgid)
 {
-  int id = -1;
-  sqlite3_stmt *stmt;
-  gchar *query = dt_util_dstrcat(NULL, "SELECT rowid FROM memory.collected_images WHERE imgid=%d", imgid);
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
-  {
-    id = sqlite3_column_int(stmt, 0);
-  }
-  g_free(query);
-  sqlite3_finalize(stmt);
-  return id;
+  _collected_update();
+  gpointer rowid = NULL;
+  if(!g_hash_table_lookup_extended(_collected.rowids, GINT_TO_POINTER(imgid), NULL, &rowid)) return -1;
+  return GPOINTER_TO_INT(rowid);
+}
+// number of rowids in the collection
+static int _thumb_get_count()
+{
+  _collected_update();
+  return _collected.count;
 }
 
 // get the coordinate of the rectangular area used by all the loaded thumbs
@@ -502,7 +538,6 @@ static int _thumbs_remove_unneeded(dt_thumbtable_t *table)
 static int _thumbs_load_needed(dt_thumbtable_t *table)
 {
   if(!table->list) return 0;
-  sqlite3_stmt *stmt;
   int changed = 0;
 
   // we remember image margins for new thumbs (this limit flickering)
@@ -521,24 +556,20 @@ static int _thumbs_load_needed(dt_thumbtable_t *table)
     int space = first->y;
     if(table->mode == DT_THUMBTABLE_MODE_FILMSTRIP) space = first->x;
     const int nb_to_load = space / table->thumb_size + (space % table->thumb_size != 0);
-    gchar *query = dt_util_dstrcat
-      (NULL,
-       "SELECT rowid, imgid"
-       " FROM memory.collected_images"
-       " WHERE rowid<%d"
-       " ORDER BY rowid DESC LIMIT %d",
-        first->rowid, nb_to_load * table->thumbs_per_row);
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
     int posx = first->x;
     int posy = first->y;
     _pos_get_previous(table, &posx, &posy);
-    while(sqlite3_step(stmt) == SQLITE_ROW)
+    int loaded = 0;
+    for(int rowid = first->rowid - 1; rowid >= 1 && loaded < nb_to_load * table->thumbs_per_row; rowid--)
     {
+      const int imgid = _thumb_get_imgid(rowid);
+      if(imgid <= 0) continue;
+      loaded++;
       if(posy < table->view_height) // we don't load invisible thumbs
       {
         dt_thumbnail_t *thumb = dt_thumbnail_new(
-            table->thumb_size, table->thumb_size, IMG_TO_FIT, sqlite3_column_int(stmt, 1),
-            sqlite3_column_int(stmt, 0), table->overlays,
+            table->thumb_size, table->thumb_size, IMG_TO_FIT, imgid,
+            rowid, table->overlays,
             DT_THUMBNAIL_CONTAINER_LIGHTTABLE, table->show_tooltips);
 
         if(table->mode == DT_THUMBTABLE_MODE_FILMSTRIP)
@@ -556,8 +587,6 @@ static int _thumbs_load_needed(dt_thumbtable_t *table)
       }
       _pos_get_previous(table, &posx, &posy);
     }
-    g_free(query);
-    sqlite3_finalize(stmt);
   }
 
   // we load images at the end
@@ -576,26 +605,23 @@ static int _thumbs_load_needed(dt_thumbtable_t *table)
     if(table->mode == DT_THUMBTABLE_MODE_FILMSTRIP)
       space = table->view_width - (last->x + table->thumb_size);
     const int nb_to_load = space / table->thumb_size + (space % table->thumb_size != 0);
-    gchar *query = dt_util_dstrcat
-      (NULL,
-       "SELECT rowid, imgid"
-       " FROM memory.collected_images"
-       " WHERE rowid>%d"
-       " ORDER BY rowid LIMIT %d",
-        last->rowid, nb_to_load * table->thumbs_per_row);
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+    const int count = _thumb_get_count();
 
     int posx = last->x;
     int posy = last->y;
     _pos_get_next(table, &posx, &posy);
 
-    while(sqlite3_step(stmt) == SQLITE_ROW)
+    int loaded = 0;
+    for(int rowid = last->rowid + 1; rowid <= count && loaded < nb_to_load * table->thumbs_per_row; rowid++)
     {
+      const int imgid = _thumb_get_imgid(rowid);
+      if(imgid <= 0) continue;
+      loaded++;
       if(posy + table->thumb_size >= 0) // we don't load invisible thumbs
       {
         dt_thumbnail_t *thumb = dt_thumbnail_new
-          (table->thumb_size, table->thumb_size, IMG_TO_FIT, sqlite3_column_int(stmt, 1),
-           sqlite3_column_int(stmt, 0), table->overlays,
+          (table->thumb_size, table->thumb_size, IMG_TO_FIT, imgid,
+           rowid, table->overlays,
            DT_THUMBNAIL_CONTAINER_LIGHTTABLE, table->show_tooltips);
         if(table->mode == DT_THUMBTABLE_MODE_FILMSTRIP)
         {
@@ -612,13 +638,130 @@ static int _thumbs_load_needed(dt_thumbtable_t *table)
       }
       _pos_get_next(table, &posx, &posy);
     }
-    g_free(query);
-    sqlite3_finalize(stmt);
   }
 
   return changed;
 }
 
+// how far ahead of the scrolling we prefetch, in seconds at the current speed
+#define DT_THUMBTABLE_PREFETCH_HORIZON 1.0
+// and the bounds of that range, in screens
+#define DT_THUMBTABLE_PREFETCH_MIN_SCREENS 1
+#define DT_THUMBTABLE_PREFETCH_MAX_SCREENS 3
+
+typedef struct dt_thumbtable_prefetch_t
+{
+  dt_thumbtable_t *table;
+  int generation;
+  dt_mipmap_size_t mip;
+  int count;
+  int *imgids; // nearest first
+} dt_thumbtable_prefetch_t;
+
+static void _thumbs_prefetch_free(void *data)
+{
+  dt_thumbtable_prefetch_t *params = (dt_thumbtable_prefetch_t *)data;
+  g_free(params->imgids);
+  free(params);
+}
+
+static int32_t _thumbs_prefetch_job_run(dt_job_t *job)
+{
+  dt_thumbtable_prefetch_t *params = dt_control_job_get_params(job);
+  int done = 0;
+  for(; done < params->count; done++)
+  {
+    // the user has changed direction or the collection has changed, leave the worker to more useful things
+    if(g_atomic_int_get(&params->table->prefetch_generation) != params->generation) break;
+
+    dt_mipmap_buffer_t buf;
+    dt_mipmap_cache_get(darktable.mipmap_cache, &buf, params->imgids[done], params->mip, DT_MIPMAP_BLOCKING, 'r');
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  }
+  dt_print(DT_DEBUG_LIGHTTABLE, "[thumbtable] prefetched %d of %d thumbnails%s\n", done, params->count,
+           done < params->count ? ", cancelled" : "");
+  return 0;
+}
+
+// drop the prefetch in flight, if any
+static void _thumbs_prefetch_cancel(dt_thumbtable_t *table)
+{
+  g_atomic_int_inc(&table->prefetch_generation);
+  table->prefetch_from = table->prefetch_to = 0;
+  table->scroll_speed = 0.0f;
+}
+
+// track the scrolling speed and load the thumbnails of the next screens in the scrolling direction
+// in the background, so they are in the mipmap cache by the time they become visible.
+static void _thumbs_prefetch(dt_thumbtable_t *table, const int dx, const int dy)
+{
+  if(!table->list || table->thumb_size <= 0) return;
+  // the zoomable table moves in both directions and shows few, big thumbnails
+  if(table->mode == DT_THUMBTABLE_MODE_ZOOM) return;
+
+  // the move in rows, > 0 when going towards the end of the collection
+  const int delta = (table->mode == DT_THUMBTABLE_MODE_FILMSTRIP) ? dx : dy;
+  if(delta == 0) return;
+  const float rows = -(float)delta / table->thumb_size;
+
+  const double now = dt_get_wtime();
+  const double elapsed = now - table->scroll_time;
+  table->scroll_time = now;
+  const float speed = rows / MAX(elapsed, 0.001);
+  // after a pause, or when the direction changes, start over from the current move
+  if(elapsed > 0.5 || speed * table->scroll_speed < 0.0f)
+    table->scroll_speed = speed;
+  else
+    table->scroll_speed = 0.7f * table->scroll_speed + 0.3f * speed;
+
+  const gboolean forward = table->scroll_speed > 0.0f;
+  const int screen = MAX(1, table->rows);
+  const int ahead = CLAMP((int)(fabsf(table->scroll_speed) * DT_THUMBTABLE_PREFETCH_HORIZON),
+                          DT_THUMBTABLE_PREFETCH_MIN_SCREENS * screen, DT_THUMBTABLE_PREFETCH_MAX_SCREENS * screen)
+                    * table->thumbs_per_row;
+
+  const dt_thumbnail_t *first = (dt_thumbnail_t *)table->list->data;
+  const dt_thumbnail_t *last = (dt_thumbnail_t *)g_list_last(table->list)->data;
+  const int count = _thumb_get_count();
+  const int from = forward ? last->rowid + 1 : MAX(1, first->rowid - ahead);
+  const int to = forward ? MIN(count, last->rowid + ahead) : first->rowid - 1;
+  if(from > to) return;
+
+  // the last request still covers at least half of what we need
+  const int half = (to - from) / 2;
+  if(table->prefetch_from > 0
+     && (forward ? (table->prefetch_from <= from && table->prefetch_to >= from + half)
+                 : (table->prefetch_to >= to && table->prefetch_from <= to - half)))
+    return;
+
+  // supersede the previous request, the thumbnails it has already loaded stay in the cache
+  const int generation = g_atomic_int_add(&table->prefetch_generation, 1) + 1;
+  table->prefetch_from = from;
+  table->prefetch_to = to;
+
+  dt_thumbtable_prefetch_t *params = (dt_thumbtable_prefetch_t *)calloc(1, sizeof(dt_thumbtable_prefetch_t));
+  if(!params) return;
+  params->table = table;
+  params->generation = generation;
+  params->mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, table->thumb_size * darktable.gui->ppd,
+                                                  table->thumb_size * darktable.gui->ppd);
+  params->imgids = g_malloc_n(to - from + 1, sizeof(int));
+  for(int k = 0; k <= to - from; k++)
+  {
+    const int imgid = _thumb_get_imgid(forward ? from + k : to - k);
+    if(imgid > 0) params->imgids[params->count++] = imgid;
+  }
+
+  dt_job_t *job = dt_control_job_create(&_thumbs_prefetch_job_run, "prefetch thumbnails");
+  if(!job)
+  {
+    _thumbs_prefetch_free(params);
+    return;
+  }
+  dt_control_job_set_params(job, params, _thumbs_prefetch_free);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, job);
+}
+
 // move all thumbs from the table.
 // if clamp, we verify that the move is allowed (collection bounds, etc...)
 static gboolean _move(dt_thumbtable_t *table, const int x, const int y, gboolean clamp)
@@ -658,13 +801,7 @@ static gboolean _move(dt_thumbtable_t *table, const int x, const int y, gboolean
       if(table->thumbs_per_row == 1 && posy < 0 && g_list_is_singleton(table->list))
       {
         // special case for zoom == 1 as we don't want any space under last image (the image would have disappear)
-        int nbid = 1;
-        sqlite3_stmt *stmt;
-        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT COUNT(*) FROM memory.collected_images",
-                                    -1, &stmt, NULL);
-        if(sqlite3_step(stmt) == SQLITE_ROW) nbid = sqlite3_column_int(stmt, 0);
-        sqlite3_finalize(stmt);
-        if(nbid <= last->rowid) return FALSE;
+        if(_thumb_get_count() <= last->rowid) return FALSE;
       }
       else
       {
@@ -723,6 +860,9 @@ static gboolean _move(dt_thumbtable_t *table, const int x, const int y, gboolean
   // if there has been changed, we recompute thumbs area
   if(changed > 0) _pos_compute_area(table);
 
+  // and we get the next thumbnails ready
+  _thumbs_prefetch(table, posx, posy);
+
   // we update the offset
   if(table->mode == DT_THUMBTABLE_MODE_FILEMANAGER)
   {
@@ -1377,6 +1517,8 @@ static void _dt_collection_changed_callback(gpointer instance, dt_collection_cha
 {
   if(!user_data) return;
   dt_thumbtable_t *table = (dt_thumbtable_t *)user_data;
+  // whatever was about to be scrolled in may not be part of the collection anymore
+  _thumbs_prefetch_cancel(table);
   if(query_change == DT_COLLECTION_CHANGE_RELOAD)
   {
     int old_hover = dt_control_get_mouse_over_id();
@@ -2208,15 +2350,7 @@ static gboolean _accel_paste(GtkAccelGroup *accel_group, GObject *acceleratable,
 {
   GList *imgs = g_list_copy((GList *)dt_view_get_images_to_act_on(TRUE, TRUE, FALSE));
 
-  dt_dev_undo_start_record(darktable.develop);
-
-  const gboolean ret = dt_history_paste_on_list(imgs, TRUE);
-  if(ret)
-    dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_RELOAD, DT_COLLECTION_PROP_UNDEF, imgs);
-  else
-    g_list_free(imgs);
-
-  dt_dev_undo_end_record(darktable.develop);
+  dt_control_paste_history(imgs);
 
   return TRUE;
 }
@@ -2225,15 +2359,7 @@ static gboolean _accel_paste_parts(GtkAccelGroup *accel_group, GObject *accelera
 {
   GList *imgs = g_list_copy((GList *)dt_view_get_images_to_act_on(TRUE, TRUE, FALSE));
 
-  dt_dev_undo_start_record(darktable.develop);
-
-  const gboolean ret = dt_history_paste_parts_on_list(imgs, TRUE);
-  if(ret)
-    dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_RELOAD, DT_COLLECTION_PROP_UNDEF, imgs);
-  else
-    g_list_free(imgs);
-
-  dt_dev_undo_end_record(darktable.develop);
+  dt_control_paste_parts_history(imgs);
   return TRUE;
 }
 static gboolean _accel_hist_discard(GtkAccelGroup *accel_group, GObject *acceleratable, const guint keyval,
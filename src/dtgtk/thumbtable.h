@@ -103,6 +103,12 @@ typedef struct dt_thumbtable_t
   // let's remember previous thumbnail generation settings to detect if they change
   int pref_embedded;
   int pref_hq;
+
+  // predictive loading of the thumbnails which are about to be scrolled in
+  double scroll_time;             // time of the last move
+  float scroll_speed;             // smoothed scroll speed in rows per second, > 0 towards the end
+  int prefetch_from, prefetch_to; // rowids of the last prefetched range
+  int prefetch_generation;        // bumped to cancel a pending prefetch
 } dt_thumbtable_t;
 
 dt_thumbtable_t *dt_thumbtable_new();
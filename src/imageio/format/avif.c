@@ -202,29 +202,30 @@ void cleanup(dt_imageio_module_format_t *self)
 {
 }
 
-int write_image(struct dt_imageio_module_data_t *data,
-                const char *filename,
-                const void *in,
-                dt_colorspaces_color_profile_type_t over_type,
-                const char *over_filename,
-                void *exif,
-                int exif_len,
-                int imgid,
-                int num,
-                int total,
-                struct dt_dev_pixelpipe_t *pipe,
-                const gboolean export_masks)
+typedef struct dt_imageio_avif_writer_t
+{
+  avifImage *image;
+  const char *filename;
+} dt_imageio_avif_writer_t;
+
+void *write_rows_begin(struct dt_imageio_module_data_t *data,
+                       const char *filename,
+                       dt_colorspaces_color_profile_type_t over_type,
+                       const char *over_filename,
+                       void *exif,
+                       int exif_len,
+                       int imgid,
+                       int num,
+                       int total,
+                       struct dt_dev_pixelpipe_t *pipe,
+                       const gboolean export_masks)
 {
   dt_imageio_avif_t *d = (dt_imageio_avif_t *)data;
 
   avifPixelFormat format = AVIF_PIXEL_FORMAT_NONE;
   avifImage *image = NULL;
-  avifRGBImage rgb = { .format = AVIF_RGB_FORMAT_RGB, };
-  avifEncoder *encoder = NULL;
   uint8_t *icc_profile_data = NULL;
   uint32_t icc_profile_len;
-  avifResult result;
-  int rc;
 
   const size_t width = d->global.width;
   const size_t height = d->global.height;
@@ -267,8 +268,7 @@ int write_image(struct dt_imageio_module_data_t *data,
     dt_print(DT_DEBUG_IMAGEIO,
              "Failed to create AVIF image for writing [%s]\n",
              filename);
-    rc = 1;
-    goto out;
+    goto error;
   }
 
   dt_print(DT_DEBUG_IMAGEIO,
@@ -359,8 +359,7 @@ int write_image(struct dt_imageio_module_data_t *data,
         icc_profile_data = malloc(sizeof(uint8_t) * icc_profile_len);
         if(icc_profile_data == NULL)
         {
-          rc = 1;
-          goto out;
+          goto error;
         }
         cmsSaveProfileToMem(out_profile, icc_profile_data, &icc_profile_len);
         avifImageSetProfileICC(image,
@@ -386,7 +385,73 @@ int write_image(struct dt_imageio_module_data_t *data,
    */
   image->yuvRange = AVIF_RANGE_FULL;
 
-  avifRGBImageSetDefaults(&rgb, image);
+  switch(bit_depth)
+  {
+    case 12:
+    case 10:
+    case 8:
+      break;
+    default:
+      dt_control_log(_("invalid AVIF bit depth!"));
+      goto error;
+  }
+
+  avifImageSetMetadataExif(image, exif, exif_len);
+
+  // the rows are converted straight into the YUV planes of the image. libavif only encodes whole images,
+  // so these planes are full size, only the RGB input is streamed.
+  avifImageAllocatePlanes(image, AVIF_PLANES_YUV);
+
+  dt_imageio_avif_writer_t *w = malloc(sizeof(dt_imageio_avif_writer_t));
+  if(w == NULL) goto error;
+  w->image = image;
+  w->filename = filename;
+  free(icc_profile_data);
+  return w;
+
+error:
+  if(image) avifImageDestroy(image);
+  free(icc_profile_data);
+  return NULL;
+}
+
+int write_rows(struct dt_imageio_module_data_t *data, void *handle, const void *rows, const int first_row,
+               const int num_rows)
+{
+  dt_imageio_avif_writer_t *w = (dt_imageio_avif_writer_t *)handle;
+  avifImage *image = w->image;
+
+  const size_t width = image->width;
+  const size_t height = num_rows;
+  const size_t bit_depth = image->depth;
+
+  /*
+   * Convert the rows in a band sharing the planes of the image. Bands start
+   * on even rows, so the chroma subsampling gives the same result as for the
+   * whole image.
+   */
+  avifPixelFormatInfo info;
+  avifGetPixelFormatInfo(image->yuvFormat, &info);
+  if(first_row & info.chromaShiftY) return 1;
+
+  avifImage *band = avifImageCreate(width, height, bit_depth, image->yuvFormat);
+  if(band == NULL) return 1;
+
+  band->colorPrimaries = image->colorPrimaries;
+  band->transferCharacteristics = image->transferCharacteristics;
+  band->matrixCoefficients = image->matrixCoefficients;
+  band->yuvRange = image->yuvRange;
+  for(int c = AVIF_CHAN_Y; c <= AVIF_CHAN_V; c++)
+  {
+    if(image->yuvPlanes[c] == NULL) continue;
+    const size_t row = (c == AVIF_CHAN_Y) ? first_row : first_row >> info.chromaShiftY;
+    band->yuvPlanes[c] = image->yuvPlanes[c] + row * image->yuvRowBytes[c];
+    band->yuvRowBytes[c] = image->yuvRowBytes[c];
+  }
+  band->imageOwnsYUVPlanes = AVIF_FALSE;
+
+  avifRGBImage rgb = { .format = AVIF_RGB_FORMAT_RGB, };
+  avifRGBImageSetDefaults(&rgb, band);
   rgb.format = AVIF_RGB_FORMAT_RGB;
 
   avifRGBImageAllocatePixels(&rgb);
@@ -395,7 +460,7 @@ int write_image(struct dt_imageio_module_data_t *data,
 
   const size_t rowbytes = rgb.rowBytes;
 
-  const float *const restrict in_data = (const float *)in;
+  const float *const restrict in_data = (const float *)rows;
   uint8_t *const restrict out = (uint8_t *)rgb.pixels;
 
   switch(bit_depth)
@@ -446,15 +511,38 @@ int write_image(struct dt_imageio_module_data_t *data,
     break;
     }
     default:
-      dt_control_log(_("invalid AVIF bit depth!"));
-      rc = 1;
-      goto out;
+      break;
   }
 
-  avifImageRGBToYUV(image, &rgb);
+  const avifResult result = avifImageRGBToYUV(band, &rgb);
 
+  // the planes belong to the image
+  for(int c = AVIF_CHAN_Y; c <= AVIF_CHAN_V; c++) band->yuvPlanes[c] = NULL;
+  avifImageDestroy(band);
+  avifRGBImageFreePixels(&rgb);
 
-  avifImageSetMetadataExif(image, exif, exif_len);
+  return result != AVIF_RESULT_OK;
+}
+
+int write_rows_end(struct dt_imageio_module_data_t *data, void *handle, const int failed)
+{
+  dt_imageio_avif_t *d = (dt_imageio_avif_t *)data;
+  dt_imageio_avif_writer_t *w = (dt_imageio_avif_writer_t *)handle;
+  avifImage *image = w->image;
+  const char *filename = w->filename;
+  avifEncoder *encoder = NULL;
+  avifRWData output = AVIF_DATA_EMPTY;
+  avifResult result;
+  int rc;
+
+  const size_t width = d->global.width;
+  const size_t height = d->global.height;
+
+  if(failed)
+  {
+    rc = 1;
+    goto out;
+  }
 
   encoder = avifEncoderCreate();
   if(encoder == NULL)
@@ -542,8 +630,6 @@ int write_image(struct dt_imageio_module_data_t *data,
            encoder->tileRowsLog2,
            encoder->maxThreads);
 
-  avifRWData output = AVIF_DATA_EMPTY;
-
   result = avifEncoderWrite(encoder, image, &output);
   if(result != AVIF_RESULT_OK)
   {
@@ -587,15 +673,35 @@ int write_image(struct dt_imageio_module_data_t *data,
 
   rc = 0; /* success */
 out:
-  avifRGBImageFreePixels(&rgb);
   avifImageDestroy(image);
-  avifEncoderDestroy(encoder);
+  if(encoder) avifEncoderDestroy(encoder);
   avifRWDataFree(&output);
-  free(icc_profile_data);
+  free(w);
 
   return rc;
 }
 
+int write_image(struct dt_imageio_module_data_t *data,
+                const char *filename,
+                const void *in,
+                dt_colorspaces_color_profile_type_t over_type,
+                const char *over_filename,
+                void *exif,
+                int exif_len,
+                int imgid,
+                int num,
+                int total,
+                struct dt_dev_pixelpipe_t *pipe,
+                const gboolean export_masks)
+{
+  void *w = write_rows_begin(data, filename, over_type, over_filename, exif, exif_len, imgid, num, total, pipe,
+                             export_masks);
+  if(w == NULL) return 1;
+
+  const int rc = write_rows(data, w, in, 0, data->height);
+  return write_rows_end(data, w, rc);
+}
+
 
 size_t params_size(dt_imageio_module_format_t *self)
 {
@@ -46,7 +46,7 @@ extern "C" {
 extern "C" {
 #endif
 
-DT_MODULE(4)
+DT_MODULE(5)
 
 enum dt_imageio_exr_compression_t
 {
@@ -60,6 +60,10 @@ enum dt_imageio_exr_compression_t
                           // fixed compression rate
   B44A_COMPRESSION = 7,   // lossy 4-by-4 pixel block compression,
                           // flat fields are compressed more
+  DWAA_COMPRESSION = 8,   // lossy DCT based compression, in blocks
+                          // of 32 scanlines
+  DWAB_COMPRESSION = 9,   // lossy DCT based compression, in blocks
+                          // of 256 scanlines
   NUM_COMPRESSION_METHODS // number of different compression methods
 };                        // copy of Imf::Compression
 
@@ -67,10 +71,12 @@ typedef struct dt_imageio_exr_t
 {
   dt_imageio_module_data_t global;
   dt_imageio_exr_compression_t compression;
+  int bpp; // 16 (half) or 32 (float)
 } dt_imageio_exr_t;
 
 typedef struct dt_imageio_exr_gui_t
 {
+  GtkWidget *bpp;
   GtkWidget *compression;
 } dt_imageio_exr_gui_t;
 
@@ -86,9 +92,12 @@ void init(dt_imageio_module_format_t *self)
   luaA_enum_value_name(darktable.lua_state.state, dt_imageio_exr_compression_t, PXR24_COMPRESSION, "pxr24");
   luaA_enum_value_name(darktable.lua_state.state, dt_imageio_exr_compression_t, B44_COMPRESSION, "b44");
   luaA_enum_value_name(darktable.lua_state.state, dt_imageio_exr_compression_t, B44A_COMPRESSION, "b44a");
+  luaA_enum_value_name(darktable.lua_state.state, dt_imageio_exr_compression_t, DWAA_COMPRESSION, "dwaa");
+  luaA_enum_value_name(darktable.lua_state.state, dt_imageio_exr_compression_t, DWAB_COMPRESSION, "dwab");
 
   dt_lua_register_module_member(darktable.lua_state.state, self, dt_imageio_exr_t, compression,
                                 dt_imageio_exr_compression_t);
+  dt_lua_register_module_member(darktable.lua_state.state, self, dt_imageio_exr_t, bpp, int);
 #endif
   Imf::BlobAttribute::registerAttributeType();
 }
@@ -104,7 +113,11 @@ int write_image(dt_imageio_module_data_t *tmp, const char *filename, const void
 {
   const dt_imageio_exr_t *exr = (dt_imageio_exr_t *)tmp;
 
-  Imf::setGlobalThreadCount(dt_get_num_threads());
+  // OpenEXR compresses the tiles on its global thread pool, allow limiting it
+  // when several exports run concurrently.
+  const int max_threads = dt_conf_get_int("plugins/imageio/format/exr/threads");
+  const int threads = max_threads > 0 ? MIN(max_threads, (int)dt_get_num_threads()) : (int)dt_get_num_threads();
+  Imf::setGlobalThreadCount(threads);
 
   Imf::Blob exif_blob(exif_len, (uint8_t *)exif);
 
@@ -192,9 +205,12 @@ icc_error:
 icc_end:
 
 
-  header.channels().insert("R", Imf::Channel(Imf::PixelType::FLOAT));
-  header.channels().insert("G", Imf::Channel(Imf::PixelType::FLOAT));
-  header.channels().insert("B", Imf::Channel(Imf::PixelType::FLOAT));
+  // the frame buffer slices always point to the float pipe output, for half
+  // channels OpenEXR converts while compressing, without an extra copy.
+  const Imf::PixelType pixel_type = exr->bpp == 16 ? Imf::PixelType::HALF : Imf::PixelType::FLOAT;
+  header.channels().insert("R", Imf::Channel(pixel_type));
+  header.channels().insert("G", Imf::Channel(pixel_type));
+  header.channels().insert("B", Imf::Channel(pixel_type));
 
   header.setTileDescription(Imf::TileDescription(100, 100, Imf::ONE_LEVEL));
 
@@ -213,9 +229,15 @@ icc_end:
   data.insert("B", Imf::Slice(Imf::PixelType::FLOAT, (char *)(in + 2), 4 * sizeof(float),
                               4 * sizeof(float) * exr->global.width));
 
+  const double start = dt_get_wtime();
+
   file.setFrameBuffer(data);
   file.writeTiles(0, file.numXTiles() - 1, 0, file.numYTiles() - 1);
 
+  const double mpix = (double)exr->global.width * exr->global.height / 1e6;
+  dt_print(DT_DEBUG_PERF, "[exr export] %d bit, compression %d on %d threads: %.1f MPix/s\n", exr->bpp,
+           (int)exr->compression, threads, mpix / (dt_get_wtime() - start));
+
   return 0;
 }
 
@@ -228,7 +250,7 @@ void *legacy_params(dt_imageio_module_format_t *self, const void *const old_para
                     const size_t old_params_size, const int old_version, const int new_version,
                     size_t *new_size)
 {
-  if(old_version == 1 && new_version == 4)
+  if(old_version == 1 && new_version == 5)
   {
     struct dt_imageio_exr_v1_t
     {
@@ -247,10 +269,11 @@ void *legacy_params(dt_imageio_module_format_t *self, const void *const old_para
     g_strlcpy(n->global.style, o->style, sizeof(o->style));
     n->global.style_append = FALSE;
     n->compression = (dt_imageio_exr_compression_t)PIZ_COMPRESSION;
+    n->bpp = 32;
     *new_size = self->params_size(self);
     return n;
   }
-  if(old_version == 2 && new_version == 4)
+  if(old_version == 2 && new_version == 5)
   {
     enum dt_imageio_exr_pixeltype_t
     {
@@ -272,7 +295,6 @@ void *legacy_params(dt_imageio_module_format_t *self, const void *const old_para
     const dt_imageio_exr_v2_t *o = (dt_imageio_exr_v2_t *)old_params;
     dt_imageio_exr_t *n = (dt_imageio_exr_t *)malloc(sizeof(dt_imageio_exr_t));
 
-    // last param was dropped (pixel type)
     n->global.max_width = o->max_width;
     n->global.max_height = o->max_height;
     n->global.width = o->width;
@@ -280,10 +302,11 @@ void *legacy_params(dt_imageio_module_format_t *self, const void *const old_para
     g_strlcpy(n->global.style, o->style, sizeof(o->style));
     n->global.style_append = FALSE;
     n->compression = o->compression;
+    n->bpp = o->pixel_type == EXR_PT_HALF ? 16 : 32;
     *new_size = self->params_size(self);
     return n;
   }
-  if(old_version == 3 && new_version == 4)
+  if(old_version == 3 && new_version == 5)
   {
     struct dt_imageio_exr_v3_t
     {
@@ -303,6 +326,24 @@ void *legacy_params(dt_imageio_module_format_t *self, const void *const old_para
     g_strlcpy(n->global.style, o->style, sizeof(o->style));
     n->global.style_append = FALSE;
     n->compression = o->compression;
+    n->bpp = 32;
+    *new_size = self->params_size(self);
+    return n;
+  }
+  if(old_version == 4 && new_version == 5)
+  {
+    struct dt_imageio_exr_v4_t
+    {
+      dt_imageio_module_data_t global;
+      dt_imageio_exr_compression_t compression;
+    };
+
+    const dt_imageio_exr_v4_t *o = (dt_imageio_exr_v4_t *)old_params;
+    dt_imageio_exr_t *n = (dt_imageio_exr_t *)malloc(sizeof(dt_imageio_exr_t));
+
+    n->global = o->global;
+    n->compression = o->compression;
+    n->bpp = 32;
     *new_size = self->params_size(self);
     return n;
   }
@@ -313,6 +354,7 @@ void *get_params(dt_imageio_module_format_t *self)
 {
   dt_imageio_exr_t *d = (dt_imageio_exr_t *)calloc(1, sizeof(dt_imageio_exr_t));
   d->compression = (dt_imageio_exr_compression_t)dt_conf_get_int("plugins/imageio/format/exr/compression");
+  d->bpp = dt_conf_get_int("plugins/imageio/format/exr/bpp") == 16 ? 16 : 32;
   return d;
 }
 
@@ -326,6 +368,7 @@ int set_params(dt_imageio_module_format_t *self, const void *params, const int s
   if(size != (int)self->params_size(self)) return 1;
   dt_imageio_exr_t *d = (dt_imageio_exr_t *)params;
   dt_imageio_exr_gui_t *g = (dt_imageio_exr_gui_t *)self->gui_data;
+  dt_bauhaus_combobox_set(g->bpp, d->bpp == 16 ? 0 : 1);
   dt_bauhaus_combobox_set(g->compression, d->compression);
   return 0;
 }
@@ -352,7 +395,13 @@ const char *extension(dt_imageio_module_data_t *data)
 
 const char *name()
 {
-  return _("OpenEXR (float)");
+  return _("OpenEXR (16/32-bit float)");
+}
+
+static void bpp_combobox_changed(GtkWidget *widget, gpointer user_data)
+{
+  const int bpp = dt_bauhaus_combobox_get(widget);
+  dt_conf_set_int("plugins/imageio/format/exr/bpp", bpp == 0 ? 16 : 32);
 }
 
 static void combobox_changed(GtkWidget *widget, gpointer user_data)
@@ -368,8 +417,17 @@ void gui_init(dt_imageio_module_format_t *self)
 
   self->widget = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
 
+  const int bpp_last = dt_conf_get_int("plugins/imageio/format/exr/bpp");
   const int compression_last = dt_conf_get_int("plugins/imageio/format/exr/compression");
 
+  gui->bpp = dt_bauhaus_combobox_new(NULL);
+  dt_bauhaus_widget_set_label(gui->bpp, NULL, N_("bit depth"));
+  dt_bauhaus_combobox_add(gui->bpp, _("16 bit (half float)"));
+  dt_bauhaus_combobox_add(gui->bpp, _("32 bit (float)"));
+  dt_bauhaus_combobox_set(gui->bpp, bpp_last == 16 ? 0 : 1);
+  gtk_box_pack_start(GTK_BOX(self->widget), gui->bpp, TRUE, TRUE, 0);
+  g_signal_connect(G_OBJECT(gui->bpp), "value-changed", G_CALLBACK(bpp_combobox_changed), NULL);
+
   gui->compression = dt_bauhaus_combobox_new(NULL);
   dt_bauhaus_widget_set_label(gui->compression, NULL, N_("compression mode"));
 
@@ -381,6 +439,8 @@ void gui_init(dt_imageio_module_format_t *self)
   dt_bauhaus_combobox_add(gui->compression, _("PXR24 (lossy)"));
   dt_bauhaus_combobox_add(gui->compression, _("B44 (lossy)"));
   dt_bauhaus_combobox_add(gui->compression, _("B44A (lossy)"));
+  dt_bauhaus_combobox_add(gui->compression, _("DWAA (lossy)"));
+  dt_bauhaus_combobox_add(gui->compression, _("DWAB (lossy)"));
   dt_bauhaus_combobox_set(gui->compression, compression_last);
   gtk_box_pack_start(GTK_BOX(self->widget), gui->compression, TRUE, TRUE, 0);
   g_signal_connect(G_OBJECT(gui->compression), "value-changed", G_CALLBACK(combobox_changed), NULL);
@@ -395,6 +455,7 @@ void gui_reset(dt_imageio_module_format_t *self)
 {
   dt_imageio_exr_gui_t *gui = (dt_imageio_exr_gui_t *)self->gui_data;
 
+  dt_bauhaus_combobox_set(gui->bpp, dt_confgen_get_int("plugins/imageio/format/exr/bpp", DT_DEFAULT) == 16 ? 0 : 1);
   dt_bauhaus_combobox_set(gui->compression, dt_confgen_get_int("plugins/imageio/format/exr/compression", DT_DEFAULT));
 }
 
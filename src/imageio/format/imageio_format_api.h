@@ -80,6 +80,19 @@ REQUIRED(int, write_image, struct dt_imageio_module_data_t *data, const char *fi
                            dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
                            void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
                            const gboolean export_masks);
+/* optional row streaming alternative to write_image. the export converts the pipe output to bpp() in
+ * bands of rows and hands them over top to bottom, so that no converted copy of the whole image is needed.
+ * formats whose encoder only takes whole images (webp, avif) still keep their own full size picture.
+ * rows have 4 channels like the write_image input, every band starts on an even row. begin returns a
+ * handle for the following calls or NULL on failure, end closes it and returns != 0 on fail.
+ * formats returning FORMAT_FLAGS_NO_ROWS from flags() get write_image called instead. */
+OPTIONAL(void *, write_rows_begin, struct dt_imageio_module_data_t *data, const char *filename,
+                                   dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                                   void *exif, int exif_len, int imgid, int num, int total,
+                                   struct dt_dev_pixelpipe_t *pipe, const gboolean export_masks);
+OPTIONAL(int, write_rows, struct dt_imageio_module_data_t *data, void *handle, const void *rows,
+                          const int first_row, const int num_rows);
+OPTIONAL(int, write_rows_end, struct dt_imageio_module_data_t *data, void *handle, const int failed);
 /* flag that describes the available precision/levels of output format. mainly used for dithering. */
 OPTIONAL(int, levels, struct dt_imageio_module_data_t *data);
 
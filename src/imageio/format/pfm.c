@@ -26,51 +26,85 @@
 
 DT_MODULE(1)
 
-int write_image(dt_imageio_module_data_t *data, const char *filename, const void *ivoid,
-                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
-                void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
-                const gboolean export_masks)
+typedef struct _pfm_file_t
+{
+  FILE *f;
+  long header_length;
+} _pfm_file_t;
+
+void *write_rows_begin(dt_imageio_module_data_t *pfm, const char *filename,
+                       dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                       void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
+                       const gboolean export_masks)
 {
-  const dt_imageio_module_data_t *const pfm = data;
-  int status = 0;
   FILE *f = g_fopen(filename, "wb");
-  if(f)
+  if(!f) return NULL;
+
+  // align pfm header to sse, assuming the file will
+  // be mmapped to page boundaries.
+  char header[1024];
+  snprintf(header, 1024, "PF\n%d %d\n-1.0", pfm->width, pfm->height);
+  size_t len = strlen(header);
+  fprintf(f, "PF\n%d %d\n-1.0", pfm->width, pfm->height);
+  ssize_t off = 0;
+  while((len + 1 + off) & 0xf) off++;
+  while(off-- > 0) fprintf(f, "0");
+  fprintf(f, "\n");
+
+  _pfm_file_t *file = g_malloc(sizeof(_pfm_file_t));
+  file->f = f;
+  file->header_length = ftell(f);
+  return file;
+}
+
+int write_rows(dt_imageio_module_data_t *pfm, void *handle, const void *rows, const int first_row,
+               const int num_rows)
+{
+  _pfm_file_t *file = (_pfm_file_t *)handle;
+  const size_t linesize = sizeof(float) * 3 * pfm->width;
+  float *buf_line = dt_alloc_align_float((size_t)3 * pfm->width);
+  if(!buf_line) return 1;
+
+  int status = 0;
+  for(int j = 0; j < num_rows && !status; j++)
   {
-    // align pfm header to sse, assuming the file will
-    // be mmapped to page boundaries.
-    char header[1024];
-    snprintf(header, 1024, "PF\n%d %d\n-1.0", pfm->width, pfm->height);
-    size_t len = strlen(header);
-    fprintf(f, "PF\n%d %d\n-1.0", pfm->width, pfm->height);
-    ssize_t off = 0;
-    while((len + 1 + off) & 0xf) off++;
-    while(off-- > 0) fprintf(f, "0");
-    fprintf(f, "\n");
-    void *buf_line = dt_alloc_align_float((size_t)3 * pfm->width);
-    for(int j = 0; j < pfm->height; j++)
+    // NOTE: pfm has rows in reverse order
+    const int row_out = pfm->height - 1 - (first_row + j);
+    const float *in = (const float *)rows + 4 * (size_t)pfm->width * j;
+    float *out = buf_line;
+    for(int i = 0; i < pfm->width; i++, in += 4, out += 3)
     {
-      // NOTE: pfm has rows in reverse order
-      const int row_in = pfm->height - 1 - j;
-      const float *in = (const float *)ivoid + 4 * (size_t)pfm->width * row_in;
-      float *out = (float *)buf_line;
-      for(int i = 0; i < pfm->width; i++, in += 4, out += 3)
-      {
-        memcpy(out, in, sizeof(float) * 3);
-      }
-      // INFO: per-line fwrite call seems to perform best. LebedevRI, 18.04.2014
-      int cnt = fwrite(buf_line, sizeof(float) * 3, pfm->width, f);
-      if(cnt != pfm->width)
-        status = 1;
-      else
-        status = 0;
+      memcpy(out, in, sizeof(float) * 3);
     }
-    dt_free_align(buf_line);
-    buf_line = NULL;
-    fclose(f);
+    // INFO: per-line fwrite call seems to perform best. LebedevRI, 18.04.2014
+    if(fseek(file->f, file->header_length + linesize * row_out, SEEK_SET)
+       || fwrite(buf_line, sizeof(float) * 3, pfm->width, file->f) != pfm->width)
+      status = 1;
   }
+  dt_free_align(buf_line);
   return status;
 }
 
+int write_rows_end(dt_imageio_module_data_t *pfm, void *handle, const int failed)
+{
+  _pfm_file_t *file = (_pfm_file_t *)handle;
+  const int status = fclose(file->f) != 0;
+  g_free(file);
+  return status;
+}
+
+int write_image(dt_imageio_module_data_t *data, const char *filename, const void *ivoid,
+                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
+                const gboolean export_masks)
+{
+  void *file = write_rows_begin(data, filename, over_type, over_filename, exif, exif_len, imgid, num, total,
+                                pipe, export_masks);
+  if(!file) return 1;
+  const int status = write_rows(data, file, ivoid, 0, data->height);
+  return write_rows_end(data, file, status) || status;
+}
+
 size_t params_size(dt_imageio_module_format_t *self)
 {
   return sizeof(dt_imageio_module_data_t);
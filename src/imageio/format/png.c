@@ -117,6 +117,268 @@ static void PNGwriteRawProfile(png_struct *ping, png_info *ping_info, char *prof
   png_free(ping, text);
 }
 
+/*
+ * Parallel PNG encoding.
+ *
+ * libpng filters and deflates the image on a single thread. For large images we do it
+ * ourselves: rows are filtered with libpng's minimum sum of absolute differences heuristic,
+ * and the filtered data is cut into chunks which are deflated on all threads. Each chunk
+ * is primed with the last 32 KiB of the previous one as dictionary and ends on a byte
+ * aligned sync flush, so that the pieces concatenate into a single zlib stream. The result
+ * is written as IDAT chunks through libpng.
+ */
+
+// only images larger than this are encoded in parallel
+#define PNG_PARALLEL_MIN_PIXELS (1024 * 1024)
+// uncompressed size of the pieces compressed by each thread
+#define PNG_CHUNK_SIZE (256 * 1024)
+// deflate window size
+#define PNG_DICT_SIZE 32768
+// maximum size of one IDAT chunk
+#define PNG_IDAT_SIZE (1024 * 1024)
+
+static inline uint8_t _paeth(const int a, const int b, const int c)
+{
+  const int p = a + b - c;
+  const int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+  if(pa <= pb && pa <= pc) return a;
+  return (pb <= pc) ? b : c;
+}
+
+// filter one row of rowbytes bytes, prev is NULL for the first row. writes the
+// filter type byte followed by the filtered row to out, tmp holds rowbytes bytes.
+static void _filter_row(const uint8_t *row, const uint8_t *prev, uint8_t *out, uint8_t *tmp,
+                        const size_t rowbytes, const size_t bpp)
+{
+  uint8_t *best = out + 1;
+  uint8_t *cand = tmp;
+  size_t best_sum = SIZE_MAX;
+
+  for(int type = PNG_FILTER_VALUE_NONE; type < PNG_FILTER_VALUE_LAST; type++)
+  {
+    size_t sum = 0;
+    for(size_t i = 0; i < rowbytes; i++)
+    {
+      const int a = i >= bpp ? row[i - bpp] : 0;
+      const int b = prev ? prev[i] : 0;
+      const int c = (prev && i >= bpp) ? prev[i - bpp] : 0;
+      uint8_t v = row[i];
+      switch(type)
+      {
+        case PNG_FILTER_VALUE_SUB:
+          v -= a;
+          break;
+        case PNG_FILTER_VALUE_UP:
+          v -= b;
+          break;
+        case PNG_FILTER_VALUE_AVG:
+          v -= (a + b) >> 1;
+          break;
+        case PNG_FILTER_VALUE_PAETH:
+          v -= _paeth(a, b, c);
+          break;
+        default:
+          break;
+      }
+      cand[i] = v;
+      sum += v < 128 ? v : 256 - v;
+    }
+    if(sum < best_sum)
+    {
+      best_sum = sum;
+      out[0] = type;
+      // keep the best candidate in out and reuse the other buffer
+      uint8_t *t = best;
+      best = cand;
+      cand = t;
+    }
+  }
+  if(best != out + 1) memcpy(out + 1, best, rowbytes);
+}
+
+// pack the RGBX input row to 8 or big endian 16 bit RGB
+static void _pack_row(const void *ivoid, const size_t y, const size_t width, const int bpp, uint8_t *out)
+{
+  if(bpp > 8)
+  {
+    const uint16_t *in = (const uint16_t *)ivoid + (size_t)4 * y * width;
+    for(size_t x = 0; x < width; x++)
+      for(int c = 0; c < 3; c++)
+      {
+        out[6 * x + 2 * c] = in[4 * x + c] >> 8;
+        out[6 * x + 2 * c + 1] = in[4 * x + c] & 0xff;
+      }
+  }
+  else
+  {
+    const uint8_t *in = (const uint8_t *)ivoid + (size_t)4 * y * width;
+    for(size_t x = 0; x < width; x++)
+      for(int c = 0; c < 3; c++) out[3 * x + c] = in[4 * x + c];
+  }
+}
+
+typedef struct _idat_t
+{
+  png_structp png_ptr;
+  uint8_t *buf;
+  size_t fill;
+} _idat_t;
+
+static void _idat_flush(_idat_t *idat)
+{
+  if(idat->fill) png_write_chunk(idat->png_ptr, (png_const_bytep) "IDAT", idat->buf, idat->fill);
+  idat->fill = 0;
+}
+
+static void _idat_put(_idat_t *idat, const uint8_t *data, const size_t len)
+{
+  for(size_t pos = 0; pos < len;)
+  {
+    const size_t n = MIN(len - pos, PNG_IDAT_SIZE - idat->fill);
+    memcpy(idat->buf + idat->fill, data + pos, n);
+    idat->fill += n;
+    pos += n;
+    if(idat->fill == PNG_IDAT_SIZE) _idat_flush(idat);
+  }
+}
+
+// writes the last IDAT and closes the file. png_write_end() refuses to, as libpng
+// did not write the IDAT chunks itself.
+static void _idat_finish(_idat_t *idat)
+{
+  _idat_flush(idat);
+  png_write_chunk(idat->png_ptr, (png_const_bytep) "IEND", NULL, 0);
+}
+
+// returns -1 if the image should be written by libpng, 0 on success and 1 on error.
+// on success, the file is closed with IEND.
+static int _write_idat_parallel(png_structp png_ptr, const dt_imageio_png_t *p, const void *ivoid)
+{
+  const int nthreads = dt_get_num_threads();
+  const size_t width = p->global.width, height = p->global.height;
+  if(nthreads < 2 || width * height < PNG_PARALLEL_MIN_PIXELS) return -1;
+
+  const int depth = p->bpp;
+  const size_t bpp = 3 * depth / 8;
+  const size_t rowbytes = width * bpp;
+  const size_t filtered_size = (rowbytes + 1) * height;
+  const size_t nchunks = (filtered_size + PNG_CHUNK_SIZE - 1) / PNG_CHUNK_SIZE;
+
+  uint8_t *filtered = dt_alloc_align(64, filtered_size);
+  uint8_t *scratch = dt_alloc_align(64, 3 * rowbytes * nthreads);
+  uint8_t **comp = calloc(nchunks, sizeof(uint8_t *));
+  size_t *comp_len = calloc(nchunks, sizeof(size_t));
+  uLong *adler = calloc(nchunks, sizeof(uLong));
+  int err = !filtered || !scratch || !comp || !comp_len || !adler;
+
+  const double start = dt_get_wtime();
+  const int level = p->compression;
+
+  if(!err)
+  {
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(ivoid, filtered, scratch, width, height, depth, bpp, rowbytes) \
+    schedule(static)
+#endif
+    for(size_t y = 0; y < height; y++)
+    {
+      uint8_t *row = scratch + 3 * rowbytes * dt_get_thread_num();
+      uint8_t *prev = row + rowbytes;
+      uint8_t *tmp = prev + rowbytes;
+      _pack_row(ivoid, y, width, depth, row);
+      if(y > 0) _pack_row(ivoid, y - 1, width, depth, prev);
+      _filter_row(row, y > 0 ? prev : NULL, filtered + y * (rowbytes + 1), tmp, rowbytes, bpp);
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(filtered, comp, comp_len, adler, filtered_size, nchunks, level) \
+    schedule(dynamic) reduction(|:err)
+#endif
+    for(size_t k = 0; k < nchunks; k++)
+    {
+      const size_t offset = k * PNG_CHUNK_SIZE;
+      const size_t len = MIN(PNG_CHUNK_SIZE, filtered_size - offset);
+      const int last = (k == nchunks - 1);
+
+      z_stream strm = { 0 };
+      if(deflateInit2(&strm, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+      {
+        err |= 1;
+        continue;
+      }
+      if(k > 0)
+      {
+        const size_t dict = MIN(PNG_DICT_SIZE, offset);
+        deflateSetDictionary(&strm, filtered + offset - dict, dict);
+      }
+
+      // room for the sync flush marker on top of the worst case
+      const size_t bound = deflateBound(&strm, len) + 16;
+      comp[k] = malloc(bound);
+      if(!comp[k])
+      {
+        deflateEnd(&strm);
+        err |= 1;
+        continue;
+      }
+      strm.next_in = filtered + offset;
+      strm.avail_in = len;
+      strm.next_out = comp[k];
+      strm.avail_out = bound;
+      const int ret = deflate(&strm, last ? Z_FINISH : Z_SYNC_FLUSH);
+      if((last && ret != Z_STREAM_END) || (!last && (ret != Z_OK || strm.avail_in || !strm.avail_out))) err |= 1;
+      comp_len[k] = bound - strm.avail_out;
+      deflateEnd(&strm);
+
+      adler[k] = adler32(adler32(0L, Z_NULL, 0), filtered + offset, len);
+    }
+  }
+
+  if(!err)
+  {
+    // zlib header as written by deflate() for the given level, 32 KiB window. deflate() takes
+    // Z_DEFAULT_COMPRESSION as level 6.
+    const int zlevel = level == Z_DEFAULT_COMPRESSION ? 6 : level;
+    const int level_flags = zlevel < 2 ? 0 : zlevel < 6 ? 1 : zlevel == 6 ? 2 : 3;
+    unsigned int header = ((Z_DEFLATED + (7 << 4)) << 8) | (level_flags << 6);
+    header += 31 - (header % 31);
+
+    uLong check = adler32(0L, Z_NULL, 0);
+    for(size_t k = 0; k < nchunks; k++)
+      check = adler32_combine(check, adler[k], MIN(PNG_CHUNK_SIZE, filtered_size - k * PNG_CHUNK_SIZE));
+
+    // assemble the stream in IDAT sized pieces
+    _idat_t idat = { .png_ptr = png_ptr, .buf = malloc(PNG_IDAT_SIZE), .fill = 0 };
+    if(idat.buf)
+    {
+      const uint8_t zhead[2] = { header >> 8, header & 0xff };
+      const uint8_t ztail[4] = { check >> 24, (check >> 16) & 0xff, (check >> 8) & 0xff, check & 0xff };
+      _idat_put(&idat, zhead, sizeof(zhead));
+      for(size_t k = 0; k < nchunks; k++) _idat_put(&idat, comp[k], comp_len[k]);
+      _idat_put(&idat, ztail, sizeof(ztail));
+      _idat_finish(&idat);
+      free(idat.buf);
+    }
+    else
+      err = 1;
+  }
+
+  if(!err)
+    dt_print(DT_DEBUG_PERF, "[png] compression of %.1f MB on %d threads: %.1f MB/s\n", filtered_size / 1e6,
+             nthreads, filtered_size / 1e6 / (dt_get_wtime() - start));
+
+  if(comp)
+    for(size_t k = 0; k < nchunks; k++) free(comp[k]);
+  free(comp);
+  free(comp_len);
+  free(adler);
+  dt_free_align(filtered);
+  dt_free_align(scratch);
+  return err;
+}
+
 int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const void *ivoid,
                 dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
                 void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
@@ -195,6 +457,15 @@ int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const voi
 
   png_write_info(png_ptr, info_ptr);
 
+  const int parallel_rc = _write_idat_parallel(png_ptr, p, ivoid);
+  if(parallel_rc >= 0)
+  {
+    // all metadata went before the pixels and the file is complete
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+    fclose(f);
+    return parallel_rc;
+  }
+
   /*
    * Get rid of filler (OR ALPHA) bytes, pack XRGB/RGBX/ARGB/RGBA into
    * RGB (4 channels -> 3 channels). The second parameter is not used.
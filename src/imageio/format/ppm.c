@@ -33,35 +33,52 @@ void cleanup(dt_imageio_module_format_t *self)
 {
 }
 
-int write_image(dt_imageio_module_data_t *ppm, const char *filename, const void *in_tmp,
-                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
-                void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
-                const gboolean export_masks)
+void *write_rows_begin(dt_imageio_module_data_t *ppm, const char *filename,
+                       dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                       void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
+                       const gboolean export_masks)
 {
-  const uint16_t *in = (const uint16_t *)in_tmp;
-  int status = 0;
-  uint16_t *row = (uint16_t *)in;
-  uint16_t swapped[3];
   FILE *f = g_fopen(filename, "wb");
-  if(f)
+  if(f) (void)fprintf(f, "P6\n%d %d\n65535\n", ppm->width, ppm->height);
+  return f;
+}
+
+int write_rows(dt_imageio_module_data_t *ppm, void *handle, const void *rows, const int first_row,
+               const int num_rows)
+{
+  FILE *f = (FILE *)handle;
+  uint16_t *line = dt_alloc_align(64, sizeof(uint16_t) * 3 * ppm->width);
+  if(!line) return 1;
+
+  int status = 0;
+  for(int y = 0; y < num_rows && !status; y++)
   {
-    (void)fprintf(f, "P6\n%d %d\n65535\n", ppm->width, ppm->height);
-    for(int y = 0; y < ppm->height; y++)
-    {
-      for(int x = 0; x < ppm->width; x++)
-      {
-        for(int c = 0; c < 3; c++) swapped[c] = (0xff00 & (row[c] << 8)) | (row[c] >> 8);
-        int cnt = fwrite(&swapped, sizeof(uint16_t), 3, f);
-        if(cnt != 3) break;
-        row += 4;
-      }
-    }
-    fclose(f);
-    status = 0;
+    const uint16_t *row = (const uint16_t *)rows + (size_t)4 * ppm->width * y;
+    for(int x = 0; x < ppm->width; x++, row += 4)
+      for(int c = 0; c < 3; c++) line[3 * x + c] = (0xff00 & (row[c] << 8)) | (row[c] >> 8);
+    if(fwrite(line, sizeof(uint16_t) * 3, ppm->width, f) != ppm->width) status = 1;
   }
+  dt_free_align(line);
   return status;
 }
 
+int write_rows_end(dt_imageio_module_data_t *ppm, void *handle, const int failed)
+{
+  return fclose((FILE *)handle) != 0;
+}
+
+int write_image(dt_imageio_module_data_t *ppm, const char *filename, const void *in_tmp,
+                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
+                const gboolean export_masks)
+{
+  void *f = write_rows_begin(ppm, filename, over_type, over_filename, exif, exif_len, imgid, num, total, pipe,
+                             export_masks);
+  if(!f) return 1;
+  const int status = write_rows(ppm, f, in_tmp, 0, ppm->height);
+  return write_rows_end(ppm, f, status) || status;
+}
+
 size_t params_size(dt_imageio_module_format_t *self)
 {
   return sizeof(dt_imageio_module_data_t);
@@ -31,6 +31,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <tiffio.h>
+#include <zlib.h>
 
 // it would be nice to save space by storing the masks as single channel float data,
 // but at least GIMP can't open TIFF files where not all layers have the same format.
@@ -56,27 +57,188 @@ typedef struct dt_imageio_tiff_gui_t
   GtkWidget *shortfiles;
 } dt_imageio_tiff_gui_t;
 
+// apply the tiff predictor to one row of packed samples,
+// the same way libtiff's horDiff*() and fpDiff() do it.
+static void _predict_row(uint8_t *row, uint8_t *tmp, const int bpp, const int predictor, const size_t samples,
+                         const size_t stride)
+{
+  if(predictor == PREDICTOR_HORIZONTAL)
+  {
+    if(bpp == 16)
+    {
+      uint16_t *r = (uint16_t *)row;
+      for(size_t i = samples - 1; i >= stride; i--) r[i] -= r[i - stride];
+    }
+    else
+    {
+      for(size_t i = samples - 1; i >= stride; i--) row[i] -= row[i - stride];
+    }
+  }
+  else if(predictor == PREDICTOR_FLOATINGPOINT)
+  {
+    // split the floats into byte planes, most significant first, then difference the bytes
+    const size_t bytes = samples * sizeof(float);
+    memcpy(tmp, row, bytes);
+    for(size_t k = 0; k < samples; k++)
+      for(size_t b = 0; b < sizeof(float); b++)
+        row[(sizeof(float) - b - 1) * samples + k] = tmp[sizeof(float) * k + b];
+    for(size_t i = bytes - 1; i >= stride; i--) row[i] -= row[i - stride];
+  }
+}
 
-int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const void *in_void,
-                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
-                void *exif, int exif_len, int imgid, int num, int total, dt_dev_pixelpipe_t *pipe,
-                const gboolean export_masks)
+// state of a tiff file written row by row. compressed images collect a batch of strips which
+// are deflate compressed on all threads and written in order as raw strips, which gives the
+// same file libtiff would write sequentially. other images are written line by line.
+typedef struct dt_imageio_tiff_writer_t
 {
-  const dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)d_tmp;
+  TIFF *tif;
+  const char *filename;
+#ifdef _WIN32
+  wchar_t *wfilename;
+#endif
+  uint8_t *profile;
+  void *exif;
+  int exif_len;
+  dt_dev_pixelpipe_t *pipe;
+  uint16_t n_pages;
+  uint16_t layers;
+  int predictor;
+  int resolution;
+  size_t rowsize;
+  void *rowdata;
+  // batch of strips for the parallel compression, raw is NULL if it is not used
+  size_t rows_per_strip;
+  size_t strip_size;
+  size_t bound;
+  size_t batch;
+  size_t first_strip;
+  size_t rows_in_batch;
+  uint8_t *raw;
+  uint8_t *comp;
+  uint8_t *scratch;
+  uLongf *comp_len;
+  double time;
+} dt_imageio_tiff_writer_t;
+
+// pack a row of 4 channel pixels to the layers stored in the file
+static inline void _pack_row(uint8_t *out, const uint8_t *in, const size_t width, const uint16_t layers,
+                             const size_t Bps)
+{
+  for(size_t x = 0; x < width; x++) memcpy(out + x * layers * Bps, in + x * 4 * Bps, layers * Bps);
+}
 
-  uint8_t *profile = NULL;
-  uint32_t profile_len = 0;
+// set up the parallel deflate compression, returns 1 on error.
+// w->raw stays NULL if this path is not applicable.
+static int _deflate_strips_init(dt_imageio_tiff_writer_t *w, const dt_imageio_tiff_t *d)
+{
+  // the predictor and the raw strips are written in host byte order
+  if(G_BYTE_ORDER != G_LITTLE_ENDIAN || d->compress == 0) return 0;
+
+  const int nthreads = dt_get_num_threads();
+  uint32_t rows_per_strip = 0;
+  TIFFGetFieldDefaulted(w->tif, TIFFTAG_ROWSPERSTRIP, &rows_per_strip);
+  rows_per_strip = MIN(rows_per_strip, (uint32_t)d->global.height);
+  const size_t nstrips = TIFFNumberOfStrips(w->tif);
+  if(nthreads < 2 || nstrips < 2 || rows_per_strip == 0) return 0;
+
+  // bound the memory used for one batch to about 64 MiB of uncompressed data
+  w->rows_per_strip = rows_per_strip;
+  w->strip_size = w->rowsize * rows_per_strip;
+  w->bound = compressBound(w->strip_size);
+  w->batch = MIN(nstrips, MAX((size_t)nthreads, ((size_t)64 << 20) / w->strip_size));
+
+  w->raw = dt_alloc_align(64, w->strip_size * w->batch);
+  w->comp = dt_alloc_align(64, w->bound * w->batch);
+  w->scratch = dt_alloc_align(64, w->rowsize * nthreads);
+  w->comp_len = malloc(sizeof(uLongf) * w->batch);
+  return !w->raw || !w->comp || !w->scratch || !w->comp_len;
+}
+
+// compress the rows collected in the current batch of strips on all threads and write them
+static int _deflate_strips_flush(dt_imageio_tiff_writer_t *w, const dt_imageio_tiff_t *d)
+{
+  if(w->rows_in_batch == 0) return 0;
+
+  const double start = dt_get_wtime();
+  const size_t width = d->global.width;
+  const int bpp = d->bpp;
+  const int level = d->compresslevel;
+  const int predictor = w->predictor;
+  const uint16_t layers = w->layers;
+  const size_t rowsize = w->rowsize;
+  const size_t rows_per_strip = w->rows_per_strip;
+  const size_t rows_in_batch = w->rows_in_batch;
+  const size_t strip_size = w->strip_size;
+  const size_t bound = w->bound;
+  const size_t count = (rows_in_batch + rows_per_strip - 1) / rows_per_strip;
+  uint8_t *const raw = w->raw;
+  uint8_t *const comp = w->comp;
+  uint8_t *const scratch = w->scratch;
+  uLongf *const comp_len = w->comp_len;
+  int err = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(raw, comp, scratch, comp_len, count, width, layers, bpp, rowsize, rows_per_strip) \
+  dt_omp_firstprivate(rows_in_batch, strip_size, bound, predictor, level) \
+  schedule(dynamic) reduction(|:err)
+#endif
+  for(size_t s = 0; s < count; s++)
+  {
+    const size_t rows = MIN(rows_per_strip, rows_in_batch - s * rows_per_strip);
+    uint8_t *strip = raw + s * strip_size;
+    uint8_t *tmp = scratch + rowsize * dt_get_thread_num();
 
-  TIFF *tif = NULL;
+    for(size_t j = 0; j < rows; j++) _predict_row(strip + j * rowsize, tmp, bpp, predictor, width * layers, layers);
 
-  void *rowdata = NULL;
+    comp_len[s] = bound;
+    if(compress2(comp + s * bound, &comp_len[s], strip, rows * rowsize, level) != Z_OK) err |= 1;
+  }
 
-  gboolean free_mask = FALSE;
-  float *raster_mask = NULL;
+  for(size_t s = 0; s < count && !err; s++)
+    if(TIFFWriteRawStrip(w->tif, w->first_strip + s, comp + s * bound, comp_len[s]) == -1) err = 1;
+
+  w->first_strip += count;
+  w->rows_in_batch = 0;
+  w->time += dt_get_wtime() - start;
+  return err;
+}
+
+static void _writer_free(dt_imageio_tiff_writer_t *w)
+{
+  if(w->tif) TIFFClose(w->tif);
+  free(w->profile);
+  free(w->rowdata);
+  dt_free_align(w->raw);
+  dt_free_align(w->comp);
+  dt_free_align(w->scratch);
+  free(w->comp_len);
 #ifdef _WIN32
-  wchar_t *wfilename = g_utf8_to_utf16(filename, -1, NULL, NULL, NULL);
+  g_free(w->wfilename);
 #endif
-  int rc = 1; // default to error
+  free(w);
+}
+
+// open the file and write the tags of the image. if the whole image is given, it is checked for
+// a grayscale image in short file mode.
+static dt_imageio_tiff_writer_t *_writer_open(const dt_imageio_tiff_t *d, const char *filename,
+                                              dt_colorspaces_color_profile_type_t over_type,
+                                              const char *over_filename, void *exif, int exif_len, int imgid,
+                                              dt_dev_pixelpipe_t *pipe, const gboolean export_masks,
+                                              const void *in_void)
+{
+  dt_imageio_tiff_writer_t *w = calloc(1, sizeof(dt_imageio_tiff_writer_t));
+  if(!w) return NULL;
+
+  w->filename = filename;
+  w->exif = exif;
+  w->exif_len = exif_len;
+  w->pipe = pipe;
+#ifdef _WIN32
+  w->wfilename = g_utf8_to_utf16(filename, -1, NULL, NULL, NULL);
+#endif
+
+  uint32_t profile_len = 0;
 
   if(imgid > 0)
   {
@@ -84,42 +246,35 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
     cmsSaveProfileToMem(out_profile, 0, &profile_len);
     if(profile_len > 0)
     {
-      profile = malloc(profile_len);
-      if(!profile)
-      {
-        rc = 1;
-        goto exit;
-      }
-      cmsSaveProfileToMem(out_profile, profile, &profile_len);
+      w->profile = malloc(profile_len);
+      if(!w->profile) goto error;
+      cmsSaveProfileToMem(out_profile, w->profile, &profile_len);
     }
   }
 
-  uint16_t n_pages = 1;
+  w->n_pages = 1;
   // only when masks are to be stored we check for extra pages!
   if(export_masks && pipe)
   {
     for(GList *iter = pipe->nodes; iter; iter = g_list_next(iter))
-      n_pages += g_hash_table_size(((dt_dev_pixelpipe_iop_t *)iter->data)->raster_masks);
+      w->n_pages += g_hash_table_size(((dt_dev_pixelpipe_iop_t *)iter->data)->raster_masks);
   }
 
   // Create little endian tiff image
 #ifdef _WIN32
-  tif = TIFFOpenW(wfilename, "wl");
+  w->tif = TIFFOpenW(w->wfilename, "wl");
 #else
-  tif = TIFFOpen(filename, "wl");
+  w->tif = TIFFOpen(filename, "wl");
 #endif
+  TIFF *tif = w->tif;
 
-  if(!tif)
-  {
-    rc = 1;
-    goto exit;
-  }
+  if(!tif) goto error;
 
-  if(n_pages > 1)
+  if(w->n_pages > 1)
   {
     TIFFSetField(tif, TIFFTAG_SUBFILETYPE, FILETYPE_PAGE);
     TIFFSetField(tif, TIFFTAG_PAGENAME, _("image"));
-    TIFFSetField(tif, TIFFTAG_PAGENUMBER, 0, n_pages);
+    TIFFSetField(tif, TIFFTAG_PAGENUMBER, 0, w->n_pages);
   }
   else
     TIFFSetField(tif, TIFFTAG_SUBFILETYPE, 0);
@@ -133,6 +288,7 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
   // "write the official compression code (0x0008)."
   // http://www.awaresystems.be/imaging/tiff/tifftags/compression.html
   // http://www.awaresystems.be/imaging/tiff/tifftags/predictor.html
+  w->predictor = PREDICTOR_NONE;
   if(d->compress == 1)
   {
     TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
@@ -141,17 +297,15 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
   }
   else if(d->compress == 2)
   {
+    w->predictor = (d->bpp == 32) ? PREDICTOR_FLOATINGPOINT : PREDICTOR_HORIZONTAL;
     TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
-    if(d->bpp == 32)
-      TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_FLOATINGPOINT);
-    else
-      TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+    TIFFSetField(tif, TIFFTAG_PREDICTOR, w->predictor);
     TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
   }
 
-  if(profile != NULL)
+  if(w->profile != NULL)
   {
-    TIFFSetField(tif, TIFFTAG_ICCPROFILE, (uint32_t)profile_len, profile);
+    TIFFSetField(tif, TIFFTAG_ICCPROFILE, (uint32_t)profile_len, w->profile);
   }
 
 /* Howto check for a grayscale image?
@@ -160,6 +314,7 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
    it's safe to assume a grayscale.
    As there might be pipeline errors at the border we leave them alone.
    After these checks layers can be used later on.
+   The check needs the whole image, flags() keeps the export from writing rows in short file mode.
 */
   uint16_t layers = 3;  // default are rgb images
 
@@ -167,7 +322,7 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
   if(dt_conf_key_exists("plugins/imageio/format/tiff/shortfile"))
     shortmode = dt_conf_get_int("plugins/imageio/format/tiff/shortfile");
 
-  if((d->global.height > 4) && (d->global.width > 4) && shortmode)
+  if(in_void && (d->global.height > 4) && (d->global.width > 4) && shortmode)
   {
     layers = 1;    // let's now assume a grayscale
     if(d->bpp == 32)
@@ -246,300 +401,322 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
   TIFFSetField(tif, TIFFTAG_YRESOLUTION, (float)resolution);
   TIFFSetField(tif, TIFFTAG_RESOLUTIONUNIT, RESUNIT_INCH);
 
-  const size_t rowsize = (d->global.width * layers) * d->bpp / 8;
-  if((rowdata = malloc(rowsize)) == NULL)
-  {
-    rc = 1;
-    goto exit;
-  }
+  w->layers = layers;
+  w->resolution = resolution;
 
-  if(d->bpp == 32)
-  {
-    for(int y = 0; y < d->global.height; y++)
-    {
-      float *in = (float *)in_void + (size_t)4 * y * d->global.width;
-      float *out = (float *)rowdata;
-
-      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
-      {
-        memcpy(out, in, sizeof(float) * layers);
-      }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
-    }
-  }
-  else if(d->bpp == 16)
-  {
-    for(int y = 0; y < d->global.height; y++)
-    {
-      uint16_t *in = (uint16_t *)in_void + (size_t)4 * y * d->global.width;
-      uint16_t *out = (uint16_t *)rowdata;
-
-      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
-      {
-        memcpy(out, in, sizeof(uint16_t) * layers);
-      }
+  w->rowsize = (d->global.width * layers) * d->bpp / 8;
+  if((w->rowdata = malloc(w->rowsize)) == NULL) goto error;
 
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
-    }
-  }
-  else
-  {
-    for(int y = 0; y < d->global.height; y++)
-    {
-      uint8_t *in = (uint8_t *)in_void + (size_t)4 * y * d->global.width;
-      uint8_t *out = (uint8_t *)rowdata;
+  // compressed images are encoded on all threads if possible, otherwise line by line
+  if(_deflate_strips_init(w, d)) goto error;
 
-      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
-      {
-        memcpy(out, in, sizeof(uint8_t) * layers);
-      }
+  return w;
 
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
-    }
-  }
-
-  rc = 0;
-
-  // close the file before adding exif data
-  if(tif)
-  {
-    TIFFClose(tif);
-    tif = NULL;
-  }
-  if(!rc && exif)
-  {
-    rc = dt_exif_write_blob(exif, exif_len, filename, d->compress > 0);
-    // Until we get symbolic error status codes, if rc is 1, return 0
-    rc = (rc == 1) ? 0 : 1;
-  }
+error:
+  _writer_free(w);
+  return NULL;
+}
 
-  // exiv2 doesn't support multi page tiffs. so we have to write in two steps. :-(
+// exiv2 doesn't support multi page tiffs. so we have to write in two steps. :-(
+static int _write_masks(dt_imageio_tiff_writer_t *writer, const dt_imageio_tiff_t *d)
+{
+  dt_dev_pixelpipe_t *pipe = writer->pipe;
+  const uint16_t layers = writer->layers;
+  const uint16_t n_pages = writer->n_pages;
+  const int resolution = writer->resolution;
+  gboolean free_mask = FALSE;
+  float *raster_mask = NULL;
+  int rc = 1; // default to error
 
-  if(rc == 0 && n_pages > 1)
-  {
 #ifdef _WIN32
-    tif = TIFFOpenW(wfilename, "al");
+  TIFF *tif = TIFFOpenW(writer->wfilename, "al");
 #else
-    tif = TIFFOpen(filename, "al");
+  TIFF *tif = TIFFOpen(writer->filename, "al");
 #endif
 
-    if(!tif)
-    {
-      rc = 1;
-      goto exit;
-    }
+  if(!tif) return 1;
+
+  // add masks
+  float missing_raster_mask[8 * 8] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0,
+                                       0.0, 0.0, 1.0, 1.0, 1.0, 1.0, 0.0, 0.0,
+                                       0.0, 1.0, 0.0, 1.0, 1.0, 0.0, 1.0, 0.0,
+                                       0.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 0.0,
+                                       0.0, 0.0, 1.0, 0.0, 0.0, 1.0, 0.0, 0.0,
+                                       0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0,
+                                       0.0, 0.0, 1.0, 1.0, 1.0, 1.0, 0.0, 0.0,
+                                       0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+  static const size_t missing_raster_mask_w = 8, missing_raster_mask_h = 8;
+  uint16_t page = 1;
+  for(GList *iter = pipe->nodes; iter; iter = g_list_next(iter))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)iter->data;
 
-    // add masks
-    float missing_raster_mask[8 * 8] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0,
-                                         0.0, 0.0, 1.0, 1.0, 1.0, 1.0, 0.0, 0.0,
-                                         0.0, 1.0, 0.0, 1.0, 1.0, 0.0, 1.0, 0.0,
-                                         0.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 0.0,
-                                         0.0, 0.0, 1.0, 0.0, 0.0, 1.0, 0.0, 0.0,
-                                         0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0,
-                                         0.0, 0.0, 1.0, 1.0, 1.0, 1.0, 0.0, 0.0,
-                                         0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
-    static const size_t missing_raster_mask_w = 8, missing_raster_mask_h = 8;
-    uint16_t page = 1;
-    for(GList *iter = pipe->nodes; iter; iter = g_list_next(iter))
+    GHashTableIter rm_iter;
+    gpointer key, value;
+
+    g_hash_table_iter_init(&rm_iter, piece->raster_masks);
+    while(g_hash_table_iter_next(&rm_iter, &key, &value))
     {
-      dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)iter->data;
+      if(free_mask) dt_free_align(raster_mask);
+      raster_mask = dt_dev_get_raster_mask(pipe, piece->module, GPOINTER_TO_INT(key), NULL, &free_mask);
 
-      GHashTableIter rm_iter;
-      gpointer key, value;
 
-      g_hash_table_iter_init(&rm_iter, piece->raster_masks);
-      while(g_hash_table_iter_next(&rm_iter, &key, &value))
+      size_t w = d->global.width, h = d->global.height;
+      if(!raster_mask)
       {
-        if(free_mask) dt_free_align(raster_mask);
-        raster_mask = dt_dev_get_raster_mask(pipe, piece->module, GPOINTER_TO_INT(key), NULL, &free_mask);
-
+        // this should never happen
+        w = missing_raster_mask_w;
+        h = missing_raster_mask_h;
+        raster_mask = missing_raster_mask;
+        free_mask = FALSE;
+      }
 
-        size_t w = d->global.width, h = d->global.height;
-        if(!raster_mask)
-        {
-          // this should never happen
-          w = missing_raster_mask_w;
-          h = missing_raster_mask_h;
-          raster_mask = missing_raster_mask;
-          free_mask = FALSE;
-        }
+      TIFFSetField(tif, TIFFTAG_SUBFILETYPE, FILETYPE_PAGE);
+      TIFFSetField(tif, TIFFTAG_PAGENUMBER, page, n_pages);
 
-        TIFFSetField(tif, TIFFTAG_SUBFILETYPE, FILETYPE_PAGE);
-        TIFFSetField(tif, TIFFTAG_PAGENUMBER, page, n_pages);
+      const char *pagename = g_hash_table_lookup(piece->module->raster_mask.source.masks, key);
+      if(pagename)
+        TIFFSetField(tif, TIFFTAG_PAGENAME, pagename);
+      else
+        TIFFSetField(tif, TIFFTAG_PAGENAME, piece->module->name());
 
-        const char *pagename = g_hash_table_lookup(piece->module->raster_mask.source.masks, key);
-        if(pagename)
-          TIFFSetField(tif, TIFFTAG_PAGENAME, pagename);
+      if(d->compress == 1)
+      {
+        TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
+        TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_NONE);
+        TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
+      }
+      else if(d->compress == 2)
+      {
+        TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
+        if(d->bpp == 32)
+          TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_FLOATINGPOINT);
         else
-          TIFFSetField(tif, TIFFTAG_PAGENAME, piece->module->name());
-
-        if(d->compress == 1)
-        {
-          TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
-          TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_NONE);
-          TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
-        }
-        else if(d->compress == 2)
-        {
-          TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
-          if(d->bpp == 32)
-            TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_FLOATINGPOINT);
-          else
-            TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
-          TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
-        }
+          TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+        TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
+      }
 
-        TIFFSetField(tif, TIFFTAG_XRESOLUTION, (float)resolution);
-        TIFFSetField(tif, TIFFTAG_YRESOLUTION, (float)resolution);
-        TIFFSetField(tif, TIFFTAG_RESOLUTIONUNIT, RESUNIT_INCH);
+      TIFFSetField(tif, TIFFTAG_XRESOLUTION, (float)resolution);
+      TIFFSetField(tif, TIFFTAG_YRESOLUTION, (float)resolution);
+      TIFFSetField(tif, TIFFTAG_RESOLUTIONUNIT, RESUNIT_INCH);
 
-        TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, (uint32_t)w);
-        TIFFSetField(tif, TIFFTAG_IMAGELENGTH, (uint32_t)h);
-        TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
-        TIFFSetField(tif, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
+      TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, (uint32_t)w);
+      TIFFSetField(tif, TIFFTAG_IMAGELENGTH, (uint32_t)h);
+      TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+      TIFFSetField(tif, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
 
 #ifdef MASKS_USE_SAME_FORMAT
-        TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, layers);
-        TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, (uint16_t)d->bpp);
-        TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, (d->bpp == 32) ? SAMPLEFORMAT_IEEEFP : SAMPLEFORMAT_UINT);
-        if(layers == 3)
-          TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
-        else
-          TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
-        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(tif, 0));
+      TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, layers);
+      TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, (uint16_t)d->bpp);
+      TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, (d->bpp == 32) ? SAMPLEFORMAT_IEEEFP : SAMPLEFORMAT_UINT);
+      if(layers == 3)
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+      else
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+      TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(tif, 0));
 
-        if(w != d->global.width)
-        {
-          free(rowdata);
-          const size_t _rowsize = (w * layers) * d->bpp / 8;
-          rowdata = malloc(_rowsize);
-        }
+      if(w != d->global.width)
+      {
+        free(writer->rowdata);
+        const size_t _rowsize = (w * layers) * d->bpp / 8;
+        writer->rowdata = malloc(_rowsize);
+      }
 
-        if(d->bpp == 32)
+      if(d->bpp == 32)
+      {
+        for(int y = 0; y < h; y++)
         {
-          for(int y = 0; y < h; y++)
+          const float *in = raster_mask + (size_t)y * w;
+          float *out = (float *)writer->rowdata;
+
+          for(int x = 0; x < w; x++, out += layers)
           {
-            const float *in = raster_mask + (size_t)y * w;
-            float *out = (float *)rowdata;
-
-            for(int x = 0; x < w; x++, out += layers)
-            {
-              for(int c = 0; c < layers; c++)
-                out[c] = in[x];
-            }
-
-            if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-            {
-              rc = 1;
-              goto exit;
-            }
+            for(int c = 0; c < layers; c++)
+              out[c] = in[x];
           }
-        }
-        else if(d->bpp == 16)
-        {
-          for(int y = 0; y < h; y++)
+
+          if(TIFFWriteScanline(tif, writer->rowdata, y, 0) == -1)
           {
-            const float *in = raster_mask + (size_t)y * w;
-            uint16_t *out = (uint16_t *)rowdata;
-
-            for(int x = 0; x < w; x++, out += layers)
-            {
-              for(int c = 0; c < layers; c++)
-                out[c] = CLIP(in[x]) * 65535.0f + 0.5f;
-            }
-
-            if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-            {
-              rc = 1;
-              goto exit;
-            }
+            rc = 1;
+            goto exit;
           }
         }
-        else
+      }
+      else if(d->bpp == 16)
+      {
+        for(int y = 0; y < h; y++)
         {
-          for(int y = 0; y < h; y++)
+          const float *in = raster_mask + (size_t)y * w;
+          uint16_t *out = (uint16_t *)writer->rowdata;
+
+          for(int x = 0; x < w; x++, out += layers)
           {
-            const float *in = raster_mask + (size_t)y * w;
-            uint8_t *out = (uint8_t *)rowdata;
-
-            for(int x = 0; x < w; x++, out += layers)
-            {
-              for(int c = 0; c < layers; c++)
-                out[c] = CLIP(in[x]) * 255.0f + 0.5f;
-            }
-
-            if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-            {
-              rc = 1;
-              goto exit;
-            }
+            for(int c = 0; c < layers; c++)
+              out[c] = CLIP(in[x]) * 65535.0f + 0.5f;
           }
-        }
-#else // MASKS_USE_SAME_FORMAT
-        TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
-        TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 32);
-        TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_IEEEFP);
-        if(d->compress == 2) // override predictor set above assuming MASKS_USE_SAME_FORMAT
-            TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_FLOATINGPOINT);
-        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
-        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(tif, 0));
 
+          if(TIFFWriteScanline(tif, writer->rowdata, y, 0) == -1)
+          {
+            rc = 1;
+            goto exit;
+          }
+        }
+      }
+      else
+      {
         for(int y = 0; y < h; y++)
         {
           const float *in = raster_mask + (size_t)y * w;
-          if(TIFFWriteScanline(tif, (void *)in, y, 0) == -1)
+          uint8_t *out = (uint8_t *)writer->rowdata;
+
+          for(int x = 0; x < w; x++, out += layers)
+          {
+            for(int c = 0; c < layers; c++)
+              out[c] = CLIP(in[x]) * 255.0f + 0.5f;
+          }
+
+          if(TIFFWriteScanline(tif, writer->rowdata, y, 0) == -1)
           {
             rc = 1;
             goto exit;
           }
         }
+      }
+#else // MASKS_USE_SAME_FORMAT
+      TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+      TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 32);
+      TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_IEEEFP);
+      if(d->compress == 2) // override predictor set above assuming MASKS_USE_SAME_FORMAT
+          TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_FLOATINGPOINT);
+      TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+      TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(tif, 0));
+
+      for(int y = 0; y < h; y++)
+      {
+        const float *in = raster_mask + (size_t)y * w;
+        if(TIFFWriteScanline(tif, (void *)in, y, 0) == -1)
+        {
+          rc = 1;
+          goto exit;
+        }
+      }
 #endif // MASKS_USE_SAME_FORMAT
 
-        page++;
+      page++;
 
-        if(page < n_pages)
-        {
-          TIFFWriteDirectory(tif);
-        }
-      } // for all raster masks
-    } // for all pipe nodes
+      if(page < n_pages)
+      {
+        TIFFWriteDirectory(tif);
+      }
+    } // for all raster masks
+  } // for all pipe nodes
 
-    // success
-    rc = 0;
-  } // if more than 1 page, i.e., there are masks
+  // success
+  rc = 0;
 
 exit:
-  if(tif)
+  if(tif) TIFFClose(tif);
+  if(free_mask)
+    dt_free_align(raster_mask);
+
+  return rc;
+}
+
+void *write_rows_begin(dt_imageio_module_data_t *d_tmp, const char *filename,
+                       dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                       void *exif, int exif_len, int imgid, int num, int total, dt_dev_pixelpipe_t *pipe,
+                       const gboolean export_masks)
+{
+  return _writer_open((dt_imageio_tiff_t *)d_tmp, filename, over_type, over_filename, exif, exif_len, imgid,
+                      pipe, export_masks, NULL);
+}
+
+int write_rows(dt_imageio_module_data_t *d_tmp, void *handle, const void *rows, const int first_row,
+               const int num_rows)
+{
+  const dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)d_tmp;
+  dt_imageio_tiff_writer_t *w = (dt_imageio_tiff_writer_t *)handle;
+  const size_t width = d->global.width;
+  const size_t Bps = d->bpp / 8;
+  const size_t in_stride = width * 4 * Bps;
+  const size_t rowsize = w->rowsize;
+  const uint16_t layers = w->layers;
+
+  if(!w->raw)
   {
-    TIFFClose(tif);
-    tif = NULL;
+    for(int y = 0; y < num_rows; y++)
+    {
+      _pack_row(w->rowdata, (const uint8_t *)rows + y * in_stride, width, layers, Bps);
+      if(TIFFWriteScanline(w->tif, w->rowdata, first_row + y, 0) == -1) return 1;
+    }
+    return 0;
   }
-  free(profile);
-  profile = NULL;
-  free(rowdata);
-  rowdata = NULL;
-#ifdef _WIN32
-  g_free(wfilename);
+
+  for(int y = 0; y < num_rows;)
+  {
+    // collect as many rows as fit into the current batch of strips
+    const size_t count = MIN((size_t)(num_rows - y), w->batch * w->rows_per_strip - w->rows_in_batch);
+    uint8_t *const out = w->raw + w->rows_in_batch * rowsize;
+    const uint8_t *const in = (const uint8_t *)rows + y * in_stride;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(out, in, count, rowsize, in_stride, width, layers, Bps) \
+    schedule(static)
 #endif
-  if(free_mask)
-    dt_free_align(raster_mask);
+    for(size_t j = 0; j < count; j++) _pack_row(out + j * rowsize, in + j * in_stride, width, layers, Bps);
 
+    w->rows_in_batch += count;
+    y += count;
+    if(w->rows_in_batch == w->batch * w->rows_per_strip && _deflate_strips_flush(w, d)) return 1;
+  }
+  return 0;
+}
+
+int write_rows_end(dt_imageio_module_data_t *d_tmp, void *handle, const int failed)
+{
+  const dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)d_tmp;
+  dt_imageio_tiff_writer_t *w = (dt_imageio_tiff_writer_t *)handle;
+
+  int rc = failed;
+  if(!rc && w->raw)
+  {
+    rc = _deflate_strips_flush(w, d);
+    const size_t size = w->rowsize * d->global.height;
+    dt_print(DT_DEBUG_PERF, "[tiff] deflate compression of %.1f MB on %d threads: %.1f MB/s\n",
+             size / 1e6, dt_get_num_threads(), size / 1e6 / w->time);
+  }
+
+  // close the file before adding exif data
+  TIFFClose(w->tif);
+  w->tif = NULL;
+
+  if(!rc && w->exif)
+  {
+    rc = dt_exif_write_blob(w->exif, w->exif_len, w->filename, d->compress > 0);
+    // Until we get symbolic error status codes, if rc is 1, return 0
+    rc = (rc == 1) ? 0 : 1;
+  }
+
+  if(!rc && w->n_pages > 1) rc = _write_masks(w, d);
+
+  _writer_free(w);
   return rc;
 }
 
+int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const void *in_void,
+                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                void *exif, int exif_len, int imgid, int num, int total, dt_dev_pixelpipe_t *pipe,
+                const gboolean export_masks)
+{
+  dt_imageio_tiff_writer_t *w = _writer_open((dt_imageio_tiff_t *)d_tmp, filename, over_type, over_filename,
+                                             exif, exif_len, imgid, pipe, export_masks, in_void);
+  if(!w) return 1;
+
+  const int rc = write_rows(d_tmp, w, in_void, 0, d_tmp->height);
+  return write_rows_end(d_tmp, w, rc);
+}
+
 #if 0
 int dt_imageio_tiff_read_header(const char *filename, dt_imageio_tiff_t *tiff)
 {
@@ -869,7 +1046,10 @@ void gui_reset(dt_imageio_module_format_t *self)
 
 int flags(dt_imageio_module_data_t *data)
 {
-  return FORMAT_FLAGS_SUPPORT_XMP | FORMAT_FLAGS_SUPPORT_LAYERS;
+  // the grayscale check of short files has to see the whole image before the first row is written
+  const gboolean shortfile = dt_conf_key_exists("plugins/imageio/format/tiff/shortfile")
+                             && dt_conf_get_int("plugins/imageio/format/tiff/shortfile");
+  return FORMAT_FLAGS_SUPPORT_XMP | FORMAT_FLAGS_SUPPORT_LAYERS | (shortfile ? FORMAT_FLAGS_NO_ROWS : 0);
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
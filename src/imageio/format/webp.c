@@ -121,78 +121,159 @@ static int FileWriter(const uint8_t *data, size_t data_size, const WebPPicture *
   return data_size ? (fwrite(data, data_size, 1, out) == 1) : 1;
 }
 
-int write_image(dt_imageio_module_data_t *webp, const char *filename, const void *in_tmp,
-                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
-                void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
-                const gboolean export_masks)
+typedef struct dt_imageio_webp_writer_t
 {
-  FILE *out = NULL;
+  FILE *out;
+  const char *filename;
+  void *exif;
+  int exif_len;
+  WebPConfig config;
+  // libwebp only encodes whole pictures, so this holds the full frame: YUV 4:2:0 planes when lossy, ARGB when
+  // lossless. only the RGBX input is streamed.
   WebPPicture pic;
-  int pic_init = 0;
+  gboolean allocated;
+} dt_imageio_webp_writer_t;
 
+void *write_rows_begin(dt_imageio_module_data_t *webp, const char *filename,
+                       dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                       void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
+                       const gboolean export_masks)
+{
   dt_imageio_webp_t *webp_data = (dt_imageio_webp_t *)webp;
-  out = g_fopen(filename, "w+b");
-  if (!out)
+  dt_imageio_webp_writer_t *w = calloc(1, sizeof(dt_imageio_webp_writer_t));
+  if(!w) return NULL;
+
+  w->filename = filename;
+  w->exif = exif;
+  w->exif_len = exif_len;
+  w->out = g_fopen(filename, "w+b");
+  if (!w->out)
   {
     fprintf(stderr, "[webp export] error saving to %s\n", filename);
     goto error;
   }
 
   // Create, configure and validate a WebPConfig instance
-  WebPConfig config;
-  if(!WebPConfigPreset(&config, webp_data->hint, (float)webp_data->quality)) goto error;
+  WebPConfig *config = &w->config;
+  if(!WebPConfigPreset(config, webp_data->hint, (float)webp_data->quality)) goto error;
 
   // TODO(jinxos): expose more config options in the UI
-  config.lossless = webp_data->comp_type;
-  config.image_hint = webp_data->hint;
-  config.method = 6;
+  config->lossless = webp_data->comp_type;
+  config->image_hint = webp_data->hint;
+  config->method = 6;
 
   // these are to allow for large image export.
   // TODO(jinxos): these values should be adjusted as needed and ideally determined at runtime.
-  config.segments = 4;
-  config.partition_limit = 70;
-  if(!WebPValidateConfig(&config))
+  config->segments = 4;
+  config->partition_limit = 70;
+  if(!WebPValidateConfig(config))
   {
     fprintf(stderr, "[webp export] error validating encoder configuration\n");
     goto error;
   }
 
-  if(!WebPPictureInit(&pic)) goto error;
-  pic_init = 1;
-  pic.width = webp_data->global.width;
-  pic.height = webp_data->global.height;
-  pic.use_argb = !!(config.lossless);
-  pic.writer = FileWriter;
-  pic.custom_ptr = out;
+  if(!WebPPictureInit(&w->pic)) goto error;
+  w->pic.width = webp_data->global.width;
+  w->pic.height = webp_data->global.height;
+  // webp is more efficient at coding YUV images, as we go lossy
+  // let the encoder where best to spend its bits instead of forcing it
+  // to spend bits equally on RGB data that doesn't weight the same when
+  // considering the human visual system.
+  w->pic.use_argb = !!(config->lossless);
+  w->pic.writer = FileWriter;
+  w->pic.custom_ptr = w->out;
+  return w;
+
+error:
+  if(w->out) fclose(w->out);
+  free(w);
+  return NULL;
+}
+
+int write_rows(dt_imageio_module_data_t *webp, void *handle, const void *rows, const int first_row,
+               const int num_rows)
+{
+  dt_imageio_webp_writer_t *w = (dt_imageio_webp_writer_t *)handle;
+  WebPPicture *pic = &w->pic;
+  const int width = pic->width;
+
+  // the whole image is imported in one go, as write_image() always did
+  if(first_row == 0 && num_rows == pic->height)
+    return !WebPPictureImportRGBX(pic, (const uint8_t *)rows, width * 4);
+
+  if(!w->allocated)
+  {
+    if(!WebPPictureAlloc(pic)) return 1;
+    w->allocated = TRUE;
+  }
+
+  if(pic->use_argb)
+  {
+    for(int y = 0; y < num_rows; y++)
+    {
+      const uint8_t *in = (const uint8_t *)rows + (size_t)4 * width * y;
+      uint32_t *out = pic->argb + (size_t)pic->argb_stride * (first_row + y);
+      for(int x = 0; x < width; x++, in += 4)
+        out[x] = 0xff000000u | ((uint32_t)in[0] << 16) | ((uint32_t)in[1] << 8) | in[2];
+    }
+    return 0;
+  }
 
-  WebPPictureImportRGBX(&pic, (const uint8_t *)in_tmp, webp_data->global.width * 4);
-  if(!config.lossless)
+  // convert the band to YUV 4:2:0 on its own and copy the planes into place. bands start on
+  // even rows, so the chroma of each pair of rows is the same as for the whole image.
+  if(first_row & 1) return 1;
+  WebPPicture band;
+  if(!WebPPictureInit(&band)) return 1;
+  band.width = width;
+  band.height = num_rows;
+  if(!WebPPictureImportRGBX(&band, (const uint8_t *)rows, width * 4))
+  {
+    WebPPictureFree(&band);
+    return 1;
+  }
+  for(int y = 0; y < num_rows; y++)
+    memcpy(pic->y + (size_t)pic->y_stride * (first_row + y), band.y + (size_t)band.y_stride * y, width);
+  const int uv_width = (width + 1) / 2;
+  for(int y = 0; y < (num_rows + 1) / 2; y++)
   {
-    // webp is more efficient at coding YUV images, as we go lossy
-    // let the encoder where best to spend its bits instead of forcing it
-    // to spend bits equally on RGB data that doesn't weight the same when
-    // considering the human visual system.
-    WebPPictureARGBToYUVA(&pic, WEBP_YUV420A);
+    memcpy(pic->u + (size_t)pic->uv_stride * (first_row / 2 + y), band.u + (size_t)band.uv_stride * y, uv_width);
+    memcpy(pic->v + (size_t)pic->uv_stride * (first_row / 2 + y), band.v + (size_t)band.uv_stride * y, uv_width);
   }
+  WebPPictureFree(&band);
+  return 0;
+}
+
+int write_rows_end(dt_imageio_module_data_t *webp, void *handle, const int failed)
+{
+  dt_imageio_webp_writer_t *w = (dt_imageio_webp_writer_t *)handle;
 
-  if(!WebPEncode(&config, &pic))
+  int rc = failed;
+  if(!rc && !WebPEncode(&w->config, &w->pic))
   {
     fprintf(stderr, "[webp export] error during encoding (err:%d - %s)\n",
-            pic.error_code, get_error_str(pic.error_code));
-    goto error;
+            w->pic.error_code, get_error_str(w->pic.error_code));
+    rc = 1;
   }
 
-  WebPPictureFree(&pic);
-  fclose(out);
+  WebPPictureFree(&w->pic);
+  fclose(w->out);
 
-  dt_exif_write_blob(exif, exif_len, filename, 1);
+  if(!rc) dt_exif_write_blob(w->exif, w->exif_len, w->filename, 1);
 
-  return 0;
+  free(w);
+  return rc;
+}
 
-error:
-  if (pic_init) WebPPictureFree(&pic);
-  if(out) fclose(out);
-  return 1;
+int write_image(dt_imageio_module_data_t *webp, const char *filename, const void *in_tmp,
+                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
+                const gboolean export_masks)
+{
+  void *w = write_rows_begin(webp, filename, over_type, over_filename, exif, exif_len, imgid, num, total, pipe,
+                             export_masks);
+  if(!w) return 1;
+  const int rc = write_rows(webp, w, in_tmp, 0, webp->height);
+  return write_rows_end(webp, w, rc);
 }
 
 size_t params_size(dt_imageio_module_format_t *self)
@@ -192,6 +192,13 @@ public:
     values = new Value[maxFill()]{ 0 };
   }
 
+  /* Constructor for a table holding n entries without growing */
+  explicit HashTablePermutohedral(size_t n)
+  {
+    allocate(n);
+    filled = 0;
+  }
+
   HashTablePermutohedral(const HashTablePermutohedral &) = delete;
 
   ~HashTablePermutohedral()
@@ -271,6 +278,38 @@ public:
     return (offset < 0) ? nullptr : values + offset;
   };
 
+  /* Drops the content of the table and makes room for n distinct keys, to be stored
+   * with insertUnique().
+   */
+  void resetUnique(size_t n)
+  {
+    delete[] entries;
+    delete[] keys;
+    delete[] values;
+    allocate(n);
+    filled = n;
+  }
+
+  /* Stores a key and its value at the given index. The keys must all be distinct and so must the
+   * indices, in which case several threads can insert at the same time: only the bucket needs to be
+   * claimed atomically.
+   */
+  void insertUnique(int idx, const Key &key, const Value &value)
+  {
+    keys[idx] = key;
+    values[idx] = value;
+    size_t h = key.hash & capacity_bits;
+    while(1)
+    {
+      int expected = -1;
+      if(__atomic_load_n(&entries[h].keyIdx, __ATOMIC_RELAXED) == -1
+         && __atomic_compare_exchange_n(&entries[h].keyIdx, &expected, idx, false, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED))
+        return;
+      h = (h + 1) & capacity_bits;
+    }
+  }
+
   /* Grows the size of the hash table */
   void grow(int order = 1)
   {
@@ -311,6 +350,21 @@ public:
   }
 
 private:
+  // allocate empty arrays for at least n entries
+  void allocate(size_t n)
+  {
+    capacity = 1 << 4;
+    capacity_bits = 0xf;
+    while(maxFill() < n)
+    {
+      capacity *= 2;
+      capacity_bits = (capacity_bits << 1) | 1;
+    }
+    entries = new Entry[capacity];
+    keys = new Key[maxFill()];
+    values = new Value[maxFill()];
+  }
+
   // Private struct for the hash table entries.
   struct Entry
   {
@@ -340,6 +394,10 @@ private:
   typedef typename HashTable::Key Key;
   typedef typename HashTable::Value Value;
 
+  // below this many threads merge_splat_threads() stays sequential. with 2.5x the work, the
+  // partitioned merge breaks even at about three cores, and only the merging itself scales with them.
+  static constexpr int PARALLEL_MERGE_THREADS = 8;
+
 public:
   /* Constructor
    *     d_ : dimensionality of key vectors
@@ -508,8 +566,23 @@ public:
     }
   }
 
-  /* Merge the multiple threads' hash tables into the totals. */
+  /* Merge the multiple threads' hash tables into the totals.
+   *
+   * The partitioned merge below does about 2.5 times the work of the sequential one, which only pays
+   * off once it is spread over enough cores. Both give bit-identical results, so the choice is made
+   * on the thread count alone; src/tests/permutohedral.cc times both to tune the threshold.
+   */
   void merge_splat_threads()
+  {
+    if(nThreads <= 1) return;
+    if(nThreads < PARALLEL_MERGE_THREADS)
+      merge_splat_threads_sequential();
+    else
+      merge_splat_threads_partitioned();
+  }
+
+  /* Merge the threads' hash tables one after the other into the first one. */
+  void merge_splat_threads_sequential()
   {
     if(nThreads <= 1) return;
 
@@ -550,6 +623,7 @@ public:
       {
         for(int dim = 0; dim <= D; dim++)
           replay[i].offset[dim] = offset_remap[replay[i].table][replay[i].offset[dim]];
+        replay[i].table = 0;
       }
     }
 
@@ -557,6 +631,170 @@ public:
     delete[] offset_remap;
   }
 
+  /* Merge the multiple threads' hash tables into the totals, using all threads.
+   *
+   * The keys are split into partitions by the high bits of their hash, which the tables do not use to
+   * pick a bucket. Each partition is merged by a single thread into a small table of its own, visiting
+   * the threads' tables in order, so every value adds up its contributions in the same order as a
+   * sequential merge would. The merged vertices are then numbered as a sequential merge would have
+   * appended them, which keeps the spatial locality of the first table for blur and slice, and stored
+   * into the first table by all threads at once since the keys are now distinct.
+   */
+  void merge_splat_threads_partitioned()
+  {
+    if(nThreads <= 1) return;
+
+    constexpr int partition_bits = 8;
+    constexpr int partitions = 1 << partition_bits;
+    constexpr int stride = partitions + 1;
+    const auto partition = [](const Key &k) { return (int)(k.hash >> (32 - partition_bits)); };
+
+    /* Sort the entries of each table by partition, keeping their order within a partition. */
+    int *const start = new int[nThreads * stride];
+    int **const order = new int *[nThreads];
+    int **const offset_remap = new int *[nThreads];
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for(int i = 0; i < nThreads; i++)
+    {
+      const Key *keys = hashTables[i].getKeys();
+      const int filled = hashTables[i].size();
+      int *const first = start + i * stride;
+      int next[partitions];
+      order[i] = new int[filled];
+      offset_remap[i] = new int[filled];
+      std::fill(first, first + stride, 0);
+      for(int j = 0; j < filled; j++) first[partition(keys[j]) + 1]++;
+      for(int p = 0; p < partitions; p++) first[p + 1] += first[p];
+      std::copy(first, first + partitions, next);
+      for(int j = 0; j < filled; j++) order[i][next[partition(keys[j])]++] = j;
+    }
+
+    /* Merge each partition on its own. Remember where each entry went, and for each merged vertex
+     * the entry which created it, flagging it with -1 in the remap table.
+     */
+    HashTable **const merged = new HashTable *[partitions];
+    int **const creator = new int *[partitions];
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for(int p = 0; p < partitions; p++)
+    {
+      size_t count = 0;
+      for(int i = 0; i < nThreads; i++) count += start[i * stride + p + 1] - start[i * stride + p];
+      merged[p] = new HashTable(count);
+      creator[p] = new int[2 * count];
+      for(int i = 0; i < nThreads; i++)
+      {
+        const Key *oldKeys = hashTables[i].getKeys();
+        const Value *oldVals = hashTables[i].getValues();
+        for(int k = start[i * stride + p]; k < start[i * stride + p + 1]; k++)
+        {
+          const int j = order[i][k];
+          const int filled = merged[p]->size();
+          Value *val = merged[p]->lookup(oldKeys[j], true);
+          val->add(oldVals[j]);
+          const int offset = val - merged[p]->getValues();
+          if(offset == filled)
+          {
+            creator[p][2 * offset] = i;
+            creator[p][2 * offset + 1] = j;
+            offset_remap[i][j] = -1;
+          }
+          else
+            offset_remap[i][j] = offset;
+        }
+      }
+    }
+
+    /* Number the merged vertices in the order of the entries which created them, reusing the
+     * sorting arrays, then replace the creator of each merged vertex by its number.
+     */
+    int *const numbered = new int[nThreads + 1];
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for(int i = 0; i < nThreads; i++)
+    {
+      numbered[i + 1] = 0;
+      for(int j = 0; j < hashTables[i].size(); j++)
+        if(offset_remap[i][j] < 0) numbered[i + 1]++;
+    }
+    numbered[0] = 0;
+    for(int i = 0; i < nThreads; i++) numbered[i + 1] += numbered[i];
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for(int i = 0; i < nThreads; i++)
+    {
+      int index = numbered[i];
+      for(int j = 0; j < hashTables[i].size(); j++)
+        order[i][j] = offset_remap[i][j] < 0 ? index++ : -1;
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for(int p = 0; p < partitions; p++)
+      for(int l = 0; l < merged[p]->size(); l++)
+        creator[p][2 * l] = order[creator[p][2 * l]][creator[p][2 * l + 1]];
+
+    /* Make the remap table point to the final indices. */
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for(int i = 0; i < nThreads; i++)
+    {
+      const Key *keys = hashTables[i].getKeys();
+      for(int j = 0; j < hashTables[i].size(); j++)
+      {
+        const int offset = offset_remap[i][j];
+        offset_remap[i][j] = offset < 0 ? order[i][j] : creator[partition(keys[j])][2 * offset];
+      }
+    }
+
+    /* Store the merged vertices into the first table, which has been fully read by now. */
+    hashTables[0].resetUnique(numbered[nThreads]);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for(int p = 0; p < partitions; p++)
+    {
+      const Key *keys = merged[p]->getKeys();
+      const Value *values = merged[p]->getValues();
+      for(int l = 0; l < merged[p]->size(); l++) hashTables[0].insertUnique(creator[p][2 * l], keys[l], values[l]);
+    }
+
+    /* Rewrite the offsets in the replay structure from the above generated table. */
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for(int i = 0; i < nData; i++)
+    {
+      const int *remap = offset_remap[replay[i].table];
+      for(int dim = 0; dim <= D; dim++) replay[i].offset[dim] = remap[replay[i].offset[dim]];
+      replay[i].table = 0;
+    }
+
+    for(int i = 0; i < nThreads; i++)
+    {
+      delete[] order[i];
+      delete[] offset_remap[i];
+    }
+    for(int p = 0; p < partitions; p++)
+    {
+      delete merged[p];
+      delete[] creator[p];
+    }
+    delete[] order;
+    delete[] offset_remap;
+    delete[] merged;
+    delete[] creator;
+    delete[] numbered;
+    delete[] start;
+  }
+
   /* Performs slicing out of position vectors. Note that the barycentric weights and the simplex
    * containing each position vector were calculated and stored in the splatting step.
    * We may reuse this to accelerate the algorithm. (See pg. 6 in paper.)
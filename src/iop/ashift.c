@@ -950,6 +950,45 @@ int distort_backtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
   return 1;
 }
 
+int distort_matrix(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const int backward, float *const matrix)
+{
+  const dt_iop_ashift_data_t *const data = (dt_iop_ashift_data_t *)piece->data;
+
+  // clipping offset
+  const float fullwidth = (float)piece->buf_out.width / (data->cr - data->cl);
+  const float fullheight = (float)piece->buf_out.height / (data->cb - data->ct);
+  const float cx = fullwidth * data->cl;
+  const float cy = fullheight * data->ct;
+
+  float DT_ALIGNED_ARRAY homograph[3][3];
+  float DT_ALIGNED_ARRAY clip[3][3] = { { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } };
+
+  if(isneutral(data))
+  {
+    memcpy(matrix, clip, sizeof(clip));
+    return 1;
+  }
+
+  homography((float *)homograph, data->rotation, data->lensshift_v, data->lensshift_h, data->shear, data->f_length_kb,
+             data->orthocorr, data->aspect, piece->buf_in.width, piece->buf_in.height,
+             backward ? ASHIFT_HOMOGRAPH_INVERTED : ASHIFT_HOMOGRAPH_FORWARD);
+
+  // the forward transform applies the homography first and then removes the clipping offset
+  if(backward)
+  {
+    clip[0][2] = cx;
+    clip[1][2] = cy;
+    mat3mul(matrix, (float *)homograph, (float *)clip);
+  }
+  else
+  {
+    clip[0][2] = -cx;
+    clip[1][2] = -cy;
+    mat3mul(matrix, (float *)clip, (float *)homograph);
+  }
+  return 1;
+}
+
 void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const float *const in,
                   float *const out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
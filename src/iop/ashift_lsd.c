@@ -25,6 +25,10 @@
  *      catch (unlikely) division by zero near line 2035
  *      rename rad1 and rad2 to radius1 and radius2 in reduce_region_radius()
  *        to avoid naming conflict in windows build
+ *      compute both subsamplings of gaussian_sampler() row by row with
+ *        precomputed kernels, in parallel
+ *      compute the gradient in ll_angle() in parallel and build its pixel list
+ *        by a parallel stable bucket sort, leaving out pixels with undefined angle
  *
  */
 
@@ -167,6 +171,9 @@
 /** Label for pixels already used in detection. */
 #define USED    1
 
+/** Number of column blocks sorted in parallel by ll_angle(). */
+#define LL_ANGLE_BLOCKS 64
+
 /*----------------------------------------------------------------------------*/
 /** Chained list of coordinates.
  */
@@ -648,7 +655,9 @@ static image_double gaussian_sampler( image_double in, double scale,
   ntuple_list kernel;
   unsigned int N,M,h,n,x,y,i;
   int xc,yc,j,double_x_size,double_y_size;
-  double sigma,xx,yy,sum,prec;
+  double sigma,xx,yy,prec;
+  double *kernel_x,*kernel_y;
+  int *index_x,*index_y;
 
   /* check parameters */
   if( in == NULL || in->data == NULL || in->xsize == 0 || in->ysize == 0 )
@@ -685,8 +694,19 @@ static image_double gaussian_sampler( image_double in, double scale,
   double_x_size = (int) (2 * in->xsize);
   double_y_size = (int) (2 * in->ysize);
 
-  /* First subsampling: x axis */
-  for(x=0;x<aux->xsize;x++)
+  /*
+     The kernels and the source pixels of each output column and row
+     are computed once, so that both subsamplings below can run over
+     whole rows in parallel.
+   */
+  kernel_x = (double *) malloc( (size_t) N * n * sizeof(double) );
+  kernel_y = (double *) malloc( (size_t) M * n * sizeof(double) );
+  index_x = (int *) malloc( (size_t) N * n * sizeof(int) );
+  index_y = (int *) malloc( (size_t) M * n * sizeof(int) );
+  if( kernel_x == NULL || kernel_y == NULL || index_x == NULL || index_y == NULL )
+    error("not enough memory.");
+
+  for(x=0;x<N;x++)
     {
       /*
          x   is the coordinate in the new image.
@@ -701,26 +721,21 @@ static image_double gaussian_sampler( image_double in, double scale,
       /* the kernel must be computed for each x because the fine
          offset xx-xc is different in each case */
 
-      for(y=0;y<aux->ysize;y++)
+      for(i=0;i<n;i++)
         {
-          sum = 0.0;
-          for(i=0;i<kernel->dim;i++)
-            {
-              j = xc - h + i;
+          j = xc - h + i;
 
-              /* symmetry boundary condition */
-              while( j < 0 ) j += double_x_size;
-              while( j >= double_x_size ) j -= double_x_size;
-              if( j >= (int) in->xsize ) j = double_x_size-1-j;
+          /* symmetry boundary condition */
+          while( j < 0 ) j += double_x_size;
+          while( j >= double_x_size ) j -= double_x_size;
+          if( j >= (int) in->xsize ) j = double_x_size-1-j;
 
-              sum += in->data[ j + y * in->xsize ] * kernel->values[i];
-            }
-          aux->data[ x + y * aux->xsize ] = sum;
+          kernel_x[ x * n + i ] = kernel->values[i];
+          index_x[ x * n + i ] = j;
         }
     }
 
-  /* Second subsampling: y axis */
-  for(y=0;y<out->ysize;y++)
+  for(y=0;y<M;y++)
     {
       /*
          y   is the coordinate in the new image.
@@ -735,25 +750,68 @@ static image_double gaussian_sampler( image_double in, double scale,
       /* the kernel must be computed for each y because the fine
          offset yy-yc is different in each case */
 
-      for(x=0;x<out->xsize;x++)
+      for(i=0;i<n;i++)
         {
-          sum = 0.0;
-          for(i=0;i<kernel->dim;i++)
-            {
-              j = yc - h + i;
+          j = yc - h + i;
 
-              /* symmetry boundary condition */
-              while( j < 0 ) j += double_y_size;
-              while( j >= double_y_size ) j -= double_y_size;
-              if( j >= (int) in->ysize ) j = double_y_size-1-j;
+          /* symmetry boundary condition */
+          while( j < 0 ) j += double_y_size;
+          while( j >= double_y_size ) j -= double_y_size;
+          if( j >= (int) in->ysize ) j = double_y_size-1-j;
 
-              sum += aux->data[ x + j * aux->xsize ] * kernel->values[i];
-            }
-          out->data[ x + y * out->xsize ] = sum;
+          kernel_y[ y * n + i ] = kernel->values[i];
+          index_y[ y * n + i ] = j;
+        }
+    }
+
+  /* First subsampling: x axis */
+  const double *const in_data = in->data;
+  double *const aux_data = aux->data;
+  const unsigned int in_xsize = in->xsize;
+  const unsigned int aux_ysize = aux->ysize;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in_data, aux_data, kernel_x, index_x, in_xsize, aux_ysize, N, n) \
+  schedule(static)
+#endif
+  for(unsigned int yr=0;yr<aux_ysize;yr++)
+    {
+      const double *const row = in_data + (size_t) yr * in_xsize;
+      for(unsigned int xr=0;xr<N;xr++)
+        {
+          double sum = 0.0;
+          for(unsigned int k=0;k<n;k++)
+            sum += row[ index_x[ xr * n + k ] ] * kernel_x[ xr * n + k ];
+          aux_data[ xr + (size_t) yr * N ] = sum;
+        }
+    }
+
+  /* Second subsampling: y axis */
+  double *const out_data = out->data;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(aux_data, out_data, kernel_y, index_y, M, N, n) \
+  schedule(static)
+#endif
+  for(unsigned int yr=0;yr<M;yr++)
+    {
+      /* accumulate whole rows, in the same order for each pixel as
+         a sum over the kernel would do */
+      double *const row = out_data + (size_t) yr * N;
+      for(unsigned int xr=0;xr<N;xr++) row[xr] = 0.0;
+      for(unsigned int k=0;k<n;k++)
+        {
+          const double *const src = aux_data + (size_t) index_y[ yr * n + k ] * N;
+          const double weight = kernel_y[ yr * n + k ];
+          for(unsigned int xr=0;xr<N;xr++) row[xr] += src[xr] * weight;
         }
     }
 
   /* free memory */
+  free( (void *) kernel_x );
+  free( (void *) kernel_y );
+  free( (void *) index_x );
+  free( (void *) index_y );
   free_ntuple_list(kernel);
   free_image_double(aux);
 
@@ -772,8 +830,8 @@ static image_double gaussian_sampler( image_double in, double scale,
     - an image_double with the angle at each pixel, or NOTDEF if not defined.
     - the image_double 'modgrad' (a pointer is passed as argument)
       with the gradient magnitude at each point.
-    - a list of pixels 'list_p' roughly ordered by decreasing
-      gradient magnitude. (The order is made by classifying points
+    - a list of the pixels with a defined angle 'list_p' roughly
+      ordered by decreasing gradient magnitude. (The order is made by classifying points
       into bins by gradient magnitude. The parameters 'n_bins' and
       'max_grad' specify the number of bins and the gradient modulus
       at the highest bin. The pixels in the list would be in
@@ -787,16 +845,12 @@ static image_double ll_angle( image_double in, double threshold,
                               image_double * modgrad, unsigned int n_bins )
 {
   image_double g;
-  unsigned int n,p,x,y,adr,i;
-  double com1,com2,gx,gy,norm,norm2;
+  unsigned int n,p,x,y,b,i;
   /* the rest of the variables are used for pseudo-ordering
      the gradient magnitude values */
-  int list_count = 0;
   struct coorlist * list;
-  struct coorlist ** range_l_s; /* array of pointers to start of bin list */
-  struct coorlist ** range_l_e; /* array of pointers to end of bin list */
-  struct coorlist * start;
-  struct coorlist * end;
+  unsigned int * bin_pos; /* per block and bin: count, then list position */
+  unsigned int n_blocks,list_count;
   double max_grad = 0.0;
 
   /* check parameters */
@@ -818,26 +872,24 @@ static image_double ll_angle( image_double in, double threshold,
   /* get memory for the image of gradient modulus */
   *modgrad = new_image_double(in->xsize,in->ysize);
 
-  /* get memory for "ordered" list of pixels */
-  list = (struct coorlist *) calloc( (size_t) (n*p), sizeof(struct coorlist) );
-  *mem_p = (void *) list;
-  range_l_s = (struct coorlist **) calloc( (size_t) n_bins,
-                                           sizeof(struct coorlist *) );
-  range_l_e = (struct coorlist **) calloc( (size_t) n_bins,
-                                           sizeof(struct coorlist *) );
-  if( list == NULL || range_l_s == NULL || range_l_e == NULL )
-    error("not enough memory.");
-  for(i=0;i<n_bins;i++) range_l_s[i] = range_l_e[i] = NULL;
-
   /* 'undefined' on the down and right boundaries */
   for(x=0;x<p;x++) g->data[(n-1)*p+x] = NOTDEF;
   for(y=0;y<n;y++) g->data[p*y+p-1]   = NOTDEF;
 
   /* compute gradient on the remaining pixels */
-  for(x=0;x<p-1;x++)
-    for(y=0;y<n-1;y++)
+  const double *const in_data = in->data;
+  double *const g_data = g->data;
+  double *const mod_data = (*modgrad)->data;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in_data, g_data, mod_data, n, p, threshold) \
+  reduction(max : max_grad) \
+  schedule(static)
+#endif
+  for(unsigned int yr=0;yr<n-1;yr++)
+    for(unsigned int xr=0;xr<p-1;xr++)
       {
-        adr = y*p+x;
+        const unsigned int adr = yr*p+xr;
 
         /*
            Norm 2 computation using 2x2 pixel window:
@@ -850,72 +902,110 @@ static image_double ll_angle( image_double in, double threshold,
              gy = C+D - (A+B)   vertical difference
            com1 and com2 are just to avoid 2 additions.
          */
-        com1 = in->data[adr+p+1] - in->data[adr];
-        com2 = in->data[adr+1]   - in->data[adr+p];
+        const double com1 = in_data[adr+p+1] - in_data[adr];
+        const double com2 = in_data[adr+1]   - in_data[adr+p];
 
-        gx = com1+com2; /* gradient x component */
-        gy = com1-com2; /* gradient y component */
-        norm2 = gx*gx+gy*gy;
-        norm = sqrt( norm2 / 4.0 ); /* gradient norm */
+        const double gx = com1+com2; /* gradient x component */
+        const double gy = com1-com2; /* gradient y component */
+        const double norm2 = gx*gx+gy*gy;
+        const double norm = sqrt( norm2 / 4.0 ); /* gradient norm */
 
-        (*modgrad)->data[adr] = norm; /* store gradient norm */
+        mod_data[adr] = norm; /* store gradient norm */
 
         if( norm <= threshold ) /* norm too small, gradient no defined */
-          g->data[adr] = NOTDEF; /* gradient angle not defined */
+          g_data[adr] = NOTDEF; /* gradient angle not defined */
         else
           {
             /* gradient angle computation */
-            g->data[adr] = atan2(gx,-gy);
+            g_data[adr] = atan2(gx,-gy);
 
             /* look for the maximum of the gradient */
             if( norm > max_grad ) max_grad = norm;
           }
       }
 
-  /* compute histogram of gradient values */
-  for(x=0;x<p-1;x++)
-    for(y=0;y<n-1;y++)
-      {
-        norm = (*modgrad)->data[y*p+x];
-
-        /* store the point in the right bin according to its norm */
-        i = (unsigned int) (norm * (double) n_bins / max_grad);
-        if( i >= n_bins ) i = n_bins-1;
-        if( range_l_e[i] == NULL )
-          range_l_s[i] = range_l_e[i] = list+list_count++;
-        else
-          {
-            range_l_e[i]->next = list+list_count;
-            range_l_e[i] = list+list_count++;
-          }
-        range_l_e[i]->x = (int) x;
-        range_l_e[i]->y = (int) y;
-        range_l_e[i]->next = NULL;
-      }
-
-  /* Make the list of pixels (almost) ordered by norm value.
+  /*
+     Make the list of pixels (almost) ordered by norm value.
      It starts by the larger bin, so the list starts by the
      pixels with the highest gradient value. Pixels would be ordered
      by norm value, up to a precision given by max_grad/n_bins.
+     Inside of a bin the pixels are ordered by x, then by y.
+
+     Pixels with an undefined angle are never used as seed of a
+     region, so they are left out of the list. The list is built by a
+     stable bucket sort over blocks of columns: each block counts its
+     pixels per bin, the counts are turned into list positions, and
+     each block then stores its pixels. This gives the same order as
+     inserting all pixels one by one, for any number of threads.
    */
-  for(i=n_bins-1; i>0 && range_l_s[i]==NULL; i--);
-  start = range_l_s[i];
-  end = range_l_e[i];
-  if( start != NULL )
-    while(i>0)
-      {
-        --i;
-        if( range_l_s[i] != NULL )
+  n_blocks = p-1 < LL_ANGLE_BLOCKS ? p-1 : LL_ANGLE_BLOCKS;
+  bin_pos = (unsigned int *) calloc( (size_t) (n_blocks > 0 ? n_blocks : 1) * n_bins,
+                                     sizeof(unsigned int) );
+  if( bin_pos == NULL ) error("not enough memory.");
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(g_data, mod_data, bin_pos, n, p, n_blocks, n_bins, max_grad) \
+  schedule(static)
+#endif
+  for(unsigned int blk=0;blk<n_blocks;blk++)
+    {
+      unsigned int *const count = bin_pos + (size_t) blk * n_bins;
+      const unsigned int x_end = (unsigned int) ( (size_t) (blk+1) * (p-1) / n_blocks );
+      for(unsigned int xr=(unsigned int) ( (size_t) blk * (p-1) / n_blocks );xr<x_end;xr++)
+        for(unsigned int yr=0;yr<n-1;yr++)
           {
-            end->next = range_l_s[i];
-            end = range_l_e[i];
+            const unsigned int adr = yr*p+xr;
+            if( g_data[adr] == NOTDEF ) continue;
+            unsigned int bin = (unsigned int) (mod_data[adr] * (double) n_bins / max_grad);
+            if( bin >= n_bins ) bin = n_bins-1;
+            count[bin]++;
           }
+    }
+
+  /* list positions of the pixels of each block in each bin */
+  list_count = 0;
+  for(i=n_bins;i>0;i--)
+    for(b=0;b<n_blocks;b++)
+      {
+        const unsigned int count = bin_pos[ (size_t) b * n_bins + i-1 ];
+        bin_pos[ (size_t) b * n_bins + i-1 ] = list_count;
+        list_count += count;
       }
-  *list_p = start;
+
+  /* get memory for "ordered" list of pixels */
+  list = (struct coorlist *) calloc( (size_t) (list_count > 0 ? list_count : 1),
+                                     sizeof(struct coorlist) );
+  if( list == NULL ) error("not enough memory.");
+  *mem_p = (void *) list;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(g_data, mod_data, bin_pos, list, list_count, n, p, n_blocks, n_bins, max_grad) \
+  schedule(static)
+#endif
+  for(unsigned int blk=0;blk<n_blocks;blk++)
+    {
+      unsigned int *const pos = bin_pos + (size_t) blk * n_bins;
+      const unsigned int x_end = (unsigned int) ( (size_t) (blk+1) * (p-1) / n_blocks );
+      for(unsigned int xr=(unsigned int) ( (size_t) blk * (p-1) / n_blocks );xr<x_end;xr++)
+        for(unsigned int yr=0;yr<n-1;yr++)
+          {
+            const unsigned int adr = yr*p+xr;
+            if( g_data[adr] == NOTDEF ) continue;
+            unsigned int bin = (unsigned int) (mod_data[adr] * (double) n_bins / max_grad);
+            if( bin >= n_bins ) bin = n_bins-1;
+            const unsigned int k = pos[bin]++;
+            list[k].x = (int) xr;
+            list[k].y = (int) yr;
+            list[k].next = k+1 < list_count ? list+k+1 : NULL;
+          }
+    }
+
+  *list_p = list_count > 0 ? list : NULL;
 
   /* free memory */
-  free( (void *) range_l_s );
-  free( (void *) range_l_e );
+  free( (void *) bin_pos );
 
   return g;
 }
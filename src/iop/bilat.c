@@ -38,7 +38,7 @@
 
 // this is the version of the modules parameters,
 // and includes version information about compile-time dt
-DT_MODULE_INTROSPECTION(3, dt_iop_bilat_params_t)
+DT_MODULE_INTROSPECTION(4, dt_iop_bilat_params_t)
 
 typedef enum dt_iop_bilat_mode_t
 {
@@ -54,9 +54,20 @@ typedef struct dt_iop_bilat_params_t
   float sigma_s; // $MIN: 0.0 $MAX: 100.0 $DEFAULT: 0.5 shadows 100 & spatial 1 100 50
   float detail;  // $MIN: -1.0 $MAX: 4.0 $DEFAULT: 0.25
   float midtone; // $MIN: 0.001 $MAX: 1.0 $DEFAULT: 0.5 $DESCRIPTION: "midtone range"
+  gboolean fast; // $DEFAULT: FALSE $DESCRIPTION: "fast mode"
 }
 dt_iop_bilat_params_t;
 
+typedef struct dt_iop_bilat_params_v3_t
+{
+  uint32_t mode;
+  float sigma_r;
+  float sigma_s;
+  float detail;
+  float midtone;
+}
+dt_iop_bilat_params_v3_t;
+
 typedef struct dt_iop_bilat_params_v2_t
 {
   uint32_t mode;
@@ -85,6 +96,7 @@ typedef struct dt_iop_bilat_gui_data_t
   GtkWidget *range;
   GtkWidget *detail;
   GtkWidget *mode;
+  GtkWidget *fast;
 }
 dt_iop_bilat_gui_data_t;
 
@@ -124,7 +136,19 @@ int legacy_params(
     dt_iop_module_t *self, const void *const old_params, const int old_version,
     void *new_params, const int new_version)
 {
-  if(old_version == 2 && new_version == 3)
+  if(old_version == 3 && new_version == 4)
+  {
+    const dt_iop_bilat_params_v3_t *p3 = old_params;
+    dt_iop_bilat_params_t *p = new_params;
+    p->detail  = p3->detail;
+    p->sigma_r = p3->sigma_r;
+    p->sigma_s = p3->sigma_s;
+    p->midtone = p3->midtone;
+    p->mode    = p3->mode;
+    p->fast    = FALSE;
+    return 0;
+  }
+  else if(old_version == 2 && new_version == 4)
   {
     const dt_iop_bilat_params_v2_t *p2 = old_params;
     dt_iop_bilat_params_t *p = new_params;
@@ -133,9 +157,10 @@ int legacy_params(
     p->sigma_s = p2->sigma_s;
     p->midtone = 0.2f;
     p->mode    = p2->mode;
+    p->fast    = FALSE;
     return 0;
   }
-  else if(old_version == 1 && new_version == 3)
+  else if(old_version == 1 && new_version == 4)
   {
     const dt_iop_bilat_params_v1_t *p1 = old_params;
     dt_iop_bilat_params_t *p = new_params;
@@ -144,6 +169,7 @@ int legacy_params(
     p->sigma_s = p1->sigma_s;
     p->midtone = 0.2f;
     p->mode    = s_mode_bilateral;
+    p->fast    = FALSE;
     return 0;
   }
   return 1;
@@ -260,6 +286,9 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
     const int rad = MIN(roi_in->width, ceilf(256 * roi_in->scale / piece->iscale));
 
     tiling->factor = 2.0f + (float)local_laplacian_memory_use(width, height) / basebuffer;
+#ifdef HAVE_OPENCL
+    tiling->factor_cl = 2.0f + (float)local_laplacian_memory_use_cl(width, height) / basebuffer;
+#endif
     tiling->maxbuf
         = fmax(1.0f, (float)local_laplacian_singlebuffer_size(width, height) / basebuffer);
     tiling->overhead = 0;
@@ -279,6 +308,9 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 #ifdef HAVE_OPENCL
   if(d->mode == s_mode_bilateral)
     piece->process_cl_ready = (piece->process_cl_ready && !(darktable.opencl->avoid_atomics));
+  // the fast mode is only implemented on the cpu, keep the result the same everywhere
+  if(d->mode == s_mode_local_laplacian && d->fast)
+    piece->process_cl_ready = 0;
 #endif
   if(d->mode == s_mode_local_laplacian)
     piece->process_tiling_ready = 0; // can't deal with tiles, sorry.
@@ -322,7 +354,7 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
   }
   else // s_mode_local_laplacian
   {
-    local_laplacian_sse2(i, o, roi_in->width, roi_in->height, d->midtone, d->sigma_s, d->sigma_r, d->detail, 0);
+    local_laplacian_sse2(i, o, roi_in->width, roi_in->height, d->midtone, d->sigma_s, d->sigma_r, d->detail, d->fast, 0);
   }
 
   if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK) dt_iop_alpha_copy(i, o, roi_in->width, roi_in->height);
@@ -352,7 +384,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   }
   else // s_mode_local_laplacian
   {
-    local_laplacian(i, o, roi_in->width, roi_in->height, d->midtone, d->sigma_s, d->sigma_r, d->detail, 0);
+    local_laplacian(i, o, roi_in->width, roi_in->height, d->midtone, d->sigma_s, d->sigma_r, d->detail, d->fast, 0);
   }
 
   if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK) dt_iop_alpha_copy(i, o, roi_in->width, roi_in->height);
@@ -362,7 +394,7 @@ void gui_changed(dt_iop_module_t *self, GtkWidget *w, void *previous)
 {
   dt_iop_bilat_gui_data_t *g = (dt_iop_bilat_gui_data_t *)self->gui_data;
   dt_iop_bilat_params_t *p = (dt_iop_bilat_params_t *)self->params;
-  if(w == g->highlights || w == g->shadows || w == g->midtone)
+  if(w == g->highlights || w == g->shadows || w == g->midtone || w == g->fast)
   {
     dt_bauhaus_combobox_set(g->mode, s_mode_local_laplacian);
   }
@@ -389,6 +421,7 @@ void gui_changed(dt_iop_module_t *self, GtkWidget *w, void *previous)
     gtk_widget_set_visible(g->highlights, p->mode == s_mode_local_laplacian);
     gtk_widget_set_visible(g->shadows, p->mode == s_mode_local_laplacian);
     gtk_widget_set_visible(g->midtone, p->mode == s_mode_local_laplacian);
+    gtk_widget_set_visible(g->fast, p->mode == s_mode_local_laplacian);
     gtk_widget_set_visible(g->range, p->mode != s_mode_local_laplacian);
     gtk_widget_set_visible(g->spatial, p->mode != s_mode_local_laplacian);
   }
@@ -400,6 +433,7 @@ void gui_update(dt_iop_module_t *self)
   dt_iop_bilat_params_t *p = (dt_iop_bilat_params_t *)self->params;
   dt_bauhaus_slider_set(g->detail, p->detail);
   dt_bauhaus_combobox_set(g->mode, p->mode);
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(g->fast), p->fast);
 
   if(p->mode == s_mode_local_laplacian)
   {
@@ -469,10 +503,18 @@ void gui_init(dt_iop_module_t *self)
   dt_bauhaus_slider_set_digits(g->midtone, 3);
   gtk_widget_set_tooltip_text(g->midtone, _("defines what counts as midtones. lower for better dynamic range compression (reduce shadow and highlight contrast), increase for more powerful local contrast"));
 
+  g->fast = dt_bauhaus_toggle_from_params(self, "fast");
+  gtk_widget_set_tooltip_text(g->fast, _("keep the finest details of the image instead of remapping them.\n"
+                                         "about twice as fast and needs less memory, but the finest details\n"
+                                         "get no local contrast and the result differs visibly from the full\n"
+                                         "mode, more so with high detail and strong edges.\n"
+                                         "always processed on the CPU."));
+
   // work around multi-instance issue which calls show all a fair bit:
   g_object_set(G_OBJECT(g->highlights), "no-show-all", TRUE, NULL);
   g_object_set(G_OBJECT(g->shadows), "no-show-all", TRUE, NULL);
   g_object_set(G_OBJECT(g->midtone), "no-show-all", TRUE, NULL);
+  g_object_set(G_OBJECT(g->fast), "no-show-all", TRUE, NULL);
   g_object_set(G_OBJECT(g->range), "no-show-all", TRUE, NULL);
   g_object_set(G_OBJECT(g->spatial), "no-show-all", TRUE, NULL);
 
@@ -290,6 +290,20 @@ int distort_backtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
   return 1;
 }
 
+int distort_matrix(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const int backward, float *const matrix)
+{
+  dt_iop_crop_data_t *d = (dt_iop_crop_data_t *)piece->data;
+
+  const float crop_top = piece->buf_in.height * d->cy;
+  const float crop_left = piece->buf_in.width * d->cx;
+  const float sign = backward ? 1.0f : -1.0f;
+
+  matrix[0] = 1.0f; matrix[1] = 0.0f; matrix[2] = sign * crop_left;
+  matrix[3] = 0.0f; matrix[4] = 1.0f; matrix[5] = sign * crop_top;
+  matrix[6] = 0.0f; matrix[7] = 0.0f; matrix[8] = 1.0f;
+  return 1;
+}
+
 void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const float *const in,
                   float *const out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -611,7 +611,8 @@ static void xtrans_markesteijn_interpolate(float *out, const float *const in,
   static const short orth[12] = { 1, 0, 0, 1, -1, 0, 0, -1, 1, 0, 0, 1 },
                      patt[2][16] = { { 0, 1, 0, -1, 2, 0, -1, 0, 1, 1, 1, -1, 0, 0, 0, 0 },
                                      { 0, 1, 0, -2, 1, 0, -2, 0, 1, 1, -2, -2, 1, -1, -1, 1 } },
-                     dir[4] = { 1, TS, TS + 1, TS - 1 };
+                     // horizontal, vertical and both diagonal directions as row and column steps
+                     drow[4] = { 0, 1, 1, 1 }, dcol[4] = { 1, 0, 1, -1 };
 
   short allhex[3][3][8];
   // sgrow/sgcol is the offset in the sensor matrix of the solitary
@@ -622,7 +623,8 @@ static void xtrans_markesteijn_interpolate(float *out, const float *const in,
   const int height = roi_out->height;
   const int ndir = 4 << (passes > 1);
 
-  const size_t buffer_size = (size_t)TS * TS * (ndir * 4 + 3) * sizeof(float);
+  // rgb for all directions plus gmin and gmax, the final stages only need a few rows at a time
+  const size_t buffer_size = (size_t)TS * TS * (ndir * 3 + 2) * sizeof(float);
   size_t padded_buffer_size;
   char *const all_buffers = (char *)dt_alloc_perthread(buffer_size, sizeof(char), &padded_buffer_size);
   if(!all_buffers)
@@ -660,420 +662,458 @@ static void xtrans_markesteijn_interpolate(float *out, const float *const in,
 
   // extra passes propagates out errors at edges, hence need more padding
   const int pad_tile = (passes == 1) ? 12 : 17;
+  // tiles overlap the prior as interpolation needs a substantial border
+  const int tile_step = TS - (pad_tile*2);
+  const int tiles_x = (width + tile_step - 1) / tile_step;
+  const int tiles = tiles_x * ((height + tile_step - 1) / tile_step);
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(all_buffers, padded_buffer_size, dir, height, in, ndir, pad_tile, passes, roi_in, width, xtrans) \
+  dt_omp_firstprivate(all_buffers, padded_buffer_size, drow, dcol, height, in, ndir, pad_tile, passes, roi_in, \
+                      tile_step, tiles, tiles_x, width, xtrans) \
   shared(sgrow, sgcol, allhex, out) \
-  schedule(static)
+  schedule(dynamic)
 #endif
-  // step through TSxTS cells of image, each tile overlapping the
-  // prior as interpolation needs a substantial border
-  for(int top = -pad_tile; top < height - pad_tile; top += TS - (pad_tile*2))
+  // step through TSxTS cells of image; tiles at the image borders carry
+  // less work than the inner ones, hence the dynamic schedule
+  for(int tile = 0; tile < tiles; tile++)
   {
+    const int top = -pad_tile + (tile / tiles_x) * tile_step;
+    const int left = -pad_tile + (tile % tiles_x) * tile_step;
     char *const buffer = dt_get_perthread(all_buffers, padded_buffer_size);
     // rgb points to ndir TSxTS tiles of 3 channels (R, G, and B)
     float(*rgb)[TS][TS][3] = (float(*)[TS][TS][3])buffer;
-    // yuv points to 3 channel (Y, u, and v) TSxTS tiles
-    // note that channels come before tiles to allow for a
-    // vectorization optimization when building drv[] from yuv[]
-    float (*const yuv)[TS][TS] = (float(*)[TS][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float));
-    // drv points to ndir TSxTS tiles, each a single channel of derivatives
-    float (*const drv)[TS][TS] = (float(*)[TS][TS])(buffer + TS * TS * (ndir * 3 + 3) * sizeof(float));
-    // gmin and gmax reuse memory which is used later by yuv buffer;
-    // each points to a TSxTS tile of single channel data
+    // gmin and gmax each point to a TSxTS tile of single channel data
     float (*const gmin)[TS] = (float(*)[TS])(buffer + TS * TS * (ndir * 3) * sizeof(float));
     float (*const gmax)[TS] = (float(*)[TS])(buffer + TS * TS * (ndir * 3 + 1) * sizeof(float));
-    // homo and homosum reuse memory which is used earlier in the
-    // loop; each points to ndir single-channel TSxTS tiles
-    uint8_t (*const homo)[TS][TS] = (uint8_t(*)[TS][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float));
-    uint8_t (*const homosum)[TS][TS] = (uint8_t(*)[TS][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float)
-                                                            + TS * TS * ndir * sizeof(uint8_t));
-
-    for(int left = -pad_tile; left < width - pad_tile; left += TS - (pad_tile*2))
-    {
-      int mrow = MIN(top + TS, height + pad_tile);
-      int mcol = MIN(left + TS, width + pad_tile);
-
-      // Copy current tile from in to image buffer. If border goes
-      // beyond edges of image, fill with mirrored/interpolated edges.
-      // The extra border avoids discontinuities at image edges.
-      for(int row = top; row < mrow; row++)
-        for(int col = left; col < mcol; col++)
+    // the final stages reuse the memory of gmin and gmax for ring
+    // buffers of a few rows each. yuv holds 3 rows of the 3 channels
+    // (Y, u, and v), drv 3 rows and homo 5 rows per direction, homosum
+    // the row being averaged. columns are innermost so that all of them
+    // vectorize along the row.
+    float (*const yuv)[8][3][TS] = (float(*)[8][3][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float));
+    float (*const drv)[8][TS] = (float(*)[8][TS])(yuv + 3);
+    uint8_t (*const homo)[8][TS] = (uint8_t(*)[8][TS])(drv + 3);
+    uint8_t (*const homosum)[TS] = (uint8_t(*)[TS])(homo + 5);
+
+    int mrow = MIN(top + TS, height + pad_tile);
+    int mcol = MIN(left + TS, width + pad_tile);
+
+    // Copy current tile from in to image buffer. If border goes
+    // beyond edges of image, fill with mirrored/interpolated edges.
+    // The extra border avoids discontinuities at image edges.
+    for(int row = top; row < mrow; row++)
+      for(int col = left; col < mcol; col++)
+      {
+        float(*const pix) = rgb[0][row - top][col - left];
+        if((col >= 0) && (row >= 0) && (col < width) && (row < height))
         {
-          float(*const pix) = rgb[0][row - top][col - left];
-          if((col >= 0) && (row >= 0) && (col < width) && (row < height))
-          {
-            const int f = FCxtrans(row, col, roi_in, xtrans);
-            for(int c = 0; c < 3; c++) pix[c] = (c == f) ? in[roi_in->width * row + col] : 0.f;
-          }
-          else
+          const int f = FCxtrans(row, col, roi_in, xtrans);
+          for(int c = 0; c < 3; c++) pix[c] = (c == f) ? in[roi_in->width * row + col] : 0.f;
+        }
+        else
+        {
+          // mirror a border pixel if beyond image edge
+          const int c = FCxtrans(row, col, roi_in, xtrans);
+          for(int cc = 0; cc < 3; cc++)
           {
-            // mirror a border pixel if beyond image edge
-            const int c = FCxtrans(row, col, roi_in, xtrans);
-            for(int cc = 0; cc < 3; cc++)
+            if(cc != c)
+              pix[cc] = 0.0f;
+            else
             {
-              if(cc != c)
-                pix[cc] = 0.0f;
+#define TRANSLATE(n, size) ((n >= size) ? (2 * size - n - 2) : abs(n))
+              const int cy = TRANSLATE(row, height), cx = TRANSLATE(col, width);
+              if(c == FCxtrans(cy, cx, roi_in, xtrans))
+                pix[c] = in[roi_in->width * cy + cx];
               else
               {
-#define TRANSLATE(n, size) ((n >= size) ? (2 * size - n - 2) : abs(n))
-                const int cy = TRANSLATE(row, height), cx = TRANSLATE(col, width);
-                if(c == FCxtrans(cy, cx, roi_in, xtrans))
-                  pix[c] = in[roi_in->width * cy + cx];
-                else
-                {
-                  // interpolate if mirror pixel is a different color
-                  float sum = 0.0f;
-                  uint8_t count = 0;
-                  for(int y = row - 1; y <= row + 1; y++)
-                    for(int x = col - 1; x <= col + 1; x++)
+                // interpolate if mirror pixel is a different color
+                float sum = 0.0f;
+                uint8_t count = 0;
+                for(int y = row - 1; y <= row + 1; y++)
+                  for(int x = col - 1; x <= col + 1; x++)
+                  {
+                    const int yy = TRANSLATE(y, height), xx = TRANSLATE(x, width);
+                    const int ff = FCxtrans(yy, xx, roi_in, xtrans);
+                    if(ff == c)
                     {
-                      const int yy = TRANSLATE(y, height), xx = TRANSLATE(x, width);
-                      const int ff = FCxtrans(yy, xx, roi_in, xtrans);
-                      if(ff == c)
-                      {
-                        sum += in[roi_in->width * yy + xx];
-                        count++;
-                      }
+                      sum += in[roi_in->width * yy + xx];
+                      count++;
                     }
-                  pix[c] = sum / count;
-                }
+                  }
+                pix[c] = sum / count;
               }
             }
           }
         }
+      }
 
-      // duplicate rgb[0] to rgb[1], rgb[2], and rgb[3]
-      for(int c = 1; c <= 3; c++) memcpy(rgb[c], rgb[0], sizeof(*rgb));
+    // duplicate rgb[0] to rgb[1], rgb[2], and rgb[3]
+    for(int c = 1; c <= 3; c++) memcpy(rgb[c], rgb[0], sizeof(*rgb));
 
-      // note that successive calculations are inset within the tile
-      // so as to give enough border data, and there needs to be a 6
-      // pixel border initially to allow allhex to find neighboring
-      // pixels
+    // note that successive calculations are inset within the tile
+    // so as to give enough border data, and there needs to be a 6
+    // pixel border initially to allow allhex to find neighboring
+    // pixels
 
-      /* Set green1 and green3 to the minimum and maximum allowed values:   */
-      // Run through each red/blue or blue/red pair, setting their g1
-      // and g3 values to the min/max of green pixels surrounding the
-      // pair. Use a 3 pixel border as gmin/gmax is used by
-      // interpolate green which has a 3 pixel border.
-      const int pad_g1_g3 = 3;
-      for(int row = top + pad_g1_g3; row < mrow - pad_g1_g3; row++)
+    /* Set green1 and green3 to the minimum and maximum allowed values:   */
+    // Run through each red/blue or blue/red pair, setting their g1
+    // and g3 values to the min/max of green pixels surrounding the
+    // pair. Use a 3 pixel border as gmin/gmax is used by
+    // interpolate green which has a 3 pixel border.
+    const int pad_g1_g3 = 3;
+    for(int row = top + pad_g1_g3; row < mrow - pad_g1_g3; row++)
+    {
+      // setting max to 0.0f signifies that this is a new pair, which
+      // requires a new min/max calculation of its neighboring greens
+      float min = FLT_MAX, max = 0.0f;
+      for(int col = left + pad_g1_g3; col < mcol - pad_g1_g3; col++)
       {
-        // setting max to 0.0f signifies that this is a new pair, which
-        // requires a new min/max calculation of its neighboring greens
-        float min = FLT_MAX, max = 0.0f;
-        for(int col = left + pad_g1_g3; col < mcol - pad_g1_g3; col++)
+        // if in row of horizontal red & blue pairs (or processing
+        // vertical red & blue pairs near image bottom), reset min/max
+        // between each pair
+        if(FCxtrans(row, col, roi_in, xtrans) == 1)
         {
-          // if in row of horizontal red & blue pairs (or processing
-          // vertical red & blue pairs near image bottom), reset min/max
-          // between each pair
-          if(FCxtrans(row, col, roi_in, xtrans) == 1)
-          {
-            min = FLT_MAX, max = 0.0f;
-            continue;
-          }
-          // if at start of red & blue pair, calculate min/max of green
-          // pixels surrounding it; note that while normally using == to
-          // compare floats is suspect, here the check is if 0.0f has
-          // explicitly been assigned to max (which signifies a new
-          // red/blue pair)
-          if(max == 0.0f)
-          {
-            float (*const pix)[3] = &rgb[0][row - top][col - left];
-            const short *const hex = hexmap(row,col,allhex);
-            for(int c = 0; c < 6; c++)
-            {
-              const float val = pix[hex[c]][1];
-              if(min > val) min = val;
-              if(max < val) max = val;
-            }
-          }
-          gmin[row - top][col - left] = min;
-          gmax[row - top][col - left] = max;
-          // handle vertical red/blue pairs
-          switch((row - sgrow) % 3)
-          {
-            // hop down a row to second pixel in vertical pair
-            case 1:
-              if(row < mrow - 4) row++, col--;
-              break;
-            // then if not done with the row hop up and right to next
-            // vertical red/blue pair, resetting min/max
-            case 2:
-              min = FLT_MAX, max = 0.0f;
-              if((col += 2) < mcol - 4 && row > top + 3) row--;
-          }
+          min = FLT_MAX, max = 0.0f;
+          continue;
         }
-      }
-
-      /* Interpolate green horizontally, vertically, and along both diagonals: */
-      // need a 3 pixel border here as 3*hex[] can have a 3 unit offset
-      const int pad_g_interp = 3;
-      for(int row = top + pad_g_interp; row < mrow - pad_g_interp; row++)
-        for(int col = left + pad_g_interp; col < mcol - pad_g_interp; col++)
+        // if at start of red & blue pair, calculate min/max of green
+        // pixels surrounding it; note that while normally using == to
+        // compare floats is suspect, here the check is if 0.0f has
+        // explicitly been assigned to max (which signifies a new
+        // red/blue pair)
+        if(max == 0.0f)
         {
-          float color[8];
-          const int f = FCxtrans(row, col, roi_in, xtrans);
-          if(f == 1) continue;
           float (*const pix)[3] = &rgb[0][row - top][col - left];
           const short *const hex = hexmap(row,col,allhex);
-          // TODO: these constants come from integer math constants in
-          // dcraw -- calculate them instead from interpolation math
-          color[0] = 0.6796875f * (pix[hex[1]][1] + pix[hex[0]][1])
-                     - 0.1796875f * (pix[2 * hex[1]][1] + pix[2 * hex[0]][1]);
-          color[1] = 0.87109375f * pix[hex[3]][1] + pix[hex[2]][1] * 0.13f
-                     + 0.359375f * (pix[0][f] - pix[-hex[2]][f]);
-          for(int c = 0; c < 2; c++)
-            color[2 + c] = 0.640625f * pix[hex[4 + c]][1] + 0.359375f * pix[-2 * hex[4 + c]][1]
-                           + 0.12890625f * (2 * pix[0][f] - pix[3 * hex[4 + c]][f] - pix[-3 * hex[4 + c]][f]);
-          for(int c = 0; c < 4; c++)
-            rgb[c ^ !((row - sgrow) % 3)][row - top][col - left][1]
-                = CLAMPS(color[c], gmin[row - top][col - left], gmax[row - top][col - left]);
+          for(int c = 0; c < 6; c++)
+          {
+            const float val = pix[hex[c]][1];
+            if(min > val) min = val;
+            if(max < val) max = val;
+          }
         }
-
-      for(int pass = 0; pass < passes; pass++)
-      {
-        if(pass == 1)
+        gmin[row - top][col - left] = min;
+        gmax[row - top][col - left] = max;
+        // handle vertical red/blue pairs
+        switch((row - sgrow) % 3)
         {
-          // if on second pass, copy rgb[0] to [3] into rgb[4] to [7],
-          // and process that second set of buffers
-          memcpy(rgb + 4, rgb, sizeof(*rgb) * 4);
-          rgb += 4;
+          // hop down a row to second pixel in vertical pair
+          case 1:
+            if(row < mrow - 4) row++, col--;
+            break;
+          // then if not done with the row hop up and right to next
+          // vertical red/blue pair, resetting min/max
+          case 2:
+            min = FLT_MAX, max = 0.0f;
+            if((col += 2) < mcol - 4 && row > top + 3) row--;
         }
+      }
+    }
 
-        /* Recalculate green from interpolated values of closer pixels: */
-        if(pass)
-        {
-          const int pad_g_recalc = 6;
-          for(int row = top + pad_g_recalc; row < mrow - pad_g_recalc; row++)
-            for(int col = left + pad_g_recalc; col < mcol - pad_g_recalc; col++)
-            {
-              const int f = FCxtrans(row, col, roi_in, xtrans);
-              if(f == 1) continue;
-              const short *const hex = hexmap(row,col,allhex);
-              for(int d = 3; d < 6; d++)
-              {
-                float(*rfx)[3] = &rgb[(d - 2) ^ !((row - sgrow) % 3)][row - top][col - left];
-                const float val = rfx[-2 * hex[d]][1]
-                            + 2 * rfx[hex[d]][1] - rfx[-2 * hex[d]][f]
-                            - 2 * rfx[hex[d]][f] + 3 * rfx[0][f];
-                rfx[0][1] = CLAMPS(val / 3.0f, gmin[row - top][col - left], gmax[row - top][col - left]);
-              }
-            }
-        }
+    /* Interpolate green horizontally, vertically, and along both diagonals: */
+    // need a 3 pixel border here as 3*hex[] can have a 3 unit offset
+    const int pad_g_interp = 3;
+    for(int row = top + pad_g_interp; row < mrow - pad_g_interp; row++)
+      for(int col = left + pad_g_interp; col < mcol - pad_g_interp; col++)
+      {
+        float color[8];
+        const int f = FCxtrans(row, col, roi_in, xtrans);
+        if(f == 1) continue;
+        float (*const pix)[3] = &rgb[0][row - top][col - left];
+        const short *const hex = hexmap(row,col,allhex);
+        // TODO: these constants come from integer math constants in
+        // dcraw -- calculate them instead from interpolation math
+        color[0] = 0.6796875f * (pix[hex[1]][1] + pix[hex[0]][1])
+                   - 0.1796875f * (pix[2 * hex[1]][1] + pix[2 * hex[0]][1]);
+        color[1] = 0.87109375f * pix[hex[3]][1] + pix[hex[2]][1] * 0.13f
+                   + 0.359375f * (pix[0][f] - pix[-hex[2]][f]);
+        for(int c = 0; c < 2; c++)
+          color[2 + c] = 0.640625f * pix[hex[4 + c]][1] + 0.359375f * pix[-2 * hex[4 + c]][1]
+                         + 0.12890625f * (2 * pix[0][f] - pix[3 * hex[4 + c]][f] - pix[-3 * hex[4 + c]][f]);
+        for(int c = 0; c < 4; c++)
+          rgb[c ^ !((row - sgrow) % 3)][row - top][col - left][1]
+              = CLAMPS(color[c], gmin[row - top][col - left], gmax[row - top][col - left]);
+      }
+
+    for(int pass = 0; pass < passes; pass++)
+    {
+      if(pass == 1)
+      {
+        // if on second pass, copy rgb[0] to [3] into rgb[4] to [7],
+        // and process that second set of buffers
+        memcpy(rgb + 4, rgb, sizeof(*rgb) * 4);
+        rgb += 4;
+      }
 
-        /* Interpolate red and blue values for solitary green pixels:   */
-        const int pad_rb_g = (passes == 1) ? 6 : 5;
-        for(int row = (top - sgrow + pad_rb_g + 2) / 3 * 3 + sgrow; row < mrow - pad_rb_g; row += 3)
-          for(int col = (left - sgcol + pad_rb_g + 2) / 3 * 3 + sgcol; col < mcol - pad_rb_g; col += 3)
+      /* Recalculate green from interpolated values of closer pixels: */
+      if(pass)
+      {
+        const int pad_g_recalc = 6;
+        for(int row = top + pad_g_recalc; row < mrow - pad_g_recalc; row++)
+          for(int col = left + pad_g_recalc; col < mcol - pad_g_recalc; col++)
           {
-            float(*rfx)[3] = &rgb[0][row - top][col - left];
-            int h = FCxtrans(row, col + 1, roi_in, xtrans);
-            float diff[6] = { 0.0f };
-            // interplated color: first index is red/blue, second is
-            // pass, is double actual result
-            float color[2][6];
-            // Six passes, alternating hori/vert interp (i),
-            // starting with R or B (h) depending on which is closest.
-            // Passes 0,1 to rgb[0], rgb[1] of hori/vert interp. Pass
-            // 3,5 to rgb[2], rgb[3] of best of interp hori/vert
-            // results. Each pass which outputs moves on to the next
-            // rgb[] for input of interp greens.
-            for(int i = 1, d = 0; d < 6; d++, i ^= TS ^ 1, h ^= 2)
+            const int f = FCxtrans(row, col, roi_in, xtrans);
+            if(f == 1) continue;
+            const short *const hex = hexmap(row,col,allhex);
+            for(int d = 3; d < 6; d++)
             {
-              // look 1 and 2 pixels distance from solitary green to
-              // red then blue or blue then red
-              for(int c = 0; c < 2; c++, h ^= 2)
-              {
-                // rate of change in greens between current pixel and
-                // interpolated pixels 1 or 2 distant: a quick
-                // derivative which will be divided by two later to be
-                // rate of luminance change for red/blue between known
-                // red/blue neighbors and the current unknown pixel
-                const float g = 2 * rfx[0][1] - rfx[i << c][1] - rfx[-(i << c)][1];
-                // color is halved before being stored in rgb, hence
-                // this becomes green rate of change plus the average
-                // of the near red or blue pixels on current axis
-                color[h != 0][d] = g + rfx[i << c][h] + rfx[-(i << c)][h];
-                // Note that diff will become the slope for both red
-                // and blue differentials in the current direction.
-                // For 2nd and 3rd hori+vert passes, create a sum of
-                // steepness for both cardinal directions.
-                if(d > 1)
-                  diff[d] += SQR(rfx[i << c][1] - rfx[-(i << c)][1] - rfx[i << c][h] + rfx[-(i << c)][h])
-                             + SQR(g);
-              }
-              if((d < 2) || (d & 1))
-              { // output for passes 0, 1, 3, 5
-                // for 0, 1 just use hori/vert, for 3, 5 use best of x/y dir
-                const int d_out = d - ((d > 1) && (diff[d-1] < diff[d]));
-                rfx[0][0] = color[0][d_out] / 2.f;
-                rfx[0][2] = color[1][d_out] / 2.f;
-                rfx += TS * TS;
-              }
+              float(*rfx)[3] = &rgb[(d - 2) ^ !((row - sgrow) % 3)][row - top][col - left];
+              const float val = rfx[-2 * hex[d]][1]
+                          + 2 * rfx[hex[d]][1] - rfx[-2 * hex[d]][f]
+                          - 2 * rfx[hex[d]][f] + 3 * rfx[0][f];
+              rfx[0][1] = CLAMPS(val / 3.0f, gmin[row - top][col - left], gmax[row - top][col - left]);
             }
           }
+      }
 
-        /* Interpolate red for blue pixels and vice versa:              */
-        const int pad_rb_br = (passes == 1) ? 6 : 5;
-        for(int row = top + pad_rb_br; row < mrow - pad_rb_br; row++)
-          for(int col = left + pad_rb_br; col < mcol - pad_rb_br; col++)
+      /* Interpolate red and blue values for solitary green pixels:   */
+      const int pad_rb_g = (passes == 1) ? 6 : 5;
+      for(int row = (top - sgrow + pad_rb_g + 2) / 3 * 3 + sgrow; row < mrow - pad_rb_g; row += 3)
+        for(int col = (left - sgcol + pad_rb_g + 2) / 3 * 3 + sgcol; col < mcol - pad_rb_g; col += 3)
+        {
+          float(*rfx)[3] = &rgb[0][row - top][col - left];
+          int h = FCxtrans(row, col + 1, roi_in, xtrans);
+          float diff[6] = { 0.0f };
+          // interplated color: first index is red/blue, second is
+          // pass, is double actual result
+          float color[2][6];
+          // Six passes, alternating hori/vert interp (i),
+          // starting with R or B (h) depending on which is closest.
+          // Passes 0,1 to rgb[0], rgb[1] of hori/vert interp. Pass
+          // 3,5 to rgb[2], rgb[3] of best of interp hori/vert
+          // results. Each pass which outputs moves on to the next
+          // rgb[] for input of interp greens.
+          for(int i = 1, d = 0; d < 6; d++, i ^= TS ^ 1, h ^= 2)
           {
-            const int f = 2 - FCxtrans(row, col, roi_in, xtrans);
-            if(f == 1) continue;
-            float(*rfx)[3] = &rgb[0][row - top][col - left];
-            const int c = (row - sgrow) % 3 ? TS : 1;
-            const int h = 3 * (c ^ TS ^ 1);
-            for(int d = 0; d < 4; d++, rfx += TS * TS)
+            // look 1 and 2 pixels distance from solitary green to
+            // red then blue or blue then red
+            for(int c = 0; c < 2; c++, h ^= 2)
             {
-              const int i = d > 1 || ((d ^ c) & 1) ||
-                ((fabsf(rfx[0][1]-rfx[c][1]) + fabsf(rfx[0][1]-rfx[-c][1])) <
-                 2.f*(fabsf(rfx[0][1]-rfx[h][1]) + fabsf(rfx[0][1]-rfx[-h][1]))) ? c:h;
-              rfx[0][f] = (rfx[i][f] + rfx[-i][f] + 2.f * rfx[0][1] - rfx[i][1] - rfx[-i][1]) / 2.f;
+              // rate of change in greens between current pixel and
+              // interpolated pixels 1 or 2 distant: a quick
+              // derivative which will be divided by two later to be
+              // rate of luminance change for red/blue between known
+              // red/blue neighbors and the current unknown pixel
+              const float g = 2 * rfx[0][1] - rfx[i << c][1] - rfx[-(i << c)][1];
+              // color is halved before being stored in rgb, hence
+              // this becomes green rate of change plus the average
+              // of the near red or blue pixels on current axis
+              color[h != 0][d] = g + rfx[i << c][h] + rfx[-(i << c)][h];
+              // Note that diff will become the slope for both red
+              // and blue differentials in the current direction.
+              // For 2nd and 3rd hori+vert passes, create a sum of
+              // steepness for both cardinal directions.
+              if(d > 1)
+                diff[d] += SQR(rfx[i << c][1] - rfx[-(i << c)][1] - rfx[i << c][h] + rfx[-(i << c)][h])
+                           + SQR(g);
+            }
+            if((d < 2) || (d & 1))
+            { // output for passes 0, 1, 3, 5
+              // for 0, 1 just use hori/vert, for 3, 5 use best of x/y dir
+              const int d_out = d - ((d > 1) && (diff[d-1] < diff[d]));
+              rfx[0][0] = color[0][d_out] / 2.f;
+              rfx[0][2] = color[1][d_out] / 2.f;
+              rfx += TS * TS;
             }
           }
+        }
 
-        /* Fill in red and blue for 2x2 blocks of green:                */
-        const int pad_g22 = (passes == 1) ? 8 : 4;
-        for(int row = top + pad_g22; row < mrow - pad_g22; row++)
+      /* Interpolate red for blue pixels and vice versa:              */
+      const int pad_rb_br = (passes == 1) ? 6 : 5;
+      for(int row = top + pad_rb_br; row < mrow - pad_rb_br; row++)
+        for(int col = left + pad_rb_br; col < mcol - pad_rb_br; col++)
         {
-          if((row - sgrow) % 3)
-            for(int col = left + pad_g22; col < mcol - pad_g22; col++)
-              if((col - sgcol) % 3)
-              {
-                float(*rfx)[3] = &rgb[0][row - top][col - left];
-                const short *const hex = hexmap(row,col,allhex);
-                for(int d = 0; d < ndir; d += 2, rfx += TS * TS)
-                  if(hex[d] + hex[d + 1])
-                  {
-                    const float g = 3.f * rfx[0][1] - 2.f * rfx[hex[d]][1] - rfx[hex[d + 1]][1];
-                    for(int c = 0; c < 4; c += 2)
-                      rfx[0][c] = (g + 2.f * rfx[hex[d]][c] + rfx[hex[d + 1]][c]) / 3.f;
-                  }
-                  else
-                  {
-                    const float g = 2.f * rfx[0][1] - rfx[hex[d]][1] - rfx[hex[d + 1]][1];
-                    for(int c = 0; c < 4; c += 2)
-                      rfx[0][c] = (g + rfx[hex[d]][c] + rfx[hex[d + 1]][c]) / 2.f;
-                  }
-              }
+          const int f = 2 - FCxtrans(row, col, roi_in, xtrans);
+          if(f == 1) continue;
+          float(*rfx)[3] = &rgb[0][row - top][col - left];
+          const int c = (row - sgrow) % 3 ? TS : 1;
+          const int h = 3 * (c ^ TS ^ 1);
+          for(int d = 0; d < 4; d++, rfx += TS * TS)
+          {
+            const int i = d > 1 || ((d ^ c) & 1) ||
+              ((fabsf(rfx[0][1]-rfx[c][1]) + fabsf(rfx[0][1]-rfx[-c][1])) <
+               2.f*(fabsf(rfx[0][1]-rfx[h][1]) + fabsf(rfx[0][1]-rfx[-h][1]))) ? c:h;
+            rfx[0][f] = (rfx[i][f] + rfx[-i][f] + 2.f * rfx[0][1] - rfx[i][1] - rfx[-i][1]) / 2.f;
+          }
         }
-      } // end of multipass loop
-
-      // jump back to the first set of rgb buffers (this is a nop
-      // unless on the second pass)
-      rgb = (float(*)[TS][TS][3])buffer;
-      // from here on out, mainly are working within the current tile
-      // rather than in reference to the image, so don't offset
-      // mrow/mcol by top/left of tile
-      mrow -= top;
-      mcol -= left;
 
-      /* Convert to perceptual colorspace and differentiate in all directions:  */
-      // Original dcraw algorithm uses CIELab as perceptual space
-      // (presumably coming from original AHD) and converts taking
-      // camera matrix into account. Now use YPbPr which requires much
-      // less code and is nearly indistinguishable. It assumes the
-      // camera RGB is roughly linear.
+      /* Fill in red and blue for 2x2 blocks of green:                */
+      const int pad_g22 = (passes == 1) ? 8 : 4;
+      for(int row = top + pad_g22; row < mrow - pad_g22; row++)
+      {
+        if((row - sgrow) % 3)
+          for(int col = left + pad_g22; col < mcol - pad_g22; col++)
+            if((col - sgcol) % 3)
+            {
+              float(*rfx)[3] = &rgb[0][row - top][col - left];
+              const short *const hex = hexmap(row,col,allhex);
+              for(int d = 0; d < ndir; d += 2, rfx += TS * TS)
+                if(hex[d] + hex[d + 1])
+                {
+                  const float g = 3.f * rfx[0][1] - 2.f * rfx[hex[d]][1] - rfx[hex[d + 1]][1];
+                  for(int c = 0; c < 4; c += 2)
+                    rfx[0][c] = (g + 2.f * rfx[hex[d]][c] + rfx[hex[d + 1]][c]) / 3.f;
+                }
+                else
+                {
+                  const float g = 2.f * rfx[0][1] - rfx[hex[d]][1] - rfx[hex[d + 1]][1];
+                  for(int c = 0; c < 4; c += 2)
+                    rfx[0][c] = (g + rfx[hex[d]][c] + rfx[hex[d + 1]][c]) / 2.f;
+                }
+            }
+      }
+    } // end of multipass loop
+
+    // jump back to the first set of rgb buffers (this is a nop
+    // unless on the second pass)
+    rgb = (float(*)[TS][TS][3])buffer;
+    // from here on out, mainly are working within the current tile
+    // rather than in reference to the image, so don't offset
+    // mrow/mcol by top/left of tile
+    mrow -= top;
+    mcol -= left;
+
+    /* Convert to perceptual colorspace and differentiate in all directions:  */
+    // Original dcraw algorithm uses CIELab as perceptual space
+    // (presumably coming from original AHD) and converts taking
+    // camera matrix into account. Now use YPbPr which requires much
+    // less code and is nearly indistinguishable. It assumes the
+    // camera RGB is roughly linear.
+    // Each of the following stages only needs the rows up to two
+    // below the current one of the stage before, so all of them run
+    // in a single sweep over the rows of the tile: yuv is built for
+    // row, drv for row - 1, homo for row - 2 and the final average
+    // for row - 4.
+    const int pad_yuv = (passes == 1) ? 8 : 13;
+    const int pad_drv = (passes == 1) ? 9 : 14;
+    const int pad_homo = (passes == 1) ? 10 : 15;
+    for(int row = pad_yuv; row < mrow - pad_yuv; row++)
+    {
       for(int d = 0; d < ndir; d++)
       {
-        const int pad_yuv = (passes == 1) ? 8 : 13;
-        for(int row = pad_yuv; row < mrow - pad_yuv; row++)
-          for(int col = pad_yuv; col < mcol - pad_yuv; col++)
-          {
-            const float *rx = rgb[d][row][col];
-            // use ITU-R BT.2020 YPbPr, which is great, but could use
-            // a better/simpler choice? note that imageop.h provides
-            // dt_iop_RGB_to_YCbCr which uses Rec. 601 conversion,
-            // which appears less good with specular highlights
-            const float y = 0.2627f * rx[0] + 0.6780f * rx[1] + 0.0593f * rx[2];
-            yuv[0][row][col] = y;
-            yuv[1][row][col] = (rx[2] - y) * 0.56433f;
-            yuv[2][row][col] = (rx[0] - y) * 0.67815f;
-          }
-        // Note that f can offset by a column (-1 or +1) and by a row
-        // (-TS or TS). The row-wise offsets cause the undefined
-        // behavior sanitizer to warn of an out of bounds index, but
-        // as yfx is multi-dimensional and there is sufficient
-        // padding, that is not actually so.
-        const int f = dir[d & 3];
-        const int pad_drv = (passes == 1) ? 9 : 14;
-        for(int row = pad_drv; row < mrow - pad_drv; row++)
-          for(int col = pad_drv; col < mcol - pad_drv; col++)
-          {
-            const float(*yfx)[TS][TS] = (float(*)[TS][TS]) & yuv[0][row][col];
-            drv[d][row][col] = SQR(2 * yfx[0][0][0] - yfx[0][0][f] - yfx[0][0][-f])
-                               + SQR(2 * yfx[1][0][0] - yfx[1][0][f] - yfx[1][0][-f])
-                               + SQR(2 * yfx[2][0][0] - yfx[2][0][f] - yfx[2][0][-f]);
-          }
+        float (*const yrow)[TS] = yuv[row % 3][d];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+        for(int col = pad_yuv; col < mcol - pad_yuv; col++)
+        {
+          const float *rx = rgb[d][row][col];
+          // use ITU-R BT.2020 YPbPr, which is great, but could use
+          // a better/simpler choice? note that imageop.h provides
+          // dt_iop_RGB_to_YCbCr which uses Rec. 601 conversion,
+          // which appears less good with specular highlights
+          const float y = 0.2627f * rx[0] + 0.6780f * rx[1] + 0.0593f * rx[2];
+          yrow[0][col] = y;
+          yrow[1][col] = (rx[2] - y) * 0.56433f;
+          yrow[2][col] = (rx[0] - y) * 0.67815f;
+        }
       }
 
-      /* Build homogeneity maps from the derivatives:                   */
-      memset(homo, 0, sizeof(uint8_t) * ndir * TS * TS);
-      const int pad_homo = (passes == 1) ? 10 : 15;
-      for(int row = pad_homo; row < mrow - pad_homo; row++)
-        for(int col = pad_homo; col < mcol - pad_homo; col++)
+      const int rdrv = row - 1;
+      if(rdrv >= pad_drv && rdrv < mrow - pad_drv)
+        for(int d = 0; d < ndir; d++)
         {
-          float tr = FLT_MAX;
-          for(int d = 0; d < ndir; d++)
-            if(tr > drv[d][row][col]) tr = drv[d][row][col];
-          tr *= 8;
-          for(int d = 0; d < ndir; d++)
-            for(int v = -1; v <= 1; v++)
-              for(int h = -1; h <= 1; h++)
-                homo[d][row][col] += ((drv[d][row + v][col + h] <= tr) ? 1 : 0);
+          const int v = drow[d & 3], h = dcol[d & 3];
+          const float (*const yp)[TS] = yuv[(rdrv + v) % 3][d];
+          const float (*const y0)[TS] = yuv[rdrv % 3][d];
+          const float (*const ym)[TS] = yuv[(rdrv - v) % 3][d];
+          float *const dfx = drv[rdrv % 3][d];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+          for(int col = pad_drv; col < mcol - pad_drv; col++)
+            dfx[col] = SQR(2 * y0[0][col] - yp[0][col + h] - ym[0][col - h])
+                       + SQR(2 * y0[1][col] - yp[1][col + h] - ym[1][col - h])
+                       + SQR(2 * y0[2][col] - yp[2][col + h] - ym[2][col - h]);
         }
 
-      /* Build 5x5 sum of homogeneity maps for each pixel & direction */
-      for(int d = 0; d < ndir; d++)
-        for(int row = pad_tile; row < mrow - pad_tile; row++)
+      /* Build homogeneity maps from the derivatives:                   */
+      const int rhomo = row - 2;
+      if(rhomo >= pad_homo && rhomo < mrow - pad_homo)
+      {
+        const float (*const dabove)[TS] = drv[(rhomo - 1) % 3];
+        const float (*const dcur)[TS] = drv[rhomo % 3];
+        const float (*const dbelow)[TS] = drv[(rhomo + 1) % 3];
+        float tr[TS];
+        for(int col = pad_homo; col < mcol - pad_homo; col++) tr[col] = FLT_MAX;
+        for(int d = 0; d < ndir; d++)
         {
-          // start before first column where homo[d][row][col+2] != 0,
-          // so can know v5sum and homosum[d][row][col] will be 0
-          int col = pad_tile-5;
-          uint8_t v5sum[5] = { 0 };
-          homosum[d][row][col] = 0;
-          // calculate by rolling through column sums
-          for(col++; col < mcol - pad_tile; col++)
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+          for(int col = pad_homo; col < mcol - pad_homo; col++)
+            if(tr[col] > dcur[d][col]) tr[col] = dcur[d][col];
+        }
+        for(int col = pad_homo; col < mcol - pad_homo; col++) tr[col] *= 8;
+        for(int d = 0; d < ndir; d++)
+        {
+          uint8_t *const hfx = homo[rhomo % 5][d];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+          for(int col = pad_homo; col < mcol - pad_homo; col++)
           {
-            uint8_t colsum = 0;
-            for(int v = -2; v <= 2; v++) colsum += homo[d][row + v][col + 2];
-            homosum[d][row][col] = homosum[d][row][col - 1] - v5sum[col % 5] + colsum;
-            v5sum[col % 5] = colsum;
+            uint8_t count = 0;
+            for(int h = -1; h <= 1; h++)
+              count += (dabove[d][col + h] <= tr[col]) + (dcur[d][col + h] <= tr[col])
+                       + (dbelow[d][col + h] <= tr[col]);
+            hfx[col] = count;
           }
         }
+      }
 
-      /* Average the most homogeneous pixels for the final result:       */
-      for(int row = pad_tile; row < mrow - pad_tile; row++)
+      const int ravg = row - 4;
+      if(ravg < pad_tile || ravg >= mrow - pad_tile) continue;
+
+      /* Build 5x5 sum of homogeneity maps for each pixel & direction */
+      for(int d = 0; d < ndir; d++)
+      {
+        // column sums of the 5 rows around ravg, then the sums of 5
+        // neighbouring columns
+        uint8_t colsum[TS];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+        for(int col = pad_homo; col < mcol - pad_homo; col++)
+          colsum[col] = homo[(ravg - 2) % 5][d][col] + homo[(ravg - 1) % 5][d][col] + homo[ravg % 5][d][col]
+                        + homo[(ravg + 1) % 5][d][col] + homo[(ravg + 2) % 5][d][col];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
         for(int col = pad_tile; col < mcol - pad_tile; col++)
+          homosum[d][col] = colsum[col - 2] + colsum[col - 1] + colsum[col] + colsum[col + 1] + colsum[col + 2];
+      }
+
+      /* Average the most homogeneous pixels for the final result:       */
+      for(int col = pad_tile; col < mcol - pad_tile; col++)
+      {
+        uint8_t hm[8] = { 0 };
+        uint8_t maxval = 0;
+        for(int d = 0; d < ndir; d++)
         {
-          uint8_t hm[8] = { 0 };
-          uint8_t maxval = 0;
-          for(int d = 0; d < ndir; d++)
-          {
-            hm[d] = homosum[d][row][col];
-            maxval = (maxval < hm[d] ? hm[d] : maxval);
-          }
-          maxval -= maxval >> 3;
-          for(int d = 0; d < ndir - 4; d++)
-          {
-            if(hm[d] < hm[d + 4])
-              hm[d] = 0;
-            else if(hm[d] > hm[d + 4])
-              hm[d + 4] = 0;
-          }
-          float avg[4] = { 0.0f };
-          for(int d = 0; d < ndir; d++)
+          hm[d] = homosum[d][col];
+          maxval = (maxval < hm[d] ? hm[d] : maxval);
+        }
+        maxval -= maxval >> 3;
+        for(int d = 0; d < ndir - 4; d++)
+        {
+          if(hm[d] < hm[d + 4])
+            hm[d] = 0;
+          else if(hm[d] > hm[d + 4])
+            hm[d + 4] = 0;
+        }
+        float avg[4] = { 0.0f };
+        for(int d = 0; d < ndir; d++)
+        {
+          if(hm[d] >= maxval)
           {
-            if(hm[d] >= maxval)
-            {
-              for(int c = 0; c < 3; c++) avg[c] += rgb[d][row][col][c];
-              avg[3]++;
-            }
+            for(int c = 0; c < 3; c++) avg[c] += rgb[d][ravg][col][c];
+            avg[3]++;
           }
-          for(int c = 0; c < 3; c++)
-            out[4 * (width * (row + top) + col + left) + c] = avg[c]/avg[3];
         }
+        for(int c = 0; c < 3; c++)
+          out[4 * (width * (ravg + top) + col + left) + c] = avg[c]/avg[3];
+      }
     }
   }
   dt_free_align(all_buffers);
@@ -2929,6 +2969,34 @@ static int demosaic_qual_flags(const dt_dev_pixelpipe_iop_t *const piece,
 
 #include "dual_demosaic.c"
 
+// applies the work of the fused raw modules to the whole input
+static void apply_rawfront(float *const out, const float *const in, const dt_iop_roi_t *const roi_in,
+                           const uint32_t filters, const dt_dev_pixelpipe_rawfront_t *const front)
+{
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, out, roi_in, filters, front) \
+  schedule(static)
+#endif
+  for(int j = 0; j < roi_in->height; j++)
+  {
+    const int c0 = FC(j + roi_in->y, roi_in->x, filters);
+    const int c1 = FC(j + roi_in->y, roi_in->x + 1, filters);
+    const float coeffs[2] = { front->coeffs[c0], front->coeffs[c1] };
+    const float clip[2] = { front->clip[c0], front->clip[c1] };
+    const float *const row_in = in + (size_t)j * roi_in->width;
+    float *const row_out = out + (size_t)j * roi_in->width;
+    for(int i = 0; i < roi_in->width; i++)
+      row_out[i] = fminf(row_in[i] * coeffs[i & 1], clip[i & 1]);
+  }
+}
+
+int accept_rawfront(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece)
+{
+  const uint32_t filters = piece->pipe->dsc.filters;
+  return filters && filters != 9u;
+}
+
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const i, void *const o,
              const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -2965,7 +3033,25 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   && !((demosaicing_method & DEMOSAIC_DUAL) && showmask))
     demosaicing_method = (piece->pipe->dsc.filters != 9u) ? DT_IOP_DEMOSAIC_RCD : DT_IOP_DEMOSAIC_MARKESTEIJN;
 
-  const float *const pixels = (float *)i;
+  // the work of the raw modules the pipe fused into this one. rcd does it while filling its
+  // tiles, all other paths get a prepared copy of the input, which still saves the passes of
+  // the fused modules.
+  const dt_dev_pixelpipe_rawfront_t *front = piece->rawfront.count ? &piece->rawfront : NULL;
+  float *prepared = NULL;
+  if(front
+     && !((qual_flags & DEMOSAIC_FULL_SCALE) && demosaicing_method == DT_IOP_DEMOSAIC_RCD
+          && !(img->flags & DT_IMAGE_4BAYER) && data->green_eq == DT_IOP_GREEN_EQ_NO))
+  {
+    prepared = dt_alloc_align_float((size_t)roi_in->width * roi_in->height);
+    if(!prepared)
+    {
+      fprintf(stderr, "[demosaic] not able to allocate the buffer for the fused raw modules\n");
+      return;
+    }
+    apply_rawfront(prepared, (const float *)i, roi_in, piece->pipe->dsc.filters, front);
+    front = NULL;
+  }
+  const float *const pixels = prepared ? prepared : (float *)i;
 
   if(qual_flags & DEMOSAIC_FULL_SCALE)
   {
@@ -3044,7 +3130,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       }
       else if((demosaicing_method & ~DEMOSAIC_DUAL) == DT_IOP_DEMOSAIC_RCD)
       {
-        rcd_demosaic(piece, tmp, in, &roo, &roi, piece->pipe->dsc.filters);
+        rcd_demosaic(piece, tmp, in, &roo, &roi, piece->pipe->dsc.filters, front);
       }
       else if(demosaicing_method == DT_IOP_DEMOSAIC_LMMSE)
       {
@@ -3113,6 +3199,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     // we just clear the mask data as we might have changed the preview downsampling
     dt_dev_clear_rawdetail_mask(piece->pipe);
   }
+  dt_free_align(prepared);
   if(data->color_smoothing)
     color_smoothing(o, roi_out, data->color_smoothing);
 }
@@ -5378,6 +5465,8 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
     tiling->yalign = MAX(6, tiling->yalign);
     tiling->overlap = MAX(6, tiling->overlap);
   }
+  // prepared copy of the input if the fused raw front-end is not applied on the fly
+  if(piece->rawfront.count) tiling->factor += 0.25f;
   return;
 }
 #undef RCD_TILESIZE
@@ -19,6 +19,7 @@
 #include "config.h"
 #endif
 #include "bauhaus/bauhaus.h"
+#include "common/bspline.h"
 #include "common/darktable.h"
 #include "common/fast_guided_filter.h"
 #include "common/gaussian.h"
@@ -378,13 +379,6 @@ void init_presets(dt_iop_module_so_t *self)
   dt_gui_presets_add_generic(_("inpaint highlights"), self->op, self->version(), &p, sizeof(p), 1, DEVELOP_BLEND_CS_RGB_SCENE);
 }
 
-// B spline filter
-#define FSIZE 5
-
-// The B spline best approximate a Gaussian of standard deviation :
-// see https://eng.aurelienpierre.com/2021/03/rotation-invariant-laplacian-for-2d-grids/
-#define B_SPLINE_SIGMA 1.0553651328015339f
-
 static inline float normalize_laplacian(const float sigma)
 {
   // Normalize the wavelet scale to approximate a laplacian
@@ -419,46 +413,6 @@ static inline unsigned int num_steps_to_reach_equivalent_sigma(const float sigma
   return s + 1;
 }
 
-inline static void blur_2D_Bspline(const float *const restrict in, float *const restrict HF,
-                                   float *const restrict LF,
-                                   const size_t width, const size_t height, const int mult)
-{
-  // Blur and compute the decimated wavelet at once
-#ifdef _OPENMP
-#pragma omp parallel for default(none) dt_omp_firstprivate(width, height, in, LF, HF, mult) \
-    schedule(simd: static)    \
-    collapse(2)
-#endif
-  for(size_t i = 0; i < height; i++)
-  {
-    for(size_t j = 0; j < width; j++)
-    {
-      const size_t index = (i * width + j) * 4; // full scale
-      float DT_ALIGNED_PIXEL acc[4] = { 0.f };
-
-      for(size_t ii = 0; ii < FSIZE; ++ii)
-        for(size_t jj = 0; jj < FSIZE; ++jj)
-        {
-          const size_t row = CLAMP((int)i + mult * (int)(ii - (FSIZE - 1) / 2), (int)0, (int)height - 1);
-          const size_t col = CLAMP((int)j + mult * (int)(jj - (FSIZE - 1) / 2), (int)0, (int)width - 1);
-          const size_t k_index = (row * width + col) * 4;
-
-          const float DT_ALIGNED_ARRAY filter[FSIZE]
-              = { 1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f };
-          const float filters = filter[ii] * filter[jj];
-
-          for_four_channels(c, aligned(in : 64) aligned(acc : 16)) acc[c] += filters * in[k_index + c];
-        }
-
-      for_four_channels(c, aligned(in, HF, LF : 64) aligned(acc : 16))
-      {
-        LF[index + c] = acc[c];
-        HF[index + c] = in[index + c] - acc[c];
-      }
-    }
-  }
-}
-
 static inline void init_reconstruct(float *const restrict reconstructed, const size_t width, const size_t height)
 {
 // init the reconstructed buffer with non-clipped and partially clipped pixels
@@ -776,7 +730,8 @@ static inline gint wavelets_process(const float *const restrict in, float *const
                                     const int has_mask,
                                     float *const restrict HF[MAX_NUM_SCALES],
                                     float *const restrict LF_odd,
-                                    float *const restrict LF_even)
+                                    float *const restrict LF_even,
+                                    float *const restrict tempbuf, const size_t padded_size)
 {
   gint success = TRUE;
 
@@ -823,7 +778,7 @@ static inline gint wavelets_process(const float *const restrict in, float *const
       buffer_out = LF_odd;
     }
 
-    blur_2D_Bspline(buffer_in, HF[s], buffer_out, width, height, mult);
+    decompose_2D_Bspline(buffer_in, HF[s], buffer_out, width, height, mult, tempbuf, padded_size, FALSE);
 
     residual = buffer_out;
 
@@ -982,10 +937,14 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
   float *const restrict LF_odd = dt_alloc_align_float(width * height * 4);
   float *const restrict LF_even = dt_alloc_align_float(width * height * 4);
 
+  // thread-private rows for the separable blur, shared by all scales and iterations
+  size_t padded_size;
+  float *const restrict tempbuf = dt_bspline_alloc_tempbuf(width, &padded_size);
+
   // PAUSE !
   // check that all buffers exist before processing,
   // because we use a lot of memory here.
-  if(!temp1 || !temp2 || !LF_odd || !LF_even || out_of_memory)
+  if(!temp1 || !temp2 || !LF_odd || !LF_even || !tempbuf || out_of_memory)
   {
     dt_control_log(_("diffuse/sharpen failed to allocate memory, check your RAM settings"));
     goto error;
@@ -1023,7 +982,7 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
     }
 
     if(it == (int)iterations - 1) temp_out = out;
-    wavelets_process(temp_in, temp_out, mask, roi_out->width, roi_out->height, data, final_radius, scale, scales, has_mask, HF, LF_odd, LF_even);
+    wavelets_process(temp_in, temp_out, mask, roi_out->width, roi_out->height, data, final_radius, scale, scales, has_mask, HF, LF_odd, LF_even, tempbuf, padded_size);
   }
 
 error:
@@ -1032,6 +991,7 @@ error:
   if(temp2) dt_free_align(temp2);
   if(LF_even) dt_free_align(LF_even);
   if(LF_odd) dt_free_align(LF_odd);
+  if(tempbuf) dt_free_align(tempbuf);
   for(int s = 0; s < scales; s++) if(HF[s]) dt_free_align(HF[s]);
 }
 
@@ -28,6 +28,7 @@
 
 #include "common/debug.h"
 #include "common/imageio.h"
+#include "common/math.h"
 #include "common/opencl.h"
 #include "control/conf.h"
 #include "control/control.h"
@@ -260,6 +261,32 @@ int distort_backtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
   return 1;
 }
 
+int distort_matrix(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const int backward, float *const matrix)
+{
+  const dt_iop_flip_data_t *d = (dt_iop_flip_data_t *)piece->data;
+
+  // mirroring first
+  const float sx = (d->orientation & ORIENTATION_FLIP_X) ? -1.0f : 1.0f;
+  const float sy = (d->orientation & ORIENTATION_FLIP_Y) ? -1.0f : 1.0f;
+  const float tx = (d->orientation & ORIENTATION_FLIP_X) ? piece->buf_in.width : 0.0f;
+  const float ty = (d->orientation & ORIENTATION_FLIP_Y) ? piece->buf_in.height : 0.0f;
+  float DT_ALIGNED_ARRAY flip[9] = { sx, 0.0f, tx,
+                                     0.0f, sy, ty,
+                                     0.0f, 0.0f, 1.0f };
+  // then swapping, both are their own inverse
+  const float DT_ALIGNED_ARRAY swap[9] = { 0.0f, 1.0f, 0.0f,
+                                           1.0f, 0.0f, 0.0f,
+                                           0.0f, 0.0f, 1.0f };
+
+  if(!(d->orientation & ORIENTATION_SWAP_XY))
+    memcpy(matrix, flip, sizeof(flip));
+  else if(backward)
+    mat3mul(matrix, flip, swap);
+  else
+    mat3mul(matrix, swap, flip);
+  return 1;
+}
+
 void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const float *const in,
                   float *const out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -967,6 +967,24 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK) dt_iop_alpha_copy(ivoid, ovoid, roi_out->width, roi_out->height);
 }
 
+int fuse_rawfront(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, dt_iop_buffer_dsc_t *dsc,
+                  dt_dev_pixelpipe_rawfront_t *front)
+{
+  // only clipping is point-wise, the reconstruction modes need the neighbourhood
+  const dt_iop_highlights_data_t *const d = (dt_iop_highlights_data_t *)piece->data;
+  const uint32_t filters = piece->pipe->dsc.filters;
+  if(!filters || filters == 9u || d->mode != DT_IOP_HIGHLIGHTS_CLIP) return 0;
+  if(!front) return 1;
+
+  const float clip
+      = d->clip * fminf(dsc->processed_maximum[0], fminf(dsc->processed_maximum[1], dsc->processed_maximum[2]));
+  for(int k = 0; k < 4; k++) front->clip[k] = fminf(front->clip[k], clip);
+
+  const float m = fmaxf(fmaxf(dsc->processed_maximum[0], dsc->processed_maximum[1]), dsc->processed_maximum[2]);
+  for(int k = 0; k < 3; k++) dsc->processed_maximum[k] = m;
+  return 1;
+}
+
 void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_t *pipe,
                    dt_dev_pixelpipe_iop_t *piece)
 {
@@ -46,6 +46,7 @@ struct dt_dev_pixelpipe_iop_t;
 struct dt_iop_roi_t;
 struct dt_develop_tiling_t;
 struct dt_iop_buffer_dsc_t;
+struct dt_dev_pixelpipe_rawfront_t;
 struct _GtkWidget;
 
 #ifndef DT_IOP_PARAMS_T
@@ -195,6 +196,14 @@ OPTIONAL(void, process_sse2, struct dt_iop_module_t *self, struct dt_dev_pixelpi
                              const struct dt_iop_roi_t *const roi_out);
 #endif
 
+/** for point-wise modules on the raw mosaic: return 1 if the work of process() with the current
+ * parameters can be left to a later module, see dt_dev_pixelpipe_rawfront_t. if front is not
+ * NULL, also add the operation to it and update dsc the way process() would. */
+OPTIONAL(int, fuse_rawfront, struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                             struct dt_iop_buffer_dsc_t *dsc, struct dt_dev_pixelpipe_rawfront_t *front);
+/** return 1 if process() applies piece->rawfront to its input. */
+OPTIONAL(int, accept_rawfront, struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece);
+
 #ifdef HAVE_OPENCL
 /** the opencl equivalent of process(). */
 OPTIONAL(int, process_cl, struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in,
@@ -216,6 +225,12 @@ DEFAULT(int, distort_transform, struct dt_iop_module_t *self, struct dt_dev_pixe
 DEFAULT(int, distort_backtransform, struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, float *points,
                                      size_t points_count);
 
+/** if the point transformation of the iop is a projective map, store it as row major 3x3
+ * homogeneous matrix and return 1. this allows the pipe to fold consecutive modules into a
+ * single pass over the points. */
+OPTIONAL(int, distort_matrix, struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                              const int backward, float *const matrix);
+
 OPTIONAL(void, distort_mask, struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const float *const in,
                              float *const out, const struct dt_iop_roi_t *const roi_in, const struct dt_iop_roi_t *const roi_out);
 
@@ -140,6 +140,13 @@ typedef struct dt_iop_lensfun_data_t
   gboolean do_nan_checks;
   gboolean tca_override;
   lfLensCalibTCA custom_tca;
+  // modifiers for distort_transform() [0] and distort_backtransform() [1]. setting one up is
+  // much more expensive than transforming a few points, so they are kept until the parameters
+  // or the input size change.
+  dt_pthread_mutex_t point_lock;
+  lfModifier *point_modifier[2];
+  int point_modflags[2];
+  int point_width[2], point_height[2];
 } dt_iop_lensfun_data_t;
 
 
@@ -854,48 +861,34 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
   return;
 }
 
-int distort_transform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, float *const __restrict points, size_t points_count)
+static void _free_point_modifiers(dt_iop_lensfun_data_t *d)
 {
-  dt_iop_lensfun_data_t *d = (dt_iop_lensfun_data_t *)piece->data;
-  if(!d->lens || !d->lens->Maker || d->crop <= 0.0f) return 0;
-
-  const float orig_w = piece->buf_in.width, orig_h = piece->buf_in.height;
-  int modflags;
-
-  const lfModifier *modifier = get_modifier(&modflags, orig_w, orig_h, d, LF_MODIFY_ALL, TRUE);
-  if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
+  for(int k = 0; k < 2; k++)
   {
-
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-    dt_omp_firstprivate(points_count, points, modifier) \
-    schedule(static) if(points_count > 100)
-#endif
-    for(size_t i = 0; i < points_count * 2; i += 2)
-    {
-      float DT_ALIGNED_ARRAY buf[6];
-      modifier->ApplySubpixelGeometryDistortion(points[i], points[i + 1], 1, 1, buf);
-      points[i] = buf[0];
-      points[i + 1] = buf[3];
-    }
+    delete d->point_modifier[k];
+    d->point_modifier[k] = NULL;
   }
-
-  delete modifier;
-  return 1;
 }
 
-int distort_backtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, float *const __restrict points,
-                          size_t points_count)
+static int _distort_points(dt_dev_pixelpipe_iop_t *piece, float *const __restrict points, size_t points_count,
+                           const int backward)
 {
   dt_iop_lensfun_data_t *d = (dt_iop_lensfun_data_t *)piece->data;
-
   if(!d->lens || !d->lens->Maker || d->crop <= 0.0f) return 0;
 
-  const float orig_w = piece->buf_in.width, orig_h = piece->buf_in.height;
-  int modflags;
-  const lfModifier *modifier = get_modifier(&modflags, orig_w, orig_h, d, LF_MODIFY_ALL, FALSE);
+  const int orig_w = piece->buf_in.width, orig_h = piece->buf_in.height;
 
-  if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
+  dt_pthread_mutex_lock(&d->point_lock);
+  if(!d->point_modifier[backward] || d->point_width[backward] != orig_w || d->point_height[backward] != orig_h)
+  {
+    delete d->point_modifier[backward];
+    d->point_modifier[backward] = get_modifier(&d->point_modflags[backward], orig_w, orig_h, d, LF_MODIFY_ALL, !backward);
+    d->point_width[backward] = orig_w;
+    d->point_height[backward] = orig_h;
+  }
+  const lfModifier *modifier = d->point_modifier[backward];
+
+  if(d->point_modflags[backward] & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
   {
 
 #ifdef _OPENMP
@@ -912,10 +905,21 @@ int distort_backtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
     }
   }
 
-  delete modifier;
+  dt_pthread_mutex_unlock(&d->point_lock);
   return 1;
 }
 
+int distort_transform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, float *const __restrict points, size_t points_count)
+{
+  return _distort_points(piece, points, points_count, 0);
+}
+
+int distort_backtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, float *const __restrict points,
+                          size_t points_count)
+{
+  return _distort_points(piece, points, points_count, 1);
+}
+
 // TODO: Shall we keep LF_MODIFY_TCA in the modifiers?
 void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const float *const in,
                   float *const out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
@@ -1114,6 +1118,10 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
   const lfCamera *camera = NULL;
   const lfCamera **cam = NULL;
 
+  dt_pthread_mutex_lock(&d->point_lock);
+  _free_point_modifiers(d);
+  dt_pthread_mutex_unlock(&d->point_lock);
+
   if(d->lens)
   {
     delete d->lens;
@@ -1200,7 +1208,9 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
-  piece->data = calloc(1, sizeof(dt_iop_lensfun_data_t));
+  dt_iop_lensfun_data_t *d = (dt_iop_lensfun_data_t *)calloc(1, sizeof(dt_iop_lensfun_data_t));
+  dt_pthread_mutex_init(&d->point_lock, NULL);
+  piece->data = d;
 }
 
 void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -1212,6 +1222,8 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
     delete d->lens;
     d->lens = NULL;
   }
+  _free_point_modifiers(d);
+  dt_pthread_mutex_destroy(&d->point_lock);
   free(piece->data);
   piece->data = NULL;
 }
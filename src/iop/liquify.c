@@ -34,6 +34,7 @@
 #include <assert.h>
 #include <cairo.h>
 #include <complex.h>
+#include <limits.h>
 #include <math.h>
 #include <stdlib.h>
 
@@ -261,6 +262,28 @@ typedef struct
   int warp_kernel;
 } dt_iop_liquify_global_data_t;
 
+// number of distortion maps kept per pipe, typically the map for processing plus the
+// forward and inverted maps for the transformation of points.
+#define DT_LIQUIFY_MAP_CACHE_SIZE 3
+
+// a distortion map covering all warps at a given scale, shared between process() and the
+// transformation of points. it is refcounted, as a map may be evicted from the cache while
+// another thread is still using it.
+typedef struct dt_liquify_map_t
+{
+  uint64_t hash;                // params of this and the upstream distorting modules, scale, direction
+  cairo_rectangle_int_t extent; // in roi coordinates at the given scale
+  float complex *map;           // NULL if there are no warps
+  int refs;
+} dt_liquify_map_t;
+
+typedef struct dt_iop_liquify_data_t
+{
+  dt_iop_liquify_params_t params;
+  dt_pthread_mutex_t lock;                            // protects the map cache
+  dt_liquify_map_t *maps[DT_LIQUIFY_MAP_CACHE_SIZE]; // most recently used first
+} dt_iop_liquify_data_t;
+
 typedef struct
 {
   dt_iop_liquify_params_t params;
@@ -962,42 +985,27 @@ static void build_round_stamp(float complex **pstamp,
 /*
   Applies a stamp at a specified position.
 
-  Applies a stamp at the position specified by @a point and adds the
-  resulting vector field to the global distortion map @a global_map.
+  Adds row @a y of the stamp placed at @a stamp_extent (in global map
+  coordinates) to the global distortion map @a global_map.
 
   The global distortion map is a map of relative pixel displacements
   encompassing all our paths.
 */
 
-static void add_to_global_distortion_map(float complex *global_map,
-                                          const cairo_rectangle_int_t *const restrict global_map_extent,
-                                          const dt_liquify_warp_t *const restrict warp,
-                                          const float complex *const restrict stamp,
-                                          const cairo_rectangle_int_t *stamp_extent)
-{
-  cairo_rectangle_int_t mmext = *stamp_extent;
-  mmext.x += (int) round(crealf(warp->point));
-  mmext.y += (int) round(cimagf(warp->point));
-  cairo_rectangle_int_t cmmext = mmext;
-  cairo_region_t *mmreg = cairo_region_create_rectangle(&mmext);
-  cairo_region_intersect_rectangle(mmreg, global_map_extent);
-  cairo_region_get_extents(mmreg, &cmmext);
-  free(mmreg);
+static inline void add_to_global_distortion_map_row(float complex *const restrict global_map,
+                                                    const cairo_rectangle_int_t *const restrict global_map_extent,
+                                                    const float complex *const restrict stamp,
+                                                    const cairo_rectangle_int_t *const restrict stamp_extent,
+                                                    const int y)
+{
+  const int x_from = MAX(stamp_extent->x, global_map_extent->x);
+  const int x_to = MIN(stamp_extent->x + stamp_extent->width, global_map_extent->x + global_map_extent->width);
 
-  #ifdef _OPENMP
-  #pragma omp parallel for schedule (static) default (shared)
-  #endif
+  const float complex *const srcrow = stamp + (size_t)(y - stamp_extent->y) * stamp_extent->width;
+  float complex *const destrow = global_map + (size_t)(y - global_map_extent->y) * global_map_extent->width;
 
-  for(int y = cmmext.y; y < cmmext.y + cmmext.height; y++)
-  {
-    const float complex *const srcrow = stamp + ((y - mmext.y) * mmext.width);
-    float complex *const destrow = global_map + ((y - global_map_extent->y) * global_map_extent->width);
-
-    for(int x = cmmext.x; x < cmmext.x + cmmext.width; x++)
-    {
-      destrow[x - global_map_extent->x] -= srcrow[x - mmext.x];
-    }
-  }
+  for(int x = x_from; x < x_to; x++)
+    destrow[x - global_map_extent->x] -= srcrow[x - stamp_extent->x];
 }
 
 /*
@@ -1069,14 +1077,18 @@ static void apply_global_distortion_map(struct dt_iop_module_t *module,
   }
 }
 
-// calculate the map extent.
+// calculate the map extent. with roi_out == NULL all the paths are kept.
 
 static GSList *_get_map_extent(const dt_iop_roi_t *roi_out,
                                const GList *interpolated,
                                cairo_rectangle_int_t *map_extent)
 {
-  const cairo_rectangle_int_t roi_out_rect = { roi_out->x, roi_out->y, roi_out->width, roi_out->height };
-  cairo_region_t *roi_out_region = cairo_region_create_rectangle(&roi_out_rect);
+  cairo_region_t *roi_out_region = NULL;
+  if(roi_out)
+  {
+    const cairo_rectangle_int_t roi_out_rect = { roi_out->x, roi_out->y, roi_out->width, roi_out->height };
+    roi_out_region = cairo_region_create_rectangle(&roi_out_rect);
+  }
   cairo_region_t *map_region = cairo_region_create();
   GSList *in_roi = NULL;
 
@@ -1086,7 +1098,7 @@ static GSList *_get_map_extent(const dt_iop_roi_t *roi_out,
     cairo_rectangle_int_t r;
     compute_round_stamp_extent(&r, warp);
     // add extent if not entirely outside the roi
-    if(cairo_region_contains_rectangle(roi_out_region, &r) != CAIRO_REGION_OVERLAP_OUT)
+    if(!roi_out_region || cairo_region_contains_rectangle(roi_out_region, &r) != CAIRO_REGION_OVERLAP_OUT)
     {
       cairo_region_union_rectangle(map_region, &r);
       in_roi = g_slist_prepend(in_roi, i->data);
@@ -1096,14 +1108,16 @@ static GSList *_get_map_extent(const dt_iop_roi_t *roi_out,
   // return the paths and the extent of all paths
   cairo_region_get_extents(map_region, map_extent);
   cairo_region_destroy(map_region);
-  cairo_region_destroy(roi_out_region);
+  if(roi_out_region) cairo_region_destroy(roi_out_region);
 
   return g_slist_reverse(in_roi);
 }
 
+// number of stamps built at once before they are added to the map
+#define DT_LIQUIFY_STAMP_BATCH 64
+
 static float complex *create_global_distortion_map(const cairo_rectangle_int_t *map_extent,
-                                                   const GSList *interpolated,
-                                                   gboolean inverted)
+                                                   const GSList *interpolated)
 {
   const int mapsize = map_extent->width * map_extent->height;
   if (mapsize == 0)
@@ -1115,98 +1129,338 @@ static float complex *create_global_distortion_map(const cairo_rectangle_int_t *
 
   // allocate distortion map big enough to contain all paths
   float complex *map = dt_alloc_align(64, sizeof(float complex) * mapsize);
-  memset(map, 0, sizeof(float complex) * mapsize);
-
-  // build map
-  for(const GSList *i = interpolated; i; i = g_slist_next(i))
+  const int nwarps = g_slist_length((GSList *)interpolated);
+  const dt_liquify_warp_t **warps = malloc(sizeof(dt_liquify_warp_t *) * MAX(nwarps, 1));
+  if(!map || !warps)
   {
-    const dt_liquify_warp_t *warp = ((dt_liquify_warp_t *) i->data);
-    float complex *stamp = NULL;
-    cairo_rectangle_int_t r;
-    build_round_stamp(&stamp, &r, warp);
-    add_to_global_distortion_map(map, map_extent, warp, stamp, &r);
-    free((void *) stamp);
+    fprintf(stderr, "[liquify] not able to allocate the distortion map of %d pixels\n", mapsize);
+    dt_free_align(map);
+    free(warps);
+    return NULL;
   }
+  memset(map, 0, sizeof(float complex) * mapsize);
 
-  if(inverted)
+  int n = 0;
+  for(const GSList *i = interpolated; i; i = g_slist_next(i)) warps[n++] = (dt_liquify_warp_t *)i->data;
+
+  float complex *stamps[DT_LIQUIFY_STAMP_BATCH];
+  cairo_rectangle_int_t stamp_extents[DT_LIQUIFY_STAMP_BATCH];
+
+  // build map. the stamps of a batch are computed in parallel, then every thread adds all of
+  // them to its own band of rows of the map. the stamps are still added in the order of the
+  // paths, so the result does not depend on the number of threads.
+  for(int first = 0; first < nwarps; first += DT_LIQUIFY_STAMP_BATCH)
   {
-    float complex * const imap = dt_alloc_align(64, sizeof(float complex) * mapsize);
-    memset(imap, 0, sizeof(float complex) * mapsize);
+    const int count = MIN(DT_LIQUIFY_STAMP_BATCH, nwarps - first);
 
-    // copy map into imap(inverted map).
-    // imap [ n + dx(map[n]) , n + dy(map[n]) ] = -map[n]
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(warps, first, count) \
+    shared(stamps, stamp_extents) \
+    schedule(dynamic)
+#endif
+    for(int k = 0; k < count; k++)
+    {
+      const dt_liquify_warp_t *warp = warps[first + k];
+      build_round_stamp(&stamps[k], &stamp_extents[k], warp);
+      stamp_extents[k].x += (int) round(crealf(warp->point));
+      stamp_extents[k].y += (int) round(cimagf(warp->point));
+    }
 
-    #ifdef _OPENMP
-    #pragma omp parallel for schedule (static) default (shared)
-    #endif
+    int y_from = INT_MAX, y_to = INT_MIN;
+    for(int k = 0; k < count; k++)
+    {
+      y_from = MIN(y_from, stamp_extents[k].y);
+      y_to = MAX(y_to, stamp_extents[k].y + stamp_extents[k].height);
+    }
+    y_from = MAX(y_from, map_extent->y);
+    y_to = MIN(y_to, map_extent->y + map_extent->height);
 
-    for(int y = 0; y <  map_extent->height; y++)
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(map, map_extent, count, y_from, y_to) \
+    shared(stamps, stamp_extents) \
+    schedule(static)
+#endif
+    for(int y = y_from; y < y_to; y++)
     {
-      const float complex *const row = map + y * map_extent->width;
-      for(int x = 0; x < map_extent->width; x++)
+      for(int k = 0; k < count; k++)
       {
-        const float complex d = row[x];
-        // compute new position (nx,ny) given the displacement d
-        const int nx = x + (int)crealf(d);
-        const int ny = y + (int)cimagf(d);
-
-        // if the point falls into the extent, set it
-        if(nx>0 && nx<map_extent->width && ny>0 && ny<map_extent->height)
-          imap[nx + ny * map_extent->width] = -d;
+        if(y >= stamp_extents[k].y && y < stamp_extents[k].y + stamp_extents[k].height)
+          add_to_global_distortion_map_row(map, map_extent, stamps[k], &stamp_extents[k], y);
       }
     }
 
-    dt_free_align((void *) map);
+    for(int k = 0; k < count; k++) free(stamps[k]);
+  }
+
+  free(warps);
+  return map;
+}
+
+// computes the inverted map of @a map.
+static float complex *invert_global_distortion_map(const float complex *const map,
+                                                   const cairo_rectangle_int_t *map_extent)
+{
+  const int mapsize = map_extent->width * map_extent->height;
+  float complex * const imap = dt_alloc_align(64, sizeof(float complex) * mapsize);
+  if(!imap) return NULL;
+  memset(imap, 0, sizeof(float complex) * mapsize);
 
-    // now just do a pass to avoid gap with a displacement of zero, note that we do not need high
-    // precision here as the inverted distortion mask is only used to compute a final displacement
-    // of points.
+  // copy map into imap(inverted map).
+  // imap [ n + dx(map[n]) , n + dy(map[n]) ] = -map[n]
 
-    #ifdef _OPENMP
-    #pragma omp parallel for schedule (static) default (shared)
-    #endif
+  #ifdef _OPENMP
+  #pragma omp parallel for schedule (static) default (shared)
+  #endif
 
-    for(int y = 0; y <  map_extent->height; y++)
+  for(int y = 0; y <  map_extent->height; y++)
+  {
+    const float complex *const row = map + y * map_extent->width;
+    for(int x = 0; x < map_extent->width; x++)
     {
-      float complex *const row = imap + y * map_extent->width;
-      float complex last[2] = { 0, 0 };
-      for(int x = 0; x < map_extent->width / 2 + 1; x++)
+      const float complex d = row[x];
+      // compute new position (nx,ny) given the displacement d
+      const int nx = x + (int)crealf(d);
+      const int ny = y + (int)cimagf(d);
+
+      // if the point falls into the extent, set it
+      if(nx>0 && nx<map_extent->width && ny>0 && ny<map_extent->height)
+        imap[nx + ny * map_extent->width] = -d;
+    }
+  }
+
+  // now just do a pass to avoid gap with a displacement of zero, note that we do not need high
+  // precision here as the inverted distortion mask is only used to compute a final displacement
+  // of points.
+
+  #ifdef _OPENMP
+  #pragma omp parallel for schedule (static) default (shared)
+  #endif
+
+  for(int y = 0; y <  map_extent->height; y++)
+  {
+    float complex *const row = imap + y * map_extent->width;
+    float complex last[2] = { 0, 0 };
+    for(int x = 0; x < map_extent->width / 2 + 1; x++)
+    {
+      float complex *cl = row + x;
+      float complex *cr = row + map_extent->width - x;
+      if(x!=0)
       {
-        float complex *cl = row + x;
-        float complex *cr = row + map_extent->width - x;
-        if(x!=0)
-        {
-          if(*cl == 0) *cl = last[0];
-          if(*cr == 0) *cr = last[1];
-        }
-        last[0] = *cl; last[1] = *cr;
+        if(*cl == 0) *cl = last[0];
+        if(*cr == 0) *cr = last[1];
       }
+      last[0] = *cl; last[1] = *cr;
     }
+  }
 
-    map = imap;
+  return imap;
+}
+
+// bernstein hash (djb2) of everything the distortion map depends on: our params, the
+// distorting modules before us through which the paths are transformed, and the scale.
+static uint64_t _map_hash(struct dt_iop_module_t *module, const dt_dev_pixelpipe_iop_t *piece,
+                          const float scale, const gboolean inverted)
+{
+  dt_develop_t *dev = module->dev;
+  uint64_t hash = 5381;
+  GList *modules = piece->pipe->iop;
+  GList *pieces = piece->pipe->nodes;
+  for(; modules && pieces; modules = g_list_next(modules), pieces = g_list_next(pieces))
+  {
+    const dt_iop_module_t *m = (dt_iop_module_t *)modules->data;
+    const dt_dev_pixelpipe_iop_t *p = (dt_dev_pixelpipe_iop_t *)pieces->data;
+    if(m->iop_order >= module->iop_order) continue;
+    // same selection as dt_dev_distort_transform_locked()
+    if(p->enabled && (m->operation_tags() & IOP_TAG_DISTORT)
+       && !(dev->gui_module && dev->gui_module != m
+            && (dev->gui_module->operation_tags_filter() & m->operation_tags())))
+      hash = ((hash << 5) + hash) ^ p->hash;
   }
-  return map;
+  hash = ((hash << 5) + hash) ^ piece->hash;
+
+  const float scales[2] = { scale, piece->pipe->iscale };
+  const char *str = (const char *)scales;
+  for(size_t i = 0; i < sizeof(scales); i++) hash = ((hash << 5) + hash) ^ str[i];
+  return ((hash << 5) + hash) ^ inverted;
+}
+
+static void _map_release(dt_iop_liquify_data_t *d, dt_liquify_map_t *m)
+{
+  dt_pthread_mutex_lock(&d->lock);
+  const int refs = --m->refs;
+  dt_pthread_mutex_unlock(&d->lock);
+  if(refs) return;
+  if(m->map) dt_free_align(m->map);
+  free(m);
+}
+
+static void _map_cache_flush(dt_iop_liquify_data_t *d)
+{
+  for(int k = 0; k < DT_LIQUIFY_MAP_CACHE_SIZE; k++)
+  {
+    if(d->maps[k]) _map_release(d, d->maps[k]);
+    d->maps[k] = NULL;
+  }
+}
+
+// looks up a map and moves it to the front of the cache. the caller gets a reference.
+static dt_liquify_map_t *_map_cache_get(dt_iop_liquify_data_t *d, const uint64_t hash)
+{
+  dt_liquify_map_t *m = NULL;
+  dt_pthread_mutex_lock(&d->lock);
+  for(int k = 0; k < DT_LIQUIFY_MAP_CACHE_SIZE; k++)
+  {
+    if(d->maps[k] && d->maps[k]->hash == hash)
+    {
+      m = d->maps[k];
+      memmove(d->maps + 1, d->maps, sizeof(dt_liquify_map_t *) * k);
+      d->maps[0] = m;
+      m->refs++;
+      break;
+    }
+  }
+  dt_pthread_mutex_unlock(&d->lock);
+  return m;
+}
+
+// inserts a newly built map, unless another thread was faster. returns the map to be used
+// with a reference for the caller.
+static dt_liquify_map_t *_map_cache_put(dt_iop_liquify_data_t *d, dt_liquify_map_t *m)
+{
+  dt_liquify_map_t *evicted = NULL;
+  dt_pthread_mutex_lock(&d->lock);
+  for(int k = 0; k < DT_LIQUIFY_MAP_CACHE_SIZE; k++)
+  {
+    if(d->maps[k] && d->maps[k]->hash == m->hash)
+    {
+      // use theirs, drop ours
+      evicted = m;
+      m = d->maps[k];
+      break;
+    }
+  }
+  if(!evicted)
+  {
+    evicted = d->maps[DT_LIQUIFY_MAP_CACHE_SIZE - 1];
+    memmove(d->maps + 1, d->maps, sizeof(dt_liquify_map_t *) * (DT_LIQUIFY_MAP_CACHE_SIZE - 1));
+    d->maps[0] = m;
+  }
+  m->refs++; // one for the cache, one for the caller
+  dt_pthread_mutex_unlock(&d->lock);
+
+  if(evicted) _map_release(d, evicted);
+  return m;
+}
+
+// returns the distortion map of all paths at the given scale, from the cache if possible.
+// release it with _map_release(). returns NULL if out of memory, nothing is cached then.
+static dt_liquify_map_t *get_global_distortion_map(struct dt_iop_module_t *module,
+                                                   const dt_dev_pixelpipe_iop_t *piece,
+                                                   const float scale,
+                                                   const gboolean inverted,
+                                                   const gboolean from_distort_transform)
+{
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *)piece->data;
+  const uint64_t hash = _map_hash(module, piece, scale, inverted);
+
+  dt_liquify_map_t *m = _map_cache_get(d, hash);
+  if(m) return m;
+
+  const double start = dt_get_wtime();
+  m = (dt_liquify_map_t *)calloc(1, sizeof(dt_liquify_map_t));
+  if(!m) return NULL;
+  m->hash = hash;
+  m->refs = 1;
+
+  if(inverted)
+  {
+    // derived from the forward map, which is likely to be needed as well
+    dt_liquify_map_t *forward = get_global_distortion_map(module, piece, scale, FALSE, from_distort_transform);
+    if(!forward)
+    {
+      free(m);
+      return NULL;
+    }
+    m->extent = forward->extent;
+    if(forward->map) m->map = invert_global_distortion_map(forward->map, &forward->extent);
+    _map_release(d, forward);
+  }
+  else
+  {
+    // copy params
+    dt_iop_liquify_params_t copy_params;
+    memcpy(&copy_params, &d->params, sizeof(dt_iop_liquify_params_t));
+
+    distort_paths_raw_to_piece(module, piece->pipe, scale, &copy_params, from_distort_transform);
+
+    GList *interpolated = interpolate_paths(&copy_params);
+    GSList *all_paths = _get_map_extent(NULL, interpolated, &m->extent);
+
+    m->map = create_global_distortion_map(&m->extent, all_paths);
+
+    g_slist_free(all_paths);
+    g_list_free_full(interpolated, free);
+  }
+
+  // an empty extent has no map, anything else failed to allocate and is not cached
+  if(!m->map && m->extent.width > 0 && m->extent.height > 0)
+  {
+    free(m);
+    return NULL;
+  }
+
+  dt_print(DT_DEBUG_PERF, "[liquify] %s distortion map %dx%d built in %.3f secs\n",
+           inverted ? "inverted" : "forward", m->extent.width, m->extent.height, dt_get_wtime() - start);
+
+  return _map_cache_put(d, m);
 }
 
+// copies the part of the map needed for roi_out, the map being cached as a whole.
 static float complex *build_global_distortion_map(struct dt_iop_module_t *module,
                                                    const dt_dev_pixelpipe_iop_t *piece,
                                                    const dt_iop_roi_t *roi_in,
                                                    const dt_iop_roi_t *roi_out,
                                                    cairo_rectangle_int_t *map_extent)
 {
-  // copy params
-  dt_iop_liquify_params_t copy_params;
-  memcpy(&copy_params, (dt_iop_liquify_params_t *)piece->data, sizeof(dt_iop_liquify_params_t));
-
-  distort_paths_raw_to_piece(module, piece->pipe, roi_in->scale, &copy_params, FALSE);
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *)piece->data;
+  dt_liquify_map_t *m = get_global_distortion_map(module, piece, roi_in->scale, FALSE, FALSE);
+  if(!m)
+  {
+    map_extent->width = map_extent->height = 0;
+    return NULL;
+  }
 
-  GList *interpolated = interpolate_paths(&copy_params);
-  GSList *interpolated_in_roi = _get_map_extent(roi_out, interpolated, map_extent);
+  const cairo_rectangle_int_t roi_out_rect = { roi_out->x, roi_out->y, roi_out->width, roi_out->height };
+  map_extent->x = MAX(m->extent.x, roi_out_rect.x);
+  map_extent->y = MAX(m->extent.y, roi_out_rect.y);
+  map_extent->width = MIN(m->extent.x + m->extent.width, roi_out_rect.x + roi_out_rect.width) - map_extent->x;
+  map_extent->height = MIN(m->extent.y + m->extent.height, roi_out_rect.y + roi_out_rect.height) - map_extent->y;
+
+  float complex *map = NULL;
+  if(m->map && map_extent->width > 0 && map_extent->height > 0)
+    map = dt_alloc_align(64, sizeof(float complex) * map_extent->width * map_extent->height);
+  if(map)
+  {
+    const float complex *const src = m->map;
+    const cairo_rectangle_int_t src_extent = m->extent;
+    const cairo_rectangle_int_t dst_extent = *map_extent;
 
-  float complex *map = create_global_distortion_map(map_extent, interpolated_in_roi, FALSE);
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(map, src, src_extent, dst_extent) \
+    schedule(static)
+#endif
+    for(int y = 0; y < dst_extent.height; y++)
+      memcpy(map + (size_t)y * dst_extent.width,
+             src + (size_t)(y + dst_extent.y - src_extent.y) * src_extent.width + dst_extent.x - src_extent.x,
+             sizeof(float complex) * dst_extent.width);
+  }
+  else
+    map_extent->width = map_extent->height = 0;
 
-  g_slist_free(interpolated_in_roi);
-  g_list_free_full(interpolated, free);
+  _map_release(d, m);
   return map;
 }
 
@@ -1235,7 +1489,7 @@ void modify_roi_in(struct dt_iop_module_t *module,
 
   // copy params
   dt_iop_liquify_params_t copy_params;
-  memcpy(&copy_params, (dt_iop_liquify_params_t*)piece->data, sizeof(dt_iop_liquify_params_t));
+  memcpy(&copy_params, &((dt_iop_liquify_data_t *)piece->data)->params, sizeof(dt_iop_liquify_params_t));
 
   distort_paths_raw_to_piece(module, piece->pipe, roi_in->scale, &copy_params, FALSE);
 
@@ -1284,81 +1538,47 @@ static int _distort_xtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pi
 {
   const float scale = piece->iscale;
 
-  // compute the extent of all points (all computations are done in RAW coordinate)
-  float xmin = FLT_MAX, xmax = FLT_MIN, ymin = FLT_MAX, ymax = FLT_MIN;
+  // the map covers all the warps and is shared by all the calls with the same params, so the
+  // masks, guides and the forward and backward transformations don't rebuild it every time.
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *)piece->data;
+  dt_liquify_map_t *m = get_global_distortion_map(self, piece, scale, inverted, TRUE);
+  if(m == NULL) return 0;
 
-#ifdef _OPENMP
-#pragma omp parallel for simd default(none) \
-    dt_omp_firstprivate(points_count, points, scale) \
-    schedule(static) if(points_count > 100) aligned(points:64) \
-    reduction(min:xmin, ymin) reduction(max:xmax, ymax)
-#endif
-  for(size_t i = 0; i < points_count * 2; i += 2)
+  if(m->map == NULL)
   {
-    const float x = points[i] * scale;
-    const float y = points[i + 1] * scale;
-    xmin = fmin(xmin, x);
-    xmax = fmax(xmax, x);
-    ymin = fmin(ymin, y);
-    ymax = fmax(ymax, y);
+    _map_release(d, m);
+    return 0;
   }
 
-  cairo_rectangle_int_t extent = { .x = (int)(xmin - .5), .y = (int)(ymin - .5),
-                                   .width = (int)(xmax - xmin + 2.5), .height = (int)(ymax - ymin + 2.5) };
+  const float complex *const map = m->map;
+  const cairo_rectangle_int_t extent = m->extent;
+  const int map_size =  extent.width * extent.height;
+  const int x_last = extent.x + extent.width;
+  const int y_last = extent.y + extent.height;
 
-  if(extent.width > 0 && extent.height > 0)
-  {
-    // copy params
-    dt_iop_liquify_params_t copy_params;
-    memcpy(&copy_params, (dt_iop_liquify_params_t *)piece->data, sizeof(dt_iop_liquify_params_t));
-
-    distort_paths_raw_to_piece(self, piece->pipe, scale, &copy_params, TRUE);
-
-    // create the distortion map for this extent
-
-    GList *interpolated = interpolate_paths(&copy_params);
-
-    // we need to adjust the extent to be the union enclosing all the points (currently in extent) and
-    // the warps that are in (possibly partly) in this same region.
-
-    dt_iop_roi_t roi_in = { .x = extent.x, .y = extent.y, .width = extent.width, .height = extent.height };
-    GSList *interpolated_in_roi = _get_map_extent(&roi_in, interpolated, &extent);
-
-    float complex *map = create_global_distortion_map(&extent, interpolated_in_roi, inverted);
-    g_slist_free(interpolated_in_roi);
-    g_list_free_full(interpolated, free);
-
-    if(map == NULL) return 0;
-
-    const int map_size =  extent.width * extent.height;
-    const int x_last = extent.x + extent.width;
-    const int y_last = extent.y + extent.height;
-
-    // apply distortion to all points (this is a simple displacement given by a vector at this same point in the map)
+  // apply distortion to all points (this is a simple displacement given by a vector at this same point in the map)
 #ifdef _OPENMP
 #pragma omp parallel for simd default(none) \
     dt_omp_firstprivate(points_count, points, scale, extent, map, map_size, y_last, x_last) \
     schedule(static) if(points_count > 100) aligned(points:64)
 #endif
-    for(size_t i = 0; i < points_count; i++)
-    {
-      float *px = &points[i*2];
-      float *py = &points[i*2+1];
-      const float x = *px * scale;
-      const float y = *py * scale;
-      const int map_offset = ((int)(x - 0.5) - extent.x) + ((int)(y - 0.5) - extent.y) * extent.width;
+  for(size_t i = 0; i < points_count; i++)
+  {
+    float *px = &points[i*2];
+    float *py = &points[i*2+1];
+    const float x = *px * scale;
+    const float y = *py * scale;
+    const int map_offset = ((int)(x - 0.5) - extent.x) + ((int)(y - 0.5) - extent.y) * extent.width;
 
-      if(x >= extent.x && x < x_last && y >= extent.y && y < y_last && map_offset >= 0 && map_offset < map_size)
-      {
-        const float complex dist = map[map_offset] / scale;
-        *px += crealf(dist);
-        *py += cimagf(dist);
-      }
+    if(x >= extent.x && x < x_last && y >= extent.y && y < y_last && map_offset >= 0 && map_offset < map_size)
+    {
+      const float complex dist = map[map_offset] / scale;
+      *px += crealf(dist);
+      *py += cimagf(dist);
     }
-
-    dt_free_align((void *) map);
   }
 
+  _map_release(d, m);
   return 1;
 }
 
@@ -1669,11 +1889,16 @@ void init(dt_iop_module_t *module)
 
 void init_pipe(struct dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
-  piece->data = malloc(module->params_size);
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *)calloc(1, sizeof(dt_iop_liquify_data_t));
+  dt_pthread_mutex_init(&d->lock, NULL);
+  piece->data = d;
 }
 
 void cleanup_pipe(struct dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *)piece->data;
+  _map_cache_flush(d);
+  dt_pthread_mutex_destroy(&d->lock);
   free(piece->data);
   piece->data = NULL;
 }
@@ -1685,7 +1910,10 @@ void commit_params(struct dt_iop_module_t *module,
                     dt_dev_pixelpipe_t *pipe,
                     dt_dev_pixelpipe_iop_t *piece)
 {
-  memcpy(piece->data, params, module->params_size);
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *)piece->data;
+  memcpy(&d->params, params, module->params_size);
+  // cached maps are keyed by the piece hash, no need to flush them here: going back to the
+  // previous params, e.g. by undo or when toggling the module, will hit the cache
 }
 
 // calculate the dot product of 2 vectors.
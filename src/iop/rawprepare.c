@@ -194,6 +194,19 @@ int distort_backtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
   return 1;
 }
 
+int distort_matrix(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const int backward, float *const matrix)
+{
+  dt_iop_rawprepare_data_t *d = (dt_iop_rawprepare_data_t *)piece->data;
+
+  const float scale = piece->buf_in.scale / piece->iscale;
+  const float sign = backward ? 1.0f : -1.0f;
+
+  matrix[0] = 1.0f; matrix[1] = 0.0f; matrix[2] = sign * (float)d->x * scale;
+  matrix[3] = 0.0f; matrix[4] = 1.0f; matrix[5] = sign * (float)d->y * scale;
+  matrix[6] = 0.0f; matrix[7] = 0.0f; matrix[8] = 1.0f;
+  return 1;
+}
+
 void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const float *const in,
                   float *const out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
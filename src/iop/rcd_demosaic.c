@@ -107,8 +107,22 @@ static INLINE float sqrf(float a)
   return a * a;
 }
 
+// The fused raw front-end (white balance and clipping done by the pipe's fused modules) per CFA position,
+// FC() repeats every 8 rows and 2 columns.
+typedef struct rcd_front_t
+{
+  float coeffs[8][2];
+  float clip[8][2];
+} rcd_front_t;
+
+static INLINE float rcd_front(const rcd_front_t *const front, const float a, const int row, const int col)
+{
+  return front ? fminf(a * front->coeffs[row & 7][col & 1], front->clip[row & 7][col & 1]) : a;
+}
+
 /** This is basically ppg adopted to only write data to RCD_MARGIN */
-static void rcd_ppg_border(float *const out, const float *const in, const int width, const int height, const uint32_t filters, const int margin)
+static void rcd_ppg_border(float *const out, const float *const in, const int width, const int height, const uint32_t filters, const int margin,
+                           const rcd_front_t *const front)
 {
   const int border = margin + 3;
   // write approximatad 3-pixel border region to out
@@ -127,7 +141,7 @@ static void rcd_ppg_border(float *const out, const float *const in, const int wi
           if((y >= 0) && (x >= 0) && (y < height) && (x < width))
           {
             const int f = FC(y, x, filters);
-            sum[f] += fmaxf(0.0f, in[(size_t)y * width + x]);
+            sum[f] += fmaxf(0.0f, rcd_front(front, in[(size_t)y * width + x], y, x));
             sum[f + 4]++;
           }
         }
@@ -138,7 +152,7 @@ static void rcd_ppg_border(float *const out, const float *const in, const int wi
         if(c != f && sum[c + 4] > 0.0f)
           out[4 * ((size_t)j * width + i) + c] = sum[c] / sum[c + 4];
         else
-          out[4 * ((size_t)j * width + i) + c] = fmaxf(0.0f, in[(size_t)j * width + i]);
+          out[4 * ((size_t)j * width + i) + c] = fmaxf(0.0f, rcd_front(front, in[(size_t)j * width + i], j, i));
       }
     }
   }
@@ -147,7 +161,7 @@ static void rcd_ppg_border(float *const out, const float *const in, const int wi
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(filters, out, width, height, border) \
+  dt_omp_firstprivate(filters, out, width, height, border, front) \
   shared(input) \
   schedule(static)
 #endif
@@ -167,22 +181,22 @@ static void rcd_ppg_border(float *const out, const float *const in, const int wi
 
       const int c = FC(j, i, filters);
       float color[4];
-      const float pc = fmaxf(0.0f, buf_in[0]);
+      const float pc = fmaxf(0.0f, rcd_front(front, buf_in[0], j, i));
       if(c == 0 || c == 2)
       {
         color[c] = pc;
-        const float pym  = fmaxf(0.0f, buf_in[-width * 1]);
-        const float pym2 = fmaxf(0.0f, buf_in[-width * 2]);
-        const float pym3 = fmaxf(0.0f, buf_in[-width * 3]);
-        const float pyM  = fmaxf(0.0f, buf_in[+width * 1]);
-        const float pyM2 = fmaxf(0.0f, buf_in[+width * 2]);
-        const float pyM3 = fmaxf(0.0f, buf_in[+width * 3]);
-        const float pxm  = fmaxf(0.0f, buf_in[-1]);
-        const float pxm2 = fmaxf(0.0f, buf_in[-2]);
-        const float pxm3 = fmaxf(0.0f, buf_in[-3]);
-        const float pxM  = fmaxf(0.0f, buf_in[+1]);
-        const float pxM2 = fmaxf(0.0f, buf_in[+2]);
-        const float pxM3 = fmaxf(0.0f, buf_in[+3]);
+        const float pym  = fmaxf(0.0f, rcd_front(front, buf_in[-width * 1], j - 1, i));
+        const float pym2 = fmaxf(0.0f, rcd_front(front, buf_in[-width * 2], j - 2, i));
+        const float pym3 = fmaxf(0.0f, rcd_front(front, buf_in[-width * 3], j - 3, i));
+        const float pyM  = fmaxf(0.0f, rcd_front(front, buf_in[+width * 1], j + 1, i));
+        const float pyM2 = fmaxf(0.0f, rcd_front(front, buf_in[+width * 2], j + 2, i));
+        const float pyM3 = fmaxf(0.0f, rcd_front(front, buf_in[+width * 3], j + 3, i));
+        const float pxm  = fmaxf(0.0f, rcd_front(front, buf_in[-1], j, i - 1));
+        const float pxm2 = fmaxf(0.0f, rcd_front(front, buf_in[-2], j, i - 2));
+        const float pxm3 = fmaxf(0.0f, rcd_front(front, buf_in[-3], j, i - 3));
+        const float pxM  = fmaxf(0.0f, rcd_front(front, buf_in[+1], j, i + 1));
+        const float pxM2 = fmaxf(0.0f, rcd_front(front, buf_in[+2], j, i + 2));
+        const float pxM3 = fmaxf(0.0f, rcd_front(front, buf_in[+3], j, i + 3));
 
         const float guessx = (pxm + pc + pxM) * 2.0f - pxM2 - pxm2;
         const float diffx = (fabsf(pxm2 - pc) + fabsf(pxM2 - pc) + fabsf(pxm - pxM)) * 3.0f
@@ -300,7 +314,8 @@ static void rcd_ppg_border(float *const out, const float *const in, const int wi
   #pragma omp declare simd aligned(in, out)
 #endif
 static void rcd_demosaic(dt_dev_pixelpipe_iop_t *piece, float *const restrict out, const float *const restrict in, dt_iop_roi_t *const roi_out,
-                                   const dt_iop_roi_t *const roi_in, const uint32_t filters)
+                                   const dt_iop_roi_t *const roi_in, const uint32_t filters,
+                                   const dt_dev_pixelpipe_rawfront_t *const rawfront)
 {
   const int width = roi_in->width;
   const int height = roi_in->height;
@@ -311,7 +326,21 @@ static void rcd_demosaic(dt_dev_pixelpipe_iop_t *piece, float *const restrict ou
     return;
   }
 
-  rcd_ppg_border(out, in, width, height, filters, RCD_MARGIN);
+  // With a fused raw front-end we apply it while filling the tiles, so the full-size mosaic is read once
+  rcd_front_t front_data;
+  const rcd_front_t *const front = rawfront ? &front_data : NULL;
+  if(rawfront)
+  {
+    for(int row = 0; row < 8; row++)
+      for(int col = 0; col < 2; col++)
+      {
+        const int c = FC(row + roi_in->y, col + roi_in->x, filters);
+        front_data.coeffs[row][col] = rawfront->coeffs[c];
+        front_data.clip[row][col] = rawfront->clip[c];
+      }
+  }
+
+  rcd_ppg_border(out, in, width, height, filters, RCD_MARGIN, front);
 
   const float scaler = fmaxf(piece->pipe->dsc.processed_maximum[0], fmaxf(piece->pipe->dsc.processed_maximum[1], piece->pipe->dsc.processed_maximum[2]));
   const float revscaler = 1.0f / scaler;
@@ -321,7 +350,7 @@ static void rcd_demosaic(dt_dev_pixelpipe_iop_t *piece, float *const restrict ou
 
 #ifdef _OPENMP
   #pragma omp parallel \
-  dt_omp_firstprivate(width, height, filters, out, in, scaler, revscaler)
+  dt_omp_firstprivate(width, height, filters, out, in, scaler, revscaler, front)
 #endif
   {
     float *const VH_Dir = dt_alloc_align_float((size_t) RCD_TILESIZE * RCD_TILESIZE);
@@ -365,7 +394,7 @@ static void rcd_demosaic(dt_dev_pixelpipe_iop_t *piece, float *const restrict ou
           const int c1 = FC(row, colStart + 1, filters);
           for(int col = colStart, indx = (row - rowStart) * RCD_TILESIZE, in_indx = row * width + colStart; col < colEnd; col++, indx++, in_indx++)
           {
-            cfa[indx] = rgb[c0][indx] = rgb[c1][indx] = safe_in(in[in_indx], revscaler);
+            cfa[indx] = rgb[c0][indx] = rgb[c1][indx] = safe_in(rcd_front(front, in[in_indx], row, col), revscaler);
           }
         }
 
@@ -22,6 +22,7 @@
 #include <xmmintrin.h>
 #endif
 #include <assert.h>
+#include <float.h>
 #include <lcms2.h>
 #include <math.h>
 #include <stdlib.h>
@@ -521,6 +522,26 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   }
 }
 
+int fuse_rawfront(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, dt_iop_buffer_dsc_t *dsc,
+                  dt_dev_pixelpipe_rawfront_t *front)
+{
+  // on a bayer mosaic process() is a plain multiplication per CFA color
+  const uint32_t filters = piece->pipe->dsc.filters;
+  if(!filters || filters == 9u) return 0;
+  if(!front) return 1;
+
+  const dt_iop_temperature_data_t *const d = (dt_iop_temperature_data_t *)piece->data;
+  dsc->temperature.enabled = 1;
+  for(int k = 0; k < 4; k++)
+  {
+    front->coeffs[k] *= d->coeffs[k];
+    if(front->clip[k] < FLT_MAX) front->clip[k] *= d->coeffs[k];
+    dsc->temperature.coeffs[k] = d->coeffs[k];
+    dsc->processed_maximum[k] = d->coeffs[k] * dsc->processed_maximum[k];
+  }
+  return 1;
+}
+
 #if defined(__SSE__)
 void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
                   void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
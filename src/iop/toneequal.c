@@ -197,6 +197,7 @@ typedef struct dt_iop_toneequalizer_data_t
   float scale;
   int radius;
   int iterations;
+  int guide_downsampling; // compute the luminance mask at 1/n of the resolution
   dt_iop_luminance_mask_method_t method;
   dt_iop_toneequalizer_filter_t details;
 } dt_iop_toneequalizer_data_t;
@@ -789,7 +790,7 @@ static inline float pixel_correction(const float exposure,
 __DT_CLONE_TARGETS__
 static inline void compute_luminance_mask(const float *const restrict in, float *const restrict luminance,
                                           const size_t width, const size_t height, const size_t ch,
-                                          const dt_iop_toneequalizer_data_t *const d)
+                                          const int radius, const dt_iop_toneequalizer_data_t *const d)
 {
   switch(d->details)
   {
@@ -804,7 +805,7 @@ static inline void compute_luminance_mask(const float *const restrict in, float
     {
       // Still no contrast boost
       luminance_mask(in, luminance, width, height, ch, d->method, d->exposure_boost, 0.0f, 1.0f);
-      fast_surface_blur(luminance, width, height, d->radius, d->feathering, d->iterations,
+      fast_surface_blur(luminance, width, height, radius, d->feathering, d->iterations,
                     DT_GF_BLENDING_GEOMEAN, d->scale, d->quantization, exp2f(-14.0f), 4.0f);
       break;
     }
@@ -820,7 +821,7 @@ static inline void compute_luminance_mask(const float *const restrict in, float
       // the exposure boost should be used to make this assumption true
       luminance_mask(in, luminance, width, height, ch, d->method, d->exposure_boost,
                       CONTRAST_FULCRUM, d->contrast_boost);
-      fast_surface_blur(luminance, width, height, d->radius, d->feathering, d->iterations,
+      fast_surface_blur(luminance, width, height, radius, d->feathering, d->iterations,
                     DT_GF_BLENDING_LINEAR, d->scale, d->quantization, exp2f(-14.0f), 4.0f);
       break;
     }
@@ -829,7 +830,7 @@ static inline void compute_luminance_mask(const float *const restrict in, float
     {
       // Still no contrast boost
       luminance_mask(in, luminance, width, height, ch, d->method, d->exposure_boost, 0.0f, 1.0f);
-      fast_eigf_surface_blur(luminance, width, height, d->radius, d->feathering, d->iterations,
+      fast_eigf_surface_blur(luminance, width, height, radius, d->feathering, d->iterations,
                     DT_GF_BLENDING_GEOMEAN, d->scale, d->quantization, exp2f(-14.0f), 4.0f);
       break;
     }
@@ -838,7 +839,7 @@ static inline void compute_luminance_mask(const float *const restrict in, float
     {
       luminance_mask(in, luminance, width, height, ch, d->method, d->exposure_boost,
                       CONTRAST_FULCRUM, d->contrast_boost);
-      fast_eigf_surface_blur(luminance, width, height, d->radius, d->feathering, d->iterations,
+      fast_eigf_surface_blur(luminance, width, height, radius, d->feathering, d->iterations,
                     DT_GF_BLENDING_LINEAR, d->scale, d->quantization, exp2f(-14.0f), 4.0f);
       break;
     }
@@ -852,6 +853,67 @@ static inline void compute_luminance_mask(const float *const restrict in, float
 }
 
 
+__DT_CLONE_TARGETS__
+static inline void compute_guide(const float *const restrict in, float *const restrict luminance,
+                                 const size_t width, const size_t height, const size_t ch,
+                                 const dt_iop_toneequalizer_data_t *const d)
+{
+  const int factor = d->guide_downsampling;
+  const size_t ds_width = width / MAX(factor, 1);
+  const size_t ds_height = height / MAX(factor, 1);
+
+  if(factor <= 1 || ds_width < 16 || ds_height < 16 || d->details == DT_TONEEQ_NONE)
+  {
+    compute_luminance_mask(in, luminance, width, height, ch, d->radius, d);
+    return;
+  }
+
+  // Downsampled guide : the mask is a smooth surface, so filter a downscaled copy
+  // of the image and upsample the result. Edges get blurred over about factor pixels.
+  float *const restrict ds_in = dt_alloc_sse_ps(dt_round_size_sse(ds_width * ds_height * ch));
+  float *const restrict ds_luminance = dt_alloc_sse_ps(dt_round_size_sse(ds_width * ds_height));
+
+  if(!ds_in || !ds_luminance)
+  {
+    // fall back to the full resolution guide
+    compute_luminance_mask(in, luminance, width, height, ch, d->radius, d);
+  }
+  else
+  {
+    const dt_iop_roi_t roi_full = { 0, 0, (int)width, (int)height, 1.0f };
+    const dt_iop_roi_t roi_ds = { 0, 0, (int)ds_width, (int)ds_height, (float)ds_width / (float)width };
+    dt_iop_clip_and_zoom(ds_in, in, &roi_ds, &roi_full, ds_width, width);
+    compute_luminance_mask(ds_in, ds_luminance, ds_width, ds_height, ch, MAX(d->radius / factor, 1), d);
+    interpolate_bilinear(ds_luminance, ds_width, ds_height, luminance, width, height, 1);
+  }
+
+  if(ds_in) dt_free_align(ds_in);
+  if(ds_luminance) dt_free_align(ds_luminance);
+}
+
+
+// The luminance mask only depends on the upstream pipe, the region of interest and
+// the guide parameters. The curve is left out on purpose, so changing it only
+// reapplies the correction LUT on the cached mask.
+static uint64_t compute_guide_hash(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
+                                   const dt_iop_roi_t *const roi_in)
+{
+  const dt_iop_toneequalizer_data_t *const d = (const dt_iop_toneequalizer_data_t *const)piece->data;
+
+  // hash of the modules before this one
+  const int position = g_list_index(piece->pipe->nodes, piece);
+  uint64_t hash = dt_dev_pixelpipe_cache_hash(piece->pipe->image.id, roi_in, piece->pipe, MAX(position, 0));
+
+  const float guide[] = { d->feathering, d->contrast_boost, d->exposure_boost, d->quantization, d->scale,
+                          (float)d->radius, (float)d->iterations, (float)d->guide_downsampling,
+                          (float)d->method, (float)d->details };
+  const char *str = (const char *)guide;
+  for(size_t i = 0; i < sizeof(guide); i++) hash = ((hash << 5) + hash) ^ str[i];
+
+  return hash;
+}
+
+
 /***
  * Actual transfer functions
  **/
@@ -917,9 +979,9 @@ void toneeq_process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
   const size_t num_elem = width * height;
   const size_t ch = 4;
 
-  // Get the hash of the upstream pipe to track changes
+  // Get the hash of the upstream pipe and the guide to track changes
   const int position = self->iop_order;
-  uint64_t hash = dt_dev_pixelpipe_cache_hash(piece->pipe->image.id, roi_out, piece->pipe, position);
+  uint64_t hash = compute_guide_hash(self, piece, roi_in);
 
   // Sanity checks
   if(width < 1 || height < 1) return;
@@ -1027,7 +1089,7 @@ void toneeq_process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
       if(hash != saved_hash || !luminance_valid)
       {
         /* compute only if upstream pipe state has changed */
-        compute_luminance_mask(in, luminance, width, height, ch, d);
+        compute_guide(in, luminance, width, height, ch, d);
         hash_set_get(&hash, &g->ui_preview_hash, &self->gui_lock);
       }
     }
@@ -1046,20 +1108,20 @@ void toneeq_process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
         dt_iop_gui_enter_critical_section(self);
         g->thumb_preview_hash = hash;
         g->histogram_valid = FALSE;
-        compute_luminance_mask(in, luminance, width, height, ch, d);
+        compute_guide(in, luminance, width, height, ch, d);
         g->luminance_valid = TRUE;
         dt_iop_gui_leave_critical_section(self);
       }
     }
     else // make it dummy-proof
     {
-      compute_luminance_mask(in, luminance, width, height, ch, d);
+      compute_guide(in, luminance, width, height, ch, d);
     }
   }
   else
   {
     // no caching path : compute no matter what
-    compute_luminance_mask(in, luminance, width, height, ch, d);
+    compute_guide(in, luminance, width, height, ch, d);
   }
 
   // Display output
@@ -1523,6 +1585,11 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
   d->contrast_boost = exp2f(p->contrast_boost);
   d->exposure_boost = exp2f(p->exposure_boost);
 
+  // exports can trade some edge accuracy of the mask for speed
+  d->guide_downsampling = ((pipe->type & DT_DEV_PIXELPIPE_EXPORT) == DT_DEV_PIXELPIPE_EXPORT)
+                              ? MAX(dt_conf_get_int("plugins/darkroom/toneequal/export_guide_downsampling"), 1)
+                              : 1;
+
   /*
    * Perform a radial-based interpolation using a series gaussian functions
    */
@@ -182,29 +182,10 @@ static void load_button_clicked(GtkWidget *widget, dt_lib_module_t *self)
 
 static void compress_button_clicked(GtkWidget *widget, gpointer user_data)
 {
-  const GtkWidget *win = dt_ui_main_window(darktable.gui->ui);
   const GList *imgs = dt_view_get_images_to_act_on(TRUE, TRUE, FALSE);
   if(!imgs) return;  // do nothing if no images to be acted on
 
-  const int missing = dt_history_compress_on_list(imgs);
-
-  dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_RELOAD, DT_COLLECTION_PROP_UNDEF,
-                             g_list_copy((GList *)imgs));
-  dt_control_queue_redraw_center();
-  if (missing)
-  {
-    GtkWidget *dialog = gtk_message_dialog_new(
-    GTK_WINDOW(win), GTK_DIALOG_DESTROY_WITH_PARENT, GTK_MESSAGE_QUESTION, GTK_BUTTONS_CLOSE,
-    ngettext("no history compression of 1 image.\nsee tag: darktable|problem|history-compress.",
-             "no history compression of %d images.\nsee tag: darktable|problem|history-compress.", missing ), missing);
-#ifdef GDK_WINDOWING_QUARTZ
-    dt_osx_disallow_fullscreen(dialog);
-#endif
-
-    gtk_window_set_title(GTK_WINDOW(dialog), _("history compression warning"));
-    gtk_dialog_run(GTK_DIALOG(dialog));
-    gtk_widget_destroy(dialog);
-  }
+  dt_control_compress_history(g_list_copy((GList *)imgs));
 }
 
 
@@ -282,11 +263,7 @@ static void paste_button_clicked(GtkWidget *widget, gpointer user_data)
   /* copy history from previously copied image and past onto selection */
   const GList *imgs = dt_view_get_images_to_act_on(TRUE, TRUE, FALSE);
 
-  if(dt_history_paste_on_list(imgs, TRUE))
-  {
-    dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_RELOAD, DT_COLLECTION_PROP_UNDEF,
-                               g_list_copy((GList *)imgs));
-  }
+  dt_control_paste_history(g_list_copy((GList *)imgs));
 }
 
 static void paste_parts_button_clicked(GtkWidget *widget, gpointer user_data)
@@ -298,16 +275,7 @@ static void paste_parts_button_clicked(GtkWidget *widget, gpointer user_data)
   // back dt_view_get_images_to_act_on() which free list and create a new one. So we
   // make a copy because the above imgs will be invalidated.
 
-  GList* imgs_copy = g_list_copy((GList*)imgs);
-  if(dt_history_paste_parts_on_list(imgs_copy, TRUE))
-  {
-    dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_RELOAD, DT_COLLECTION_PROP_UNDEF,
-                               imgs_copy); // frees imgs_copy
-  }
-  else
-  {
-    g_list_free(imgs_copy);
-  }
+  dt_control_paste_parts_history(g_list_copy((GList *)imgs));
 }
 
 static void pastemode_combobox_changed(GtkWidget *widget, gpointer user_data)
@@ -18,7 +18,6 @@
 #include <stdint.h>
 
 #include "bauhaus/bauhaus.h"
-#include "common/atomic.h"
 #include "common/darktable.h"
 #include "common/debug.h"
 #include "common/histogram.h"
@@ -45,6 +44,8 @@
 // FIXME: would fewer gradations still produce a nice hue ring? are this many gradations (32 * 6 = 192) slow to draw on the scope?
 #define VECTORSCOPE_HUES 32
 #define VECTORSCOPE_BASE_LOG 30
+// previews larger than this are decimated before the scopes are computed
+#define SCOPES_MAX_SAMPLES (4 * 1024 * 1024)
 
 DT_MODULE(1)
 
@@ -90,6 +91,16 @@ const gchar *dt_lib_histogram_scale_names[DT_LIB_HISTOGRAM_SCALE_N] = { "logarit
 const gchar *dt_lib_histogram_waveform_type_names[DT_LIB_HISTOGRAM_WAVEFORM_N] = { "overlaid", "parade" };
 const gchar *dt_lib_histogram_vectorscope_type_names[DT_LIB_HISTOGRAM_VECTORSCOPE_N] = { "u*v*", "AzBz" };
 
+// a preview image waiting for the scopes job
+typedef struct dt_lib_histogram_request_t
+{
+  float *buf;
+  int width, height;
+  dt_histogram_roi_t roi;
+  const dt_iop_order_iccprofile_info_t *profile_info_from;
+  const dt_iop_order_iccprofile_info_t *profile_info_to;
+} dt_lib_histogram_request_t;
+
 typedef struct dt_lib_histogram_t
 {
   // histogram for display
@@ -111,6 +122,9 @@ typedef struct dt_lib_histogram_t
   dt_lib_histogram_vectorscope_type_t hue_ring_colorspace;
   double vectorscope_radius;
   dt_pthread_mutex_t lock;
+  // the scopes are computed in a background job, which always picks up the latest request
+  dt_lib_histogram_request_t *pending;
+  gboolean job_queued;
   GtkWidget *scope_draw;               // GtkDrawingArea -- scope, scale, and draggable overlays
   GtkWidget *button_box;               // GtkButtonBox -- contains scope control buttons
   GtkWidget *button_stack;             // GtkStack -- flips between red and colorspace buttons
@@ -170,9 +184,7 @@ static void _lib_histogram_process_histogram(dt_lib_histogram_t *const d, const
   const dt_iop_colorspace_type_t cst = iop_cs_rgb;
   dt_dev_histogram_stats_t histogram_stats = { .bins_count = HISTOGRAM_BINS, .ch = 4, .pixels = 0 };
   uint32_t histogram_max[4] = { 0 };
-
-  d->histogram_max = 0;
-  memset(d->histogram, 0, sizeof(uint32_t) * 4 * HISTOGRAM_BINS);
+  uint32_t *histogram = NULL;
 
   histogram_params.roi = roi;
   histogram_params.bins_count = HISTOGRAM_BINS;
@@ -180,9 +192,18 @@ static void _lib_histogram_process_histogram(dt_lib_histogram_t *const d, const
 
   // FIXME: for point sample, calculate whole graph and the point sample values, draw these on top of the graph
   // FIXME: set up "custom" histogram worker which can do colorspace conversion on fly -- in cases that we need to do that -- may need to add from colorspace to dt_dev_histogram_collection_params_t
-  dt_histogram_helper(&histogram_params, &histogram_stats, cst, iop_cs_NONE, input, &d->histogram, FALSE, NULL);
-  dt_histogram_max_helper(&histogram_stats, cst, iop_cs_NONE, &d->histogram, histogram_max);
+  // the worker bins into per-thread histograms, so there is no contention
+  dt_histogram_helper(&histogram_params, &histogram_stats, cst, iop_cs_NONE, input, &histogram, FALSE, NULL);
+  dt_histogram_max_helper(&histogram_stats, cst, iop_cs_NONE, &histogram, histogram_max);
+
+  dt_pthread_mutex_lock(&d->lock);
+  if(histogram)
+    memcpy(d->histogram, histogram, sizeof(uint32_t) * 4 * HISTOGRAM_BINS);
+  else
+    memset(d->histogram, 0, sizeof(uint32_t) * 4 * HISTOGRAM_BINS);
   d->histogram_max = MAX(MAX(histogram_max[0], histogram_max[1]), histogram_max[2]);
+  dt_pthread_mutex_unlock(&d->lock);
+  free(histogram);
 }
 
 static void _lib_histogram_process_waveform(dt_lib_histogram_t *const d, const float *const input,
@@ -196,8 +217,8 @@ static void _lib_histogram_process_waveform(dt_lib_histogram_t *const d, const f
   // will be <= 360x175x4. Hence process works with a relatively small
   // quantity of data.
   const float *const restrict in = DT_IS_ALIGNED((const float *const restrict)input);
+  // only ever touched by the scopes job, so no need to lock
   float *const restrict wf_linear = DT_IS_ALIGNED((float *const restrict)d->waveform_linear);
-  uint8_t *const restrict wf_8bit = DT_IS_ALIGNED((uint8_t *const restrict)d->waveform_8bit);
 
   // Use integral sized bins for columns, as otherwise they will be
   // unequal and have banding. Rely on draw to smoothly do horizontal
@@ -208,8 +229,6 @@ static void _lib_histogram_process_waveform(dt_lib_histogram_t *const d, const f
   // width and # of bins.
   const size_t bin_width = ceilf(sample_width / (float)d->waveform_max_width);
   const size_t wf_width = ceilf(sample_width / (float)bin_width);
-  d->waveform_width = wf_width;
-  const size_t wf_8bit_stride = cairo_format_stride_for_width(CAIRO_FORMAT_A8, wf_width);
   const size_t wf_height = d->waveform_height;
   dt_iop_image_fill(wf_linear, 0.0f, wf_width, wf_height, 3);
 
@@ -224,26 +243,37 @@ static void _lib_histogram_process_waveform(dt_lib_histogram_t *const d, const f
   const float height_f = height_i;
 
   // FIXME: for point sample, calculate whole graph and the point sample values, draw these on top of a dimmer graph
-  // count the colors
-  // FIXME: could flip x/y axes here and when reading to make row-wise iteration?
-  // FIXME: Try histogram-style worker threads to process by row and consolidate results. Have the workers do colorspace conversion per-pixel. As there will be no intermediate buffer, even 20 per-thread output buffers will still use less memory.
+  // count the colors. each thread owns a band of output columns, so no two threads write the
+  // same bin, and walks its part of the image row by row.
+  const size_t nbands = MIN(wf_width, (size_t)dt_get_num_threads());
+  const size_t x_end = roi->width - roi->crop_width;
+  const size_t y_end = roi->height - roi->crop_height;
 #if defined(_OPENMP)
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(in, wf_linear, roi, wf_width, wf_height, bin_width, height_f, height_i, scale) \
+  dt_omp_firstprivate(in, wf_linear, roi, wf_width, wf_height, bin_width, height_f, height_i, scale, nbands) \
+  dt_omp_firstprivate(x_end, y_end) \
   schedule(static)
 #endif
-  for(size_t out_x = 0; out_x < wf_width; out_x++)
+  for(size_t band = 0; band < nbands; band++)
   {
-    const size_t x_from = out_x * bin_width + roi->crop_x;
-    const size_t x_high = MIN(x_from + bin_width, roi->width - roi->crop_width);
-    for(size_t in_x = x_from; in_x < x_high; in_x++)
-      for(size_t in_y = roi->crop_y; in_y < roi->height - roi->crop_height; in_y++)
+    const size_t out_from = band * wf_width / nbands;
+    const size_t out_to = (band + 1) * wf_width / nbands;
+    const size_t x_from = out_from * bin_width + roi->crop_x;
+    const size_t x_high = MIN(out_to * bin_width + roi->crop_x, x_end);
+    for(size_t in_y = roi->crop_y; in_y < y_end; in_y++)
+    {
+      const float *const restrict row = in + 4U * roi->width * in_y;
+      for(size_t in_x = x_from; in_x < x_high; in_x++)
+      {
+        const size_t out_x = (in_x - roi->crop_x) / bin_width;
         for(size_t k = 0; k < 3; k++)
         {
-          const float v = 1.0f - (8.0f / 9.0f) * in[4U * (roi->width * in_y + in_x) + k];
+          const float v = 1.0f - (8.0f / 9.0f) * row[4U * in_x + k];
           const size_t out_y = isnan(v) ? 0 : MIN((size_t)fmaxf(v*height_f, 0.0f), height_i);
           wf_linear[(k * wf_height + out_y) * wf_width + out_x] += scale;
         }
+      }
+    }
   }
 
   // shortcut to change from linear to display gamma -- borrow hybrid log-gamma LUT
@@ -253,6 +283,10 @@ static void _lib_histogram_process_waveform(dt_lib_histogram_t *const d, const f
   const float *const restrict lut = DT_IS_ALIGNED((const float *const restrict)profile->lut_out[0]);
   const float lutmax = profile->lutsize - 1;
 
+  dt_pthread_mutex_lock(&d->lock);
+  uint8_t *const restrict wf_8bit = DT_IS_ALIGNED((uint8_t *const restrict)d->waveform_8bit);
+  const size_t wf_8bit_stride = cairo_format_stride_for_width(CAIRO_FORMAT_A8, wf_width);
+  d->waveform_width = wf_width;
   // loops are too small (3 * 360 * 175 max iterations) to need threads
   for(size_t ch = 0; ch < 3; ch++)
     for(size_t y = 0; y < wf_height; y++)
@@ -262,6 +296,7 @@ static void _lib_histogram_process_waveform(dt_lib_histogram_t *const d, const f
         const float display = lut[(int)(linear * lutmax)];
         wf_8bit[(ch * wf_height + y) * wf_8bit_stride + x] = display * 255.f;
       }
+  dt_pthread_mutex_unlock(&d->lock);
 }
 
 static void _lib_histogram_hue_ring(dt_lib_histogram_t *d, const dt_iop_order_iccprofile_info_t *const vs_prof)
@@ -336,9 +371,9 @@ static inline float baselog(float x, float bound)
   return log1pf((VECTORSCOPE_BASE_LOG - 1.f) * x / bound) / log(VECTORSCOPE_BASE_LOG) * bound;
 }
 
-static inline void log_scale(const dt_lib_histogram_t *d, float *x, float *y, float r)
+static inline void _log_scale(const dt_lib_histogram_scale_t scale, float *x, float *y, float r)
 {
-  if(d->vectorscope_scale == DT_LIB_HISTOGRAM_SCALE_LOGARITHMIC)
+  if(scale == DT_LIB_HISTOGRAM_SCALE_LOGARITHMIC)
   {
     const float h = hypotf(*x,*y);
     const float s = baselog(h, r);
@@ -347,12 +382,16 @@ static inline void log_scale(const dt_lib_histogram_t *d, float *x, float *y, fl
   }
 }
 
+static inline void log_scale(const dt_lib_histogram_t *d, float *x, float *y, float r)
+{
+  _log_scale(d->vectorscope_scale, x, y, r);
+}
+
 static void _lib_histogram_process_vectorscope(dt_lib_histogram_t *d, const float *const input,
                                                dt_histogram_roi_t *const roi,
                                                const dt_iop_order_iccprofile_info_t *vs_prof)
 {
   const int diam_px = d->vectorscope_diameter_px;
-  const dt_lib_histogram_vectorscope_type_t vs_type = d->vectorscope_type;
 
   if(!vs_prof || isnan(vs_prof->matrix_in[0]))
   {
@@ -360,14 +399,20 @@ static void _lib_histogram_process_vectorscope(dt_lib_histogram_t *d, const floa
     vs_prof = dt_ioppr_add_profile_info_to_list(darktable.develop, DT_COLORSPACE_LIN_REC2020, "", DT_INTENT_RELATIVE_COLORIMETRIC);
   }
 
+  // the hue ring is shared with drawing, take a consistent snapshot of the settings along with it
+  dt_pthread_mutex_lock(&d->lock);
   _lib_histogram_hue_ring(d, vs_prof);
+  const dt_lib_histogram_vectorscope_type_t vs_type = d->vectorscope_type;
+  const dt_lib_histogram_scale_t vs_scale = d->vectorscope_scale;
   // FIXME: particularly for u*v*, center on hue ring bounds rather than plot center, to be able to show a larger plot?
   const float max_radius = d->vectorscope_radius;
+  dt_pthread_mutex_unlock(&d->lock);
   const float max_diam = max_radius * 2.f;
 
   int sample_width = MAX(1, roi->width - roi->crop_width - roi->crop_x);
   int sample_height = MAX(1, roi->height - roi->crop_height - roi->crop_y);
   size_t pt_sample_x = SIZE_MAX, pt_sample_y = SIZE_MAX;
+  float pt[2] = { NAN, NAN };
   if(sample_width == 1 && sample_height == 1)
   {
     // point sample still calculates graph based on whole image
@@ -377,16 +422,16 @@ static void _lib_histogram_process_vectorscope(dt_lib_histogram_t *d, const floa
     sample_height = roi->height;
     roi->crop_x = roi->crop_y = 0;
   }
-  else
-  {
-    d->vectorscope_pt[0] = NAN;
-  }
 
   // RGB -> chromaticity (processor-heavy), count into bins by chromaticity
   // FIXME: if we do convert to histogram RGB, should it be an absolute colorimetric conversion (would mean knowing the histogram profile whitepoint and un-adapting its matrices) and then we have a meaningful whitepoint and could plot spectral locus -- or the reverse, adapt the spectral locus to the histogram profile PCS (always D50)?
   // FIXME: pre-allocate? -- use the same buffer as for waveform?
-  dt_atomic_int *const restrict binned = __builtin_assume_aligned(dt_alloc_align(64, sizeof(int) * diam_px * diam_px), 64);
-  memset(binned, 0, sizeof(int) * diam_px * diam_px);
+  // every thread counts into its own bins, which are summed up afterwards
+  const int nthreads = dt_get_num_threads();
+  const size_t nbins = (size_t)diam_px * diam_px;
+  int *const restrict partial = dt_alloc_align(64, sizeof(int) * nbins * nthreads);
+  if(!partial) return;
+  memset(partial, 0, sizeof(int) * nbins * nthreads);
   // FIXME: move verbosed interleaved comments into a method note at the start, as the code itself is succinct and clear
   // FIXME: even with getting rid of the extra profile conversion hop there's no noticeable speedup -- maybe this loop is memory bound -- if can get rid of one of the output buffers and still no speedup, consider doing more work in this loop, such as atomic binning
   // FIXME: make 2x2 averaging be conditional on preprocessor define
@@ -397,12 +442,13 @@ static void _lib_histogram_process_vectorscope(dt_lib_histogram_t *d, const floa
   // FIXME: instead of scaling, if chromaticity really depends only on XY, then make a lookup on startup of for each grid cell on graph output the minimum XY to populate that cell, then either brute-force scan that LUT, or start from position of last pixel and scan, or do an optimized search (1/2, 1/2, 1/2, etc.) -- would also find point sample pixel this way
 #if defined(_OPENMP)
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(input, binned, sample_max_x, sample_max_y, roi, pt_sample_x, pt_sample_y, d, diam_px, max_radius, max_diam, vs_prof, vs_type) \
-  schedule(static) collapse(2)
+  dt_omp_firstprivate(input, partial, nbins, sample_max_x, sample_max_y, roi, pt_sample_x, pt_sample_y, diam_px, max_radius, max_diam, vs_prof, vs_type, vs_scale) \
+  shared(pt) schedule(static) collapse(2)
 #endif
   for(size_t y=0; y<sample_max_y; y+=2)
     for(size_t x=0; x<sample_max_x; x+=2)
     {
+      int *const restrict binned = partial + nbins * dt_get_thread_num();
       // FIXME: There are unnecessary color math hops. Right now the data
       // comes into dt_lib_histogram_process() in a known profile
       // (usually from pixelpipe). Then (usually) it gets converted to
@@ -451,11 +497,11 @@ static void _lib_histogram_process_vectorscope(dt_lib_histogram_t *d, const floa
         dt_XYZ_2_JzAzBz(XYZ_D65, chromaticity);
       }
       // FIXME: we ignore the L or Jz components -- do they optimize out of the above code, or would in particular a XYZ_2_AzBz but helpful?
-      log_scale(d, chromaticity+1, chromaticity+2, max_radius);
+      _log_scale(vs_scale, chromaticity+1, chromaticity+2, max_radius);
       if(x == pt_sample_x && y == pt_sample_y)
       {
-        d->vectorscope_pt[0] = chromaticity[1];
-        d->vectorscope_pt[1] = chromaticity[2];
+        pt[0] = chromaticity[1];
+        pt[1] = chromaticity[2];
       }
 
       // FIXME: make cx,cy which are float, check 0 <= cx < 1, then multiply by diam_px
@@ -464,9 +510,20 @@ static void _lib_histogram_process_vectorscope(dt_lib_histogram_t *d, const floa
 
       // clip any out-of-scale values, so there aren't light edges
       if(out_x >= 0 && out_x <= diam_px-1 && out_y >= 0 && out_y <= diam_px-1)
-        dt_atomic_add_int(binned + out_y * diam_px + out_x, 1);
+        binned[out_y * diam_px + out_x]++;
     }
 
+  // sum up into the first set of bins
+#if defined(_OPENMP)
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(partial, nbins, nthreads) \
+  schedule(static)
+#endif
+  for(size_t k = 0; k < nbins; k++)
+    for(int n = 1; n < nthreads; n++)
+      partial[k] += partial[n * nbins + k];
+  const int *const binned = partial;
+
   // shortcut to change from linear to display gamma
   const dt_iop_order_iccprofile_info_t *const profile =
     dt_ioppr_add_profile_info_to_list(darktable.develop, DT_COLORSPACE_HLG_REC2020, "", DT_INTENT_PERCEPTUAL);
@@ -479,6 +536,10 @@ static void _lib_histogram_process_vectorscope(dt_lib_histogram_t *d, const floa
   const float gain = 1.f / 75.f;
   const float scale = gain * (diam_px * diam_px) / (sample_width * sample_height);
 
+  dt_pthread_mutex_lock(&d->lock);
+  d->vectorscope_pt[0] = pt[0];
+  d->vectorscope_pt[1] = pt[1];
+
   // loop appears to be too small to benefit w/OpenMP
   // FIXME: is this still true?
   for(size_t out_y = 0; out_y < diam_px; out_y++)
@@ -541,8 +602,100 @@ static void _lib_histogram_process_vectorscope(dt_lib_histogram_t *d, const floa
       for(int ch=0; ch<3; ch++)
         px[2U-ch] = CLAMP((int)(RGB[ch] * 255.0f), 0, 255);
     }
+  dt_pthread_mutex_unlock(&d->lock);
+
+  dt_free_align(partial);
+}
+
+static void _lib_histogram_request_free(dt_lib_histogram_request_t *req)
+{
+  if(!req) return;
+  dt_free_align(req->buf);
+  free(req);
+}
+
+static void _lib_histogram_process_request(dt_lib_histogram_t *d, dt_lib_histogram_request_t *req)
+{
+  dt_times_t start;
+  dt_get_times(&start);
+
+  // Convert pixelpipe output in display RGB to histogram profile. If
+  // in tether view, then the image is already converted by the
+  // caller.
+  // FIXME: do conversion in-place in the processing to save an extra buffer? -- at least for waveform, which already has to touch each pixel -- will need logic from _transform_matrix_rgb() -- or better yet a per-pixel callback within _transform_matrix_rgb()-ish code
+  // FIXME: in case of vectorscope, it needs XYZ data, so skip this conversion and instead it's enough that it has input & profile_info_from -- though then we don't see the result of a relative colorimetric conversion to the histogram profile...
+  float *img_display = dt_alloc_align_float((size_t)4 * req->width * req->height);
+  if(!img_display) return;
+  dt_ioppr_transform_image_colorspace_rgb(req->buf, img_display, req->width, req->height,
+                                          req->profile_info_from, req->profile_info_to, "final histogram");
+
+  dt_pthread_mutex_lock(&d->lock);
+  const dt_lib_histogram_scope_type_t scope_type = d->scope_type;
+  dt_pthread_mutex_unlock(&d->lock);
+
+  // the scopes do the heavy lifting without the lock and only take it to publish their result
+  switch(scope_type)
+  {
+    case DT_LIB_HISTOGRAM_SCOPE_HISTOGRAM:
+      _lib_histogram_process_histogram(d, img_display, &req->roi);
+      break;
+    case DT_LIB_HISTOGRAM_SCOPE_WAVEFORM:
+      _lib_histogram_process_waveform(d, img_display, &req->roi);
+      break;
+    case DT_LIB_HISTOGRAM_SCOPE_VECTORSCOPE:
+      _lib_histogram_process_vectorscope(d, img_display, &req->roi, req->profile_info_to);
+      break;
+    case DT_LIB_HISTOGRAM_SCOPE_N:
+      dt_unreachable_codepath();
+      break;
+  }
+  dt_free_align(img_display);
 
-  dt_free_align(binned);
+  dt_show_times_f(&start, "[histogram]", "final %s", dt_lib_histogram_scope_type_names[scope_type]);
+}
+
+typedef struct dt_lib_histogram_job_t
+{
+  dt_lib_module_t *self;
+  gboolean started;
+} dt_lib_histogram_job_t;
+
+static int32_t _lib_histogram_job_run(dt_job_t *job)
+{
+  dt_lib_histogram_job_t *params = dt_control_job_get_params(job);
+  dt_lib_module_t *self = params->self;
+  dt_lib_histogram_t *d = (dt_lib_histogram_t *)self->data;
+  params->started = TRUE;
+
+  // keep going as long as new previews come in, older ones have been dropped already
+  while(TRUE)
+  {
+    dt_pthread_mutex_lock(&d->lock);
+    dt_lib_histogram_request_t *req = d->pending;
+    d->pending = NULL;
+    if(!req) d->job_queued = FALSE;
+    dt_pthread_mutex_unlock(&d->lock);
+    if(!req) break;
+
+    _lib_histogram_process_request(d, req);
+    _lib_histogram_request_free(req);
+    dt_control_queue_redraw_widget(self->widget);
+  }
+  return 0;
+}
+
+static void _lib_histogram_job_cleanup(void *data)
+{
+  dt_lib_histogram_job_t *params = (dt_lib_histogram_job_t *)data;
+  // the job got pushed out of the queue, allow a new one to be scheduled
+  if(!params->started)
+  {
+    dt_lib_histogram_t *d = (dt_lib_histogram_t *)params->self->data;
+    dt_pthread_mutex_lock(&d->lock);
+    d->job_queued = FALSE;
+    dt_pthread_mutex_unlock(&d->lock);
+  }
+  free(params);
 }
 
 static void dt_lib_histogram_process(struct dt_lib_module_t *self, const float *const input,
@@ -550,9 +703,6 @@ static void dt_lib_histogram_process(struct dt_lib_module_t *self, const float *
                                      const dt_iop_order_iccprofile_info_t *const profile_info_from,
                                      const dt_iop_order_iccprofile_info_t *const profile_info_to)
 {
-  dt_times_t start;
-  dt_get_times(&start);
-
   dt_lib_histogram_t *d = (dt_lib_histogram_t *)self->data;
   dt_develop_t *dev = darktable.develop;
 
@@ -560,6 +710,8 @@ static void dt_lib_histogram_process(struct dt_lib_module_t *self, const float *
   if(!input)
   {
     dt_pthread_mutex_lock(&d->lock);
+    _lib_histogram_request_free(d->pending);
+    d->pending = NULL;
     memset(d->histogram, 0, sizeof(uint32_t) * 4 * HISTOGRAM_BINS);
     d->waveform_width = 0;
     d->vectorscope_radius = 0.f;
@@ -598,38 +750,74 @@ static void dt_lib_histogram_process(struct dt_lib_module_t *self, const float *
     }
   }
 
-  // Convert pixelpipe output in display RGB to histogram profile. If
-  // in tether view, then the image is already converted by the
-  // caller.
-  // FIXME: do conversion in-place in the processing to save an extra buffer? -- at least for waveform, which already has to touch each pixel -- will need logic from _transform_matrix_rgb() -- or better yet a per-pixel callback within _transform_matrix_rgb()-ish code
-  // FIXME: in case of vectorscope, it needs XYZ data, so skip this conversion and instead it's enough that it has input & profile_info_from -- though then we don't see the result of a relative colorimetric conversion to the histogram profile...
-  float *img_display = dt_alloc_align_float((size_t)4 * width * height);
-  if(!img_display) return;
-  dt_ioppr_transform_image_colorspace_rgb(input, img_display, width, height,
-                                          profile_info_from, profile_info_to, "final histogram");
-  dt_pthread_mutex_lock(&d->lock);
-  switch(d->scope_type)
+  // The caller's buffer is only valid during this call, so take a copy for the scopes job. Huge
+  // images (tethering) are decimated on the way, the scopes don't have that much resolution anyways.
+  const int step = ceilf(sqrtf((float)width * height / SCOPES_MAX_SAMPLES));
+  dt_lib_histogram_request_t *req = (dt_lib_histogram_request_t *)calloc(1, sizeof(dt_lib_histogram_request_t));
+  if(!req) return;
+  req->width = MAX(1, width / MAX(step, 1));
+  req->height = MAX(1, height / MAX(step, 1));
+  req->profile_info_from = profile_info_from;
+  req->profile_info_to = profile_info_to;
+  req->buf = dt_alloc_align_float((size_t)4 * req->width * req->height);
+  if(!req->buf)
   {
-    case DT_LIB_HISTOGRAM_SCOPE_HISTOGRAM:
-      _lib_histogram_process_histogram(d, img_display, &roi);
-      break;
-    case DT_LIB_HISTOGRAM_SCOPE_WAVEFORM:
-      _lib_histogram_process_waveform(d, img_display, &roi);
-      break;
-    case DT_LIB_HISTOGRAM_SCOPE_VECTORSCOPE:
-      _lib_histogram_process_vectorscope(d, img_display, &roi, profile_info_to);
-      break;
-    case DT_LIB_HISTOGRAM_SCOPE_N:
-      dt_unreachable_codepath();
-      break;
+    free(req);
+    return;
   }
+
+  if(step <= 1)
+  {
+    req->roi = roi;
+    memcpy(req->buf, input, sizeof(float) * 4 * width * height);
+  }
+  else
+  {
+    const int x_end = (width - roi.crop_width) / step, y_end = (height - roi.crop_height) / step;
+    req->roi = (dt_histogram_roi_t){ .width = req->width, .height = req->height,
+                                     .crop_x = roi.crop_x / step, .crop_y = roi.crop_y / step,
+                                     .crop_width = req->width - MIN(req->width, x_end),
+                                     .crop_height = req->height - MIN(req->height, y_end) };
+    float *const restrict out = req->buf;
+    const int out_width = req->width, out_height = req->height;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(input, out, out_width, out_height, width, step) \
+    schedule(static)
+#endif
+    for(int y = 0; y < out_height; y++)
+      for(int x = 0; x < out_width; x++)
+        for_four_channels(c)
+          out[4U * ((size_t)y * out_width + x) + c] = input[4U * ((size_t)y * step * width + (size_t)x * step) + c];
+  }
+
+  // replace what the job didn't get to yet, and start one if there isn't any
+  dt_pthread_mutex_lock(&d->lock);
+  _lib_histogram_request_free(d->pending);
+  d->pending = req;
+  const gboolean start_job = !d->job_queued;
+  d->job_queued = TRUE;
   dt_pthread_mutex_unlock(&d->lock);
-  dt_free_align(img_display);
 
-  dt_show_times_f(&start, "[histogram]", "final %s", dt_lib_histogram_scope_type_names[d->scope_type]);
+  if(start_job)
+  {
+    dt_job_t *job = dt_control_job_create(&_lib_histogram_job_run, "%s", "scopes");
+    dt_lib_histogram_job_t *params = (dt_lib_histogram_job_t *)calloc(1, sizeof(dt_lib_histogram_job_t));
+    if(!job || !params)
+    {
+      free(params);
+      dt_control_job_dispose(job);
+      dt_pthread_mutex_lock(&d->lock);
+      d->job_queued = FALSE;
+      dt_pthread_mutex_unlock(&d->lock);
+      return;
+    }
+    params->self = self;
+    dt_control_job_set_params(job, params, _lib_histogram_job_cleanup);
+    dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, job);
+  }
 }
 
-
 static void _lib_histogram_draw_histogram(dt_lib_histogram_t *d, cairo_t *cr,
                                           int width, int height, const uint8_t mask[3])
 {
@@ -1732,6 +1920,8 @@ void gui_cleanup(dt_lib_module_t *self)
 {
   dt_lib_histogram_t *d = (dt_lib_histogram_t *)self->data;
 
+  // the control jobs are gone by now, drop what they didn't get to
+  _lib_histogram_request_free(d->pending);
   free(d->histogram);
   dt_free_align(d->waveform_linear);
   dt_free_align(d->waveform_8bit);
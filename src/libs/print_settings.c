@@ -282,7 +282,7 @@ static int _export_image(dt_job_t *job, dt_image_box *img)
 {
   dt_lib_print_job_t *params = dt_control_job_get_params(job);
 
-  dt_imageio_module_format_t buf;
+  dt_imageio_module_format_t buf = { 0 };
   buf.mime = mime;
   buf.levels = levels;
   buf.bpp = bpp;
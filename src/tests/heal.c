@@ -0,0 +1,123 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// benchmark for the laplace solvers of the heal tool: round heal spots of growing size are
+// filled once with the red/black SOR iteration and once with the multigrid solver, comparing
+// the number of full resolution sweeps, the wall time and the resulting pixels.
+
+#define _DEFAULT_SOURCE
+#define DT_UNIT_TEST
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// define what heal.c needs from the rest of dt:
+#define dt_alloc_align(A, B) aligned_alloc(A, (((B) + (A) - 1) / (A)) * (A))
+#define dt_alloc_align_float(N) ((float *)dt_alloc_align(64, (N) * sizeof(float)))
+#define dt_free_align(A) free(A)
+#define dt_omp_firstprivate(...) firstprivate(__VA_ARGS__)
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define CLAMP(x, low, high) (((x) > (high)) ? (high) : (((x) < (low)) ? (low) : (x)))
+
+#include "common/heal.c"
+
+#define CH 4
+
+static double _wtime()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+// smooth gradients plus some texture, as the difference between two image patches would be
+static void _fill(float *buf, const int width, const int height)
+{
+  for(int i = 0; i < height; i++)
+    for(int j = 0; j < width; j++)
+    {
+      float *p = buf + ((size_t)i * width + j) * CH;
+      p[0] = 0.3f * sinf(0.01f * i) + 0.05f * sinf(0.7f * j);
+      p[1] = 0.2f * cosf(0.013f * j) + 0.05f * sinf(0.5f * (i + j));
+      p[2] = 0.001f * (i - j) + 0.05f * cosf(0.9f * i);
+      p[3] = 1.0f;
+    }
+}
+
+static void _circle(float *mask, const int width, const int height)
+{
+  const float r = 0.45f * MIN(width, height);
+  for(int i = 0; i < height; i++)
+    for(int j = 0; j < width; j++)
+    {
+      const float di = i - 0.5f * height, dj = j - 0.5f * width;
+      mask[(size_t)i * width + j] = (di * di + dj * dj < r * r) ? 1.0f : 0.0f;
+    }
+}
+
+int main(int argc, char *arg[])
+{
+  const int sizes[] = { 32, 64, 128, 256, 512, 1024 };
+
+  fprintf(stderr, " size |  SOR sweeps     time |   MG sweeps     time | max difference\n");
+  for(int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+  {
+    const int width = sizes[s], height = sizes[s];
+    const size_t size = (size_t)width * height;
+    // one more row for the dummy pixel of the SOR solver
+    float *sor = dt_alloc_align_float(CH * (size + width));
+    float *mg = dt_alloc_align_float(CH * (size + width));
+    float *mask = dt_alloc_align_float(size);
+    _fill(sor, width, height);
+    _circle(mask, width, height);
+    // start from zero inside the spot, as dt_heal() does for a flat source
+    for(size_t k = 0; k < size; k++)
+      if(mask[k] != 0.0f)
+        for(int c = 0; c < CH - 1; c++) sor[k * CH + c] = 0.0f;
+    memcpy(mg, sor, sizeof(float) * CH * size);
+
+    double start = _wtime();
+    const int sor_sweeps = dt_heal_laplace_loop(sor, width, height, CH, mask, 1);
+    const double sor_time = _wtime() - start;
+
+    start = _wtime();
+    const int mg_sweeps = dt_heal_laplace_multigrid(mg, width, height, CH, mask);
+    const double mg_time = _wtime() - start;
+
+    float maxdiff = 0.0f;
+    for(size_t k = 0; k < size; k++)
+      for(int c = 0; c < CH - 1; c++) maxdiff = fmaxf(maxdiff, fabsf(sor[k * CH + c] - mg[k * CH + c]));
+
+    fprintf(stderr, "%5d | %11d %7.3fs | %11d %7.3fs | %g\n", width, sor_sweeps, sor_time, mg_sweeps, mg_time,
+            maxdiff);
+
+    free(sor);
+    free(mg);
+    free(mask);
+  }
+
+  exit(0);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,182 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// consistency test and micro benchmark for the lock-free image snapshots: many threads
+// read image metadata while a few writers keep updating it. the same access pattern is
+// timed against what dt_image_cache_get() does, i.e. a global mutex for the lookup plus
+// a read lock on the entry.
+
+#include "common/atomic.c"
+#include "common/image_snapshot.c"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define NUM_IMAGES 1000
+#define READS_PER_THREAD 200000
+#define WRITERS 2
+
+typedef struct entry_t
+{
+  pthread_rwlock_t lock;
+  dt_image_snapshot_t img;
+} entry_t;
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static entry_t entries[NUM_IMAGES + 1];
+static dt_image_snapshot_table_t table;
+static dt_atomic_int running;
+static dt_atomic_int torn;
+static int use_snapshots;
+
+static double wtime()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+// all fields of a consistent image are derived from the same counter
+static void fill(dt_image_snapshot_t *img, const int id, const int gen)
+{
+  memset(img, 0, sizeof(dt_image_snapshot_t));
+  img->id = id;
+  img->group_id = img->film_id = img->version = img->flags = gen;
+  img->width = img->height = img->final_width = img->final_height = gen;
+  img->crop_x = img->crop_y = img->crop_width = img->crop_height = gen;
+  img->aspect_ratio = gen;
+  img->change_timestamp = gen;
+}
+
+static int consistent(const dt_image_snapshot_t *img)
+{
+  const int gen = img->flags;
+  return img->group_id == gen && img->width == gen && img->final_height == gen && img->crop_height == gen
+         && img->aspect_ratio == (float)gen && img->change_timestamp == gen;
+}
+
+static void *reader(void *data)
+{
+  unsigned int seed = (unsigned int)(size_t)data;
+  int sum = 0;
+  for(int k = 0; k < READS_PER_THREAD; k++)
+  {
+    const int id = 1 + rand_r(&seed) % NUM_IMAGES;
+    dt_image_snapshot_t img;
+    if(use_snapshots)
+    {
+      if(!dt_image_snapshot_read(&table, id, &img))
+      {
+        // what dt_image_cache_get_snapshot() falls back to
+        pthread_rwlock_rdlock(&entries[id].lock);
+        img = entries[id].img;
+        pthread_rwlock_unlock(&entries[id].lock);
+      }
+    }
+    else
+    {
+      pthread_mutex_lock(&cache_lock);
+      pthread_rwlock_rdlock(&entries[id].lock);
+      pthread_mutex_unlock(&cache_lock);
+      img = entries[id].img;
+      pthread_rwlock_unlock(&entries[id].lock);
+    }
+    if(img.id != id || !consistent(&img)) dt_atomic_add_int(&torn, 1);
+    sum += img.flags;
+  }
+  return (void *)(size_t)sum;
+}
+
+static void *writer(void *data)
+{
+  unsigned int seed = (unsigned int)(size_t)data;
+  int gen = 1;
+  while(dt_atomic_get_int(&running))
+  {
+    const int id = 1 + rand_r(&seed) % NUM_IMAGES;
+    pthread_mutex_lock(&cache_lock);
+    pthread_rwlock_wrlock(&entries[id].lock);
+    pthread_mutex_unlock(&cache_lock);
+    if(use_snapshots) dt_image_snapshot_invalidate(&table, id);
+    fill(&entries[id].img, id, gen++);
+    if(use_snapshots) dt_image_snapshot_publish(&table, &entries[id].img);
+    pthread_rwlock_unlock(&entries[id].lock);
+  }
+  return NULL;
+}
+
+static double run(const int threads, const int snapshots)
+{
+  use_snapshots = snapshots;
+  dt_atomic_set_int(&running, 1);
+  pthread_t *readers = malloc(sizeof(pthread_t) * threads);
+  pthread_t writers[WRITERS];
+  for(int k = 0; k < WRITERS; k++) pthread_create(writers + k, NULL, writer, (void *)(size_t)(1000 + k));
+
+  const double start = wtime();
+  for(int k = 0; k < threads; k++) pthread_create(readers + k, NULL, reader, (void *)(size_t)k);
+  for(int k = 0; k < threads; k++) pthread_join(readers[k], NULL);
+  const double end = wtime();
+
+  dt_atomic_set_int(&running, 0);
+  for(int k = 0; k < WRITERS; k++) pthread_join(writers[k], NULL);
+  free(readers);
+  return end - start;
+}
+
+int main(int argc, char *arg[])
+{
+  dt_image_snapshot_table_init(&table);
+  dt_atomic_set_int(&torn, 0);
+  for(int id = 1; id <= NUM_IMAGES; id++)
+  {
+    pthread_rwlock_init(&entries[id].lock, NULL);
+    fill(&entries[id].img, id, 0);
+    dt_image_snapshot_publish(&table, &entries[id].img);
+  }
+
+  dt_image_snapshot_t img;
+  assert(dt_image_snapshot_read(&table, 1, &img) && img.id == 1);
+  assert(!dt_image_snapshot_read(&table, 1 + DT_IMAGE_SNAPSHOT_SLOTS, &img));
+  dt_image_snapshot_invalidate(&table, 1);
+  assert(!dt_image_snapshot_read(&table, 1, &img));
+  dt_image_snapshot_publish(&table, &entries[1].img);
+  fprintf(stderr, "[passed] publish, read and invalidate\n");
+
+  const int threads[] = { 1, 8, 64 };
+  for(int k = 0; k < 3; k++)
+  {
+    const double locked = run(threads[k], 0);
+    const double lockfree = run(threads[k], 1);
+    fprintf(stderr, "%2d readers: %.3f s with locks, %.3f s with snapshots (%.1fx)\n", threads[k], locked,
+            lockfree, locked / lockfree);
+  }
+
+  assert(dt_atomic_get_int(&torn) == 0);
+  fprintf(stderr, "[passed] no torn reads with %d concurrent writers\n", WRITERS);
+
+  dt_image_snapshot_table_cleanup(&table);
+  exit(0);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
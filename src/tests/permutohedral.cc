@@ -0,0 +1,131 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// benchmark for the permutohedral lattice as used by the surface blur: an image is splatted,
+// merged, blurred and sliced with 1 to 64 threads, reporting the time of each step and the
+// largest difference to the single threaded result. the merge is timed both sequential and
+// partitioned, to tune the thread count at which merge_splat_threads() switches between them.
+//
+// usage: ./permutohedral [width height]
+
+#include <math.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "iop/Permutohedral.h"
+
+static void _fill(float *buf, const int width, const int height)
+{
+  for(int j = 0; j < height; j++)
+    for(int i = 0; i < width; i++)
+    {
+      float *p = buf + 4 * ((size_t)j * width + i);
+      p[0] = 0.5f + 0.3f * sinf(0.01f * j) + 0.1f * sinf(0.3f * i);
+      p[1] = 0.5f + 0.2f * cosf(0.013f * i) + 0.1f * sinf(0.2f * (i + j));
+      p[2] = 0.5f + 0.0001f * (i - j) + 0.1f * cosf(0.4f * j);
+      p[3] = 1.0f;
+    }
+}
+
+// same steps and parameters as the process() of iop/bilateral.cc
+static void _surface_blur(const float *const in, float *const out, const int width, const int height,
+                          const int nthreads, const bool partitioned, double times[4])
+{
+  const float sigma[5] = { 1.0f / 20.0f, 1.0f / 20.0f, 1.0f / 0.1f, 1.0f / 0.1f, 1.0f / 0.1f };
+  PermutohedralLattice<5, 4> lattice((size_t)width * height, nthreads);
+
+  double start = omp_get_wtime();
+#pragma omp parallel for schedule(static) num_threads(nthreads)
+  for(int j = 0; j < height; j++)
+  {
+    const float *p = in + (size_t)j * width * 4;
+    const int thread = omp_get_thread_num();
+    size_t index = (size_t)j * width;
+    for(int i = 0; i < width; i++, index++)
+    {
+      float pos[5] = { i * sigma[0], j * sigma[1], p[0] * sigma[2], p[1] * sigma[3], p[2] * sigma[4] };
+      float val[4] = { p[0], p[1], p[2], 1.0 };
+      lattice.splat(pos, val, index, thread);
+      p += 4;
+    }
+  }
+  times[0] = omp_get_wtime() - start;
+
+  start = omp_get_wtime();
+  if(partitioned)
+    lattice.merge_splat_threads_partitioned();
+  else
+    lattice.merge_splat_threads_sequential();
+  times[1] = omp_get_wtime() - start;
+
+  start = omp_get_wtime();
+  lattice.blur();
+  times[2] = omp_get_wtime() - start;
+
+  start = omp_get_wtime();
+#pragma omp parallel for schedule(static) num_threads(nthreads)
+  for(int j = 0; j < height; j++)
+  {
+    size_t index = (size_t)j * width;
+    for(int i = 0; i < width; i++, index++)
+    {
+      float val[4];
+      lattice.slice(val, index);
+      for(int k = 0; k < 3; k++) out[4 * index + k] = val[k] / val[3];
+    }
+  }
+  times[3] = omp_get_wtime() - start;
+}
+
+int main(int argc, char *arg[])
+{
+  const int width = argc > 2 ? atoi(arg[1]) : 2000;
+  const int height = argc > 2 ? atoi(arg[2]) : 1500;
+  const size_t size = (size_t)width * height;
+  float *in = new float[4 * size];
+  float *ref = new float[4 * size]();
+  float *out = new float[4 * size]();
+  _fill(in, width, height);
+
+  omp_set_dynamic(0);
+  fprintf(stderr, "%dx%d image, %d cores\n", width, height, omp_get_num_procs());
+  fprintf(stderr, "threads merge       |    splat    merge     blur    slice |    total | max difference\n");
+  for(int nthreads = 1; nthreads <= 64; nthreads *= 2)
+    for(int partitioned = 0; partitioned < 2; partitioned++)
+    {
+      double times[4];
+      const bool is_ref = nthreads == 1 && !partitioned;
+      _surface_blur(in, is_ref ? ref : out, width, height, nthreads, partitioned, times);
+      float maxdiff = 0.0f;
+      if(!is_ref)
+        for(size_t k = 0; k < 4 * size; k++) maxdiff = fmaxf(maxdiff, fabsf(out[k] - ref[k]));
+      fprintf(stderr, "%7d %-11s | %7.3fs %7.3fs %7.3fs %7.3fs | %7.3fs | %g\n", nthreads,
+              partitioned ? "partitioned" : "sequential", times[0], times[1], times[2], times[3],
+              times[0] + times[1] + times[2] + times[3], maxdiff);
+    }
+
+  delete[] in;
+  delete[] ref;
+  delete[] out;
+  exit(0);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,386 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the run plan of develop/pixelpipe_hb.c: which
+ * modules are fused into others, and the one pass processing of runs of
+ * point-wise modules.
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <cmocka.h>
+
+#include "../util/assert.h"
+#include "../util/tracing.h"
+
+#include "develop/pixelpipe.c"
+
+/*
+ * DEFINITIONS
+ */
+
+#define MAX_NODES 8
+
+typedef struct test_pipe_t
+{
+  dt_dev_pixelpipe_t pipe;
+  dt_develop_t dev;
+  dt_iop_module_t modules[MAX_NODES];
+  dt_dev_pixelpipe_iop_t pieces[MAX_NODES];
+  float params[MAX_NODES][2];
+  dt_develop_blend_params_t blend[MAX_NODES];
+  int count;
+} test_pipe_t;
+
+/*
+ * FAKE MODULES
+ */
+
+static int flags_pointwise(void)
+{
+  return IOP_FLAGS_POINTWISE | IOP_FLAGS_SUPPORTS_BLENDING;
+}
+
+static int flags_none(void)
+{
+  return IOP_FLAGS_SUPPORTS_BLENDING;
+}
+
+static int colorspace_raw(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
+{
+  return iop_cs_RAW;
+}
+
+static int colorspace_rgb(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
+{
+  return iop_cs_rgb;
+}
+
+static void output_format_same(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece,
+                               dt_iop_buffer_dsc_t *dsc)
+{
+}
+
+static int fuse_rawfront_scale(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, dt_iop_buffer_dsc_t *dsc,
+                               dt_dev_pixelpipe_rawfront_t *front)
+{
+  if(front)
+  {
+    const float *const p = (const float *)piece->data;
+    for(int c = 0; c < 4; c++) front->coeffs[c] *= p[0];
+  }
+  return 1;
+}
+
+static int accept_rawfront_always(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece)
+{
+  return 1;
+}
+
+// out = (in * a + b)^2 on the color channels, a different function for
+// each choice of parameters
+static void process_pointwise(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const i,
+                              void *const o, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  const float *const p = (const float *)piece->data;
+  const float *const in = (const float *)i;
+  float *const out = (float *)o;
+  for(size_t k = 0; k < (size_t)4 * roi_out->width * roi_out->height; k++)
+  {
+    const float v = in[k] * p[0] + p[1];
+    out[k] = (k % 4 == 3) ? in[k] : v * v;
+  }
+}
+
+/*
+ * HELPERS
+ */
+
+// a pipe of count enabled nodes, all point-wise rgb modules. tests change
+// the ones they need to be different.
+static test_pipe_t *pipe_new(const int count, const dt_dev_pixelpipe_type_t type)
+{
+  test_pipe_t *t = calloc(1, sizeof(test_pipe_t));
+  t->count = count;
+  t->pipe.type = type;
+  t->pipe.devid = -1;
+  for(int k = 0; k < count; k++)
+  {
+    dt_iop_module_t *module = &t->modules[k];
+    dt_dev_pixelpipe_iop_t *piece = &t->pieces[k];
+    snprintf(module->op, sizeof(module->op), "node%d", k);
+    module->flags = flags_pointwise;
+    module->default_colorspace = colorspace_rgb;
+    module->input_colorspace = colorspace_rgb;
+    module->output_colorspace = colorspace_rgb;
+    module->output_format = output_format_same;
+    module->process = process_pointwise;
+    module->request_color_pick = DT_REQUEST_COLORPICK_OFF;
+    t->params[k][0] = 0.5f + 0.25f * k;
+    t->params[k][1] = 0.01f * k;
+    t->blend[k].mask_mode = DEVELOP_MASK_DISABLED;
+    piece->module = module;
+    piece->pipe = &t->pipe;
+    piece->data = t->params[k];
+    piece->blendop_data = &t->blend[k];
+    piece->enabled = 1;
+    piece->process_pointwise_ready = 1;
+    t->pipe.iop = g_list_append(t->pipe.iop, module);
+    t->pipe.nodes = g_list_append(t->pipe.nodes, piece);
+  }
+  return t;
+}
+
+static void pipe_free(test_pipe_t *t)
+{
+  _plan_free(&t->pipe.plan);
+  g_list_free(t->pipe.iop);
+  g_list_free(t->pipe.nodes);
+  free(t);
+}
+
+// the raw part of a pipe: count - 1 point-wise raw modules which can be
+// fused, and a demosaic accepting them
+static test_pipe_t *rawpipe_new(const int count, const dt_dev_pixelpipe_type_t type)
+{
+  test_pipe_t *t = pipe_new(count, type);
+  for(int k = 0; k < count; k++)
+  {
+    t->modules[k].default_colorspace = colorspace_raw;
+    t->modules[k].input_colorspace = colorspace_raw;
+    t->modules[k].output_colorspace = colorspace_raw;
+    t->modules[k].fuse_rawfront = fuse_rawfront_scale;
+  }
+  t->modules[count - 1].flags = flags_none;
+  t->modules[count - 1].fuse_rawfront = NULL;
+  t->modules[count - 1].accept_rawfront = accept_rawfront_always;
+  return t;
+}
+
+// plans a run with all nodes active, as _plan_prepare() does without
+// the hashes
+static void plan(test_pipe_t *t)
+{
+  dt_dev_pixelpipe_plan_t *plan = &t->pipe.plan;
+  if(!plan->prev) assert_true(_plan_build(&t->pipe));
+  plan->prev[0] = 0;
+  for(int k = 1; k <= plan->count; k++) plan->prev[k] = plan->pieces[k - 1]->enabled ? k : plan->prev[k - 1];
+  _plan_fuse_rawfront(&t->pipe, &t->dev);
+  _plan_fuse_pointwise(&t->pipe, &t->dev);
+}
+
+static void check_fused(const test_pipe_t *t, const int *expected)
+{
+  for(int k = 1; k <= t->count; k++) assert_int_equal(t->pipe.plan.fused[k], expected[k - 1]);
+}
+
+static void check_pointwise(const test_pipe_t *t, const int *expected)
+{
+  for(int k = 1; k <= t->count; k++) assert_int_equal(t->pipe.plan.pointwise[k], expected[k - 1]);
+}
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_rawfront_plan(void **state)
+{
+  const int all[] = { 1, 1, 0 };
+  const int none[] = { 0, 0, 0 };
+  const int second[] = { 0, 1, 0 };
+
+  TR_STEP("two raw modules are left to demosaic");
+  test_pipe_t *t = rawpipe_new(3, DT_DEV_PIXELPIPE_EXPORT);
+  plan(t);
+  check_fused(t, all);
+  assert_int_equal(t->pipe.plan.prev[2], 0);
+
+  TR_STEP("not on the gpu");
+  t->pipe.devid = 0;
+  plan(t);
+  check_fused(t, none);
+  t->pipe.devid = -1;
+
+  TR_STEP("not a module with a mask");
+  t->blend[0].mask_mode = DEVELOP_MASK_ENABLED;
+  plan(t);
+  check_fused(t, second);
+  t->blend[0].mask_mode = DEVELOP_MASK_DISABLED;
+
+  TR_STEP("not a module with a color picker");
+  t->modules[1].request_color_pick = DT_REQUEST_COLORPICK_MODULE;
+  plan(t);
+  check_fused(t, none);
+  t->modules[1].request_color_pick = DT_REQUEST_COLORPICK_OFF;
+  pipe_free(t);
+
+  TR_STEP("disabled modules in between are left out, and do not point back to a fused one");
+  t = rawpipe_new(4, DT_DEV_PIXELPIPE_EXPORT);
+  t->pieces[1].enabled = 0;
+  plan(t);
+  const int around[] = { 1, 0, 1, 0 };
+  check_fused(t, around);
+  for(int k = 0; k < 4; k++) assert_int_equal(t->pipe.plan.prev[k], 0);
+  assert_int_equal(t->pipe.plan.prev[4], 4);
+  pipe_free(t);
+
+  TR_STEP("in the darkroom, nothing after the focused module, which may display a mask");
+  t = rawpipe_new(3, DT_DEV_PIXELPIPE_FULL);
+  t->dev.pipe = &t->pipe;
+  t->dev.gui_attached = 1;
+  t->dev.gui_module = &t->modules[0];
+  plan(t);
+  check_fused(t, none);
+  t->dev.gui_module = &t->modules[1];
+  plan(t);
+  check_fused(t, none);
+
+  TR_STEP("but all before the focused module");
+  t->dev.gui_module = &t->modules[2];
+  plan(t);
+  check_fused(t, all);
+
+  TR_STEP("and in all other pipes");
+  t->dev.gui_module = &t->modules[0];
+  t->dev.pipe = NULL;
+  plan(t);
+  check_fused(t, all);
+  pipe_free(t);
+}
+
+static void test_pointwise_plan(void **state)
+{
+  TR_STEP("runs of point-wise modules are left to their last module");
+  test_pipe_t *t = pipe_new(6, DT_DEV_PIXELPIPE_EXPORT);
+  t->modules[3].flags = flags_none;
+  plan(t);
+  const int runs[] = { 1, 1, 0, 0, 1, 0 };
+  check_pointwise(t, runs);
+  assert_int_equal(t->pieces[2].pointwise_first, 1);
+  assert_int_equal(t->pieces[5].pointwise_first, 5);
+  assert_int_equal(t->pipe.plan.prev[2], 0);
+  assert_int_equal(t->pipe.plan.prev[3], 3);
+  assert_int_equal(t->pipe.plan.prev[5], 4);
+
+  TR_STEP("disabled modules do not break a run");
+  t->pieces[1].enabled = 0;
+  plan(t);
+  const int skipped[] = { 1, 0, 0, 0, 1, 0 };
+  check_pointwise(t, skipped);
+  assert_int_equal(t->pieces[2].pointwise_first, 1);
+  assert_int_equal(t->pipe.plan.prev[2], 0);
+  t->pieces[1].enabled = 1;
+
+  TR_STEP("the focused module, or one with a mask, ends a run");
+  t->dev.gui_module = &t->modules[1];
+  plan(t);
+  const int focused[] = { 0, 0, 0, 0, 1, 0 };
+  check_pointwise(t, focused);
+  t->dev.gui_module = NULL;
+  t->blend[4].mask_mode = DEVELOP_MASK_ENABLED;
+  plan(t);
+  const int masked[] = { 1, 1, 0, 0, 0, 0 };
+  check_pointwise(t, masked);
+  t->blend[4].mask_mode = DEVELOP_MASK_DISABLED;
+
+  TR_STEP("a module which asked to stay on its own");
+  t->pieces[0].process_pointwise_ready = 0;
+  plan(t);
+  const int alone[] = { 0, 1, 0, 0, 1, 0 };
+  check_pointwise(t, alone);
+  t->pieces[0].process_pointwise_ready = 1;
+
+  TR_STEP("not in the darkroom's main pipe, nor on the gpu");
+  t->pipe.type = DT_DEV_PIXELPIPE_FULL;
+  plan(t);
+  const int none[] = { 0, 0, 0, 0, 0, 0 };
+  check_pointwise(t, none);
+  t->pipe.type = DT_DEV_PIXELPIPE_EXPORT;
+  t->pipe.devid = 0;
+  plan(t);
+  check_pointwise(t, none);
+  pipe_free(t);
+}
+
+static void check_pointwise_process(const int count, const int width, const int height)
+{
+  TR_STEP("%d modules on %dx%d pixels", count, width, height);
+  test_pipe_t *t = pipe_new(count, DT_DEV_PIXELPIPE_EXPORT);
+  plan(t);
+  dt_dev_pixelpipe_iop_t *last = &t->pieces[count - 1];
+  assert_int_equal(last->pointwise_first, 1);
+
+  const dt_iop_roi_t roi = { .x = 0, .y = 0, .width = width, .height = height, .scale = 1.0f };
+  const size_t size = (size_t)4 * width * height;
+  float *const in = dt_alloc_align_float(size);
+  float *const tmp = dt_alloc_align_float(size);
+  float *const expected = dt_alloc_align_float(size);
+  float *const result = dt_alloc_align_float(size);
+  for(size_t k = 0; k < size; k++) in[k] = (float)(k % 997) / 997.0f;
+
+  // the modules one after the other on the whole buffer, as without the plan
+  memcpy(expected, in, size * sizeof(float));
+  for(int n = 0; n < count; n++)
+  {
+    process_pointwise(&t->modules[n], &t->pieces[n], expected, tmp, &roi, &roi);
+    memcpy(expected, tmp, size * sizeof(float));
+  }
+
+  dt_iop_buffer_dsc_t format = { .channels = 4, .datatype = TYPE_FLOAT, .cst = iop_cs_rgb };
+  dt_pixelpipe_flow_t flow = PIXELPIPE_FLOW_NONE;
+  void *output = result;
+  assert_int_equal(_pixelpipe_process_pointwise_on_CPU(&t->pipe, in, &format, &roi, &output, &roi, last, &flow),
+                   0);
+  assert_true(flow & PIXELPIPE_FLOW_PROCESSED_ON_CPU);
+
+  // same operations in the same order, so the results are identical
+  for(size_t k = 0; k < size; k++) assert_float_equal(result[k], expected[k], 0.0f);
+
+  dt_free_align(in);
+  dt_free_align(tmp);
+  dt_free_align(expected);
+  dt_free_align(result);
+  pipe_free(t);
+}
+
+static void test_pointwise_process(void **state)
+{
+  // a single strip, and several strips with a partial one at the end
+  check_pointwise_process(2, 64, 16);
+  check_pointwise_process(3, 300, 501);
+  check_pointwise_process(5, 1001, 333);
+}
+
+/*
+ * MAIN FUNCTION
+ */
+int main()
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_rawfront_plan),
+    cmocka_unit_test(test_pointwise_plan),
+    cmocka_unit_test(test_pointwise_process)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
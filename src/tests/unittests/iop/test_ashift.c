@@ -0,0 +1,97 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the module iop/ashift.c
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <cmocka.h>
+
+#include "../util/assert.h"
+#include "../util/tracing.h"
+#include "../util/testdistort.h"
+
+#include "iop/ashift.c"
+
+/*
+ * DEFINITIONS
+ */
+
+// the matrix folds the clipping offset into the homography, which rounds
+// differently on a 6000 pixel wide image:
+#define E 1e-2f
+
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_distort_matrix(void **state)
+{
+  const dt_iop_ashift_data_t cases[] = {
+    // neutral
+    { .f_length_kb = DEFAULT_F_LENGTH, .aspect = 1.0f, .cr = 1.0f, .cb = 1.0f },
+    // rotation only
+    { .rotation = 2.5f, .f_length_kb = DEFAULT_F_LENGTH, .aspect = 1.0f,
+      .cr = 1.0f, .cb = 1.0f },
+    // keystone correction with clipping
+    { .rotation = -1.2f, .lensshift_v = 0.4f, .lensshift_h = -0.1f,
+      .shear = 0.05f, .f_length_kb = DEFAULT_F_LENGTH, .aspect = 1.0f,
+      .cl = 0.05f, .cr = 0.97f, .ct = 0.08f, .cb = 0.9f },
+    // specific mode with focal length, orthogonal correction and aspect
+    { .rotation = 0.7f, .lensshift_v = -0.3f, .lensshift_h = 0.2f,
+      .f_length_kb = 50.0f, .orthocorr = 60.0f, .aspect = 1.2f,
+      .cl = 0.02f, .cr = 0.99f, .ct = 0.03f, .cb = 0.95f }
+  };
+
+  dt_iop_ashift_data_t d;
+  dt_dev_pixelpipe_iop_t piece = { 0 };
+  piece.data = &d;
+  piece.buf_in.width = 6000;
+  piece.buf_in.height = 4000;
+
+  for(size_t k = 0; k < sizeof(cases) / sizeof(cases[0]); k++)
+  {
+    TR_STEP("verify that the matrix matches the transformation of the points "
+      "for case %zu", k);
+    d = cases[k];
+    piece.buf_out.width = piece.buf_in.width * (d.cr - d.cl);
+    piece.buf_out.height = piece.buf_in.height * (d.cb - d.ct);
+    testdistort_assert_matrix(NULL, &piece, distort_matrix, distort_transform,
+                              distort_backtransform, E);
+  }
+}
+
+
+/*
+ * MAIN FUNCTION
+ */
+int main()
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_distort_matrix)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
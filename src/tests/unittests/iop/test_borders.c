@@ -0,0 +1,86 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the module iop/borders.c
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <cmocka.h>
+
+#include "../util/assert.h"
+#include "../util/tracing.h"
+#include "../util/testdistort.h"
+
+#include "iop/borders.c"
+
+/*
+ * DEFINITIONS
+ */
+
+// borders only move points, so both should agree up to the float resolution
+// of the coordinates:
+#define E 1e-3f
+
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_distort_matrix(void **state)
+{
+  // horizontal and vertical position of the picture in the frame:
+  const float positions[][2] = { { 0.0f, 0.0f }, { 0.5f, 0.5f }, { 1.0f, 1.0f },
+                                 { 0.3f, 0.8f } };
+
+  dt_iop_borders_data_t d = { 0 };
+  dt_dev_pixelpipe_iop_t piece = { 0 };
+  piece.data = &d;
+  piece.buf_in.width = 600;
+  piece.buf_in.height = 400;
+  piece.buf_out.width = 700;
+  piece.buf_out.height = 530;
+
+  for(size_t k = 0; k < sizeof(positions) / sizeof(positions[0]); k++)
+  {
+    TR_STEP("verify that the matrix matches the transformation of the points "
+      "for the position {%f, %f}", positions[k][0], positions[k][1]);
+    d.pos_h = positions[k][0];
+    d.pos_v = positions[k][1];
+    testdistort_assert_matrix(NULL, &piece, distort_matrix, distort_transform,
+                              distort_backtransform, E);
+  }
+}
+
+
+/*
+ * MAIN FUNCTION
+ */
+int main()
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_distort_matrix)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,91 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the module iop/crop.c
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <cmocka.h>
+
+#include "../util/assert.h"
+#include "../util/tracing.h"
+#include "../util/testdistort.h"
+
+#include "iop/crop.c"
+
+/*
+ * DEFINITIONS
+ */
+
+// cropping only moves points, so both should agree up to the float resolution
+// of the coordinates:
+#define E 1e-3f
+
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_distort_matrix(void **state)
+{
+  // left, top, right and bottom edge of the crop window:
+  const float windows[][4] = { { 0.0f, 0.0f, 1.0f, 1.0f },
+                               { 0.1f, 0.0f, 0.9f, 1.0f },
+                               { 0.0f, 0.25f, 1.0f, 0.75f },
+                               { 0.13f, 0.07f, 0.61f, 0.98f } };
+
+  dt_iop_crop_data_t d = { 0 };
+  dt_dev_pixelpipe_iop_t piece = { 0 };
+  piece.data = &d;
+  piece.buf_in.width = 600;
+  piece.buf_in.height = 400;
+
+  for(size_t k = 0; k < sizeof(windows) / sizeof(windows[0]); k++)
+  {
+    TR_STEP("verify that the matrix matches the transformation of the points "
+      "for the crop window {%f, %f, %f, %f}",
+      windows[k][0], windows[k][1], windows[k][2], windows[k][3]);
+    d.cx = windows[k][0];
+    d.cy = windows[k][1];
+    d.cw = windows[k][2];
+    d.ch = windows[k][3];
+    piece.buf_out.width = piece.buf_in.width * (d.cw - d.cx);
+    piece.buf_out.height = piece.buf_in.height * (d.ch - d.cy);
+    testdistort_assert_matrix(NULL, &piece, distort_matrix, distort_transform,
+                              distort_backtransform, E);
+  }
+}
+
+
+/*
+ * MAIN FUNCTION
+ */
+int main()
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_distort_matrix)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,658 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the module iop/demosaic.c
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <cmocka.h>
+
+#include "../util/assert.h"
+#include "../util/tracing.h"
+
+#include "iop/demosaic.c"
+
+/*
+ * DEFINITIONS
+ */
+
+// the streaming Markesteijn keeps the order of all float operations, so
+// the results should match up to rounding
+#define E 1e-6f
+
+// standard Bayer CFA
+#define TEST_FILTERS 0x94949494u
+
+// standard X-Trans CFA as found in the Fuji X-T and X-E series
+static const uint8_t test_xtrans[6][6] = { { 1, 1, 0, 1, 1, 2 }, { 1, 1, 2, 1, 1, 0 }, { 2, 0, 1, 0, 2, 1 },
+                                           { 1, 1, 2, 1, 1, 0 }, { 1, 1, 0, 1, 1, 2 }, { 0, 2, 1, 2, 0, 1 } };
+
+/*
+ * REFERENCE IMPLEMENTATION
+ */
+
+// the Markesteijn interpolation as it was before the final stages were
+// fused into a single sweep over the rows of each tile, with full tile
+// buffers for yuv, drv, homo and homosum.
+#define TS 122
+
+static void markesteijn_reference(float *out, const float *const in,
+                                 const dt_iop_roi_t *const roi_out,
+                                 const dt_iop_roi_t *const roi_in,
+                                 const uint8_t (*const xtrans)[6], const int passes)
+{
+  static const short orth[12] = { 1, 0, 0, 1, -1, 0, 0, -1, 1, 0, 0, 1 },
+                     patt[2][16] = { { 0, 1, 0, -1, 2, 0, -1, 0, 1, 1, 1, -1, 0, 0, 0, 0 },
+                                     { 0, 1, 0, -2, 1, 0, -2, 0, 1, 1, -2, -2, 1, -1, -1, 1 } },
+                     dir[4] = { 1, TS, TS + 1, TS - 1 };
+
+  short allhex[3][3][8];
+  // sgrow/sgcol is the offset in the sensor matrix of the solitary
+  // green pixels (initialized here only to avoid compiler warning)
+  unsigned short sgrow = 0, sgcol = 0;
+
+  const int width = roi_out->width;
+  const int height = roi_out->height;
+  const int ndir = 4 << (passes > 1);
+
+  const size_t buffer_size = (size_t)TS * TS * (ndir * 4 + 3) * sizeof(float);
+  size_t padded_buffer_size;
+  char *const all_buffers = (char *)dt_alloc_perthread(buffer_size, sizeof(char), &padded_buffer_size);
+  if(!all_buffers)
+  {
+    printf("[demosaic] not able to allocate Markesteijn buffers\n");
+    return;
+  }
+
+  /* Map a green hexagon around each non-green pixel and vice versa:    */
+  for(int row = 0; row < 3; row++)
+    for(int col = 0; col < 3; col++)
+      for(int ng = 0, d = 0; d < 10; d += 2)
+      {
+        const int g = FCxtrans(row, col, NULL, xtrans) == 1;
+        if(FCxtrans(row + orth[d], col + orth[d + 2], NULL, xtrans) == 1)
+          ng = 0;
+        else
+          ng++;
+        // if there are four non-green pixels adjacent in cardinal
+        // directions, this is the solitary green pixel
+        if(ng == 4)
+        {
+          sgrow = row;
+          sgcol = col;
+        }
+        if(ng == g + 1)
+          for(int c = 0; c < 8; c++)
+          {
+            const int v = orth[d] * patt[g][c * 2] + orth[d + 1] * patt[g][c * 2 + 1];
+            const int h = orth[d + 2] * patt[g][c * 2] + orth[d + 3] * patt[g][c * 2 + 1];
+            // offset within TSxTS buffer
+            allhex[row][col][c ^ (g * 2 & d)] = h + v * TS;
+          }
+      }
+
+  // extra passes propagates out errors at edges, hence need more padding
+  const int pad_tile = (passes == 1) ? 12 : 17;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(all_buffers, padded_buffer_size, dir, height, in, ndir, pad_tile, passes, roi_in, width, xtrans) \
+  shared(sgrow, sgcol, allhex, out) \
+  schedule(static)
+#endif
+  // step through TSxTS cells of image, each tile overlapping the
+  // prior as interpolation needs a substantial border
+  for(int top = -pad_tile; top < height - pad_tile; top += TS - (pad_tile*2))
+  {
+    char *const buffer = dt_get_perthread(all_buffers, padded_buffer_size);
+    // rgb points to ndir TSxTS tiles of 3 channels (R, G, and B)
+    float(*rgb)[TS][TS][3] = (float(*)[TS][TS][3])buffer;
+    // yuv points to 3 channel (Y, u, and v) TSxTS tiles
+    // note that channels come before tiles to allow for a
+    // vectorization optimization when building drv[] from yuv[]
+    float (*const yuv)[TS][TS] = (float(*)[TS][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float));
+    // drv points to ndir TSxTS tiles, each a single channel of derivatives
+    float (*const drv)[TS][TS] = (float(*)[TS][TS])(buffer + TS * TS * (ndir * 3 + 3) * sizeof(float));
+    // gmin and gmax reuse memory which is used later by yuv buffer;
+    // each points to a TSxTS tile of single channel data
+    float (*const gmin)[TS] = (float(*)[TS])(buffer + TS * TS * (ndir * 3) * sizeof(float));
+    float (*const gmax)[TS] = (float(*)[TS])(buffer + TS * TS * (ndir * 3 + 1) * sizeof(float));
+    // homo and homosum reuse memory which is used earlier in the
+    // loop; each points to ndir single-channel TSxTS tiles
+    uint8_t (*const homo)[TS][TS] = (uint8_t(*)[TS][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float));
+    uint8_t (*const homosum)[TS][TS] = (uint8_t(*)[TS][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float)
+                                                  + TS * TS * ndir * sizeof(uint8_t));
+
+    for(int left = -pad_tile; left < width - pad_tile; left += TS - (pad_tile*2))
+    {
+      int mrow = MIN(top + TS, height + pad_tile);
+      int mcol = MIN(left + TS, width + pad_tile);
+
+      // Copy current tile from in to image buffer. If border goes
+      // beyond edges of image, fill with mirrored/interpolated edges.
+      // The extra border avoids discontinuities at image edges.
+      for(int row = top; row < mrow; row++)
+        for(int col = left; col < mcol; col++)
+        {
+          float(*const pix) = rgb[0][row - top][col - left];
+          if((col >= 0) && (row >= 0) && (col < width) && (row < height))
+          {
+            const int f = FCxtrans(row, col, roi_in, xtrans);
+            for(int c = 0; c < 3; c++) pix[c] = (c == f) ? in[roi_in->width * row + col] : 0.f;
+          }
+          else
+          {
+            // mirror a border pixel if beyond image edge
+            const int c = FCxtrans(row, col, roi_in, xtrans);
+            for(int cc = 0; cc < 3; cc++)
+            {
+              if(cc != c)
+                pix[cc] = 0.0f;
+              else
+              {
+#define TRANSLATE(n, size) ((n >= size) ? (2 * size - n - 2) : abs(n))
+                const int cy = TRANSLATE(row, height), cx = TRANSLATE(col, width);
+                if(c == FCxtrans(cy, cx, roi_in, xtrans))
+                  pix[c] = in[roi_in->width * cy + cx];
+                else
+                {
+                  // interpolate if mirror pixel is a different color
+                  float sum = 0.0f;
+                  uint8_t count = 0;
+                  for(int y = row - 1; y <= row + 1; y++)
+                    for(int x = col - 1; x <= col + 1; x++)
+                    {
+                      const int yy = TRANSLATE(y, height), xx = TRANSLATE(x, width);
+                      const int ff = FCxtrans(yy, xx, roi_in, xtrans);
+                      if(ff == c)
+                      {
+                        sum += in[roi_in->width * yy + xx];
+                        count++;
+                      }
+                    }
+                  pix[c] = sum / count;
+                }
+              }
+            }
+          }
+        }
+
+      // duplicate rgb[0] to rgb[1], rgb[2], and rgb[3]
+      for(int c = 1; c <= 3; c++) memcpy(rgb[c], rgb[0], sizeof(*rgb));
+
+      // note that successive calculations are inset within the tile
+      // so as to give enough border data, and there needs to be a 6
+      // pixel border initially to allow allhex to find neighboring
+      // pixels
+
+      /* Set green1 and green3 to the minimum and maximum allowed values:   */
+      // Run through each red/blue or blue/red pair, setting their g1
+      // and g3 values to the min/max of green pixels surrounding the
+      // pair. Use a 3 pixel border as gmin/gmax is used by
+      // interpolate green which has a 3 pixel border.
+      const int pad_g1_g3 = 3;
+      for(int row = top + pad_g1_g3; row < mrow - pad_g1_g3; row++)
+      {
+        // setting max to 0.0f signifies that this is a new pair, which
+        // requires a new min/max calculation of its neighboring greens
+        float min = FLT_MAX, max = 0.0f;
+        for(int col = left + pad_g1_g3; col < mcol - pad_g1_g3; col++)
+        {
+          // if in row of horizontal red & blue pairs (or processing
+          // vertical red & blue pairs near image bottom), reset min/max
+          // between each pair
+          if(FCxtrans(row, col, roi_in, xtrans) == 1)
+          {
+            min = FLT_MAX, max = 0.0f;
+            continue;
+          }
+          // if at start of red & blue pair, calculate min/max of green
+          // pixels surrounding it; note that while normally using == to
+          // compare floats is suspect, here the check is if 0.0f has
+          // explicitly been assigned to max (which signifies a new
+          // red/blue pair)
+          if(max == 0.0f)
+          {
+            float (*const pix)[3] = &rgb[0][row - top][col - left];
+            const short *const hex = hexmap(row,col,allhex);
+            for(int c = 0; c < 6; c++)
+            {
+              const float val = pix[hex[c]][1];
+              if(min > val) min = val;
+              if(max < val) max = val;
+            }
+          }
+          gmin[row - top][col - left] = min;
+          gmax[row - top][col - left] = max;
+          // handle vertical red/blue pairs
+          switch((row - sgrow) % 3)
+          {
+            // hop down a row to second pixel in vertical pair
+            case 1:
+              if(row < mrow - 4) row++, col--;
+              break;
+            // then if not done with the row hop up and right to next
+            // vertical red/blue pair, resetting min/max
+            case 2:
+              min = FLT_MAX, max = 0.0f;
+              if((col += 2) < mcol - 4 && row > top + 3) row--;
+          }
+        }
+      }
+
+      /* Interpolate green horizontally, vertically, and along both diagonals: */
+      // need a 3 pixel border here as 3*hex[] can have a 3 unit offset
+      const int pad_g_interp = 3;
+      for(int row = top + pad_g_interp; row < mrow - pad_g_interp; row++)
+        for(int col = left + pad_g_interp; col < mcol - pad_g_interp; col++)
+        {
+          float color[8];
+          const int f = FCxtrans(row, col, roi_in, xtrans);
+          if(f == 1) continue;
+          float (*const pix)[3] = &rgb[0][row - top][col - left];
+          const short *const hex = hexmap(row,col,allhex);
+          // TODO: these constants come from integer math constants in
+          // dcraw -- calculate them instead from interpolation math
+          color[0] = 0.6796875f * (pix[hex[1]][1] + pix[hex[0]][1])
+                     - 0.1796875f * (pix[2 * hex[1]][1] + pix[2 * hex[0]][1]);
+          color[1] = 0.87109375f * pix[hex[3]][1] + pix[hex[2]][1] * 0.13f
+                     + 0.359375f * (pix[0][f] - pix[-hex[2]][f]);
+          for(int c = 0; c < 2; c++)
+            color[2 + c] = 0.640625f * pix[hex[4 + c]][1] + 0.359375f * pix[-2 * hex[4 + c]][1]
+                           + 0.12890625f * (2 * pix[0][f] - pix[3 * hex[4 + c]][f] - pix[-3 * hex[4 + c]][f]);
+          for(int c = 0; c < 4; c++)
+            rgb[c ^ !((row - sgrow) % 3)][row - top][col - left][1]
+                = CLAMPS(color[c], gmin[row - top][col - left], gmax[row - top][col - left]);
+        }
+
+      for(int pass = 0; pass < passes; pass++)
+      {
+        if(pass == 1)
+        {
+          // if on second pass, copy rgb[0] to [3] into rgb[4] to [7],
+          // and process that second set of buffers
+          memcpy(rgb + 4, rgb, sizeof(*rgb) * 4);
+          rgb += 4;
+        }
+
+        /* Recalculate green from interpolated values of closer pixels: */
+        if(pass)
+        {
+          const int pad_g_recalc = 6;
+          for(int row = top + pad_g_recalc; row < mrow - pad_g_recalc; row++)
+            for(int col = left + pad_g_recalc; col < mcol - pad_g_recalc; col++)
+            {
+              const int f = FCxtrans(row, col, roi_in, xtrans);
+              if(f == 1) continue;
+              const short *const hex = hexmap(row,col,allhex);
+              for(int d = 3; d < 6; d++)
+              {
+                float(*rfx)[3] = &rgb[(d - 2) ^ !((row - sgrow) % 3)][row - top][col - left];
+                const float val = rfx[-2 * hex[d]][1]
+                            + 2 * rfx[hex[d]][1] - rfx[-2 * hex[d]][f]
+                            - 2 * rfx[hex[d]][f] + 3 * rfx[0][f];
+                rfx[0][1] = CLAMPS(val / 3.0f, gmin[row - top][col - left], gmax[row - top][col - left]);
+              }
+            }
+        }
+
+        /* Interpolate red and blue values for solitary green pixels:   */
+        const int pad_rb_g = (passes == 1) ? 6 : 5;
+        for(int row = (top - sgrow + pad_rb_g + 2) / 3 * 3 + sgrow; row < mrow - pad_rb_g; row += 3)
+          for(int col = (left - sgcol + pad_rb_g + 2) / 3 * 3 + sgcol; col < mcol - pad_rb_g; col += 3)
+          {
+            float(*rfx)[3] = &rgb[0][row - top][col - left];
+            int h = FCxtrans(row, col + 1, roi_in, xtrans);
+            float diff[6] = { 0.0f };
+            // interplated color: first index is red/blue, second is
+            // pass, is double actual result
+            float color[2][6];
+            // Six passes, alternating hori/vert interp (i),
+            // starting with R or B (h) depending on which is closest.
+            // Passes 0,1 to rgb[0], rgb[1] of hori/vert interp. Pass
+            // 3,5 to rgb[2], rgb[3] of best of interp hori/vert
+            // results. Each pass which outputs moves on to the next
+            // rgb[] for input of interp greens.
+            for(int i = 1, d = 0; d < 6; d++, i ^= TS ^ 1, h ^= 2)
+            {
+              // look 1 and 2 pixels distance from solitary green to
+              // red then blue or blue then red
+              for(int c = 0; c < 2; c++, h ^= 2)
+              {
+                // rate of change in greens between current pixel and
+                // interpolated pixels 1 or 2 distant: a quick
+                // derivative which will be divided by two later to be
+                // rate of luminance change for red/blue between known
+                // red/blue neighbors and the current unknown pixel
+                const float g = 2 * rfx[0][1] - rfx[i << c][1] - rfx[-(i << c)][1];
+                // color is halved before being stored in rgb, hence
+                // this becomes green rate of change plus the average
+                // of the near red or blue pixels on current axis
+                color[h != 0][d] = g + rfx[i << c][h] + rfx[-(i << c)][h];
+                // Note that diff will become the slope for both red
+                // and blue differentials in the current direction.
+                // For 2nd and 3rd hori+vert passes, create a sum of
+                // steepness for both cardinal directions.
+                if(d > 1)
+                  diff[d] += SQR(rfx[i << c][1] - rfx[-(i << c)][1] - rfx[i << c][h] + rfx[-(i << c)][h])
+                             + SQR(g);
+              }
+              if((d < 2) || (d & 1))
+              { // output for passes 0, 1, 3, 5
+                // for 0, 1 just use hori/vert, for 3, 5 use best of x/y dir
+                const int d_out = d - ((d > 1) && (diff[d-1] < diff[d]));
+                rfx[0][0] = color[0][d_out] / 2.f;
+                rfx[0][2] = color[1][d_out] / 2.f;
+                rfx += TS * TS;
+              }
+            }
+          }
+
+        /* Interpolate red for blue pixels and vice versa:              */
+        const int pad_rb_br = (passes == 1) ? 6 : 5;
+        for(int row = top + pad_rb_br; row < mrow - pad_rb_br; row++)
+          for(int col = left + pad_rb_br; col < mcol - pad_rb_br; col++)
+          {
+            const int f = 2 - FCxtrans(row, col, roi_in, xtrans);
+            if(f == 1) continue;
+            float(*rfx)[3] = &rgb[0][row - top][col - left];
+            const int c = (row - sgrow) % 3 ? TS : 1;
+            const int h = 3 * (c ^ TS ^ 1);
+            for(int d = 0; d < 4; d++, rfx += TS * TS)
+            {
+              const int i = d > 1 || ((d ^ c) & 1) ||
+                ((fabsf(rfx[0][1]-rfx[c][1]) + fabsf(rfx[0][1]-rfx[-c][1])) <
+                 2.f*(fabsf(rfx[0][1]-rfx[h][1]) + fabsf(rfx[0][1]-rfx[-h][1]))) ? c:h;
+              rfx[0][f] = (rfx[i][f] + rfx[-i][f] + 2.f * rfx[0][1] - rfx[i][1] - rfx[-i][1]) / 2.f;
+            }
+          }
+
+        /* Fill in red and blue for 2x2 blocks of green:                */
+        const int pad_g22 = (passes == 1) ? 8 : 4;
+        for(int row = top + pad_g22; row < mrow - pad_g22; row++)
+        {
+          if((row - sgrow) % 3)
+            for(int col = left + pad_g22; col < mcol - pad_g22; col++)
+              if((col - sgcol) % 3)
+              {
+                float(*rfx)[3] = &rgb[0][row - top][col - left];
+                const short *const hex = hexmap(row,col,allhex);
+                for(int d = 0; d < ndir; d += 2, rfx += TS * TS)
+                  if(hex[d] + hex[d + 1])
+                  {
+                    const float g = 3.f * rfx[0][1] - 2.f * rfx[hex[d]][1] - rfx[hex[d + 1]][1];
+                    for(int c = 0; c < 4; c += 2)
+                      rfx[0][c] = (g + 2.f * rfx[hex[d]][c] + rfx[hex[d + 1]][c]) / 3.f;
+                  }
+                  else
+                  {
+                    const float g = 2.f * rfx[0][1] - rfx[hex[d]][1] - rfx[hex[d + 1]][1];
+                    for(int c = 0; c < 4; c += 2)
+                      rfx[0][c] = (g + rfx[hex[d]][c] + rfx[hex[d + 1]][c]) / 2.f;
+                  }
+              }
+        }
+      } // end of multipass loop
+
+      // jump back to the first set of rgb buffers (this is a nop
+      // unless on the second pass)
+      rgb = (float(*)[TS][TS][3])buffer;
+      // from here on out, mainly are working within the current tile
+      // rather than in reference to the image, so don't offset
+      // mrow/mcol by top/left of tile
+      mrow -= top;
+      mcol -= left;
+
+      /* Convert to perceptual colorspace and differentiate in all directions:  */
+      // Original dcraw algorithm uses CIELab as perceptual space
+      // (presumably coming from original AHD) and converts taking
+      // camera matrix into account. Now use YPbPr which requires much
+      // less code and is nearly indistinguishable. It assumes the
+      // camera RGB is roughly linear.
+      for(int d = 0; d < ndir; d++)
+      {
+        const int pad_yuv = (passes == 1) ? 8 : 13;
+        for(int row = pad_yuv; row < mrow - pad_yuv; row++)
+          for(int col = pad_yuv; col < mcol - pad_yuv; col++)
+          {
+            const float *rx = rgb[d][row][col];
+            // use ITU-R BT.2020 YPbPr, which is great, but could use
+            // a better/simpler choice? note that imageop.h provides
+            // dt_iop_RGB_to_YCbCr which uses Rec. 601 conversion,
+            // which appears less good with specular highlights
+            const float y = 0.2627f * rx[0] + 0.6780f * rx[1] + 0.0593f * rx[2];
+            yuv[0][row][col] = y;
+            yuv[1][row][col] = (rx[2] - y) * 0.56433f;
+            yuv[2][row][col] = (rx[0] - y) * 0.67815f;
+          }
+        // Note that f can offset by a column (-1 or +1) and by a row
+        // (-TS or TS). The row-wise offsets cause the undefined
+        // behavior sanitizer to warn of an out of bounds index, but
+        // as yfx is multi-dimensional and there is sufficient
+        // padding, that is not actually so.
+        const int f = dir[d & 3];
+        const int pad_drv = (passes == 1) ? 9 : 14;
+        for(int row = pad_drv; row < mrow - pad_drv; row++)
+          for(int col = pad_drv; col < mcol - pad_drv; col++)
+          {
+            const float(*yfx)[TS][TS] = (float(*)[TS][TS]) & yuv[0][row][col];
+            drv[d][row][col] = SQR(2 * yfx[0][0][0] - yfx[0][0][f] - yfx[0][0][-f])
+                               + SQR(2 * yfx[1][0][0] - yfx[1][0][f] - yfx[1][0][-f])
+                               + SQR(2 * yfx[2][0][0] - yfx[2][0][f] - yfx[2][0][-f]);
+          }
+      }
+
+      /* Build homogeneity maps from the derivatives:                   */
+      memset(homo, 0, sizeof(uint8_t) * ndir * TS * TS);
+      const int pad_homo = (passes == 1) ? 10 : 15;
+      for(int row = pad_homo; row < mrow - pad_homo; row++)
+        for(int col = pad_homo; col < mcol - pad_homo; col++)
+        {
+          float tr = FLT_MAX;
+          for(int d = 0; d < ndir; d++)
+            if(tr > drv[d][row][col]) tr = drv[d][row][col];
+          tr *= 8;
+          for(int d = 0; d < ndir; d++)
+            for(int v = -1; v <= 1; v++)
+              for(int h = -1; h <= 1; h++)
+                homo[d][row][col] += ((drv[d][row + v][col + h] <= tr) ? 1 : 0);
+        }
+
+      /* Build 5x5 sum of homogeneity maps for each pixel & direction */
+      for(int d = 0; d < ndir; d++)
+        for(int row = pad_tile; row < mrow - pad_tile; row++)
+        {
+          // start before first column where homo[d][row][col+2] != 0,
+          // so can know v5sum and homosum[d][row][col] will be 0
+          int col = pad_tile-5;
+          uint8_t v5sum[5] = { 0 };
+          homosum[d][row][col] = 0;
+          // calculate by rolling through column sums
+          for(col++; col < mcol - pad_tile; col++)
+          {
+            uint8_t colsum = 0;
+            for(int v = -2; v <= 2; v++) colsum += homo[d][row + v][col + 2];
+            homosum[d][row][col] = homosum[d][row][col - 1] - v5sum[col % 5] + colsum;
+            v5sum[col % 5] = colsum;
+          }
+        }
+
+      /* Average the most homogeneous pixels for the final result:       */
+      for(int row = pad_tile; row < mrow - pad_tile; row++)
+        for(int col = pad_tile; col < mcol - pad_tile; col++)
+        {
+          uint8_t hm[8] = { 0 };
+          uint8_t maxval = 0;
+          for(int d = 0; d < ndir; d++)
+          {
+            hm[d] = homosum[d][row][col];
+            maxval = (maxval < hm[d] ? hm[d] : maxval);
+          }
+          maxval -= maxval >> 3;
+          for(int d = 0; d < ndir - 4; d++)
+          {
+            if(hm[d] < hm[d + 4])
+              hm[d] = 0;
+            else if(hm[d] > hm[d + 4])
+              hm[d + 4] = 0;
+          }
+          float avg[4] = { 0.0f };
+          for(int d = 0; d < ndir; d++)
+          {
+            if(hm[d] >= maxval)
+            {
+              for(int c = 0; c < 3; c++) avg[c] += rgb[d][row][col][c];
+              avg[3]++;
+            }
+          }
+          for(int c = 0; c < 3; c++)
+            out[4 * (width * (row + top) + col + left) + c] = avg[c]/avg[3];
+        }
+    }
+  }
+  dt_free_align(all_buffers);
+}
+#undef TS
+
+/*
+ * HELPERS
+ */
+
+// smooth gradients with hard edges in both directions and a bit of noise
+static float *mosaic_new(const int width, const int height)
+{
+  float *const in = dt_alloc_align_float((size_t)width * height);
+  unsigned int seed = 1;
+  for(int row = 0; row < height; row++)
+    for(int col = 0; col < width; col++)
+    {
+      seed = seed * 1103515245u + 12345u;
+      in[(size_t)row * width + col] = 0.3f + 0.2f * sinf(0.05f * row) * cosf(0.03f * col)
+                                      + (((row / 40 + col / 55) & 1) ? 0.3f : 0.0f)
+                                      + 0.02f * ((seed >> 16) & 1023) / 1023.0f;
+    }
+  return in;
+}
+
+static void check_markesteijn(const int width, const int height, const int x, const int y, const int passes)
+{
+  TR_STEP("%dx%d image at offset %d,%d, %d pass(es)", width, height, x, y, passes);
+  const dt_iop_roi_t roi = { .x = x, .y = y, .width = width, .height = height, .scale = 1.0f };
+  const size_t size = (size_t)4 * width * height;
+  float *const in = mosaic_new(width, height);
+  float *const expected = dt_alloc_align_float(size);
+  float *const result = dt_alloc_align_float(size);
+  memset(expected, 0, size * sizeof(float));
+  memset(result, 0, size * sizeof(float));
+
+  markesteijn_reference(expected, in, &roi, &roi, test_xtrans, passes);
+  xtrans_markesteijn_interpolate(result, in, &roi, &roi, test_xtrans, passes);
+
+  for(size_t k = 0; k < size; k++)
+    if(k % 4 != 3) assert_float_equal(result[k], expected[k], E);
+
+  dt_free_align(in);
+  dt_free_align(expected);
+  dt_free_align(result);
+}
+
+static void check_rcd_rawfront(const int width, const int height, const int x, const int y)
+{
+  TR_STEP("%dx%d image at offset %d,%d", width, height, x, y);
+  dt_iop_roi_t roi = { .x = x, .y = y, .width = width, .height = height, .scale = 1.0f };
+  const size_t size = (size_t)4 * width * height;
+  dt_dev_pixelpipe_t pipe = { 0 };
+  for(int c = 0; c < 3; c++) pipe.dsc.processed_maximum[c] = 1.0f;
+  dt_dev_pixelpipe_iop_t piece = { 0 };
+  piece.pipe = &pipe;
+  // white balance and clipping of the highlights, one of them below the
+  // brightest pixels
+  const dt_dev_pixelpipe_rawfront_t front = { .count = 2,
+                                              .coeffs = { 2.1f, 1.0f, 1.6f, 1.0f },
+                                              .clip = { 1.2f, 0.8f, 1.5f, FLT_MAX } };
+  float *const in = mosaic_new(width, height);
+  float *const prepared = dt_alloc_align_float((size_t)width * height);
+  float *const expected = dt_alloc_align_float(size);
+  float *const result = dt_alloc_align_float(size);
+  memset(expected, 0, size * sizeof(float));
+  memset(result, 0, size * sizeof(float));
+
+  // the fused modules applied to a copy first, as for the other methods
+  apply_rawfront(prepared, in, &roi, TEST_FILTERS, &front);
+  rcd_demosaic(&piece, expected, prepared, &roi, &roi, TEST_FILTERS, NULL);
+  // and while filling the tiles
+  rcd_demosaic(&piece, result, in, &roi, &roi, TEST_FILTERS, &front);
+
+  for(size_t k = 0; k < size; k++)
+    if(k % 4 != 3) assert_float_equal(result[k], expected[k], 0.0f);
+
+  dt_free_align(in);
+  dt_free_align(prepared);
+  dt_free_align(expected);
+  dt_free_align(result);
+}
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_markesteijn_1pass(void **state)
+{
+  // a single tile, several tiles with partial ones at the borders and a
+  // CFA pattern shifted by half its period
+  check_markesteijn(60, 40, 0, 0, 1);
+  check_markesteijn(301, 211, 0, 0, 1);
+  check_markesteijn(301, 211, 3, 3, 1);
+}
+
+static void test_markesteijn_3pass(void **state)
+{
+  check_markesteijn(60, 40, 0, 0, 3);
+  check_markesteijn(301, 211, 0, 0, 3);
+  check_markesteijn(301, 211, 3, 3, 3);
+}
+
+static void test_rcd_rawfront(void **state)
+{
+  // a single tile, several tiles with partial ones at the borders and the
+  // CFA pattern shifted in both directions
+  check_rcd_rawfront(60, 40, 0, 0);
+  check_rcd_rawfront(301, 211, 0, 0);
+  check_rcd_rawfront(301, 211, 1, 3);
+}
+
+/*
+ * MAIN FUNCTION
+ */
+int main()
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_markesteijn_1pass),
+    cmocka_unit_test(test_markesteijn_3pass),
+    cmocka_unit_test(test_rcd_rawfront)
+  };
+
+  TR_DEBUG("epsilon = %e", E);
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,82 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the module iop/flip.c
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <cmocka.h>
+
+#include "../util/assert.h"
+#include "../util/tracing.h"
+#include "../util/testdistort.h"
+
+#include "iop/flip.c"
+
+/*
+ * DEFINITIONS
+ */
+
+// flipping only moves points, so both should agree up to the float resolution
+// of the coordinates:
+#define E 1e-3f
+
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_distort_matrix(void **state)
+{
+  dt_iop_flip_data_t d = { 0 };
+  dt_dev_pixelpipe_iop_t piece = { 0 };
+  piece.data = &d;
+  piece.buf_in.width = 600;
+  piece.buf_in.height = 400;
+
+  for(int orientation = 0; orientation < 8; orientation++)
+  {
+    TR_STEP("verify that the matrix matches the transformation of the points "
+      "for orientation %d", orientation);
+    d.orientation = orientation;
+    const gboolean swap = orientation & ORIENTATION_SWAP_XY;
+    piece.buf_out.width = swap ? piece.buf_in.height : piece.buf_in.width;
+    piece.buf_out.height = swap ? piece.buf_in.width : piece.buf_in.height;
+    testdistort_assert_matrix(NULL, &piece, distort_matrix, distort_transform,
+                              distort_backtransform, E);
+  }
+}
+
+
+/*
+ * MAIN FUNCTION
+ */
+int main()
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_distort_matrix)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
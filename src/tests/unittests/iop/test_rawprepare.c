@@ -0,0 +1,90 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the module iop/rawprepare.c
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <cmocka.h>
+
+#include "../util/assert.h"
+#include "../util/tracing.h"
+#include "../util/testdistort.h"
+
+#include "iop/rawprepare.c"
+
+/*
+ * DEFINITIONS
+ */
+
+// the raw crop only moves points, so both should agree up to the float resolution
+// of the coordinates:
+#define E 1e-3f
+
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_distort_matrix(void **state)
+{
+  // left and top raw crop in sensor pixels:
+  const int32_t crops[][2] = { { 0, 0 }, { 12, 0 }, { 0, 8 }, { 37, 21 } };
+  // scale of the input buffer relative to the full image:
+  const float scales[] = { 1.0f, 0.5f, 0.1234f };
+
+  dt_iop_rawprepare_data_t d = { 0 };
+  dt_dev_pixelpipe_iop_t piece = { 0 };
+  piece.data = &d;
+  piece.iscale = 1.0f;
+
+  for(size_t k = 0; k < sizeof(crops) / sizeof(crops[0]); k++)
+    for(size_t s = 0; s < sizeof(scales) / sizeof(scales[0]); s++)
+    {
+      TR_STEP("verify that the matrix matches the transformation of the points "
+        "for the crop {%d, %d} at scale %f", crops[k][0], crops[k][1], scales[s]);
+      d.x = crops[k][0];
+      d.y = crops[k][1];
+      piece.buf_in.scale = piece.buf_out.scale = scales[s];
+      piece.buf_in.width = 6000 * scales[s];
+      piece.buf_in.height = 4000 * scales[s];
+      piece.buf_out.width = piece.buf_in.width - d.x * scales[s];
+      piece.buf_out.height = piece.buf_in.height - d.y * scales[s];
+      testdistort_assert_matrix(NULL, &piece, distort_matrix, distort_transform,
+                                distort_backtransform, E);
+    }
+}
+
+
+/*
+ * MAIN FUNCTION
+ */
+int main()
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_distort_matrix)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,96 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <cmocka.h>
+
+#include "common/darktable.h"
+
+#include "assert.h"
+#include "tracing.h"
+#include "testdistort.h"
+
+// points per side of the grid, large enough for the parallel code paths:
+#define GRID_SIZE 21
+
+void testdistort_apply_matrix(const float *const matrix, float *const points,
+                              const size_t points_count)
+{
+  for(size_t i = 0; i < points_count * 2; i += 2)
+  {
+    const float x = points[i];
+    const float y = points[i + 1];
+    const float w = matrix[6] * x + matrix[7] * y + matrix[8];
+    points[i] = (matrix[0] * x + matrix[1] * y + matrix[2]) / w;
+    points[i + 1] = (matrix[3] * x + matrix[4] * y + matrix[5]) / w;
+  }
+}
+
+void testdistort_assert_matrix(dt_iop_module_t *self,
+                               dt_dev_pixelpipe_iop_t *piece,
+                               testdistort_matrix_t distort_matrix,
+                               testdistort_points_t distort_transform,
+                               testdistort_points_t distort_backtransform,
+                               const float epsilon)
+{
+  const size_t count = GRID_SIZE * GRID_SIZE;
+  float *expected = dt_alloc_align(64, sizeof(float) * 2 * count);
+  float *actual = dt_alloc_align(64, sizeof(float) * 2 * count);
+  assert_non_null(expected);
+  assert_non_null(actual);
+
+  for(int backward = 0; backward < 2; backward++)
+  {
+    const dt_iop_roi_t *roi = backward ? &piece->buf_out : &piece->buf_in;
+    for(int j = 0; j < GRID_SIZE; j++)
+      for(int i = 0; i < GRID_SIZE; i++)
+      {
+        const size_t k = 2 * ((size_t)j * GRID_SIZE + i);
+        expected[k] = roi->width * (float)i / (GRID_SIZE - 1);
+        expected[k + 1] = roi->height * (float)j / (GRID_SIZE - 1);
+      }
+    memcpy(actual, expected, sizeof(float) * 2 * count);
+
+    float matrix[9];
+    assert_int_equal(distort_matrix(self, piece, backward, matrix), 1);
+    testdistort_apply_matrix(matrix, actual, count);
+
+    if(backward)
+      distort_backtransform(self, piece, expected, count);
+    else
+      distort_transform(self, piece, expected, count);
+
+    for(size_t k = 0; k < 2 * count; k++)
+    {
+      if(fabsf(actual[k] - expected[k]) >= epsilon)
+        TR_DEBUG("%s point %zu: %s=%f, matrix=%f",
+                 backward ? "backward" : "forward", k / 2,
+                 backward ? "distort_backtransform" : "distort_transform",
+                 expected[k], actual[k]);
+      assert_float_equal(actual[k], expected[k], epsilon);
+    }
+  }
+
+  dt_free_align(expected);
+  dt_free_align(actual);
+}
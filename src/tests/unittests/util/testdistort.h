@@ -0,0 +1,49 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * Checks of the distort_matrix() of a module against its distort_transform()
+ * and distort_backtransform(), to be used for unit testing with cmocka.
+ *
+ * Please see ../README.md for more detailed documentation.
+ */
+
+#include "develop/imageop.h"
+#include "develop/pixelpipe.h"
+
+typedef int (*testdistort_points_t)(dt_iop_module_t *self,
+                                    dt_dev_pixelpipe_iop_t *piece,
+                                    float *points, size_t points_count);
+
+typedef int (*testdistort_matrix_t)(dt_iop_module_t *self,
+                                    dt_dev_pixelpipe_iop_t *piece,
+                                    const int backward, float *const matrix);
+
+// apply a matrix from distort_matrix() to the points like the pixelpipe does:
+void testdistort_apply_matrix(const float *const matrix, float *const points,
+                              const size_t points_count);
+
+// push a grid of points covering the input buffer of the piece through the
+// matrix and through distort_transform(), a grid covering the output buffer
+// through the inverse matrix and distort_backtransform(), and assert that the
+// results do not differ by more than epsilon pixels:
+void testdistort_assert_matrix(dt_iop_module_t *self,
+                               dt_dev_pixelpipe_iop_t *piece,
+                               testdistort_matrix_t distort_matrix,
+                               testdistort_points_t distort_transform,
+                               testdistort_points_t distort_backtransform,
+                               const float epsilon);
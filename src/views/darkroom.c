@@ -3197,6 +3197,7 @@ void mouse_leave(dt_view_t *self)
   // if we are not hovering over a thumbnail in the filmstrip -> show metadata of opened image.
   dt_develop_t *dev = (dt_develop_t *)self->data;
   dt_control_set_mouse_over_id(dev->image_storage.id);
+  dev->progressive.pointer_x = dev->progressive.pointer_y = 0.0f;
 
   // masks
   int handled = dt_masks_events_mouse_leave(dev->gui_module);
@@ -3241,6 +3242,10 @@ void mouse_moved(dt_view_t *self, double x, double y, double pressure, int which
   const int32_t capwd = self->width  - 2*tb;
   const int32_t capht = self->height - 2*tb;
 
+  // the center view is refined from here when it's rendered progressively
+  dev->progressive.pointer_x = x - 0.5 * self->width;
+  dev->progressive.pointer_y = y - 0.5 * self->height;
+
   // if we are not hovering over a thumbnail in the filmstrip -> show metadata of opened image.
   int32_t mouse_over_id = dt_control_get_mouse_over_id();
   if(mouse_over_id == -1)
@@ -167,7 +167,7 @@ static void _set_delay(dt_slideshow_t *d, int value)
 
 static int process_image(dt_slideshow_t *d, dt_slideshow_slot_t slot)
 {
-  dt_imageio_module_format_t buf;
+  dt_imageio_module_format_t buf = { 0 };
   buf.mime = mime;
   buf.levels = levels;
   buf.bpp = bpp;